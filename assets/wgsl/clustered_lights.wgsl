@@ -0,0 +1,159 @@
+// shared with test.wgsl, which shades from the lists built here
+struct Frame {
+    view: mat4x4f,
+    projection: mat4x4f,
+    view_proj: mat4x4f,
+    inv_projection: mat4x4f,
+    // clusters along x y z, light count
+    grid: vec4u,
+    // render width and height, cluster tile width and height in pixels
+    screen: vec4f,
+    // near, far, slice scale, slice bias; slice = log(view depth) * scale + bias
+    depth: vec4f,
+    // x: capacity of the light index list
+    limits: vec4u
+};
+
+struct Light {
+    position: vec3f,
+    range: f32,
+    color: vec3f,
+    intensity: f32,
+    // spot lights only, normalized
+    direction: vec3f,
+    // 0 point, 1 spot
+    kind: u32,
+    // spot falloff is saturate(cos_angle * x + y)
+    cone: vec2f,
+    // first view in the shadow atlas, 0xffffffff when unshadowed
+    shadow: u32
+};
+
+// view space
+struct ClusterBounds {
+    lo: vec4f,
+    hi: vec4f
+};
+
+@group(0) @binding(0) var<uniform> frame: Frame;
+@group(0) @binding(1) var<storage, read> lights: array<Light>;
+@group(0) @binding(2) var<storage, read_write> bounds: array<ClusterBounds>;
+// offset into light_indices and light count, per cluster
+@group(0) @binding(3) var<storage, read_write> clusters: array<vec2u>;
+@group(0) @binding(4) var<storage, read_write> light_indices: array<u32>;
+// reset to zero before every binning pass
+@group(0) @binding(5) var<storage, read_write> index_count: atomic<u32>;
+
+// view-space spheres of the lights being tested, shared by a workgroup
+var<workgroup> tile_lights: array<vec4f, 64>;
+
+fn clusterCount() -> u32 {
+    return frame.grid.x * frame.grid.y * frame.grid.z;
+}
+
+// view depth where slice z begins, slices grow exponentially with depth
+fn sliceDepth(z: u32) -> f32 {
+    return frame.depth.x * pow(frame.depth.y / frame.depth.x, f32(z) / f32(frame.grid.z));
+}
+
+// point at view depth `depth` on the ray through pixel `pixel`
+fn viewPoint(pixel: vec2f, depth: f32) -> vec3f {
+    let ndc = vec2f(pixel.x / frame.screen.x * 2.0 - 1.0, 1.0 - pixel.y / frame.screen.y * 2.0);
+    let p = frame.inv_projection * vec4f(ndc, 0.5, 1.0);
+    let ray = p.xyz / p.w;
+    return ray * (depth / -ray.z);
+}
+
+@compute @workgroup_size(64)
+fn cs_build_clusters(@builtin(global_invocation_id) id: vec3u) {
+    let index = id.x;
+    if (index >= clusterCount()) {
+        return;
+    }
+    let x = index % frame.grid.x;
+    let y = (index / frame.grid.x) % frame.grid.y;
+    let z = index / (frame.grid.x * frame.grid.y);
+
+    let pixel_lo = vec2f(f32(x), f32(y)) * frame.screen.zw;
+    let pixel_hi = min(pixel_lo + frame.screen.zw, frame.screen.xy);
+    let near = sliceDepth(z);
+    let far = sliceDepth(z + 1u);
+
+    // the frustum slice is bounded by its eight corners
+    var lo = vec3f(3.4e38);
+    var hi = vec3f(-3.4e38);
+    for (var corner = 0u; corner < 8u; corner++) {
+        let pixel = select(pixel_lo, pixel_hi, vec2<bool>((corner & 1u) != 0u, (corner & 2u) != 0u));
+        let p = viewPoint(pixel, select(near, far, (corner & 4u) != 0u));
+        lo = min(lo, p);
+        hi = max(hi, p);
+    }
+    bounds[index] = ClusterBounds(vec4f(lo, 0.0), vec4f(hi, 0.0));
+}
+
+// Called from uniform control flow by the whole workgroup.
+fn loadTile(first: u32, local_index: u32) {
+    workgroupBarrier();
+    let light = first + local_index;
+    if (light < frame.grid.w) {
+        let center = frame.view * vec4f(lights[light].position, 1.0);
+        tile_lights[local_index] = vec4f(center.xyz, lights[light].range);
+    }
+    workgroupBarrier();
+}
+
+fn touches(sphere: vec4f, cluster: ClusterBounds) -> bool {
+    let d = sphere.xyz - clamp(sphere.xyz, cluster.lo.xyz, cluster.hi.xyz);
+    return dot(d, d) <= sphere.w * sphere.w;
+}
+
+// One thread per cluster. Lights are tested in tiles staged through
+// workgroup memory; a first sweep counts, one atomic reserves a compact
+// range of the index list, and a second sweep fills it.
+@compute @workgroup_size(64)
+fn cs_bin_lights(
+    @builtin(global_invocation_id) id: vec3u,
+    @builtin(local_invocation_index) local_index: u32
+) {
+    let index = id.x;
+    let active = index < clusterCount();
+    var cluster = ClusterBounds(vec4f(0.0), vec4f(0.0));
+    if (active) {
+        cluster = bounds[index];
+    }
+    let light_count = frame.grid.w;
+
+    var count = 0u;
+    for (var first = 0u; first < light_count; first += 64u) {
+        loadTile(first, local_index);
+        let tile_count = min(64u, light_count - first);
+        for (var i = 0u; i < tile_count; i++) {
+            if (active && touches(tile_lights[i], cluster)) {
+                count++;
+            }
+        }
+    }
+
+    var offset = 0u;
+    if (active && count > 0u) {
+        offset = atomicAdd(&index_count, count);
+        // an overflowing cluster keeps what fits
+        count = min(count, frame.limits.x - min(offset, frame.limits.x));
+    }
+
+    var written = 0u;
+    for (var first = 0u; first < light_count; first += 64u) {
+        loadTile(first, local_index);
+        let tile_count = min(64u, light_count - first);
+        for (var i = 0u; i < tile_count; i++) {
+            if (written < count && touches(tile_lights[i], cluster)) {
+                light_indices[offset + written] = first + i;
+                written++;
+            }
+        }
+    }
+
+    if (active) {
+        clusters[index] = vec2u(offset, count);
+    }
+}
@@ -0,0 +1,84 @@
+// as VertexIn in test.wgsl
+struct VertexIn {
+    @location(0) position: vec3f,
+    @location(1) normal: vec3f,
+    @location(2) uv: vec2f
+};
+
+struct Bake {
+    base_color: vec4f,
+    // bounding sphere in mesh space
+    center: vec3f,
+    radius: f32,
+    frames_per_side: u32,
+    albedo_layer: u32,
+    // 0 when base_color alone is the albedo
+    textured: u32
+};
+
+struct BakeOut {
+    @builtin(position) position: vec4f,
+    @location(0) normal: vec3f,
+    @location(1) uv: vec2f,
+    // toward the viewer, in radii
+    @location(2) depth: f32
+};
+
+struct FrameOut {
+    // albedo, alpha 0 where the mesh does not cover
+    @location(0) color: vec4f,
+    // mesh space normal and depth
+    @location(1) normal_depth: vec4f
+};
+
+@group(0) @binding(0) var<uniform> bake: Bake;
+@group(0) @binding(1) var albedo: texture_2d_array<f32>;
+@group(0) @binding(2) var albedo_sampler: sampler;
+
+// Octahedral map of the sphere of view directions onto [0, 1]^2, y up.
+// The same functions are in test.wgsl, the two must agree.
+fn octDecode(uv: vec2f) -> vec3f {
+    let f = uv * 2.0 - 1.0;
+    var n = vec3f(f.x, 1.0 - abs(f.x) - abs(f.y), f.y);
+    let t = max(-n.y, 0.0);
+    n.x += select(t, -t, n.x >= 0.0);
+    n.z += select(t, -t, n.z >= 0.0);
+    return normalize(n);
+}
+
+// right, up and the direction toward the viewer of a frame
+fn frameBasis(dir: vec3f) -> mat3x3f {
+    let hint = select(vec3f(0.0, 1.0, 0.0), vec3f(0.0, 0.0, 1.0), abs(dir.y) > 0.999);
+    let right = normalize(cross(hint, dir));
+    return mat3x3f(right, cross(dir, right), dir);
+}
+
+// One draw per frame, the frame is the instance; the viewport picks its
+// tile of the atlas.
+@vertex
+fn vs_main(vertex: VertexIn, @builtin(instance_index) frame: u32) -> BakeOut {
+    let n = bake.frames_per_side;
+    let cell = vec2f(f32(frame % n), f32(frame / n));
+    let basis = frameBasis(octDecode((cell + 0.5) / f32(n)));
+    let p = (vertex.position - bake.center) / bake.radius;
+    // orthographic over the bounding sphere, nearer is smaller depth
+    let depth = dot(p, basis[2]);
+    var out: BakeOut;
+    out.position = vec4f(dot(p, basis[0]), dot(p, basis[1]), 0.5 - 0.5 * depth, 1.0);
+    out.normal = vertex.normal;
+    out.uv = vertex.uv;
+    out.depth = depth;
+    return out;
+}
+
+@fragment
+fn fs_main(in: BakeOut) -> FrameOut {
+    var color = bake.base_color.rgb;
+    if (bake.textured != 0u) {
+        color *= textureSample(albedo, albedo_sampler, in.uv, bake.albedo_layer).rgb;
+    }
+    var out: FrameOut;
+    out.color = vec4f(color, 1.0);
+    out.normal_depth = vec4f(normalize(in.normal), in.depth);
+    return out;
+}
@@ -0,0 +1,26 @@
+// sums of weighted premultiplied color and of weighted coverage
+@group(0) @binding(0) var accum: texture_2d<f32>;
+// product of (1 - alpha) over every transparent fragment
+@group(0) @binding(1) var revealage: texture_2d<f32>;
+
+// one triangle covering the screen
+@vertex
+fn vs_main(@builtin(vertex_index) index: u32) -> @builtin(position) vec4f {
+    let uv = vec2f(f32((index << 1u) & 2u), f32(index & 2u));
+    return vec4f(uv.x * 2.0 - 1.0, 1.0 - uv.y * 2.0, 0.0, 1.0);
+}
+
+// Blended over the opaque color as src * (1 - a) + dst * a, so alpha
+// carries the revealage.
+@fragment
+fn fs_main(@builtin(position) position: vec4f) -> @location(0) vec4f {
+    let texel = vec2i(position.xy);
+    let reveal = textureLoad(revealage, texel, 0).r;
+    if (reveal >= 1.0) {
+        // nothing transparent covers this pixel
+        discard;
+    }
+    let sum = textureLoad(accum, texel, 0);
+    let average = sum.rgb / clamp(sum.a, 1e-4, 5e4);
+    return vec4f(average, reveal);
+}
@@ -0,0 +1,74 @@
+// as in particles.wgsl
+struct Frame {
+    view_proj: mat4x4f,
+    camera_right: vec4f,
+    camera_up: vec4f,
+    camera_position: vec3f,
+    capacity: u32,
+    position: vec3f,
+    emit_count: u32,
+    direction: vec3f,
+    spread_cos: f32,
+    gravity: vec3f,
+    drag: f32,
+    speed: vec2f,
+    lifetime: vec2f,
+    size: vec2f,
+    dt: f32,
+    seed: u32,
+    color_start: vec4f,
+    color_end: vec4f
+};
+
+// as in particles.wgsl
+struct Particle {
+    position: vec3f,
+    age: f32,
+    velocity: vec3f,
+    lifetime: f32,
+    size: vec2f,
+    color: vec2u
+};
+
+struct VertexOut {
+    @builtin(position) position: vec4f,
+    @location(0) corner: vec2f,
+    @location(1) color: vec4f
+};
+
+@group(0) @binding(0) var<uniform> frame: Frame;
+@group(0) @binding(1) var<storage, read> particles: array<Particle>;
+// particles in draw order, sorted or as the simulation left them
+@group(0) @binding(2) var<storage, read> draw_list: array<u32>;
+
+// One camera facing quad per instance, two triangles out of six vertices.
+@vertex
+fn vs_main(@builtin(vertex_index) vertex: u32, @builtin(instance_index) instance: u32) -> VertexOut {
+    var corners = array<vec2f, 6>(
+        vec2f(-1.0, -1.0), vec2f(1.0, -1.0), vec2f(-1.0, 1.0),
+        vec2f(-1.0, 1.0), vec2f(1.0, -1.0), vec2f(1.0, 1.0)
+    );
+    let corner = corners[vertex];
+    let particle = particles[draw_list[instance]];
+    let t = clamp(particle.age / particle.lifetime, 0.0, 1.0);
+    let half_size = 0.5 * mix(particle.size.x, particle.size.y, t);
+    let world = particle.position
+        + (frame.camera_right.xyz * corner.x + frame.camera_up.xyz * corner.y) * half_size;
+
+    var out: VertexOut;
+    out.position = frame.view_proj * vec4f(world, 1.0);
+    out.corner = corner;
+    out.color = mix(unpack4x8unorm(particle.color.x), unpack4x8unorm(particle.color.y), t);
+    return out;
+}
+
+// A soft disc, premultiplied for either blend mode.
+@fragment
+fn fs_main(in: VertexOut) -> @location(0) vec4f {
+    let falloff = clamp(1.0 - dot(in.corner, in.corner), 0.0, 1.0);
+    let alpha = in.color.a * falloff * falloff;
+    if (alpha <= 0.0) {
+        discard;
+    }
+    return vec4f(in.color.rgb * alpha, alpha);
+}
@@ -0,0 +1,303 @@
+// shared with particle_draw.wgsl
+struct Frame {
+    view_proj: mat4x4f,
+    // world space axes of the camera, billboards span them
+    camera_right: vec4f,
+    camera_up: vec4f,
+    camera_position: vec3f,
+    capacity: u32,
+    // emitter, world space
+    position: vec3f,
+    emit_count: u32,
+    direction: vec3f,
+    // cosine of the half angle of the cone particles leave in
+    spread_cos: f32,
+    gravity: vec3f,
+    // fraction of the velocity lost per second
+    drag: f32,
+    // min, max
+    speed: vec2f,
+    lifetime: vec2f,
+    // at birth, at death
+    size: vec2f,
+    dt: f32,
+    seed: u32,
+    color_start: vec4f,
+    color_end: vec4f
+};
+
+// shared with particle_draw.wgsl
+struct Particle {
+    position: vec3f,
+    age: f32,
+    velocity: vec3f,
+    lifetime: f32,
+    // at birth, at death
+    size: vec2f,
+    // pack4x8unorm colors at birth and at death
+    color: vec2u
+};
+
+struct Counters {
+    // entries of dead_list
+    dead: atomic<u32>,
+    // survivors of the last frame at the start of alive_list
+    alive: u32,
+    // entries of next_alive_list, the particles drawn this frame
+    next_alive: atomic<u32>,
+    // taken off the end of dead_list by cs_begin
+    emitted: u32,
+    // entries the sort covers, a power of two of at least SORT_BLOCK
+    sort_count: u32
+};
+
+// written by cs_begin and cs_finish, read back as indirect arguments
+struct Indirect {
+    emit: vec3u,
+    simulate: vec3u,
+    sort: vec3u,
+    // vertex count, instance count, first vertex, first instance
+    draw: vec4u
+};
+
+struct SortStep {
+    // size of the bitonic sequences being merged, and the compare distance
+    k: u32,
+    j: u32
+};
+
+const WORKGROUP_SIZE = 256u;
+// elements a workgroup sorts in workgroup memory, two per thread
+const SORT_BLOCK = 512u;
+
+@group(0) @binding(0) var<uniform> frame: Frame;
+@group(0) @binding(1) var<storage, read_write> particles: array<Particle>;
+@group(0) @binding(2) var<storage, read_write> dead_list: array<u32>;
+// the two alive lists trade places every frame
+@group(0) @binding(3) var<storage, read_write> alive_list: array<u32>;
+@group(0) @binding(4) var<storage, read_write> next_alive_list: array<u32>;
+@group(0) @binding(5) var<storage, read_write> counters: Counters;
+// squared camera distance, and particle, of next_alive_list entries
+@group(0) @binding(6) var<storage, read_write> sort_keys: array<f32>;
+@group(0) @binding(7) var<storage, read_write> sort_values: array<u32>;
+// only bound by the passes that write it, it cannot be written by a
+// dispatch that also reads it as arguments
+@group(1) @binding(0) var<storage, read_write> args: Indirect;
+// at a dynamic offset per sorting step
+@group(1) @binding(1) var<uniform> step: SortStep;
+
+var<workgroup> block_keys: array<f32, 512>;
+var<workgroup> block_values: array<u32, 512>;
+
+fn groups(count: u32) -> vec3u {
+    return vec3u((count + WORKGROUP_SIZE - 1u) / WORKGROUP_SIZE, 1u, 1u);
+}
+
+fn hash(value: u32) -> u32 {
+    let state = value * 747796405u + 2891336453u;
+    let word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// uniform in [0, 1)
+fn random(value: u32) -> f32 {
+    return f32(hash(value) >> 8u) / 16777216.0;
+}
+
+// uniform over the cap of the unit sphere around `axis` down to `min_cos`
+fn coneDirection(axis: vec3f, min_cos: f32, u: f32, v: f32) -> vec3f {
+    let z = mix(min_cos, 1.0, u);
+    let r = sqrt(max(1.0 - z * z, 0.0));
+    let phi = 6.28318531 * v;
+    let hint = select(vec3f(0.0, 1.0, 0.0), vec3f(1.0, 0.0, 0.0), abs(axis.y) > 0.999);
+    let tangent = normalize(cross(hint, axis));
+    let bitangent = cross(axis, tangent);
+    return tangent * (r * cos(phi)) + bitangent * (r * sin(phi)) + axis * z;
+}
+
+// Once, every particle dead.
+@compute @workgroup_size(256)
+fn cs_init(@builtin(global_invocation_id) id: vec3u) {
+    let index = id.x;
+    if (index >= frame.capacity) {
+        return;
+    }
+    // popped from the end, so the first slots are used first
+    dead_list[index] = frame.capacity - 1u - index;
+    if (index == 0u) {
+        atomicStore(&counters.dead, frame.capacity);
+        atomicStore(&counters.next_alive, 0u);
+    }
+}
+
+// One thread. Last frame's survivors are this frame's alive_list; reserves
+// the emitted particles and sizes the dispatches that follow.
+@compute @workgroup_size(1)
+fn cs_begin() {
+    let alive = atomicLoad(&counters.next_alive);
+    atomicStore(&counters.next_alive, 0u);
+    let dead = atomicLoad(&counters.dead);
+    let emitted = min(frame.emit_count, dead);
+    atomicStore(&counters.dead, dead - emitted);
+    counters.alive = alive;
+    counters.emitted = emitted;
+    args.emit = groups(emitted);
+    args.simulate = groups(alive + emitted);
+}
+
+// Takes the reserved slots off dead_list and appends them to alive_list.
+@compute @workgroup_size(256)
+fn cs_emit(@builtin(global_invocation_id) id: vec3u) {
+    let index = id.x;
+    if (index >= counters.emitted) {
+        return;
+    }
+    let slot = dead_list[atomicLoad(&counters.dead) + index];
+    let seed = hash(frame.seed ^ (index * 4u));
+    let axis = normalize(frame.direction);
+    let direction = coneDirection(axis, frame.spread_cos, random(seed), random(seed + 1u));
+
+    var particle: Particle;
+    particle.position = frame.position;
+    particle.age = 0.0;
+    particle.velocity = direction * mix(frame.speed.x, frame.speed.y, random(seed + 2u));
+    particle.lifetime = mix(frame.lifetime.x, frame.lifetime.y, random(seed + 3u));
+    particle.size = frame.size;
+    particle.color = vec2u(pack4x8unorm(frame.color_start), pack4x8unorm(frame.color_end));
+    particles[slot] = particle;
+    alive_list[counters.alive + index] = slot;
+}
+
+// Ages and moves every alive particle; survivors are appended to
+// next_alive_list, the dead go back to dead_list.
+@compute @workgroup_size(256)
+fn cs_simulate(@builtin(global_invocation_id) id: vec3u) {
+    let index = id.x;
+    if (index >= counters.alive + counters.emitted) {
+        return;
+    }
+    let slot = alive_list[index];
+    var particle = particles[slot];
+    particle.age += frame.dt;
+    if (particle.age >= particle.lifetime) {
+        dead_list[atomicAdd(&counters.dead, 1u)] = slot;
+        return;
+    }
+    particle.velocity += frame.gravity * frame.dt;
+    particle.velocity *= max(1.0 - frame.drag * frame.dt, 0.0);
+    particle.position += particle.velocity * frame.dt;
+    particles[slot] = particle;
+    next_alive_list[atomicAdd(&counters.next_alive, 1u)] = slot;
+}
+
+// One thread. Sizes the draw, and the sort of the particles it draws.
+@compute @workgroup_size(1)
+fn cs_finish() {
+    let alive = atomicLoad(&counters.next_alive);
+    let sort_count = 1u << (32u - countLeadingZeros(max(alive, SORT_BLOCK) - 1u));
+    counters.sort_count = sort_count;
+    args.sort = vec3u(sort_count / SORT_BLOCK, 1u, 1u);
+    args.draw = vec4u(6u, alive, 0u, 0u);
+}
+
+// Two entries per thread; the padding past the drawn particles sorts last.
+@compute @workgroup_size(256)
+fn cs_sort_keys(@builtin(global_invocation_id) id: vec3u) {
+    let alive = atomicLoad(&counters.next_alive);
+    for (var i = id.x * 2u; i < id.x * 2u + 2u; i++) {
+        if (i < alive) {
+            let slot = next_alive_list[i];
+            let offset = particles[slot].position - frame.camera_position;
+            sort_keys[i] = dot(offset, offset);
+            sort_values[i] = slot;
+        } else {
+            sort_keys[i] = -1.0;
+            sort_values[i] = 0u;
+        }
+    }
+}
+
+// Bitonic compare-exchange of the pair `local` owns in workgroup memory,
+// far to near across the whole sort.
+fn compareBlock(base: u32, local: u32, k: u32, j: u32) {
+    let i = 2u * j * (local / j) + local % j;
+    let l = i + j;
+    let descending = ((base + i) & k) == 0u;
+    let a = block_keys[i];
+    let b = block_keys[l];
+    if ((a < b) == descending && a != b) {
+        block_keys[i] = b;
+        block_keys[l] = a;
+        let value = block_values[i];
+        block_values[i] = block_values[l];
+        block_values[l] = value;
+    }
+    workgroupBarrier();
+}
+
+fn loadBlock(base: u32, local: u32) {
+    block_keys[local] = sort_keys[base + local];
+    block_keys[local + WORKGROUP_SIZE] = sort_keys[base + local + WORKGROUP_SIZE];
+    block_values[local] = sort_values[base + local];
+    block_values[local + WORKGROUP_SIZE] = sort_values[base + local + WORKGROUP_SIZE];
+    workgroupBarrier();
+}
+
+fn storeBlock(base: u32, local: u32) {
+    sort_keys[base + local] = block_keys[local];
+    sort_keys[base + local + WORKGROUP_SIZE] = block_keys[local + WORKGROUP_SIZE];
+    sort_values[base + local] = block_values[local];
+    sort_values[base + local + WORKGROUP_SIZE] = block_values[local + WORKGROUP_SIZE];
+}
+
+// Every stage up to SORT_BLOCK, within one block per workgroup.
+@compute @workgroup_size(256)
+fn cs_sort_block(
+    @builtin(workgroup_id) group: vec3u,
+    @builtin(local_invocation_index) local: u32
+) {
+    let base = group.x * SORT_BLOCK;
+    loadBlock(base, local);
+    for (var k = 2u; k <= SORT_BLOCK; k <<= 1u) {
+        for (var j = k >> 1u; j > 0u; j >>= 1u) {
+            compareBlock(base, local, k, j);
+        }
+    }
+    storeBlock(base, local);
+}
+
+// The steps of stage step.k closer than SORT_BLOCK, within one block.
+@compute @workgroup_size(256)
+fn cs_sort_merge(
+    @builtin(workgroup_id) group: vec3u,
+    @builtin(local_invocation_index) local: u32
+) {
+    let base = group.x * SORT_BLOCK;
+    loadBlock(base, local);
+    for (var j = WORKGROUP_SIZE; j > 0u; j >>= 1u) {
+        compareBlock(base, local, step.k, j);
+    }
+    storeBlock(base, local);
+}
+
+// One step of stage step.k at least SORT_BLOCK apart, a pair per thread.
+@compute @workgroup_size(256)
+fn cs_sort_step(@builtin(global_invocation_id) id: vec3u) {
+    let j = step.j;
+    let i = 2u * j * (id.x / j) + id.x % j;
+    let l = i + j;
+    // stages past this frame's sort_count find it sorted already
+    if (l >= counters.sort_count) {
+        return;
+    }
+    let descending = (i & step.k) == 0u;
+    let a = sort_keys[i];
+    let b = sort_keys[l];
+    if ((a < b) == descending && a != b) {
+        sort_keys[i] = b;
+        sort_keys[l] = a;
+        let value = sort_values[i];
+        sort_values[i] = sort_values[l];
+        sort_values[l] = value;
+    }
+}
@@ -0,0 +1,36 @@
+// same buffers as the model pipeline of test.wgsl, only the position is read
+struct VertexIn {
+    @location(0) position: vec3f,
+    @location(1) normal: vec3f,
+    @location(2) uv: vec2f
+};
+
+struct InstanceIn {
+    @location(3) world0: vec4f,
+    @location(4) world1: vec4f,
+    @location(5) world2: vec4f,
+    @location(6) world3: vec4f
+};
+
+// one light's view of its tile, also read by test.wgsl
+struct ShadowView {
+    view_proj: mat4x4f,
+    // tile in atlas uv: offset xy, size zw
+    rect: vec4f
+};
+
+@group(0) @binding(0) var<uniform> shadow_view: ShadowView;
+
+@vertex
+fn vs_main(vertex: VertexIn, instance: InstanceIn) -> @builtin(position) vec4f {
+    let world = mat4x4f(instance.world0, instance.world1, instance.world2, instance.world3);
+    return shadow_view.view_proj * world * vec4f(vertex.position, 1.0);
+}
+
+// a triangle over the viewport at the far plane, resets a tile before its
+// static casters are drawn again
+@vertex
+fn vs_clear(@builtin(vertex_index) index: u32) -> @builtin(position) vec4f {
+    let uv = vec2f(f32((index << 1u) & 2u), f32(index & 2u));
+    return vec4f(uv * 2.0 - 1.0, 1.0, 1.0);
+}
@@ -0,0 +1,82 @@
+struct Job {
+    first_group: u32,
+    vertex_count: u32,
+    source_offset: u32,
+    output_offset: u32,
+    joint_offset: u32,
+    _pad0: u32,
+    _pad1: u32,
+    _pad2: u32
+};
+
+struct JobTable {
+    count: u32,
+    _pad0: u32,
+    _pad1: u32,
+    _pad2: u32,
+    jobs: array<Job>
+};
+
+// vertices are two vec4s: position.xyz normal.x, normal.yz uv
+@group(0) @binding(0) var<storage, read> source: array<vec4f>;
+// x: four joint index bytes, y: four unorm8 weights
+@group(0) @binding(1) var<storage, read> weights: array<vec2u>;
+// three rows per joint
+@group(0) @binding(2) var<storage, read> joints: array<vec4f>;
+@group(0) @binding(3) var<storage, read> table: JobTable;
+@group(0) @binding(4) var<storage, read_write> skinned: array<vec4f>;
+
+@compute @workgroup_size(64)
+fn cs_main(
+    @builtin(workgroup_id) group_id: vec3u,
+    @builtin(num_workgroups) group_count: vec3u,
+    @builtin(local_invocation_index) local_index: u32
+) {
+    let group = group_id.x + group_id.y * group_count.x;
+
+    // last job starting at or before this group
+    var lo = 0u;
+    var hi = table.count;
+    while (hi - lo > 1u) {
+        let mid = (lo + hi) / 2u;
+        if (table.jobs[mid].first_group <= group) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    let job = table.jobs[lo];
+    // also rejects the padding groups of a folded dispatch
+    let vertex = (group - job.first_group) * 64u + local_index;
+    if (vertex >= job.vertex_count) {
+        return;
+    }
+
+    let src = job.source_offset + vertex;
+    let p0 = source[src * 2u];
+    let p1 = source[src * 2u + 1u];
+    let position = vec4f(p0.xyz, 1.0);
+    let normal = vec3f(p0.w, p1.xy);
+
+    // blend the matrices, then transform once
+    let influence = weights[src];
+    let w = unpack4x8unorm(influence.y);
+    var row0 = vec4f(0.0);
+    var row1 = vec4f(0.0);
+    var row2 = vec4f(0.0);
+    for (var k = 0u; k < 4u; k++) {
+        let joint = (job.joint_offset + ((influence.x >> (8u * k)) & 0xffu)) * 3u;
+        row0 += w[k] * joints[joint];
+        row1 += w[k] * joints[joint + 1u];
+        row2 += w[k] * joints[joint + 2u];
+    }
+
+    let skinned_position = vec3f(dot(row0, position), dot(row1, position), dot(row2, position));
+    // fine for rigid and uniformly scaled joints
+    let n = vec3f(dot(row0.xyz, normal), dot(row1.xyz, normal), dot(row2.xyz, normal));
+    let skinned_normal = select(n, normalize(n), dot(n, n) > 0.0);
+
+    let dst = (job.output_offset + vertex) * 2u;
+    skinned[dst] = vec4f(skinned_position, skinned_normal.x);
+    skinned[dst + 1u] = vec4f(skinned_normal.yz, p1.zw);
+}
@@ -1,20 +1,362 @@
+// one struct per vertex buffer, mirrored by the reflected header
 struct VertexIn {
-    @location(0) position: vec2f,
-    @location(1) color: vec3f
+    @location(0) position: vec3f,
+    @location(1) normal: vec3f,
+    @location(2) uv: vec2f
+};
+
+// world matrix columns, stepped per instance
+struct InstanceIn {
+    @location(3) world0: vec4f,
+    @location(4) world1: vec4f,
+    @location(5) world2: vec4f,
+    @location(6) world3: vec4f
+};
+
+// as in clustered_lights.wgsl
+struct Frame {
+    view: mat4x4f,
+    projection: mat4x4f,
+    view_proj: mat4x4f,
+    inv_projection: mat4x4f,
+    grid: vec4u,
+    screen: vec4f,
+    depth: vec4f,
+    limits: vec4u
+};
+
+struct Light {
+    position: vec3f,
+    range: f32,
+    color: vec3f,
+    intensity: f32,
+    direction: vec3f,
+    kind: u32,
+    cone: vec2f,
+    shadow: u32
+};
+
+// as in shadow.wgsl
+struct ShadowView {
+    view_proj: mat4x4f,
+    rect: vec4f
+};
+
+// as GpuMaterial in material_table.h
+struct Material {
+    base_color: vec4f,
+    emissive: vec3f,
+    // array << 16 | layer, NO_TEXTURE for none
+    albedo_texture: u32
+};
+
+// as GpuImpostorParams in impostor_atlas.h
+struct Impostors {
+    // camera distance over which instances dissolve into impostors
+    fade_start: f32,
+    fade_end: f32,
+    frames_per_side: u32,
+    frame_size: u32
+};
+
+// one far instance, drawn as a quad of its impostor
+struct ImpostorIn {
+    @location(0) world0: vec4f,
+    @location(1) world1: vec4f,
+    @location(2) world2: vec4f,
+    @location(3) world3: vec4f,
+    // mesh space bounding sphere the impostor was baked around
+    @location(4) sphere: vec4f,
+    @location(5) layer: u32
 };
 
 struct VertexOut {
     @builtin(position) position: vec4f,
-    @location(0) color: vec3f
+    @location(0) world_position: vec3f,
+    @location(1) normal: vec3f,
+    @location(2) view_depth: f32,
+    @location(3) uv: vec2f,
+    @location(4) @interpolate(flat) material: u32,
+    // how far the instance has dissolved into its impostor
+    @location(5) @interpolate(flat) fade: f32
 };
 
+struct ImpostorOut {
+    @builtin(position) position: vec4f,
+    // on the quad through the sphere's center
+    @location(0) world_position: vec3f,
+    // [0, 1] across the view's tile
+    @location(1) tile_uv: vec2f,
+    // tile column and row, atlas layer
+    @location(2) @interpolate(flat) frame: vec3u,
+    // toward the viewer the view was baked from, one radius long
+    @location(3) @interpolate(flat) forward: vec3f,
+    // mesh to world rotation
+    @location(4) @interpolate(flat) rotation0: vec3f,
+    @location(5) @interpolate(flat) rotation1: vec3f,
+    @location(6) @interpolate(flat) rotation2: vec3f,
+    @location(7) @interpolate(flat) fade: f32
+};
+
+@group(0) @binding(0) var<uniform> frame: Frame;
+@group(0) @binding(1) var<storage, read> lights: array<Light>;
+// offset and count per cluster, built by cs_bin_lights
+@group(0) @binding(2) var<storage, read> clusters: array<vec2u>;
+@group(0) @binding(3) var<storage, read> light_indices: array<u32>;
+@group(0) @binding(4) var<storage, read> shadow_views: array<ShadowView>;
+@group(0) @binding(5) var shadow_atlas: texture_depth_2d;
+@group(0) @binding(6) var shadow_sampler: sampler_comparison;
+@group(0) @binding(7) var<storage, read> materials: array<Material>;
+// material per instance, indexed by instance_index
+@group(0) @binding(8) var<storage, read> instance_materials: array<u32>;
+@group(0) @binding(9) var material_sampler: sampler;
+// one array per texture format and size, see MaterialTable
+@group(0) @binding(10) var material_textures0: texture_2d_array<f32>;
+@group(0) @binding(11) var material_textures1: texture_2d_array<f32>;
+@group(0) @binding(12) var material_textures2: texture_2d_array<f32>;
+@group(0) @binding(13) var material_textures3: texture_2d_array<f32>;
+@group(0) @binding(14) var<uniform> impostors: Impostors;
+// color with coverage, and mesh space normal with depth, see ImpostorAtlas
+@group(0) @binding(15) var impostor_color: texture_2d_array<f32>;
+@group(0) @binding(16) var impostor_normal_depth: texture_2d_array<f32>;
+@group(0) @binding(17) var impostor_sampler: sampler;
+
+const AMBIENT = 0.08;
+const NO_SHADOW = 0xffffffffu;
+const NO_TEXTURE = 0xffffffffu;
+// pushes the lookup off the surface against acne, in world units
+const SHADOW_NORMAL_OFFSET = 0.02;
+
+@vertex
+fn vs_main(vertex: VertexIn, instance: InstanceIn, @builtin(instance_index) instance_index: u32) -> VertexOut {
+    let world = mat4x4f(instance.world0, instance.world1, instance.world2, instance.world3);
+    let world_position = world * vec4f(vertex.position, 1.0);
+    var out: VertexOut;
+    out.position = frame.view_proj * world_position;
+    out.world_position = world_position.xyz;
+    out.normal = (world * vec4f(vertex.normal, 0.0)).xyz;
+    out.view_depth = -(frame.view * world_position).z;
+    out.uv = vertex.uv;
+    out.material = select(0u, instance_materials[instance_index], instance_index < arrayLength(&instance_materials));
+    out.fade = instanceFade(instance.world3.xyz);
+    return out;
+}
+
+fn cameraPosition() -> vec3f {
+    let rotation = mat3x3f(frame.view[0].xyz, frame.view[1].xyz, frame.view[2].xyz);
+    return -(transpose(rotation) * frame.view[3].xyz);
+}
+
+// 0 while an instance is all mesh, 1 once it is all impostor
+fn instanceFade(origin: vec3f) -> f32 {
+    let range = max(impostors.fade_end - impostors.fade_start, 1e-3);
+    return saturate((distance(cameraPosition(), origin) - impostors.fade_start) / range);
+}
+
+// 4x4 ordered dither in (0, 1). A mesh keeps the pixels at or above its
+// fade and the impostor the ones below, so the two never overlap.
+fn bayer2(p: vec2u) -> u32 {
+    return ((p.x ^ p.y) << 1u) | p.y;
+}
+
+fn ditherThreshold(frag_coord: vec2f) -> f32 {
+    let p = vec2u(frag_coord) & vec2u(3u);
+    let index = 4u * bayer2(p & vec2u(1u)) + bayer2(p >> vec2u(1u));
+    return (f32(index) + 0.5) / 16.0;
+}
+
+// As in impostor_bake.wgsl, which the views were baked with.
+fn octDecode(uv: vec2f) -> vec3f {
+    let f = uv * 2.0 - 1.0;
+    var n = vec3f(f.x, 1.0 - abs(f.x) - abs(f.y), f.y);
+    let t = max(-n.y, 0.0);
+    n.x += select(t, -t, n.x >= 0.0);
+    n.z += select(t, -t, n.z >= 0.0);
+    return normalize(n);
+}
+
+fn octEncode(n: vec3f) -> vec2f {
+    let p = n / (abs(n.x) + abs(n.y) + abs(n.z));
+    var e = p.xz;
+    if (p.y < 0.0) {
+        e = (1.0 - abs(p.zx)) * select(vec2f(-1.0), vec2f(1.0), p.xz >= vec2f(0.0));
+    }
+    return e * 0.5 + 0.5;
+}
+
+fn frameBasis(dir: vec3f) -> mat3x3f {
+    let hint = select(vec3f(0.0, 1.0, 0.0), vec3f(0.0, 0.0, 1.0), abs(dir.y) > 0.999);
+    let right = normalize(cross(hint, dir));
+    return mat3x3f(right, cross(dir, right), dir);
+}
 
+// A quad facing the baked view closest to the camera's direction, so the
+// tile maps onto it without distortion. Indices 0..3 are its corners.
 @vertex
-fn vs_main(@location(0) position: vec3f) -> @builtin(position) vec4f {
-    return vec4f(position, 1.0);
+fn vs_impostor(@builtin(vertex_index) vertex_index: u32, instance: ImpostorIn) -> ImpostorOut {
+    let world = mat4x4f(instance.world0, instance.world1, instance.world2, instance.world3);
+    // uniform scale only
+    let scale = length(instance.world0.xyz);
+    let rotation = mat3x3f(instance.world0.xyz, instance.world1.xyz, instance.world2.xyz) * (1.0 / scale);
+    let center = (world * vec4f(instance.sphere.xyz, 1.0)).xyz;
+    let radius = instance.sphere.w * scale;
+
+    let n = impostors.frames_per_side;
+    let to_eye = transpose(rotation) * normalize(cameraPosition() - center);
+    let cell = min(vec2u(octEncode(to_eye) * f32(n)), vec2u(n - 1u));
+    let basis = rotation * frameBasis(octDecode((vec2f(cell) + 0.5) / f32(n)));
+
+    let corner = vec2f(f32(vertex_index & 1u), f32(vertex_index >> 1u)) * 2.0 - 1.0;
+    let world_position = center + (basis[0] * corner.x + basis[1] * corner.y) * radius;
+    var out: ImpostorOut;
+    out.position = frame.view_proj * vec4f(world_position, 1.0);
+    out.world_position = world_position;
+    // the bake's clip y points up, texture rows down
+    out.tile_uv = vec2f(0.5 + 0.5 * corner.x, 0.5 - 0.5 * corner.y);
+    out.frame = vec3u(cell, instance.layer);
+    out.forward = basis[2] * radius;
+    out.rotation0 = rotation[0];
+    out.rotation1 = rotation[1];
+    out.rotation2 = rotation[2];
+    out.fade = instanceFade(instance.world3.xyz);
+    return out;
+}
+
+// the cluster this fragment falls in, same grid as cs_build_clusters
+fn clusterOf(frag_coord: vec2f, view_depth: f32) -> u32 {
+    let tile = vec2u(frag_coord / frame.screen.zw);
+    let slice = u32(max(log(max(view_depth, frame.depth.x)) * frame.depth.z + frame.depth.w, 0.0));
+    let cell = min(vec3u(tile, slice), frame.grid.xyz - vec3u(1u));
+    return cell.x + frame.grid.x * (cell.y + frame.grid.y * cell.z);
+}
+
+// 0 in shadow, 1 lit, filtered by the comparison sampler
+fn shadowFactor(light: Light, world_position: vec3f, normal: vec3f) -> f32 {
+    if (light.shadow == NO_SHADOW) {
+        return 1.0;
+    }
+    var view_index = light.shadow;
+    if (light.kind == 0u) {
+        // cube faces in +x -x +y -y +z -z order, picked by the major axis
+        let d = world_position - light.position;
+        let a = abs(d);
+        if (a.x >= a.y && a.x >= a.z) {
+            view_index += select(1u, 0u, d.x > 0.0);
+        } else if (a.y >= a.z) {
+            view_index += select(3u, 2u, d.y > 0.0);
+        } else {
+            view_index += select(5u, 4u, d.z > 0.0);
+        }
+    }
+    let view = shadow_views[view_index];
+    let clip = view.view_proj * vec4f(world_position + normal * SHADOW_NORMAL_OFFSET, 1.0);
+    let ndc = clip.xyz / clip.w;
+    if (clip.w <= 0.0 || any(abs(ndc.xy) > vec2f(1.0)) || ndc.z > 1.0) {
+        return 1.0;
+    }
+    // kept half a texel inside the tile so filtering never reads a neighbour
+    let half_texel = 0.5 / vec2f(textureDimensions(shadow_atlas));
+    let uv = view.rect.xy + vec2f(ndc.x * 0.5 + 0.5, 0.5 - ndc.y * 0.5) * view.rect.zw;
+    let clamped = clamp(uv, view.rect.xy + half_texel, view.rect.xy + view.rect.zw - half_texel);
+    return textureSampleCompareLevel(shadow_atlas, shadow_sampler, clamped, ndc.z);
+}
+
+// explicit gradients, so the texture can be picked per fragment
+fn sampleAlbedo(texture: u32, uv: vec2f, ddx: vec2f, ddy: vec2f) -> vec4f {
+    let layer = texture & 0xffffu;
+    switch (texture >> 16u) {
+        case 0u: { return textureSampleGrad(material_textures0, material_sampler, uv, layer, ddx, ddy); }
+        case 1u: { return textureSampleGrad(material_textures1, material_sampler, uv, layer, ddx, ddy); }
+        case 2u: { return textureSampleGrad(material_textures2, material_sampler, uv, layer, ddx, ddy); }
+        case 3u: { return textureSampleGrad(material_textures3, material_sampler, uv, layer, ddx, ddy); }
+        default: { return vec4f(1.0); }
+    }
+}
+
+// ambient, emission and the cluster's lights
+fn lightSurface(albedo: vec3f, emissive: vec3f, world_position: vec3f, normal: vec3f, frag_coord: vec2f, view_depth: f32) -> vec3f {
+    let cluster = clusters[clusterOf(frag_coord, view_depth)];
+    let n = normalize(normal);
+    var color = albedo * AMBIENT + emissive;
+    for (var i = 0u; i < cluster.y; i++) {
+        let light = lights[light_indices[cluster.x + i]];
+        let to_light = light.position - world_position;
+        let light_distance = length(to_light);
+        let l = to_light / max(light_distance, 1e-4);
+        // inverse square, windowed to reach zero at the range the light was binned with
+        let window = saturate(1.0 - pow(light_distance / light.range, 4.0));
+        var attenuation = window * window / (light_distance * light_distance + 1.0);
+        if (light.kind == 1u) {
+            attenuation *= saturate(dot(-l, light.direction) * light.cone.x + light.cone.y);
+        }
+        if (attenuation > 0.0) {
+            attenuation *= shadowFactor(light, world_position, n);
+        }
+        // two-sided, the pipeline does not cull
+        color += albedo * light.color * light.intensity * abs(dot(n, l)) * attenuation;
+    }
+    return color;
+}
+
+// lit color, with the material's coverage in alpha
+fn shade(in: VertexOut) -> vec4f {
+    // derivatives before any branching
+    let ddx = dpdx(in.uv);
+    let ddy = dpdy(in.uv);
+    let material = materials[min(in.material, arrayLength(&materials) - 1u)];
+    var albedo = material.base_color;
+    if (material.albedo_texture != NO_TEXTURE) {
+        albedo *= sampleAlbedo(material.albedo_texture, in.uv, ddx, ddy);
+    }
+    let color = lightSurface(albedo.rgb, material.emissive, in.world_position, in.normal, in.position.xy, in.view_depth);
+    return vec4f(color, albedo.a);
+}
+
+@fragment
+fn fs_main(in: VertexOut) -> @location(0) vec4f {
+    let color = shade(in);
+    if (ditherThreshold(in.position.xy) < in.fade) {
+        discard;
+    }
+    return vec4f(color.rgb, 1.0);
 }
 
 @fragment
-fn fs_main() -> @location(0) vec4f {
-    return vec4f(0.0, 0.4, 0.8, 1.0);
-}
\ No newline at end of file
+fn fs_impostor(in: ImpostorOut) -> @location(0) vec4f {
+    if (ditherThreshold(in.position.xy) >= in.fade) {
+        discard;
+    }
+    // half a texel inside the tile, filtering never reads a neighbour
+    let inset = 0.5 / f32(impostors.frame_size);
+    let uv = (vec2f(in.frame.xy) + clamp(in.tile_uv, vec2f(inset), vec2f(1.0 - inset))) / f32(impostors.frames_per_side);
+    let color = textureSampleLevel(impostor_color, impostor_sampler, uv, in.frame.z, 0.0);
+    if (color.a < 0.5) {
+        discard;
+    }
+    // filtered against the cleared background, so weighted by coverage
+    let normal_depth = textureSampleLevel(impostor_normal_depth, impostor_sampler, uv, in.frame.z, 0.0) / color.a;
+    let rotation = mat3x3f(in.rotation0, in.rotation1, in.rotation2);
+    let world_position = in.world_position + in.forward * normal_depth.w;
+    let view_depth = -(frame.view * vec4f(world_position, 1.0)).z;
+    let lit = lightSurface(color.rgb / color.a, vec3f(0.0), world_position, rotation * normal_depth.xyz, in.position.xy, view_depth);
+    return vec4f(lit, 1.0);
+}
+
+// weighted blended order-independent transparency, see TransparencyPass
+struct TransparentOut {
+    @location(0) accum: vec4f,
+    @location(1) revealage: f32
+};
+
+@fragment
+fn fs_transparent(in: VertexOut) -> TransparentOut {
+    let color = shade(in);
+    // eq. 10 of McGuire and Bavoil 2013: nearer and more opaque weighs more,
+    // clamped so 16-bit float accumulation neither underflows nor overflows
+    let z = in.view_depth;
+    let weight = clamp(10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0)), 1e-2, 3e3);
+    var out: TransparentOut;
+    out.accum = vec4f(color.rgb * color.a, color.a) * weight;
+    out.revealage = color.a;
+    return out;
+}
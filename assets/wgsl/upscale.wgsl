@@ -0,0 +1,28 @@
+struct Params {
+    uv_scale: vec2f,
+    uv_max: vec2f
+};
+
+struct VertexOut {
+    @builtin(position) position: vec4f,
+    @location(0) uv: vec2f
+};
+
+@group(0) @binding(0) var source: texture_2d<f32>;
+@group(0) @binding(1) var source_sampler: sampler;
+@group(0) @binding(2) var<uniform> params: Params;
+
+// one triangle covering the screen, uv spans [0, 2] so [0, 1] lands on it
+@vertex
+fn vs_main(@builtin(vertex_index) index: u32) -> VertexOut {
+    let uv = vec2f(f32((index << 1u) & 2u), f32(index & 2u));
+    var out: VertexOut;
+    out.position = vec4f(uv.x * 2.0 - 1.0, 1.0 - uv.y * 2.0, 0.0, 1.0);
+    out.uv = uv * params.uv_scale;
+    return out;
+}
+
+@fragment
+fn fs_main(in: VertexOut) -> @location(0) vec4f {
+    return textureSampleLevel(source, source_sampler, min(in.uv, params.uv_max), 0.0);
+}
@@ -68,4 +68,37 @@ function(embed_binary_as_symbol)
     if(ARG_OUTPUT_OBJECT)
         set(${ARG_OUTPUT_OBJECT} ${ARG_OUTPUT_FILE} PARENT_SCOPE)
     endif()
-endfunction()
\ No newline at end of file
+endfunction()
+
+# 定义函数：reflect_wgsl
+# 由 WGSL 源文件生成 constexpr 顶点布局与绑定组布局头文件 <名称>.wgsl.h
+# 参数：
+#   INPUT_FILE     - 输入的 WGSL 文件路径
+#   OUTPUT_DIR     - 生成头文件所在目录
+#   OUTPUT_HEADER  - 生成的头文件路径变量（可选出参）
+function(reflect_wgsl)
+    cmake_parse_arguments(
+        PARSE_ARGV 0
+        "ARG"
+        ""
+        "INPUT_FILE;OUTPUT_DIR;OUTPUT_HEADER"
+        ""
+    )
+
+    if(NOT ARG_INPUT_FILE OR NOT ARG_OUTPUT_DIR)
+        message(FATAL_ERROR "INPUT_FILE and OUTPUT_DIR must be specified!")
+    endif()
+
+    get_filename_component(WGSL_NAME ${ARG_INPUT_FILE} NAME)
+    set(HEADER_FILE "${ARG_OUTPUT_DIR}/${WGSL_NAME}.h")
+    file(MAKE_DIRECTORY ${ARG_OUTPUT_DIR})
+    add_custom_command(
+        OUTPUT ${HEADER_FILE}
+        COMMAND wgsl_reflect "${ARG_INPUT_FILE}" "${HEADER_FILE}"
+        DEPENDS "${ARG_INPUT_FILE}" wgsl_reflect
+        COMMENT "Reflecting ${ARG_INPUT_FILE} into ${HEADER_FILE}"
+    )
+    if(ARG_OUTPUT_HEADER)
+        set(${ARG_OUTPUT_HEADER} ${HEADER_FILE} PARENT_SCOPE)
+    endif()
+endfunction()
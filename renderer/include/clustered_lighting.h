@@ -0,0 +1,140 @@
+/*
+    clustered_lighting.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include "gpu_memory.h"
+#include "gpu_object_cache.h"
+#include "webgpu/webgpu.hpp"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct ClusteredLightingConfig {
+    // lights beyond this are dropped by dispatch()
+    uint32_t max_lights { 4096 };
+    uint32_t grid_x { 16 };
+    uint32_t grid_y { 9 };
+    // exponential depth slices between the near and far plane
+    uint32_t grid_z { 24 };
+    // shared by every cluster's list, a full list truncates later clusters
+    uint32_t max_light_indices { 1u << 20 };
+};
+
+struct ClusteredLightingStats {
+    uint32_t lights { 0 };
+    uint32_t clusters { 0 };
+    // cluster bounds rebuilt by the last dispatch
+    bool rebuilt { false };
+};
+
+enum class LightType : uint32_t {
+    Point,
+    Spot,
+};
+
+// World space. Spot lights are binned by the sphere of their range.
+struct Light {
+    LightType type { LightType::Point };
+    float position[3] { 0.0f, 0.0f, 0.0f };
+    float range { 1.0f };
+    float color[3] { 1.0f, 1.0f, 1.0f };
+    float intensity { 1.0f };
+    float direction[3] { 0.0f, 0.0f, -1.0f };
+    // cosines of the cone half angles, full intensity inside the inner one
+    float inner_cone_cos { 0.9f };
+    float outer_cone_cos { 0.8f };
+    // asks ShadowAtlas for a tile, point lights take six
+    bool cast_shadows { false };
+};
+
+// Column-major, right-handed view looking down -z, projection to 0..1 depth.
+struct ClusterView {
+    float view[16];
+    float projection[16];
+    uint32_t width;
+    uint32_t height;
+    float near_plane;
+    float far_plane;
+};
+
+// Clustered forward lighting. The view frustum is cut into a grid of
+// froxels, screen tiles by exponential depth slices. Every frame a compute
+// pass tests each froxel against all lights and packs the indices of the
+// ones touching it into one shared list, so shading a fragment only walks
+// the lights of its own froxel.
+//
+// Shading passes bind frameBuffer(), lightBuffer(), clusterBuffer() and
+// indexBuffer() read-only, laid out as in clustered_lights.wgsl.
+class RENDERER_LIB_API ClusteredLighting {
+public:
+    inline static constexpr uint32_t WORKGROUP_SIZE = 64;
+    // shadow view of a light without a shadow
+    inline static constexpr uint32_t NO_SHADOW = 0xffffffff;
+
+    ClusteredLighting(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache,
+        const char *wgsl_source, ClusteredLightingConfig config = {});
+    ClusteredLighting(const ClusteredLighting&) = delete;
+    ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+    ~ClusteredLighting();
+
+    inline bool ready() const { return static_cast<bool>(m_bind_group); }
+
+    // Cluster bounds are rebuilt on the next dispatch() when the projection
+    // or the extent changed; a moving camera only costs the binning.
+    void setView(const ClusterView& view);
+
+    // Uploads the lights and bins them. Must be recorded before any pass
+    // that shades with the lists. `shadow_views` holds the first shadow
+    // view of each light, as ShadowAtlas::lightViews() does; lights past
+    // its end are unshadowed.
+    void dispatch(wgpu::Queue queue, wgpu::CommandEncoder encoder, std::span<const Light> lights,
+        std::span<const uint32_t> shadow_views = {});
+
+    inline wgpu::Buffer frameBuffer() const { return m_frame; }
+    inline wgpu::Buffer lightBuffer() const { return m_lights; }
+    inline wgpu::Buffer clusterBuffer() const { return m_clusters; }
+    inline wgpu::Buffer indexBuffer() const { return m_light_indices; }
+
+    ClusteredLightingStats stats() const;
+
+private:
+    inline uint32_t clusterCount() const { return m_config.grid_x * m_config.grid_y * m_config.grid_z; }
+
+private:
+    wgpu::Device m_device;
+    GpuMemoryTracker& m_memory;
+    GpuObjectCache& m_cache;
+    ClusteredLightingConfig m_config;
+
+    wgpu::ComputePipeline m_build_pipeline { nullptr };
+    wgpu::ComputePipeline m_bin_pipeline { nullptr };
+    wgpu::BindGroupLayout m_bind_group_layout { nullptr };
+    wgpu::BindGroup m_bind_group { nullptr };
+    wgpu::Buffer m_frame { nullptr };
+    wgpu::Buffer m_lights { nullptr };
+    wgpu::Buffer m_bounds { nullptr };
+    wgpu::Buffer m_clusters { nullptr };
+    wgpu::Buffer m_light_indices { nullptr };
+    wgpu::Buffer m_index_count { nullptr };
+
+    ClusterView m_view {};
+    bool m_has_view { false };
+    bool m_bounds_dirty { true };
+    // staging in the shader's layout
+    std::vector<uint8_t> m_light_data {};
+    ClusteredLightingStats m_stats {};
+};
@@ -0,0 +1,160 @@
+/*
+    draw_queue.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include "gpu_heap.h"
+#include "result.hpp"
+#include "webgpu/webgpu.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// 64-bit draw sort key, most significant field first:
+//   pass:4 | pipeline:12 | bind group:16 | mesh:12 | depth:20
+// Sorting by the key groups draws by pass, then by state from the most to
+// the least expensive to change, then front to back.
+struct DrawKey {
+    inline static constexpr uint32_t PASS_BITS = 4;
+    inline static constexpr uint32_t PIPELINE_BITS = 12;
+    inline static constexpr uint32_t BIND_GROUP_BITS = 16;
+    inline static constexpr uint32_t MESH_BITS = 12;
+    inline static constexpr uint32_t DEPTH_BITS = 20;
+
+    inline static constexpr uint32_t DEPTH_SHIFT = 0;
+    inline static constexpr uint32_t MESH_SHIFT = DEPTH_SHIFT + DEPTH_BITS;
+    inline static constexpr uint32_t BIND_GROUP_SHIFT = MESH_SHIFT + MESH_BITS;
+    inline static constexpr uint32_t PIPELINE_SHIFT = BIND_GROUP_SHIFT + BIND_GROUP_BITS;
+    inline static constexpr uint32_t PASS_SHIFT = PIPELINE_SHIFT + PIPELINE_BITS;
+    static_assert(PASS_SHIFT + PASS_BITS == 64);
+
+    inline static constexpr uint64_t field(uint64_t value, uint32_t bits, uint32_t shift) {
+        return (value & ((1ull << bits) - 1)) << shift;
+    }
+
+    inline static constexpr uint32_t extract(uint64_t key, uint32_t bits, uint32_t shift) {
+        return static_cast<uint32_t>((key >> shift) & ((1ull << bits) - 1));
+    }
+
+    // `depth` is a view depth normalized to [0, 1]; pass 1 - depth for back
+    // to front ordering.
+    inline static constexpr uint64_t make(uint32_t pass, uint32_t pipeline, uint32_t bind_group, uint32_t mesh, float depth) {
+        float clamped = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+        uint64_t quantized = static_cast<uint64_t>(clamped * static_cast<float>((1u << DEPTH_BITS) - 1));
+        return field(pass, PASS_BITS, PASS_SHIFT)
+            | field(pipeline, PIPELINE_BITS, PIPELINE_SHIFT)
+            | field(bind_group, BIND_GROUP_BITS, BIND_GROUP_SHIFT)
+            | field(mesh, MESH_BITS, MESH_SHIFT)
+            | field(quantized, DEPTH_BITS, DEPTH_SHIFT);
+    }
+
+    inline static constexpr uint32_t pass(uint64_t key) { return extract(key, PASS_BITS, PASS_SHIFT); }
+    inline static constexpr uint32_t pipeline(uint64_t key) { return extract(key, PIPELINE_BITS, PIPELINE_SHIFT); }
+    inline static constexpr uint32_t bindGroup(uint64_t key) { return extract(key, BIND_GROUP_BITS, BIND_GROUP_SHIFT); }
+    inline static constexpr uint32_t mesh(uint64_t key) { return extract(key, MESH_BITS, MESH_SHIFT); }
+};
+
+// Geometry a draw refers to, resolved through the heap at encode time since
+// compaction may move it.
+struct DrawMesh {
+    GpuAllocation vertices {};
+    GpuAllocation indices {};
+    wgpu::IndexFormat index_format { wgpu::IndexFormat::Uint32 };
+    // bound instead of `vertices` when that is invalid, for vertex data the
+    // heap does not own such as skinned output
+    GpuRange vertex_range {};
+};
+
+struct DrawBindGroup {
+    uint32_t group_index { 0 };
+    wgpu::BindGroup bind_group { nullptr };
+};
+
+struct DrawCommand {
+    uint32_t index_count { 0 };
+    uint32_t instance_count { 1 };
+    uint32_t first_index { 0 };
+    int32_t base_vertex { 0 };
+    uint32_t first_instance { 0 };
+};
+
+struct DrawQueueStats {
+    uint32_t draws { 0 };
+    uint32_t dropped { 0 };
+    uint32_t pipeline_binds { 0 };
+    uint32_t bind_group_binds { 0 };
+    uint32_t vertex_buffer_binds { 0 };
+    uint32_t index_buffer_binds { 0 };
+    // drawn by encode() since begin(), over every pass
+    uint64_t triangles { 0 };
+};
+
+// Per-frame draw list. Any thread may push between begin() and sort(); the
+// state tables are registered from the render thread only. Draws are radix
+// sorted by key and encoded with redundant state changes skipped.
+class RENDERER_LIB_API DrawQueue {
+public:
+    inline static constexpr uint32_t NO_BIND_GROUP = 0;
+
+    explicit DrawQueue(uint32_t capacity = 1 << 16);
+    DrawQueue(const DrawQueue&) = delete;
+    DrawQueue& operator=(const DrawQueue&) = delete;
+
+    // Ids are small indices that go into the key, registering fails once a
+    // key field is exhausted. Bind group id 0 means none.
+    Result<uint32_t, void> registerPipeline(wgpu::RenderPipeline pipeline);
+    Result<uint32_t, void> registerBindGroup(DrawBindGroup bind_group);
+    Result<uint32_t, void> registerMesh(DrawMesh mesh);
+    // Swaps what a registered id binds, for bind groups recreated around
+    // resources that grew. Not while draws are being encoded.
+    bool replaceBindGroup(uint32_t id, DrawBindGroup bind_group);
+    // Likewise for meshes whose buffers were reallocated.
+    bool replaceMesh(uint32_t id, DrawMesh mesh);
+
+    // Clears the previous frame's draws, keeping the capacity. Grows to fit
+    // everything that was dropped last frame.
+    void begin();
+
+    // Lock free. Returns false and counts the draw as dropped when full.
+    bool push(uint64_t key, const DrawCommand& command);
+
+    void sort();
+
+    // Encodes the sorted draws of `pass` into `encoder`.
+    void encode(wgpu::RenderPassEncoder encoder, const GpuHeap& heap, uint32_t pass);
+
+    // Counters for the frame since begin().
+    inline const DrawQueueStats& stats() const { return m_stats; }
+
+private:
+    uint32_t m_capacity;
+    std::unique_ptr<uint64_t[]> m_keys;
+    std::unique_ptr<DrawCommand[]> m_commands;
+    std::atomic<uint32_t> m_count { 0 };
+    // sorted (key, command index) pairs and radix scratch
+    std::vector<uint64_t> m_sorted_keys {};
+    std::vector<uint32_t> m_sorted_indices {};
+    std::vector<uint64_t> m_scratch_keys {};
+    std::vector<uint32_t> m_scratch_indices {};
+    uint32_t m_sorted_count { 0 };
+
+    std::vector<wgpu::RenderPipeline> m_pipelines {};
+    std::vector<DrawBindGroup> m_bind_groups { DrawBindGroup {} };
+    std::vector<DrawMesh> m_meshes {};
+
+    DrawQueueStats m_stats {};
+};
@@ -0,0 +1,110 @@
+/*
+    dynamic_resolution.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include "gpu_memory.h"
+#include "gpu_object_cache.h"
+#include "webgpu/webgpu.hpp"
+#include <cstdint>
+
+struct DynamicResolutionConfig {
+    // per-axis bounds of the render scale
+    float min_scale { 0.5f };
+    float max_scale { 1.0f };
+    float target_gpu_ms { 14.0f };
+    // weight of each new sample in the moving average
+    float smoothing { 0.1f };
+    // no rescale while the average stays within this fraction below target
+    float headroom { 0.15f };
+    // measured frames to wait after a change before judging it
+    uint32_t settle_frames { 8 };
+};
+
+// Picks a render scale from smoothed GPU frame times. Cost is taken to grow
+// with the pixel count, so the scale moves by the square root of the time
+// ratio, a step at a time, and snaps to 1/64 to avoid churn.
+class RENDERER_LIB_API DynamicResolution {
+public:
+    explicit DynamicResolution(DynamicResolutionConfig config = {});
+
+    // Feeds one GPU frame time, returns true when the scale changed.
+    bool update(double gpu_ms);
+
+    inline float scale() const { return m_scale; }
+    inline double smoothedMs() const { return m_smoothed_ms; }
+    inline const DynamicResolutionConfig& config() const { return m_config; }
+
+    // Render extent for a full-resolution extent, at least one pixel.
+    uint32_t scaled(uint32_t full) const;
+    // The same at max_scale, what the render target must hold for the scale
+    // to recover.
+    uint32_t maxScaled(uint32_t full) const;
+
+private:
+    DynamicResolutionConfig m_config;
+    float m_scale;
+    double m_smoothed_ms { 0.0 };
+    uint32_t m_samples { 0 };
+    uint32_t m_settle { 0 };
+};
+
+// Offscreen color target sized for the largest render scale, plus the pass
+// that stretches its used corner onto the surface. The scene renders into
+// the top-left render extent, so scale changes never reallocate.
+class RENDERER_LIB_API UpscalePass {
+public:
+    UpscalePass(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache,
+        const char *wgsl_source, wgpu::TextureFormat format);
+    UpscalePass(const UpscalePass&) = delete;
+    UpscalePass& operator=(const UpscalePass&) = delete;
+    ~UpscalePass();
+
+    // (Re)creates the offscreen target, returns false when it cannot be allocated.
+    bool resize(uint32_t width, uint32_t height);
+
+    void setRenderExtent(wgpu::Queue queue, uint32_t width, uint32_t height);
+
+    inline wgpu::TextureView targetView() const { return m_target_view; }
+    inline uint32_t renderWidth() const { return m_render_width; }
+    inline uint32_t renderHeight() const { return m_render_height; }
+    // size of the target, the largest extent setRenderExtent() accepts
+    inline uint32_t targetWidth() const { return m_width; }
+    inline uint32_t targetHeight() const { return m_height; }
+
+    void encode(wgpu::CommandEncoder encoder, wgpu::TextureView surface_view,
+        const wgpu::RenderPassTimestampWrites *p_timestamp_writes = nullptr);
+
+private:
+    void releaseTarget();
+
+private:
+    wgpu::Device m_device;
+    GpuMemoryTracker& m_memory;
+    GpuObjectCache& m_cache;
+    wgpu::TextureFormat m_format;
+    wgpu::RenderPipeline m_pipeline { nullptr };
+    wgpu::BindGroupLayout m_bind_group_layout { nullptr };
+    wgpu::Sampler m_sampler { nullptr };
+    wgpu::Buffer m_params { nullptr };
+    wgpu::Texture m_target { nullptr };
+    wgpu::TextureView m_target_view { nullptr };
+    wgpu::BindGroup m_bind_group { nullptr };
+    uint32_t m_width { 0 };
+    uint32_t m_height { 0 };
+    uint32_t m_render_width { 0 };
+    uint32_t m_render_height { 0 };
+};
@@ -0,0 +1,139 @@
+/*
+    frame_capture.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include "gpu_memory.h"
+#include "thread_pool.hpp"
+#include "webgpu/webgpu.hpp"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class CaptureFormat : uint8_t {
+    // 8-bit RGBA
+    Png,
+    // tightly packed RGBA8 rows, no header
+    Raw,
+};
+
+struct FrameCaptureStats {
+    uint64_t requested { 0 };
+    uint64_t written { 0 };
+    // due while every slot was busy, or in a format that cannot be captured
+    uint64_t dropped { 0 };
+    uint64_t failed { 0 };
+};
+
+// Reads rendered frames back without ever waiting on the GPU. A due frame
+// is copied into a ring of MapRead buffers, mapped once the GPU gets there,
+// and converted, encoded and written on the pool. When every slot is still
+// in flight the frame is skipped rather than waited for.
+//
+// The captured texture must have CopySrc usage and an 8-bit RGBA or BGRA
+// format.
+class RENDERER_LIB_API FrameCapture {
+public:
+    inline static constexpr uint32_t SLOT_COUNT = 4;
+
+    FrameCapture(GpuMemoryTracker& memory, ThreadPool& pool);
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+    // Waits for encodes in progress, never for the GPU.
+    ~FrameCapture();
+
+    // Captures the next frame into `path`. A busy ring delays it to a later frame.
+    void requestCapture(std::string path, CaptureFormat format = CaptureFormat::Png);
+
+    // Captures every `interval`-th frame into `<prefix>_<frame>.<ext>`
+    // until stopSequence(). Frames that find the ring busy are dropped.
+    void startSequence(std::string prefix, CaptureFormat format = CaptureFormat::Png, uint32_t interval = 1);
+    void stopSequence();
+    inline bool sequenceActive() const { return m_sequence_active; }
+
+    // Records the copy of `texture` when a capture is due. Call once per
+    // frame, after the frame's last pass.
+    void encode(wgpu::CommandEncoder encoder, wgpu::Texture texture);
+
+    // Call right after the frame's queue.submit().
+    void submitted();
+
+    // Hands mapped frames to the pool and recycles the written ones. Call
+    // once per frame after the device has been ticked.
+    void poll();
+
+    FrameCaptureStats stats() const;
+
+private:
+    enum SlotState : uint8_t {
+        FREE,
+        // copy recorded, not yet submitted
+        COPIED,
+        MAPPING,
+        MAPPED,
+        // a worker is reading the mapped range
+        ENCODING,
+        // the worker has its copy, waiting to be unmapped
+        ENCODED,
+    };
+
+    struct State {
+        std::array<std::atomic<uint8_t>, SLOT_COUNT> slot_state {};
+        std::mutex mutex {};
+        std::condition_variable cv {};
+        uint32_t workers { 0 };
+        std::atomic<uint64_t> written { 0 };
+        std::atomic<uint64_t> failed { 0 };
+    };
+    struct MapPayload;
+
+    struct Slot {
+        wgpu::Buffer buffer { nullptr };
+        uint64_t size { 0 };
+        uint32_t width { 0 };
+        uint32_t height { 0 };
+        uint32_t row_pitch { 0 };
+        bool bgra { false };
+        CaptureFormat format { CaptureFormat::Png };
+        std::string path {};
+    };
+
+    static bool isCapturable(wgpu::TextureFormat format, bool& bgra);
+    static void encodeSlot(const std::shared_ptr<State>& state, uint32_t slot, Slot job, const void *p_mapped);
+
+private:
+    GpuMemoryTracker& m_memory;
+    ThreadPool& m_pool;
+    std::shared_ptr<State> m_state;
+    std::array<Slot, SLOT_COUNT> m_slots {};
+    uint32_t m_next_slot { 0 };
+    std::vector<uint32_t> m_copied {};
+
+    std::vector<std::pair<std::string, CaptureFormat>> m_requests {};
+    bool m_sequence_active { false };
+    std::string m_sequence_prefix {};
+    CaptureFormat m_sequence_format { CaptureFormat::Png };
+    uint32_t m_sequence_interval { 1 };
+    uint64_t m_frame { 0 };
+
+    uint64_t m_requested { 0 };
+    uint64_t m_dropped { 0 };
+};
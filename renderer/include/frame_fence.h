@@ -0,0 +1,55 @@
+/*
+    frame_fence.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include "webgpu/webgpu.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Counts submitted frames and the frames the GPU has finished, so resources
+// touched by frame N can be recycled once completed() >= N.
+class RENDERER_LIB_API FrameFence {
+public:
+    FrameFence();
+
+    // Call once per frame, right after the frame's queue.submit().
+    void signal(wgpu::Queue queue);
+
+    inline uint64_t submitted() const { return m_submitted; }
+
+    // Serial that work being recorded right now will carry once submitted.
+    inline uint64_t pending() const { return m_submitted + 1; }
+
+    inline uint64_t completed() const {
+        return m_state->completed.load(std::memory_order_acquire);
+    }
+
+    inline bool isComplete(uint64_t serial) const {
+        return completed() >= serial;
+    }
+
+private:
+    struct State {
+        std::atomic<uint64_t> completed { 0 };
+    };
+    struct Payload;
+
+    // shared with in-flight callbacks, which may fire after the fence is gone
+    std::shared_ptr<State> m_state;
+    uint64_t m_submitted { 0 };
+};
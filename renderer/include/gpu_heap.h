@@ -0,0 +1,156 @@
+/*
+    gpu_heap.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include "frame_fence.h"
+#include "gpu_memory.h"
+#include "result.hpp"
+#include "tlsf_allocator.h"
+#include "webgpu/webgpu.hpp"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+enum class GpuHeapUsage : uint8_t {
+    Vertex, Index, Uniform,
+};
+
+inline constexpr size_t GPU_HEAP_USAGE_COUNT = 3;
+
+struct GpuHeapConfig {
+    std::array<uint64_t, GPU_HEAP_USAGE_COUNT> block_size {
+        64ull << 20, // Vertex
+        32ull << 20, // Index
+        4ull << 20,  // Uniform
+    };
+    // start evacuating a pool once this fraction of its free space lies
+    // outside the largest free range
+    float compact_threshold { 0.5f };
+};
+
+// Stable handle to a suballocated range. The range itself may move during
+// compaction, resolve it when encoding instead of caching the offset.
+struct GpuAllocation {
+    inline static constexpr uint32_t INVALID = 0xffffffff;
+
+    uint32_t slot { INVALID };
+    uint32_t generation { 0 };
+
+    inline bool valid() const { return slot != INVALID; }
+};
+
+struct GpuRange {
+    wgpu::Buffer buffer { nullptr };
+    uint64_t offset { 0 };
+    uint64_t size { 0 };
+};
+
+struct GpuHeapStats {
+    uint32_t block_count { 0 };
+    uint32_t allocation_count { 0 };
+    uint64_t reserved_bytes { 0 };
+    uint64_t used_bytes { 0 };
+    uint64_t pending_free_bytes { 0 };
+};
+
+// Reserves a few large buffers per usage class and carves vertex, index and
+// uniform ranges out of them with a TLSF allocator.
+class RENDERER_LIB_API GpuHeap {
+public:
+    GpuHeap(GpuMemoryTracker& memory, const FrameFence& fence, GpuHeapConfig config = {});
+    GpuHeap(const GpuHeap&) = delete;
+    GpuHeap& operator=(const GpuHeap&) = delete;
+    ~GpuHeap();
+
+    Result<GpuAllocation, void> allocate(GpuHeapUsage usage, uint64_t size);
+
+    // The range stays alive until the GPU has finished the frame being recorded.
+    void free(GpuAllocation allocation);
+
+    GpuRange resolve(GpuAllocation allocation) const;
+
+    void write(wgpu::Queue queue, GpuAllocation allocation, const void *p_data, uint64_t size, uint64_t offset = 0);
+
+    // Retires frees whose frame has completed and releases emptied blocks.
+    // Call once per frame after the device has been ticked.
+    void collect();
+
+    // Moves live ranges out of the sparsest block of each fragmented pool,
+    // copying at most `byte_budget` bytes. The ranges take their new offsets
+    // at once: submit `encoder` before any later write(), whose queue write
+    // would otherwise run first and be overwritten by the copy.
+    void compact(wgpu::CommandEncoder encoder, uint64_t byte_budget);
+
+    // Releases every empty block, including the one collect() keeps around.
+    // Returns the number of bytes given back.
+    uint64_t trim();
+
+    GpuHeapStats stats(GpuHeapUsage usage) const;
+
+    // write() calls and their bytes since creation
+    inline uint64_t uploadCount() const { return m_upload_count; }
+    inline uint64_t uploadedBytes() const { return m_uploaded_bytes; }
+
+private:
+    struct Block {
+        wgpu::Buffer buffer { nullptr };
+        TlsfAllocator allocator;
+        bool dedicated { false };
+        bool evacuating { false };
+    };
+
+    struct Slot {
+        uint64_t offset { 0 };
+        uint64_t size { 0 };
+        uint32_t block { 0 };
+        uint32_t node { TlsfAllocator::NO_SPACE };
+        uint32_t generation { 0 };
+        GpuHeapUsage usage { GpuHeapUsage::Vertex };
+        bool live { false };
+    };
+
+    struct PendingFree {
+        uint64_t serial;
+        uint64_t size;
+        uint32_t block;
+        uint32_t node;
+        GpuHeapUsage usage;
+    };
+
+    struct Pool {
+        std::vector<Block> blocks {};
+        uint64_t pending_free_bytes { 0 };
+    };
+
+    static uint64_t granularity(GpuHeapUsage usage);
+
+    uint32_t createBlock(GpuHeapUsage usage, uint64_t size, bool dedicated);
+    void releaseBlock(GpuHeapUsage usage, uint32_t block);
+    bool allocateIn(GpuHeapUsage usage, uint64_t size, uint32_t exclude, Slot& slot);
+    void compactPool(GpuHeapUsage usage, wgpu::CommandEncoder encoder, uint64_t& byte_budget);
+
+private:
+    GpuMemoryTracker& m_memory;
+    const FrameFence& m_fence;
+    GpuHeapConfig m_config;
+    std::array<Pool, GPU_HEAP_USAGE_COUNT> m_pools {};
+    std::vector<Slot> m_slots {};
+    std::vector<uint32_t> m_free_slots {};
+    std::vector<PendingFree> m_pending_frees {};
+    uint64_t m_upload_count { 0 };
+    uint64_t m_uploaded_bytes { 0 };
+};
@@ -0,0 +1,99 @@
+/*
+    gpu_memory.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include "webgpu/webgpu.hpp"
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class GpuMemoryCategory : uint8_t {
+    Geometry, Uniform, Storage, Texture, RenderTarget, Readback, Query, Other,
+};
+
+inline constexpr size_t GPU_MEMORY_CATEGORY_COUNT = 8;
+
+RENDERER_LIB_API const char *gpuMemoryCategoryName(GpuMemoryCategory category);
+
+// Bytes a texture occupies, summed over mips, layers and samples.
+RENDERER_LIB_API uint64_t estimateTextureSize(const wgpu::TextureDescriptor& desc);
+
+struct GpuMemoryStats {
+    uint64_t live_bytes { 0 };
+    uint64_t peak_bytes { 0 };
+    uint32_t live_count { 0 };
+};
+
+// Every buffer, texture and query set the renderer owns is created and
+// released through here, so we always know what is resident.
+class RENDERER_LIB_API GpuMemoryTracker {
+public:
+    // Asked to free at least `bytes`, returns how much it actually released.
+    using EvictionCallback = std::function<uint64_t(uint64_t bytes)>;
+
+    explicit GpuMemoryTracker(wgpu::Device device);
+    GpuMemoryTracker(const GpuMemoryTracker&) = delete;
+    GpuMemoryTracker& operator=(const GpuMemoryTracker&) = delete;
+
+    // Return nullptr when the budget cannot be met even after eviction.
+    wgpu::Buffer createBuffer(const wgpu::BufferDescriptor& desc, GpuMemoryCategory category);
+    wgpu::Texture createTexture(const wgpu::TextureDescriptor& desc, GpuMemoryCategory category);
+    wgpu::QuerySet createQuerySet(const wgpu::QuerySetDescriptor& desc, GpuMemoryCategory category);
+
+    void release(wgpu::Buffer& buffer);
+    void release(wgpu::Texture& texture);
+    void release(wgpu::QuerySet& query_set);
+
+    // 0 disables the budget.
+    void setBudget(uint64_t bytes);
+
+    uint32_t addEvictionCallback(EvictionCallback callback);
+    void removeEvictionCallback(uint32_t id);
+
+    GpuMemoryStats stats(GpuMemoryCategory category) const;
+    GpuMemoryStats total() const;
+
+    // Per-category totals followed by the largest live objects.
+    void report(std::ostream& out, size_t max_objects = 32) const;
+
+private:
+    struct Record {
+        std::string label;
+        uint64_t size;
+        GpuMemoryCategory category;
+    };
+
+    bool reserve(uint64_t size);
+    void track(const void *p_handle, const char *label, uint64_t size, GpuMemoryCategory category);
+    void untrack(const void *p_handle);
+
+private:
+    wgpu::Device m_device;
+    mutable std::mutex m_mutex;
+    uint64_t m_budget { 0 };
+    std::unordered_map<const void*, Record> m_records {};
+    std::array<GpuMemoryStats, GPU_MEMORY_CATEGORY_COUNT> m_stats {};
+    GpuMemoryStats m_total {};
+    std::vector<std::pair<uint32_t, EvictionCallback>> m_eviction_callbacks {};
+    uint32_t m_next_callback_id { 0 };
+    bool m_evicting { false };
+};
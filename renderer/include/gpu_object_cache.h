@@ -0,0 +1,109 @@
+/*
+    gpu_object_cache.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include "frame_fence.h"
+#include "webgpu/webgpu.hpp"
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct GpuObjectCacheStats {
+    uint64_t hits { 0 };
+    uint64_t misses { 0 };
+    uint32_t live { 0 };
+    // unreferenced but not yet evicted
+    uint32_t idle { 0 };
+};
+
+// Deduplicates bind group layouts, pipeline layouts, bind groups and
+// samplers by descriptor content. Every acquire must be paired with a
+// release; an object nobody references is kept for `keep_frames` frames in
+// case it is asked for again and destroyed once the GPU is done with it.
+//
+// Labels are not part of the key, the first label wins. Descriptors with a
+// chained struct are not understood and always create a fresh object.
+// Bind groups are keyed by their resources' handles, which stay unique for
+// as long as the cached bind group keeps them alive.
+class RENDERER_LIB_API GpuObjectCache {
+public:
+    GpuObjectCache(wgpu::Device device, const FrameFence& fence, uint32_t keep_frames = 3);
+    GpuObjectCache(const GpuObjectCache&) = delete;
+    GpuObjectCache& operator=(const GpuObjectCache&) = delete;
+    ~GpuObjectCache();
+
+    wgpu::BindGroupLayout acquire(const wgpu::BindGroupLayoutDescriptor& desc);
+    wgpu::PipelineLayout acquire(const wgpu::PipelineLayoutDescriptor& desc);
+    wgpu::BindGroup acquire(const wgpu::BindGroupDescriptor& desc);
+    wgpu::Sampler acquire(const wgpu::SamplerDescriptor& desc);
+
+    // Drop one reference and null the handle.
+    void release(wgpu::BindGroupLayout& layout);
+    void release(wgpu::PipelineLayout& layout);
+    void release(wgpu::BindGroup& bind_group);
+    void release(wgpu::Sampler& sampler);
+
+    // Destroys idle objects whose grace period is over. Call once per frame.
+    void collect();
+
+    GpuObjectCacheStats stats() const;
+
+private:
+    struct Key {
+        std::vector<uint64_t> words;
+        uint64_t hash;
+
+        inline bool operator==(const Key& other) const {
+            return hash == other.hash && words == other.words;
+        }
+    };
+    struct KeyHash {
+        inline size_t operator()(const Key& key) const { return static_cast<size_t>(key.hash); }
+    };
+
+    struct Entry {
+        void *p_handle;
+        uint32_t refs;
+        // fence serial of the frame that dropped the last reference
+        uint64_t idle_since;
+    };
+
+    struct Pool {
+        std::unordered_map<Key, Entry, KeyHash> entries {};
+        std::unordered_map<void*, const Key*> keys {};
+    };
+
+    enum PoolKind : uint8_t { BIND_GROUP_LAYOUT, PIPELINE_LAYOUT, BIND_GROUP, SAMPLER, POOL_COUNT };
+
+    static Key makeKey(std::vector<uint64_t>&& words);
+
+    // Returns the cached handle with one more reference, or nullptr on a miss.
+    void *lookup(PoolKind kind, const Key& key);
+    void insert(PoolKind kind, Key&& key, void *p_handle);
+    void unref(PoolKind kind, void *p_handle);
+    static void destroy(PoolKind kind, void *p_handle);
+
+private:
+    wgpu::Device m_device;
+    const FrameFence& m_fence;
+    uint32_t m_keep_frames;
+    mutable std::mutex m_mutex;
+    Pool m_pools[POOL_COUNT];
+    uint64_t m_uncached { 0 };
+    GpuObjectCacheStats m_stats {};
+};
@@ -0,0 +1,165 @@
+/*
+    gpu_skinning.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include "frame_fence.h"
+#include "gpu_heap.h"
+#include "gpu_memory.h"
+#include "gpu_object_cache.h"
+#include "result.hpp"
+#include "tlsf_allocator.h"
+#include "webgpu/webgpu.hpp"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct GpuSkinningConfig {
+    // pool capacities, fixed for the lifetime of the skinner
+    uint32_t max_source_vertices { 1u << 20 };
+    uint32_t max_output_vertices { 1u << 20 };
+    uint32_t max_joints { 1u << 14 };
+    uint32_t max_instances { 1024 };
+};
+
+struct GpuSkinningStats {
+    uint32_t meshes { 0 };
+    uint32_t instances { 0 };
+    // skinned by the last dispatch
+    uint32_t vertices { 0 };
+    uint32_t joints { 0 };
+};
+
+// Linear blend skinning on the GPU. Bind pose vertices and weights are
+// uploaded once per mesh; every animated instance of a mesh owns a range of
+// a shared output vertex buffer and a range of joint matrices. One compute
+// dispatch per frame skins all instances, after which every pass of the
+// frame draws the output range as an ordinary vertex buffer.
+class RENDERER_LIB_API GpuSkinning {
+public:
+    // position, normal and uv as 8 floats, in and out
+    inline static constexpr uint32_t VERTEX_STRIDE = 32;
+    // four joint index bytes followed by four unorm8 weights
+    inline static constexpr uint32_t WEIGHT_STRIDE = 8;
+    // row-major 3x4 per joint
+    inline static constexpr uint32_t JOINT_FLOATS = 12;
+    // joint indices are bytes
+    inline static constexpr uint32_t MAX_INSTANCE_JOINTS = 256;
+    inline static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+    GpuSkinning(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache, const FrameFence& fence,
+        const char *wgsl_source, GpuSkinningConfig config = {});
+    GpuSkinning(const GpuSkinning&) = delete;
+    GpuSkinning& operator=(const GpuSkinning&) = delete;
+    ~GpuSkinning();
+
+    // Fails when the source pool is full or the skinner could not be created.
+    Result<uint32_t, void> addMesh(wgpu::Queue queue, const void *p_vertices, const void *p_weights, uint32_t vertex_count);
+
+    // The mesh must not have instances left.
+    void removeMesh(uint32_t mesh);
+
+    Result<uint32_t, void> addInstance(uint32_t mesh, uint32_t joint_count);
+
+    // Ranges stay alive until the GPU has finished the frame being recorded.
+    void removeInstance(uint32_t instance);
+
+    // JOINT_FLOATS per joint, filled by the caller every frame before
+    // dispatch(). Distinct instances may be filled from different threads.
+    std::span<float> jointMatrices(uint32_t instance);
+
+    // Skinned vertices of `instance`, valid for passes recorded after
+    // dispatch() into the same frame.
+    GpuRange output(uint32_t instance) const;
+
+    // Uploads the joint matrices and skins every instance. Must be recorded
+    // before any pass that draws skinned output.
+    void dispatch(wgpu::Queue queue, wgpu::CommandEncoder encoder);
+
+    // Retires ranges whose frame has completed. Call once per frame.
+    void collect();
+
+    GpuSkinningStats stats() const;
+
+private:
+    struct Mesh {
+        TlsfAllocator::Allocation source { 0, TlsfAllocator::NO_SPACE };
+        uint32_t vertex_count { 0 };
+        uint32_t instance_count { 0 };
+        bool live { false };
+    };
+
+    struct Instance {
+        TlsfAllocator::Allocation output { 0, TlsfAllocator::NO_SPACE };
+        TlsfAllocator::Allocation joints { 0, TlsfAllocator::NO_SPACE };
+        uint32_t mesh { 0 };
+        uint32_t joint_count { 0 };
+        bool live { false };
+    };
+
+    struct PendingFree {
+        uint64_t serial;
+        TlsfAllocator *p_allocator;
+        uint32_t node;
+    };
+
+    // checked against the reflected Job struct of skinning.wgsl
+    struct Job {
+        uint32_t first_group;
+        uint32_t vertex_count;
+        uint32_t source_offset;
+        uint32_t output_offset;
+        uint32_t joint_offset;
+        uint32_t padding[3];
+    };
+
+    inline bool ready() const { return static_cast<bool>(m_bind_group); }
+
+    template<typename Slot>
+    static uint32_t claimSlot(std::vector<Slot>& slots, std::vector<uint32_t>& free_slots);
+
+private:
+    wgpu::Device m_device;
+    GpuMemoryTracker& m_memory;
+    GpuObjectCache& m_cache;
+    const FrameFence& m_fence;
+    GpuSkinningConfig m_config;
+
+    wgpu::ComputePipeline m_pipeline { nullptr };
+    wgpu::BindGroupLayout m_bind_group_layout { nullptr };
+    wgpu::BindGroup m_bind_group { nullptr };
+    wgpu::Buffer m_source { nullptr };
+    wgpu::Buffer m_weights { nullptr };
+    wgpu::Buffer m_output { nullptr };
+    wgpu::Buffer m_joints { nullptr };
+    wgpu::Buffer m_jobs { nullptr };
+
+    // in vertices and joints
+    TlsfAllocator m_source_allocator;
+    TlsfAllocator m_output_allocator;
+    TlsfAllocator m_joint_allocator;
+
+    std::vector<Mesh> m_meshes {};
+    std::vector<uint32_t> m_free_meshes {};
+    std::vector<Instance> m_instances {};
+    std::vector<uint32_t> m_free_instances {};
+    std::vector<PendingFree> m_pending_frees {};
+
+    // staging for the joint matrices, uploaded up to the highest live joint
+    std::vector<float> m_joint_data {};
+    std::vector<uint32_t> m_job_data {};
+    GpuSkinningStats m_stats {};
+};
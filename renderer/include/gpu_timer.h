@@ -0,0 +1,87 @@
+/*
+    gpu_timer.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include "gpu_memory.h"
+#include "webgpu/webgpu.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+// Measures how long the GPU spends on each frame without ever waiting on it.
+//
+// With the timestamp-query feature an empty compute pass opening the frame
+// and the frame's last pass write timestamps, so every pass in between is
+// timed; they are resolved into a small ring of MapRead buffers. Without
+// it the frame time is estimated from queue completion callbacks as
+// done - max(submit, previous done), which is exact while the GPU is busy and
+// includes some driver latency while it idles.
+class RENDERER_LIB_API GpuTimer {
+public:
+    inline static constexpr uint32_t SLOT_COUNT = 4;
+
+    GpuTimer(wgpu::Device device, GpuMemoryTracker& memory);
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+    ~GpuTimer();
+
+    inline bool usesTimestamps() const { return static_cast<bool>(m_query_set); }
+
+    // Starts a frame, stamping its beginning into `encoder`; must precede
+    // anything else the frame records. Frames are skipped, not waited on,
+    // while every readback slot is still in flight.
+    void beginFrame(wgpu::CommandEncoder encoder);
+
+    // Timestamp writes for the frame's last pass, or nullptr for any other
+    // pass and when the frame is not being timed by queries.
+    const wgpu::RenderPassTimestampWrites *passWrites(bool last_pass);
+
+    // Records the query resolve, after the last pass of the frame.
+    void endFrame(wgpu::CommandEncoder encoder);
+
+    // Call right after the frame's queue.submit().
+    void submitted(wgpu::Queue queue);
+
+    // GPU time of the newest frame measured since the last call, in ms.
+    std::optional<double> poll();
+
+private:
+    struct State {
+        std::array<std::atomic<bool>, SLOT_COUNT> slot_busy {};
+        std::atomic<uint64_t> latest_ns { 0 };
+        std::atomic<uint64_t> sample_count { 0 };
+        // completion-callback estimate
+        std::atomic<uint64_t> last_done_ns { 0 };
+    };
+    struct MapPayload;
+    struct DonePayload;
+
+    static uint64_t nowNs();
+
+private:
+    GpuMemoryTracker& m_memory;
+    std::shared_ptr<State> m_state;
+    wgpu::QuerySet m_query_set { nullptr };
+    wgpu::Buffer m_resolve_buffer { nullptr };
+    std::array<wgpu::Buffer, SLOT_COUNT> m_readback {};
+    wgpu::RenderPassTimestampWrites m_writes {};
+    uint32_t m_next_slot { 0 };
+    std::optional<uint32_t> m_frame_slot {};
+    uint64_t m_seen_samples { 0 };
+};
@@ -0,0 +1,131 @@
+/*
+    impostor_atlas.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include "gpu_heap.h"
+#include "gpu_memory.h"
+#include "gpu_object_cache.h"
+#include "result.hpp"
+#include "webgpu/webgpu.hpp"
+#include <cstdint>
+#include <limits>
+#include <string>
+
+struct ImpostorAtlasConfig {
+    // views per side of the octahedral grid, each mesh gets the square
+    uint32_t frames_per_side { 8 };
+    // texels per side of one view
+    uint32_t frame_size { 64 };
+    // meshes the atlas starts with, doubled whenever it fills up
+    uint32_t initial_layers { 2 };
+    uint32_t max_layers { 256 };
+};
+
+// What drawing impostors reads besides the atlas, laid out as Impostors in
+// test.wgsl.
+struct GpuImpostorParams {
+    // view distance over which a mesh dissolves into its impostor; the
+    // largest float keeps every instance a mesh
+    float fade_start { std::numeric_limits<float>::max() };
+    float fade_end { std::numeric_limits<float>::max() };
+    uint32_t frames_per_side { 0 };
+    uint32_t frame_size { 0 };
+};
+
+static_assert(sizeof(GpuImpostorParams) == 16);
+
+// A mesh to bake, in the Vertex layout.
+struct ImpostorBakeSource {
+    GpuRange vertices {};
+    GpuRange indices {};
+    wgpu::IndexFormat index_format { wgpu::IndexFormat::Uint32 };
+    uint32_t index_count { 0 };
+    // bounding sphere in mesh space
+    float center[3] { 0.0f, 0.0f, 0.0f };
+    float radius { 1.0f };
+    float base_color[4] { 1.0f, 1.0f, 1.0f, 1.0f };
+    // a texture_2d_array view and its sampler, bound even when
+    // albedo_layer is NO_TEXTURE
+    wgpu::TextureView albedo_array { nullptr };
+    wgpu::Sampler albedo_sampler { nullptr };
+    uint32_t albedo_layer { 0xffffffff };
+};
+
+// Octahedral impostors: every baked mesh is rendered orthographically from
+// frames_per_side^2 directions spread evenly over the sphere by an
+// octahedral map, into one layer of a color atlas and one of mesh space
+// normal and depth. Far away, an instance is drawn as a single quad showing
+// the view closest to the camera's direction.
+//
+// Layers grow like MaterialTable's arrays, bindingVersion() changes when the
+// atlas was recreated and bind groups holding it are stale.
+class RENDERER_LIB_API ImpostorAtlas {
+public:
+    inline static constexpr uint32_t NO_TEXTURE = 0xffffffff;
+    inline static constexpr wgpu::TextureFormat COLOR_FORMAT = wgpu::TextureFormat::RGBA8Unorm;
+    inline static constexpr wgpu::TextureFormat NORMAL_DEPTH_FORMAT = wgpu::TextureFormat::RGBA16Float;
+
+    ImpostorAtlas(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache,
+        const char *bake_wgsl_source, ImpostorAtlasConfig config = {});
+    ImpostorAtlas(const ImpostorAtlas&) = delete;
+    ImpostorAtlas& operator=(const ImpostorAtlas&) = delete;
+    ~ImpostorAtlas();
+
+    inline bool ready() const { return m_color_view && m_normal_depth_view && m_params && m_bake_params; }
+
+    // Renders `source` into a new layer and submits the work on `queue`,
+    // returns the layer.
+    Result<uint32_t, std::string> bake(wgpu::Queue queue, const ImpostorBakeSource& source);
+
+    // Instances whose origin is beyond `fade_end` from the camera are only
+    // impostors, the ones before `fade_start` only meshes.
+    void setFadeRange(wgpu::Queue queue, float fade_start, float fade_end);
+    inline const GpuImpostorParams& params() const { return m_params_data; }
+
+    inline uint32_t bindingVersion() const { return m_binding_version; }
+    inline wgpu::TextureView colorView() const { return m_color_view; }
+    inline wgpu::TextureView normalDepthView() const { return m_normal_depth_view; }
+    inline wgpu::Sampler sampler() const { return m_sampler; }
+    inline wgpu::Buffer paramsBuffer() const { return m_params; }
+    inline uint32_t layerCount() const { return m_layers; }
+
+private:
+    bool createAtlas(uint32_t capacity);
+    bool growAtlas(wgpu::Queue queue);
+
+private:
+    wgpu::Device m_device;
+    GpuMemoryTracker& m_memory;
+    GpuObjectCache& m_cache;
+    ImpostorAtlasConfig m_config;
+
+    wgpu::RenderPipeline m_bake_pipeline { nullptr };
+    wgpu::BindGroupLayout m_bake_layout { nullptr };
+    wgpu::Buffer m_bake_params { nullptr };
+    wgpu::Sampler m_sampler { nullptr };
+
+    wgpu::Texture m_color { nullptr };
+    wgpu::TextureView m_color_view { nullptr };
+    wgpu::Texture m_normal_depth { nullptr };
+    wgpu::TextureView m_normal_depth_view { nullptr };
+    uint32_t m_layers { 0 };
+    uint32_t m_capacity { 0 };
+    uint32_t m_binding_version { 0 };
+
+    GpuImpostorParams m_params_data {};
+    wgpu::Buffer m_params { nullptr };
+};
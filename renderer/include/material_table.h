@@ -0,0 +1,145 @@
+/*
+    material_table.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include "gpu_memory.h"
+#include "gpu_object_cache.h"
+#include "result.hpp"
+#include "webgpu/webgpu.hpp"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct MaterialTableConfig {
+    // layers a texture array starts with, doubled whenever it fills up
+    uint32_t initial_layers { 4 };
+    // maxTextureArrayLayers of the default limits
+    uint32_t max_layers { 256 };
+    uint32_t initial_materials { 64 };
+    uint32_t initial_instances { 1024 };
+};
+
+// One entry of the material table, laid out as Material in test.wgsl.
+struct GpuMaterial {
+    float base_color[4] { 1.0f, 1.0f, 1.0f, 1.0f };
+    float emissive[3] { 0.0f, 0.0f, 0.0f };
+    // from MaterialTable::addTexture(), NO_TEXTURE for none
+    uint32_t albedo_texture { 0xffffffff };
+};
+
+static_assert(sizeof(GpuMaterial) == 32);
+
+// Every material of a pass behind one set of bindings, so switching
+// materials between draws costs no bind group change.
+//
+// Textures of one format and size share a texture_2d_array, a texture is
+// named by its array and layer. Material parameters live in one storage
+// buffer, and the material of each instance in another, indexed by the
+// shader's instance_index. Arrays and buffers grow by being recreated;
+// bindingVersion() changes when that happens and the bind group holding
+// them has to be created again.
+class RENDERER_LIB_API MaterialTable {
+public:
+    // texture_2d_array bindings the shader declares
+    inline static constexpr uint32_t MAX_TEXTURE_ARRAYS = 4;
+    inline static constexpr uint32_t NO_TEXTURE = 0xffffffff;
+    // a texture reference is array << LAYER_BITS | layer
+    inline static constexpr uint32_t LAYER_BITS = 16;
+
+    MaterialTable(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache, MaterialTableConfig config = {});
+    MaterialTable(const MaterialTable&) = delete;
+    MaterialTable& operator=(const MaterialTable&) = delete;
+    ~MaterialTable();
+
+    inline bool ready() const { return m_materials_buffer && m_instances_buffer && m_placeholder_view && m_sampler; }
+
+    // Uploads one mip level of uncompressed color, rows `bytes_per_row`
+    // apart. Fails for formats the arrays do not sample as float, and once
+    // every array slot holds another format or size.
+    Result<uint32_t, std::string> addTexture(wgpu::Queue queue, wgpu::TextureFormat format, uint32_t width,
+        uint32_t height, const void *p_pixels, uint32_t bytes_per_row);
+
+    uint32_t addMaterial(const GpuMaterial& material);
+    void setMaterial(uint32_t material, const GpuMaterial& params);
+    // instances without a material use material 0
+    void setInstanceMaterial(uint32_t instance, uint32_t material);
+
+    // Writes what changed since the last call, growing the buffers first.
+    void upload(wgpu::Queue queue);
+
+    inline uint32_t bindingVersion() const { return m_binding_version; }
+    inline wgpu::Buffer materialBuffer() const { return m_materials_buffer; }
+    inline wgpu::Buffer instanceBuffer() const { return m_instances_buffer; }
+    // a 1x1 white layer for slots without an array
+    wgpu::TextureView arrayView(uint32_t slot) const;
+    inline wgpu::Sampler sampler() const { return m_sampler; }
+
+    inline uint32_t materialCount() const { return static_cast<uint32_t>(m_materials.size()); }
+    // `material` below materialCount()
+    inline const GpuMaterial& material(uint32_t material) const { return m_materials[material]; }
+    inline uint32_t instanceMaterial(uint32_t instance) const {
+        return instance < m_instance_materials.size() ? m_instance_materials[instance] : 0;
+    }
+    inline uint32_t textureArrayCount() const { return static_cast<uint32_t>(m_arrays.size()); }
+
+private:
+    struct TextureArray {
+        wgpu::TextureFormat format { wgpu::TextureFormat::Undefined };
+        uint32_t width { 0 };
+        uint32_t height { 0 };
+        uint32_t layers { 0 };
+        uint32_t capacity { 0 };
+        wgpu::Texture texture { nullptr };
+        wgpu::TextureView view { nullptr };
+    };
+
+    // a range of entries waiting for upload, empty when first >= last
+    struct Dirty {
+        uint32_t first { 0xffffffff };
+        uint32_t last { 0 };
+
+        inline void add(uint32_t i) {
+            first = i < first ? i : first;
+            last = i + 1 > last ? i + 1 : last;
+        }
+    };
+
+    bool createArray(TextureArray& array, uint32_t capacity);
+    bool growArray(wgpu::Queue queue, TextureArray& array);
+    // false when the buffer could not be created
+    bool fitBuffer(wgpu::Buffer& buffer, uint64_t size, const char *label);
+
+private:
+    wgpu::Device m_device;
+    GpuMemoryTracker& m_memory;
+    GpuObjectCache& m_cache;
+    MaterialTableConfig m_config;
+
+    std::vector<TextureArray> m_arrays {};
+    wgpu::Texture m_placeholder { nullptr };
+    wgpu::TextureView m_placeholder_view { nullptr };
+    wgpu::Sampler m_sampler { nullptr };
+
+    std::vector<GpuMaterial> m_materials {};
+    std::vector<uint32_t> m_instance_materials {};
+    Dirty m_dirty_materials {};
+    Dirty m_dirty_instances {};
+    wgpu::Buffer m_materials_buffer { nullptr };
+    wgpu::Buffer m_instances_buffer { nullptr };
+    uint32_t m_binding_version { 0 };
+};
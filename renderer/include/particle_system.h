@@ -0,0 +1,179 @@
+/*
+    particle_system.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "clustered_lighting.h"
+#include "export_api.h"
+#include "gpu_memory.h"
+#include "gpu_object_cache.h"
+#include "webgpu/webgpu.hpp"
+#include <cstdint>
+#include <vector>
+
+enum class ParticleBlend : uint8_t {
+    // order independent, never sorted
+    Additive,
+    // sorted far to near every frame
+    Alpha,
+};
+
+struct ParticleSystemConfig {
+    // particles alive at once, at most ParticleSystem::MAX_CAPACITY
+    uint32_t capacity { 1u << 20 };
+    ParticleBlend blend { ParticleBlend::Additive };
+};
+
+// World space, read again every update().
+struct ParticleEmitter {
+    float position[3] { 0.0f, 0.0f, 0.0f };
+    // particles per second
+    float rate { 0.0f };
+    float direction[3] { 0.0f, 1.0f, 0.0f };
+    // half angle in radians of the cone particles leave in
+    float spread { 0.5f };
+    float speed_min { 1.0f };
+    float speed_max { 2.0f };
+    // seconds
+    float lifetime_min { 1.0f };
+    float lifetime_max { 2.0f };
+    float size_start { 0.05f };
+    float size_end { 0.0f };
+    float color_start[4] { 1.0f, 1.0f, 1.0f, 1.0f };
+    float color_end[4] { 1.0f, 1.0f, 1.0f, 0.0f };
+    float gravity[3] { 0.0f, -9.81f, 0.0f };
+    // fraction of the velocity lost per second
+    float drag { 0.0f };
+};
+
+struct ParticleSystemStats {
+    uint32_t capacity { 0 };
+    // handed to the GPU by the last update(), it may have had fewer free
+    uint32_t emitted { 0 };
+    // sorting dispatches recorded by the last update()
+    uint32_t sort_dispatches { 0 };
+};
+
+// Particles that live on the GPU alone. Every slot is on one of three
+// lists: dead, alive this frame, or alive next frame. Each update() a
+// single thread pops the emitted slots off the dead list and sizes the
+// following dispatches; emission and simulation then run as indirect
+// dispatches over exactly the live particles, pushing the survivors onto
+// the next alive list and the dead back onto the dead list, and the two
+// alive lists trade places. The count of survivors becomes the instance
+// count of an indirect draw of camera facing quads, so the CPU never learns
+// how many particles there are and uploads nothing but one uniform of
+// emitter and camera parameters per frame.
+//
+// Alpha blended particles are sorted far to near by a bitonic sort over the
+// survivors padded to a power of two: the steps closer than a workgroup's
+// block run in workgroup memory, the wider ones as one dispatch each.
+class RENDERER_LIB_API ParticleSystem {
+public:
+    inline static constexpr uint32_t WORKGROUP_SIZE = 256;
+    // the particle buffer stays within the default 128 MiB storage binding
+    inline static constexpr uint32_t MAX_CAPACITY = 1u << 21;
+
+    // `color_format` is the format of the pass draw() records into.
+    ParticleSystem(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache,
+        const char *simulate_source, const char *draw_source, wgpu::TextureFormat color_format,
+        ParticleSystemConfig config = {});
+    ParticleSystem(const ParticleSystem&) = delete;
+    ParticleSystem& operator=(const ParticleSystem&) = delete;
+    ~ParticleSystem();
+
+    inline bool ready() const { return static_cast<bool>(m_draw_pipeline); }
+
+    // Emits for `dt` seconds of `emitter`, then steps every particle by `dt`
+    // and sorts them for `view` when blending needs it. Must be recorded
+    // before the pass that calls draw().
+    void update(wgpu::Queue queue, wgpu::CommandEncoder encoder, const ParticleEmitter& emitter, float dt,
+        const ClusterView& view);
+
+    // Draws what the last update() left alive. No depth attachment is
+    // expected, the quads are blended over whatever the pass holds.
+    void draw(wgpu::RenderPassEncoder pass) const;
+
+    inline ParticleSystemStats stats() const { return m_stats; }
+
+private:
+    enum class SortKind : uint8_t {
+        // one compare-exchange step of at least a block apart
+        Step,
+        // the remaining steps of a stage, within each block
+        Merge,
+    };
+
+    struct SortDispatch {
+        SortKind kind;
+        // stage and compare distance, as SortStep in particles.wgsl
+        uint32_t k;
+        uint32_t j;
+        // dynamic offset of its SortStep
+        uint32_t offset;
+    };
+
+    inline bool sorted() const { return m_config.blend == ParticleBlend::Alpha; }
+    void encodeSort(wgpu::CommandEncoder encoder);
+
+private:
+    wgpu::Device m_device;
+    GpuMemoryTracker& m_memory;
+    GpuObjectCache& m_cache;
+    ParticleSystemConfig m_config;
+    // capacity rounded up to a power of two, at least a sort block
+    uint32_t m_sort_capacity { 0 };
+
+    wgpu::ComputePipeline m_init_pipeline { nullptr };
+    wgpu::ComputePipeline m_begin_pipeline { nullptr };
+    wgpu::ComputePipeline m_emit_pipeline { nullptr };
+    wgpu::ComputePipeline m_simulate_pipeline { nullptr };
+    wgpu::ComputePipeline m_finish_pipeline { nullptr };
+    wgpu::ComputePipeline m_sort_keys_pipeline { nullptr };
+    wgpu::ComputePipeline m_sort_block_pipeline { nullptr };
+    wgpu::ComputePipeline m_sort_merge_pipeline { nullptr };
+    wgpu::ComputePipeline m_sort_step_pipeline { nullptr };
+    wgpu::RenderPipeline m_draw_pipeline { nullptr };
+    wgpu::BindGroupLayout m_layout { nullptr };
+    wgpu::BindGroupLayout m_args_layout { nullptr };
+    wgpu::BindGroupLayout m_step_layout { nullptr };
+    wgpu::BindGroupLayout m_draw_layout { nullptr };
+    // by which alive list the update reads
+    wgpu::BindGroup m_bind_groups[2] { nullptr, nullptr };
+    wgpu::BindGroup m_args_bind_group { nullptr };
+    wgpu::BindGroup m_step_bind_group { nullptr };
+    // drawing either alive list as it is, or the sorted one
+    wgpu::BindGroup m_draw_bind_groups[3] { nullptr, nullptr, nullptr };
+
+    wgpu::Buffer m_frame { nullptr };
+    wgpu::Buffer m_particles { nullptr };
+    wgpu::Buffer m_dead_list { nullptr };
+    wgpu::Buffer m_alive_lists[2] { nullptr, nullptr };
+    wgpu::Buffer m_counters { nullptr };
+    wgpu::Buffer m_sort_keys { nullptr };
+    wgpu::Buffer m_sort_values { nullptr };
+    wgpu::Buffer m_args { nullptr };
+    wgpu::Buffer m_steps { nullptr };
+
+    std::vector<SortDispatch> m_sort_dispatches {};
+    bool m_initialized { false };
+    // alive list the next update() reads, the other one it fills
+    uint32_t m_parity { 0 };
+    uint32_t m_draw_bind_group { 0 };
+    // emission below one particle a frame carries over
+    float m_emit_carry { 0.0f };
+    uint32_t m_seed { 0 };
+    ParticleSystemStats m_stats {};
+};
@@ -0,0 +1,203 @@
+/*
+    shadow_atlas.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "clustered_lighting.h"
+#include "export_api.h"
+#include "gpu_memory.h"
+#include "gpu_object_cache.h"
+#include "webgpu/webgpu.hpp"
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <set>
+#include <vector>
+
+struct ShadowAtlasConfig {
+    // square, a power of two
+    uint32_t size { 2048 };
+    // tile edges are powers of two between these
+    uint32_t max_tile { 1024 };
+    uint32_t min_tile { 64 };
+    // views across all lights, a point light takes six
+    uint32_t max_views { 64 };
+};
+
+struct ShadowAtlasStats {
+    uint32_t lights { 0 };
+    uint32_t views { 0 };
+    // casting lights that found no room
+    uint32_t dropped { 0 };
+    // views whose static depth was rendered again by the last encode()
+    uint32_t static_renders { 0 };
+    // texels held by tiles
+    uint64_t used_texels { 0 };
+};
+
+enum class ShadowCasters : uint8_t {
+    // drawn once into the cache, again only when the light or the static
+    // scene changes
+    Static,
+    // drawn on top of the cached depth every frame
+    Dynamic,
+};
+
+// Records one set of casters into `pass`. The caster pipeline, the view's
+// bind group at group 0 and the tile's viewport are already set; the
+// instance matrices are the callee's to bind, as in the main pass.
+using ShadowCasterDraw = std::function<void(wgpu::RenderPassEncoder pass, ShadowCasters casters)>;
+
+// Shadows of every casting light packed into one depth atlas. Tiles are
+// sized by the light's projected size on screen and packed by a quadtree,
+// a spot light takes one tile and a point light six, one per cube face.
+//
+// Static casters are cached in a second atlas. A view renders them again
+// only when its tile is new, its light changed, or invalidateStatic() was
+// called for a box its light reaches. Every frame the cache is copied into
+// the sampled atlas and dynamic casters are drawn over it.
+//
+// Lights are identified by their index in the span given to update().
+class RENDERER_LIB_API ShadowAtlas {
+public:
+    ShadowAtlas(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache,
+        const char *wgsl_source, ShadowAtlasConfig config = {});
+    ShadowAtlas(const ShadowAtlas&) = delete;
+    ShadowAtlas& operator=(const ShadowAtlas&) = delete;
+    ~ShadowAtlas();
+
+    inline bool ready() const { return static_cast<bool>(m_atlas_view); }
+
+    // Depth-only pipeline taking the model vertex and instance buffers, for
+    // the caster draws.
+    inline wgpu::RenderPipeline casterPipeline() const { return m_caster_pipeline; }
+
+    // The static scene changed, every cached view is rendered again.
+    void invalidateStatic();
+    // Static casters within the box changed, only the views of lights whose
+    // range reaches it are rendered again.
+    void invalidateStatic(const float min[3], const float max[3]);
+
+    // Whether the next encode() renders any cached view again, the static
+    // casters need only be drawn then. Valid after update().
+    bool staticDirty() const;
+
+    // Reassigns tiles for the casting lights as seen from `camera`.
+    void update(std::span<const Light> lights, const ClusterView& camera);
+
+    // First view of each light given to update(), ClusteredLighting::NO_SHADOW
+    // for lights without a tile.
+    inline std::span<const uint32_t> lightViews() const { return m_light_views; }
+
+    // Uploads the views and renders the atlas. Must be recorded before any
+    // pass that samples it.
+    void encode(wgpu::Queue queue, wgpu::CommandEncoder encoder, const ShadowCasterDraw& draw);
+
+    // For shading, laid out as ShadowView in shadow.wgsl.
+    inline wgpu::Buffer viewBuffer() const { return m_views; }
+    inline wgpu::TextureView atlasView() const { return m_atlas_view; }
+    // comparison sampler, less
+    inline wgpu::Sampler sampler() const { return m_sampler; }
+
+    inline ShadowAtlasStats stats() const { return m_stats; }
+
+private:
+    struct Tile {
+        uint32_t x { 0 };
+        uint32_t y { 0 };
+        uint32_t size { 0 };
+    };
+
+    // Power-of-two square tiles, split and merged like a buddy allocator.
+    class TileAllocator {
+    public:
+        TileAllocator(uint32_t size, uint32_t min_tile);
+        // false when no block of `size` is free
+        bool allocate(uint32_t size, Tile& tile);
+        void free(const Tile& tile);
+
+    private:
+        uint32_t level(uint32_t size) const;
+        uint32_t key(uint32_t x, uint32_t y) const;
+
+    private:
+        uint32_t m_size;
+        uint32_t m_min_tile;
+        // free blocks per level, level 0 is the whole atlas
+        std::vector<std::set<uint32_t>> m_free;
+    };
+
+    // what a cached view depends on besides the static scene
+    struct LightKey {
+        LightType type { LightType::Point };
+        float position[3] { 0.0f, 0.0f, 0.0f };
+        float direction[3] { 0.0f, 0.0f, 0.0f };
+        float range { 0.0f };
+        float outer_cone_cos { 0.0f };
+
+        bool operator==(const LightKey& other) const;
+    };
+
+    struct ShadowLight {
+        LightKey key {};
+        uint32_t first_view { ClusteredLighting::NO_SHADOW };
+        uint32_t view_count { 0 };
+        uint32_t tile_size { 0 };
+    };
+
+    struct View {
+        Tile tile {};
+        float view_proj[16] {};
+        bool live { false };
+        bool static_dirty { false };
+    };
+
+    // 0 when the light should not cast this frame
+    uint32_t desiredTileSize(const Light& light, const ClusterView& camera, const float eye[3]) const;
+    bool allocateViews(uint32_t count, uint32_t tile_size, uint32_t& first_view);
+    void freeViews(ShadowLight& light);
+    void computeViews(const Light& light, const ShadowLight& shadow);
+    void encodeTiles(wgpu::CommandEncoder encoder, wgpu::TextureView target, bool static_pass,
+        const ShadowCasterDraw& draw);
+
+private:
+    wgpu::Device m_device;
+    GpuMemoryTracker& m_memory;
+    GpuObjectCache& m_cache;
+    ShadowAtlasConfig m_config;
+
+    wgpu::RenderPipeline m_caster_pipeline { nullptr };
+    wgpu::RenderPipeline m_clear_pipeline { nullptr };
+    wgpu::BindGroupLayout m_bind_group_layout { nullptr };
+    wgpu::Sampler m_sampler { nullptr };
+    // sampled, the cache plus this frame's dynamic casters
+    wgpu::Texture m_atlas { nullptr };
+    wgpu::TextureView m_atlas_view { nullptr };
+    // static casters only
+    wgpu::Texture m_static_atlas { nullptr };
+    wgpu::TextureView m_static_view { nullptr };
+    // one uniform slot per view for rendering, packed views for shading
+    wgpu::Buffer m_view_uniforms { nullptr };
+    wgpu::Buffer m_views { nullptr };
+    std::vector<wgpu::BindGroup> m_view_bind_groups {};
+
+    TileAllocator m_tiles;
+    std::vector<View> m_view_slots {};
+    std::vector<ShadowLight> m_lights {};
+    std::vector<uint32_t> m_light_views {};
+    std::vector<uint8_t> m_uniform_data {};
+    std::vector<uint8_t> m_view_data {};
+    ShadowAtlasStats m_stats {};
+};
@@ -0,0 +1,79 @@
+/*
+    tlsf_allocator.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include <cstdint>
+#include <vector>
+
+// Two-level segregated fit allocator over an abstract [0, size) range. It
+// never touches the memory it manages, so it can carve up GPU buffers.
+// Allocation and free are O(1).
+class RENDERER_LIB_API TlsfAllocator {
+public:
+    inline static constexpr uint32_t NO_SPACE = 0xffffffff;
+
+    struct Allocation {
+        uint64_t offset;
+        uint32_t node;
+    };
+
+    explicit TlsfAllocator(uint64_t size);
+
+    // `node` is NO_SPACE when no free range is large enough
+    Allocation allocate(uint64_t size);
+
+    void free(uint32_t node);
+
+    inline uint64_t size() const { return m_size; }
+    inline uint64_t freeBytes() const { return m_free_bytes; }
+    inline uint32_t allocationCount() const { return m_allocation_count; }
+    inline uint64_t nodeSize(uint32_t node) const { return m_nodes[node].size; }
+
+    uint64_t largestFree() const;
+
+private:
+    inline static constexpr uint32_t SL_BITS = 5;
+    inline static constexpr uint32_t SL_COUNT = 1 << SL_BITS;
+    inline static constexpr uint32_t FL_COUNT = 64 - SL_BITS + 1;
+
+    struct Node {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t prev_phys { NO_SPACE };
+        uint32_t next_phys { NO_SPACE };
+        uint32_t prev_free { NO_SPACE };
+        uint32_t next_free { NO_SPACE };
+        bool used { false };
+    };
+
+    static void mapping(uint64_t size, uint32_t& fl, uint32_t& sl);
+
+    uint32_t newNode(uint64_t offset, uint64_t size);
+    void insertFree(uint32_t node);
+    void removeFree(uint32_t node);
+    uint32_t findFree(uint64_t size) const;
+
+private:
+    uint64_t m_size;
+    uint64_t m_free_bytes;
+    uint32_t m_allocation_count { 0 };
+    uint64_t m_fl_bitmap { 0 };
+    uint32_t m_sl_bitmap[FL_COUNT] {};
+    uint32_t m_heads[FL_COUNT][SL_COUNT];
+    std::vector<Node> m_nodes {};
+    std::vector<uint32_t> m_unused_nodes {};
+};
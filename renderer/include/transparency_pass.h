@@ -0,0 +1,77 @@
+/*
+    transparency_pass.h
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include "gpu_memory.h"
+#include "gpu_object_cache.h"
+#include "webgpu/webgpu.hpp"
+#include <cstdint>
+#include <functional>
+
+using TransparentDraw = std::function<void(wgpu::RenderPassEncoder pass)>;
+
+// Weighted blended order-independent transparency (McGuire and Bavoil 2013).
+// Transparent geometry is drawn in any order into two targets: the weighted
+// premultiplied color and coverage are summed in one, the product of
+// (1 - alpha) is multiplied down in the other. One fullscreen pass then
+// divides the sums and blends the average over the opaque color. Nothing is
+// sorted, at the price of an approximation that only weighs by depth.
+class RENDERER_LIB_API TransparencyPass {
+public:
+    inline static constexpr wgpu::TextureFormat ACCUM_FORMAT = wgpu::TextureFormat::RGBA16Float;
+    inline static constexpr wgpu::TextureFormat REVEALAGE_FORMAT = wgpu::TextureFormat::R16Float;
+    inline static constexpr uint32_t TARGET_COUNT = 2;
+
+    // `color_format` is the format of the targets composite() blends into.
+    TransparencyPass(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache,
+        const char *wgsl_source, wgpu::TextureFormat color_format);
+    TransparencyPass(const TransparencyPass&) = delete;
+    TransparencyPass& operator=(const TransparencyPass&) = delete;
+    ~TransparencyPass();
+
+    // (Re)creates both targets at the color target's size, returns false
+    // when they cannot be allocated.
+    bool resize(uint32_t width, uint32_t height);
+
+    // Color targets with the blending a transparent pipeline needs, in the
+    // order its fragment outputs accumulation and revealage.
+    inline const wgpu::ColorTargetState *targets() const { return m_targets; }
+
+    // Draws through `draw` into the cleared targets, then composites onto
+    // `color_view`. Both passes cover the top-left width x height.
+    void encode(wgpu::CommandEncoder encoder, wgpu::TextureView color_view, uint32_t width, uint32_t height,
+        const TransparentDraw& draw, const wgpu::RenderPassTimestampWrites *p_timestamp_writes = nullptr);
+
+private:
+    void releaseTargets();
+
+private:
+    wgpu::Device m_device;
+    GpuMemoryTracker& m_memory;
+    GpuObjectCache& m_cache;
+    wgpu::BlendState m_blends[TARGET_COUNT] {};
+    wgpu::ColorTargetState m_targets[TARGET_COUNT] {};
+    wgpu::RenderPipeline m_composite_pipeline { nullptr };
+    wgpu::BindGroupLayout m_bind_group_layout { nullptr };
+    wgpu::Texture m_accum { nullptr };
+    wgpu::TextureView m_accum_view { nullptr };
+    wgpu::Texture m_revealage { nullptr };
+    wgpu::TextureView m_revealage_view { nullptr };
+    wgpu::BindGroup m_bind_group { nullptr };
+    uint32_t m_width { 0 };
+    uint32_t m_height { 0 };
+};
@@ -0,0 +1,229 @@
+/*
+    clustered_lighting.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "clustered_lighting.h"
+#include "clustered_lights.wgsl.h"
+#include "mat4.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using GpuFrame = wgsl::clustered_lights::Frame;
+using GpuLight = wgsl::clustered_lights::Light;
+using GpuClusterBounds = wgsl::clustered_lights::ClusterBounds;
+
+ClusteredLighting::ClusteredLighting(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache,
+    const char *wgsl_source, ClusteredLightingConfig config):
+    m_device(device), m_memory(memory), m_cache(cache), m_config(config) {
+    static_assert(WORKGROUP_SIZE == wgsl::clustered_lights::cs_build_clusters::WORKGROUP_SIZE[0]);
+    static_assert(WORKGROUP_SIZE == wgsl::clustered_lights::cs_bin_lights::WORKGROUP_SIZE[0]);
+    static_assert(sizeof(GpuLight) == 64);
+    m_config.max_lights = std::max(m_config.max_lights, 1u);
+    m_config.max_light_indices = std::max(m_config.max_light_indices, 1u);
+
+    wgpu::BufferDescriptor buffer_desc = {};
+    buffer_desc.label = "Clustered lighting frame";
+    buffer_desc.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
+    buffer_desc.size = sizeof(GpuFrame);
+    m_frame = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Uniform);
+    buffer_desc.label = "Lights";
+    buffer_desc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
+    buffer_desc.size = static_cast<uint64_t>(m_config.max_lights) * sizeof(GpuLight);
+    m_lights = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    buffer_desc.label = "Light index count";
+    buffer_desc.size = sizeof(uint32_t);
+    m_index_count = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    buffer_desc.label = "Cluster bounds";
+    buffer_desc.usage = wgpu::BufferUsage::Storage;
+    buffer_desc.size = static_cast<uint64_t>(clusterCount()) * sizeof(GpuClusterBounds);
+    m_bounds = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    buffer_desc.label = "Cluster light lists";
+    buffer_desc.size = static_cast<uint64_t>(clusterCount()) * 2 * sizeof(uint32_t);
+    m_clusters = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    buffer_desc.label = "Cluster light indices";
+    buffer_desc.size = static_cast<uint64_t>(m_config.max_light_indices) * sizeof(uint32_t);
+    m_light_indices = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    if (!m_frame || !m_lights || !m_index_count || !m_bounds || !m_clusters || !m_light_indices) return;
+
+    wgpu::ShaderModuleWGSLDescriptor shader_code_desc = {};
+    shader_code_desc.chain.next = nullptr;
+    shader_code_desc.chain.sType = wgpu::SType::ShaderModuleWGSLDescriptor;
+    shader_code_desc.code = wgsl_source;
+    wgpu::ShaderModuleDescriptor shader_module_desc = {};
+    shader_module_desc.nextInChain = &shader_code_desc.chain;
+    shader_module_desc.label = "Clustered lights shader";
+#ifdef WEBGPU_BACKEND_WGPU
+    shader_module_desc.hintCount = 0;
+    shader_module_desc.hints = nullptr;
+#endif
+    wgpu::ShaderModule shader_module = m_device.createShaderModule(shader_module_desc);
+
+    wgpu::BindGroupLayoutDescriptor bind_group_layout_desc = {};
+    bind_group_layout_desc.label = "Clustered lights bind group layout";
+    bind_group_layout_desc.entryCount = wgsl::clustered_lights::group0::ENTRY_COUNT;
+    bind_group_layout_desc.entries = wgsl::clustered_lights::group0::ENTRIES;
+    m_bind_group_layout = m_cache.acquire(bind_group_layout_desc);
+
+    WGPUBindGroupLayout bind_group_layouts[1] = { m_bind_group_layout };
+    wgpu::PipelineLayoutDescriptor pipeline_layout_desc = {};
+    pipeline_layout_desc.label = "Clustered lights pipeline layout";
+    pipeline_layout_desc.bindGroupLayoutCount = 1;
+    pipeline_layout_desc.bindGroupLayouts = bind_group_layouts;
+    wgpu::PipelineLayout pipeline_layout = m_cache.acquire(pipeline_layout_desc);
+
+    // both passes share the layout and the bind group
+    wgpu::ComputePipelineDescriptor pipeline_desc = {};
+    pipeline_desc.label = "Cluster bounds pipeline";
+    pipeline_desc.layout = pipeline_layout;
+    pipeline_desc.compute.module = shader_module;
+    pipeline_desc.compute.entryPoint = wgsl::clustered_lights::cs_build_clusters::ENTRY_POINT;
+    pipeline_desc.compute.constantCount = 0;
+    pipeline_desc.compute.constants = nullptr;
+    m_build_pipeline = m_device.createComputePipeline(pipeline_desc);
+    pipeline_desc.label = "Light binning pipeline";
+    pipeline_desc.compute.entryPoint = wgsl::clustered_lights::cs_bin_lights::ENTRY_POINT;
+    m_bin_pipeline = m_device.createComputePipeline(pipeline_desc);
+
+    m_cache.release(pipeline_layout);
+    shader_module.release();
+
+    wgpu::BindGroupEntry bindings[6] = {{}, {}, {}, {}, {}, {}};
+    const wgpu::Buffer buffers[6] = { m_frame, m_lights, m_bounds, m_clusters, m_light_indices, m_index_count };
+    const uint32_t slots[6] = {
+        wgsl::clustered_lights::group0::FRAME, wgsl::clustered_lights::group0::LIGHTS,
+        wgsl::clustered_lights::group0::BOUNDS, wgsl::clustered_lights::group0::CLUSTERS,
+        wgsl::clustered_lights::group0::LIGHT_INDICES, wgsl::clustered_lights::group0::INDEX_COUNT,
+    };
+    for (uint32_t i = 0; i < 6; i++) {
+        bindings[i].binding = slots[i];
+        bindings[i].buffer = buffers[i];
+        bindings[i].offset = 0;
+        bindings[i].size = buffers[i].getSize();
+    }
+
+    wgpu::BindGroupDescriptor bind_group_desc = {};
+    bind_group_desc.label = "Clustered lights bind group";
+    bind_group_desc.layout = m_bind_group_layout;
+    bind_group_desc.entryCount = 6;
+    bind_group_desc.entries = bindings;
+    m_bind_group = m_cache.acquire(bind_group_desc);
+
+    m_light_data.reserve(static_cast<size_t>(m_config.max_lights) * sizeof(GpuLight));
+}
+
+ClusteredLighting::~ClusteredLighting() {
+    if (m_bind_group) m_cache.release(m_bind_group);
+    if (m_build_pipeline) m_build_pipeline.release();
+    if (m_bin_pipeline) m_bin_pipeline.release();
+    if (m_bind_group_layout) m_cache.release(m_bind_group_layout);
+    for (wgpu::Buffer *p_buffer : { &m_frame, &m_lights, &m_bounds, &m_clusters, &m_light_indices, &m_index_count }) {
+        if (*p_buffer) m_memory.release(*p_buffer);
+    }
+}
+
+void ClusteredLighting::setView(const ClusterView& view) {
+    if (!m_has_view
+        || std::memcmp(view.projection, m_view.projection, sizeof(view.projection)) != 0
+        || view.width != m_view.width || view.height != m_view.height
+        || view.near_plane != m_view.near_plane || view.far_plane != m_view.far_plane) {
+        m_bounds_dirty = true;
+    }
+    m_view = view;
+    m_has_view = true;
+}
+
+void ClusteredLighting::dispatch(wgpu::Queue queue, wgpu::CommandEncoder encoder, std::span<const Light> lights,
+    std::span<const uint32_t> shadow_views) {
+    TRACE_ZONE("ClusteredLighting::dispatch");
+    m_stats.rebuilt = false;
+    if (!ready() || !m_has_view || m_view.width == 0 || m_view.height == 0) return;
+
+    const uint32_t light_count = static_cast<uint32_t>(std::min<size_t>(lights.size(), m_config.max_lights));
+    m_light_data.resize(static_cast<size_t>(light_count) * sizeof(GpuLight));
+    GpuLight *p_gpu_lights = reinterpret_cast<GpuLight*>(m_light_data.data());
+    for (uint32_t i = 0; i < light_count; i++) {
+        const Light& light = lights[i];
+        GpuLight gpu = {};
+        std::copy_n(light.position, 3, gpu.position);
+        gpu.range = std::max(light.range, 1e-3f);
+        std::copy_n(light.color, 3, gpu.color);
+        gpu.intensity = light.intensity;
+        float length = std::sqrt(light.direction[0] * light.direction[0] + light.direction[1] * light.direction[1]
+            + light.direction[2] * light.direction[2]);
+        for (int k = 0; k < 3; k++) gpu.direction[k] = length > 0.0f ? light.direction[k] / length : 0.0f;
+        gpu.kind = static_cast<uint32_t>(light.type);
+        // the cone falloff as one multiply-add in the shader
+        float cone_scale = 1.0f / std::max(light.inner_cone_cos - light.outer_cone_cos, 1e-3f);
+        gpu.cone[0] = cone_scale;
+        gpu.cone[1] = -light.outer_cone_cos * cone_scale;
+        gpu.shadow = i < shadow_views.size() ? shadow_views[i] : NO_SHADOW;
+        p_gpu_lights[i] = gpu;
+    }
+    if (light_count > 0) {
+        queue.writeBuffer(m_lights, 0, m_light_data.data(), m_light_data.size());
+    }
+
+    const float near_plane = std::max(m_view.near_plane, 1e-4f);
+    const float far_plane = std::max(m_view.far_plane, near_plane * 1.001f);
+    const float log_depth_range = std::log(far_plane / near_plane);
+    GpuFrame frame = {};
+    std::memcpy(frame.view, m_view.view, sizeof(frame.view));
+    std::memcpy(frame.projection, m_view.projection, sizeof(frame.projection));
+    mat4Multiply(m_view.projection, m_view.view, &frame.view_proj[0][0]);
+    mat4Invert(m_view.projection, &frame.inv_projection[0][0]);
+    frame.grid[0] = m_config.grid_x;
+    frame.grid[1] = m_config.grid_y;
+    frame.grid[2] = m_config.grid_z;
+    frame.grid[3] = light_count;
+    frame.screen[0] = static_cast<float>(m_view.width);
+    frame.screen[1] = static_cast<float>(m_view.height);
+    frame.screen[2] = static_cast<float>((m_view.width + m_config.grid_x - 1) / m_config.grid_x);
+    frame.screen[3] = static_cast<float>((m_view.height + m_config.grid_y - 1) / m_config.grid_y);
+    frame.depth[0] = near_plane;
+    frame.depth[1] = far_plane;
+    frame.depth[2] = static_cast<float>(m_config.grid_z) / log_depth_range;
+    frame.depth[3] = -static_cast<float>(m_config.grid_z) * std::log(near_plane) / log_depth_range;
+    frame.limits[0] = m_config.max_light_indices;
+    queue.writeBuffer(m_frame, 0, &frame, sizeof(frame));
+
+    const uint32_t zero = 0;
+    queue.writeBuffer(m_index_count, 0, &zero, sizeof(zero));
+
+    const uint32_t groups = (clusterCount() + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+    wgpu::ComputePassDescriptor pass_desc = {};
+    pass_desc.label = "Light binning pass";
+    pass_desc.timestampWrites = nullptr;
+    wgpu::ComputePassEncoder pass = encoder.beginComputePass(pass_desc);
+    pass.setBindGroup(0, m_bind_group, 0, nullptr);
+    if (m_bounds_dirty) {
+        pass.setPipeline(m_build_pipeline);
+        pass.dispatchWorkgroups(groups, 1, 1);
+        m_bounds_dirty = false;
+        m_stats.rebuilt = true;
+    }
+    pass.setPipeline(m_bin_pipeline);
+    pass.dispatchWorkgroups(groups, 1, 1);
+    pass.end();
+    pass.release();
+
+    m_stats.lights = light_count;
+    m_stats.clusters = clusterCount();
+    TRACE_COUNTER("lights", light_count);
+}
+
+ClusteredLightingStats ClusteredLighting::stats() const {
+    return m_stats;
+}
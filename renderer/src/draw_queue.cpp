@@ -0,0 +1,209 @@
+/*
+    draw_queue.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "draw_queue.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <numeric>
+
+inline static constexpr uint32_t RADIX_BITS = 8;
+inline static constexpr uint32_t RADIX_PASSES = 64 / RADIX_BITS;
+inline static constexpr uint32_t RADIX_BUCKETS = 1 << RADIX_BITS;
+// below this insertion sort beats building histograms
+inline static constexpr uint32_t SMALL_SORT = 64;
+
+DrawQueue::DrawQueue(uint32_t capacity):
+    m_capacity(std::max(capacity, 1u)),
+    m_keys(std::make_unique_for_overwrite<uint64_t[]>(m_capacity)),
+    m_commands(std::make_unique_for_overwrite<DrawCommand[]>(m_capacity)) {}
+
+Result<uint32_t, void> DrawQueue::registerPipeline(wgpu::RenderPipeline pipeline) {
+    if (m_pipelines.size() >= (1u << DrawKey::PIPELINE_BITS)) return Err{};
+    m_pipelines.push_back(pipeline);
+    return Ok { static_cast<uint32_t>(m_pipelines.size() - 1) };
+}
+
+Result<uint32_t, void> DrawQueue::registerBindGroup(DrawBindGroup bind_group) {
+    if (m_bind_groups.size() >= (1u << DrawKey::BIND_GROUP_BITS)) return Err{};
+    m_bind_groups.push_back(bind_group);
+    return Ok { static_cast<uint32_t>(m_bind_groups.size() - 1) };
+}
+
+bool DrawQueue::replaceBindGroup(uint32_t id, DrawBindGroup bind_group) {
+    if (id == NO_BIND_GROUP || id >= m_bind_groups.size()) return false;
+    m_bind_groups[id] = bind_group;
+    return true;
+}
+
+Result<uint32_t, void> DrawQueue::registerMesh(DrawMesh mesh) {
+    if (m_meshes.size() >= (1u << DrawKey::MESH_BITS)) return Err{};
+    m_meshes.push_back(mesh);
+    return Ok { static_cast<uint32_t>(m_meshes.size() - 1) };
+}
+
+bool DrawQueue::replaceMesh(uint32_t id, DrawMesh mesh) {
+    if (id >= m_meshes.size()) return false;
+    m_meshes[id] = mesh;
+    return true;
+}
+
+void DrawQueue::begin() {
+    uint32_t pushed = m_count.load(std::memory_order_relaxed);
+    if (pushed > m_capacity) {
+        // only overflowing frames pay for growing, and only once
+        m_capacity = std::bit_ceil(pushed);
+        m_keys = std::make_unique_for_overwrite<uint64_t[]>(m_capacity);
+        m_commands = std::make_unique_for_overwrite<DrawCommand[]>(m_capacity);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sorted_count = 0;
+    m_stats = {};
+}
+
+bool DrawQueue::push(uint64_t key, const DrawCommand& command) {
+    // the counter keeps running past capacity so begin() knows how much to grow
+    uint32_t index = m_count.fetch_add(1, std::memory_order_relaxed);
+    if (index >= m_capacity) return false;
+    m_keys[index] = key;
+    m_commands[index] = command;
+    return true;
+}
+
+void DrawQueue::sort() {
+    uint32_t pushed = m_count.load(std::memory_order_acquire);
+    uint32_t count = std::min(pushed, m_capacity);
+    m_stats.draws = count;
+    m_stats.dropped = pushed - count;
+    m_sorted_count = count;
+
+    m_sorted_keys.resize(count);
+    m_sorted_indices.resize(count);
+    std::copy_n(m_keys.get(), count, m_sorted_keys.begin());
+    std::iota(m_sorted_indices.begin(), m_sorted_indices.end(), 0u);
+
+    if (count < SMALL_SORT) {
+        for (uint32_t i = 1; i < count; i++) {
+            uint64_t key = m_sorted_keys[i];
+            uint32_t index = m_sorted_indices[i];
+            uint32_t j = i;
+            for (; j > 0 && m_sorted_keys[j - 1] > key; j--) {
+                m_sorted_keys[j] = m_sorted_keys[j - 1];
+                m_sorted_indices[j] = m_sorted_indices[j - 1];
+            }
+            m_sorted_keys[j] = key;
+            m_sorted_indices[j] = index;
+        }
+        return;
+    }
+
+    // LSD radix sort; all histograms come from a single read of the keys
+    std::array<std::array<uint32_t, RADIX_BUCKETS>, RADIX_PASSES> histograms {};
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t key = m_sorted_keys[i];
+        for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+            histograms[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+        }
+    }
+
+    m_scratch_keys.resize(count);
+    m_scratch_indices.resize(count);
+    for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+        auto& histogram = histograms[pass];
+        uint32_t shift = pass * RADIX_BITS;
+        // a byte every key shares does not reorder anything; unused key
+        // fields make this the common case
+        if (histogram[(m_sorted_keys[0] >> shift) & (RADIX_BUCKETS - 1)] == count) continue;
+
+        uint32_t offset = 0;
+        for (auto& bucket : histogram) {
+            uint32_t bucket_count = bucket;
+            bucket = offset;
+            offset += bucket_count;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t key = m_sorted_keys[i];
+            uint32_t dst = histogram[(key >> shift) & (RADIX_BUCKETS - 1)]++;
+            m_scratch_keys[dst] = key;
+            m_scratch_indices[dst] = m_sorted_indices[i];
+        }
+        m_sorted_keys.swap(m_scratch_keys);
+        m_sorted_indices.swap(m_scratch_indices);
+    }
+}
+
+void DrawQueue::encode(wgpu::RenderPassEncoder encoder, const GpuHeap& heap, uint32_t pass) {
+    uint64_t pass_begin = DrawKey::field(pass, DrawKey::PASS_BITS, DrawKey::PASS_SHIFT);
+    auto keys_end = m_sorted_keys.begin() + m_sorted_count;
+    auto first = std::lower_bound(m_sorted_keys.begin(), keys_end, pass_begin);
+
+    constexpr uint32_t NONE = 0xffffffff;
+    uint32_t current_pipeline = NONE;
+    uint32_t current_mesh = NONE;
+    // bound bind group id per group index, WebGPU guarantees four groups
+    std::array<uint32_t, 4> current_bind_groups { NONE, NONE, NONE, NONE };
+    WGPUBuffer current_vertex_buffer = nullptr;
+    uint64_t current_vertex_offset = 0;
+    WGPUBuffer current_index_buffer = nullptr;
+    uint64_t current_index_offset = 0;
+
+    for (auto it = first; it != keys_end && DrawKey::pass(*it) == pass; ++it) {
+        uint64_t key = *it;
+        const DrawCommand& command = m_commands[m_sorted_indices[it - m_sorted_keys.begin()]];
+
+        uint32_t pipeline = DrawKey::pipeline(key);
+        if (pipeline != current_pipeline) {
+            if (pipeline >= m_pipelines.size()) continue;
+            encoder.setPipeline(m_pipelines[pipeline]);
+            current_pipeline = pipeline;
+            m_stats.pipeline_binds++;
+        }
+
+        uint32_t bind_group = DrawKey::bindGroup(key);
+        if (bind_group != NO_BIND_GROUP && bind_group < m_bind_groups.size()) {
+            const DrawBindGroup& group = m_bind_groups[bind_group];
+            if (group.group_index < current_bind_groups.size() && current_bind_groups[group.group_index] != bind_group) {
+                encoder.setBindGroup(group.group_index, group.bind_group, 0, nullptr);
+                current_bind_groups[group.group_index] = bind_group;
+                m_stats.bind_group_binds++;
+            }
+        }
+
+        uint32_t mesh = DrawKey::mesh(key);
+        if (mesh != current_mesh) {
+            if (mesh >= m_meshes.size()) continue;
+            const DrawMesh& draw_mesh = m_meshes[mesh];
+            GpuRange vertices = draw_mesh.vertices.valid() ? heap.resolve(draw_mesh.vertices) : draw_mesh.vertex_range;
+            GpuRange indices = heap.resolve(draw_mesh.indices);
+            // distinct meshes may still share a binding
+            if (static_cast<WGPUBuffer>(vertices.buffer) != current_vertex_buffer || vertices.offset != current_vertex_offset) {
+                encoder.setVertexBuffer(0, vertices.buffer, vertices.offset, vertices.size);
+                current_vertex_buffer = vertices.buffer;
+                current_vertex_offset = vertices.offset;
+                m_stats.vertex_buffer_binds++;
+            }
+            if (static_cast<WGPUBuffer>(indices.buffer) != current_index_buffer || indices.offset != current_index_offset) {
+                encoder.setIndexBuffer(indices.buffer, draw_mesh.index_format, indices.offset, indices.size);
+                current_index_buffer = indices.buffer;
+                current_index_offset = indices.offset;
+                m_stats.index_buffer_binds++;
+            }
+            current_mesh = mesh;
+        }
+
+        encoder.drawIndexed(command.index_count, command.instance_count, command.first_index, command.base_vertex, command.first_instance);
+        m_stats.triangles += static_cast<uint64_t>(command.index_count / 3) * command.instance_count;
+    }
+}
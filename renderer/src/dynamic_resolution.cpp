@@ -0,0 +1,273 @@
+/*
+    dynamic_resolution.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "dynamic_resolution.h"
+#include "upscale.wgsl.h"
+#include <algorithm>
+#include <cmath>
+
+// largest relative change of the scale per adjustment; shrinking reacts
+// faster than growing so a spike is absorbed within a few frames
+inline static constexpr float MAX_SHRINK = 0.85f;
+inline static constexpr float MAX_GROW = 1.1f;
+inline static constexpr float SCALE_QUANTUM = 64.0f;
+
+DynamicResolution::DynamicResolution(DynamicResolutionConfig config):
+    m_config(config), m_scale(config.max_scale) {
+    m_config.min_scale = std::clamp(m_config.min_scale, 0.05f, 1.0f);
+    m_config.max_scale = std::clamp(m_config.max_scale, m_config.min_scale, 2.0f);
+    m_scale = m_config.max_scale;
+}
+
+bool DynamicResolution::update(double gpu_ms) {
+    if (m_samples == 0) {
+        m_smoothed_ms = gpu_ms;
+    } else {
+        m_smoothed_ms += m_config.smoothing * (gpu_ms - m_smoothed_ms);
+    }
+    m_samples++;
+
+    if (m_settle > 0) {
+        m_settle--;
+        return false;
+    }
+    if (m_samples < m_config.settle_frames || m_smoothed_ms <= 0.0) return false;
+
+    double target = m_config.target_gpu_ms;
+    double aim;
+    if (m_smoothed_ms > target) {
+        aim = target;
+    } else if (m_smoothed_ms < target * (1.0 - m_config.headroom)) {
+        // aim for the middle of the dead band so growing does not overshoot
+        aim = target * (1.0 - 0.5 * m_config.headroom);
+    } else {
+        return false;
+    }
+
+    float desired = m_scale * static_cast<float>(std::sqrt(aim / m_smoothed_ms));
+    desired = std::clamp(desired, m_scale * MAX_SHRINK, m_scale * MAX_GROW);
+    desired = std::round(desired * SCALE_QUANTUM) / SCALE_QUANTUM;
+    desired = std::clamp(desired, m_config.min_scale, m_config.max_scale);
+    if (desired == m_scale) return false;
+
+    // predict the new cost instead of waiting for the average to catch up
+    float ratio = desired / m_scale;
+    m_smoothed_ms *= ratio * ratio;
+    m_scale = desired;
+    m_settle = m_config.settle_frames;
+    return true;
+}
+
+uint32_t DynamicResolution::scaled(uint32_t full) const {
+    return std::max(1u, static_cast<uint32_t>(std::lround(full * m_scale)));
+}
+
+uint32_t DynamicResolution::maxScaled(uint32_t full) const {
+    return std::max(1u, static_cast<uint32_t>(std::lround(full * m_config.max_scale)));
+}
+
+using UpscaleParams = wgsl::upscale::Params;
+
+UpscalePass::UpscalePass(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache,
+    const char *wgsl_source, wgpu::TextureFormat format):
+    m_device(device), m_memory(memory), m_cache(cache), m_format(format) {
+    wgpu::ShaderModuleWGSLDescriptor shader_code_desc = {};
+    shader_code_desc.chain.next = nullptr;
+    shader_code_desc.chain.sType = wgpu::SType::ShaderModuleWGSLDescriptor;
+    shader_code_desc.code = wgsl_source;
+    wgpu::ShaderModuleDescriptor shader_module_desc = {};
+    shader_module_desc.nextInChain = &shader_code_desc.chain;
+    shader_module_desc.label = "Upscale shader";
+#ifdef WEBGPU_BACKEND_WGPU
+    shader_module_desc.hintCount = 0;
+    shader_module_desc.hints = nullptr;
+#endif
+    wgpu::ShaderModule shader_module = m_device.createShaderModule(shader_module_desc);
+
+    wgpu::BindGroupLayoutDescriptor bind_group_layout_desc = {};
+    bind_group_layout_desc.label = "Upscale bind group layout";
+    bind_group_layout_desc.entryCount = wgsl::upscale::group0::ENTRY_COUNT;
+    bind_group_layout_desc.entries = wgsl::upscale::group0::ENTRIES;
+    m_bind_group_layout = m_cache.acquire(bind_group_layout_desc);
+
+    WGPUBindGroupLayout bind_group_layouts[1] = { m_bind_group_layout };
+    wgpu::PipelineLayoutDescriptor pipeline_layout_desc = {};
+    pipeline_layout_desc.label = "Upscale pipeline layout";
+    pipeline_layout_desc.bindGroupLayoutCount = 1;
+    pipeline_layout_desc.bindGroupLayouts = bind_group_layouts;
+    wgpu::PipelineLayout pipeline_layout = m_cache.acquire(pipeline_layout_desc);
+
+    wgpu::RenderPipelineDescriptor pipeline_desc = {};
+    pipeline_desc.label = "Upscale pipeline";
+    pipeline_desc.layout = pipeline_layout;
+    pipeline_desc.vertex.module = shader_module;
+    pipeline_desc.vertex.entryPoint = wgsl::upscale::vs_main::ENTRY_POINT;
+    pipeline_desc.vertex.bufferCount = 0;
+    pipeline_desc.vertex.buffers = nullptr;
+    pipeline_desc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+    pipeline_desc.primitive.stripIndexFormat = wgpu::IndexFormat::Undefined;
+    pipeline_desc.primitive.frontFace = wgpu::FrontFace::CCW;
+    pipeline_desc.primitive.cullMode = wgpu::CullMode::None;
+
+    wgpu::ColorTargetState color_target_state = {};
+    color_target_state.format = m_format;
+    color_target_state.blend = nullptr;
+    color_target_state.writeMask = wgpu::ColorWriteMask::All;
+
+    wgpu::FragmentState frag_state = {};
+    frag_state.module = shader_module;
+    frag_state.entryPoint = wgsl::upscale::fs_main::ENTRY_POINT;
+    frag_state.targetCount = 1;
+    frag_state.targets = &color_target_state;
+    pipeline_desc.fragment = &frag_state;
+    pipeline_desc.depthStencil = nullptr;
+    pipeline_desc.multisample.count = 1;
+    pipeline_desc.multisample.mask = ~0u;
+    pipeline_desc.multisample.alphaToCoverageEnabled = false;
+    m_pipeline = m_device.createRenderPipeline(pipeline_desc);
+
+    m_cache.release(pipeline_layout);
+    shader_module.release();
+
+    wgpu::SamplerDescriptor sampler_desc = {};
+    sampler_desc.label = "Upscale sampler";
+    sampler_desc.addressModeU = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.addressModeV = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.addressModeW = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.magFilter = wgpu::FilterMode::Linear;
+    sampler_desc.minFilter = wgpu::FilterMode::Linear;
+    sampler_desc.mipmapFilter = wgpu::MipmapFilterMode::Nearest;
+    sampler_desc.lodMinClamp = 0.0f;
+    sampler_desc.lodMaxClamp = 1.0f;
+    sampler_desc.compare = wgpu::CompareFunction::Undefined;
+    sampler_desc.maxAnisotropy = 1;
+    m_sampler = m_cache.acquire(sampler_desc);
+
+    wgpu::BufferDescriptor params_desc = {};
+    params_desc.label = "Upscale params";
+    params_desc.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
+    params_desc.size = sizeof(UpscaleParams);
+    m_params = m_memory.createBuffer(params_desc, GpuMemoryCategory::Uniform);
+}
+
+UpscalePass::~UpscalePass() {
+    releaseTarget();
+    if (m_params) m_memory.release(m_params);
+    m_cache.release(m_sampler);
+    m_pipeline.release();
+    m_cache.release(m_bind_group_layout);
+}
+
+bool UpscalePass::resize(uint32_t width, uint32_t height) {
+    releaseTarget();
+    if (!m_params) return false;
+
+    wgpu::TextureDescriptor target_desc = {};
+    target_desc.label = "Scaled render target";
+    target_desc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding;
+    target_desc.dimension = wgpu::TextureDimension::_2D;
+    target_desc.size = { std::max(width, 1u), std::max(height, 1u), 1 };
+    target_desc.format = m_format;
+    target_desc.mipLevelCount = 1;
+    target_desc.sampleCount = 1;
+    target_desc.viewFormatCount = 0;
+    target_desc.viewFormats = nullptr;
+    m_target = m_memory.createTexture(target_desc, GpuMemoryCategory::RenderTarget);
+    if (!m_target) return false;
+    m_width = target_desc.size.width;
+    m_height = target_desc.size.height;
+
+    wgpu::TextureViewDescriptor view_desc = {};
+    view_desc.label = "Scaled render target view";
+    view_desc.format = m_format;
+    view_desc.dimension = wgpu::TextureViewDimension::_2D;
+    view_desc.baseMipLevel = 0;
+    view_desc.mipLevelCount = 1;
+    view_desc.baseArrayLayer = 0;
+    view_desc.arrayLayerCount = 1;
+    view_desc.aspect = wgpu::TextureAspect::All;
+    m_target_view = m_target.createView(view_desc);
+
+    wgpu::BindGroupEntry entries[3] = {{}, {}, {}};
+    entries[0].binding = wgsl::upscale::group0::SOURCE;
+    entries[0].textureView = m_target_view;
+    entries[1].binding = wgsl::upscale::group0::SOURCE_SAMPLER;
+    entries[1].sampler = m_sampler;
+    entries[2].binding = wgsl::upscale::group0::PARAMS;
+    entries[2].buffer = m_params;
+    entries[2].offset = 0;
+    entries[2].size = sizeof(UpscaleParams);
+
+    wgpu::BindGroupDescriptor bind_group_desc = {};
+    bind_group_desc.label = "Upscale bind group";
+    bind_group_desc.layout = m_bind_group_layout;
+    bind_group_desc.entryCount = 3;
+    bind_group_desc.entries = entries;
+    m_bind_group = m_cache.acquire(bind_group_desc);
+    return true;
+}
+
+void UpscalePass::setRenderExtent(wgpu::Queue queue, uint32_t width, uint32_t height) {
+    m_render_width = std::clamp(width, 1u, std::max(m_width, 1u));
+    m_render_height = std::clamp(height, 1u, std::max(m_height, 1u));
+    if (!m_params || m_width == 0 || m_height == 0) return;
+
+    UpscaleParams params;
+    params.uv_scale[0] = static_cast<float>(m_render_width) / m_width;
+    params.uv_scale[1] = static_cast<float>(m_render_height) / m_height;
+    // keep bilinear taps inside the rendered corner, the rest is stale
+    params.uv_max[0] = (m_render_width - 0.5f) / m_width;
+    params.uv_max[1] = (m_render_height - 0.5f) / m_height;
+    queue.writeBuffer(m_params, 0, &params, sizeof(params));
+}
+
+void UpscalePass::encode(wgpu::CommandEncoder encoder, wgpu::TextureView surface_view,
+    const wgpu::RenderPassTimestampWrites *p_timestamp_writes) {
+    wgpu::RenderPassColorAttachment color_attachment = {};
+    color_attachment.nextInChain = nullptr;
+    color_attachment.view = surface_view;
+    color_attachment.resolveTarget = nullptr;
+    // every pixel is overwritten
+    color_attachment.loadOp = wgpu::LoadOp::Clear;
+    color_attachment.storeOp = wgpu::StoreOp::Store;
+    color_attachment.clearValue = wgpu::Color{ 0.0, 0.0, 0.0, 1.0 };
+#ifndef WEBGPU_BACKEND_WGPU
+    color_attachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
+#endif // NOT WEBGPU_BACKEND_WGPU
+
+    wgpu::RenderPassDescriptor pass_desc = {};
+    pass_desc.label = "Upscale pass";
+    pass_desc.colorAttachmentCount = 1;
+    pass_desc.colorAttachments = &color_attachment;
+    pass_desc.depthStencilAttachment = nullptr;
+    pass_desc.timestampWrites = p_timestamp_writes;
+
+    wgpu::RenderPassEncoder pass = encoder.beginRenderPass(pass_desc);
+    pass.setPipeline(m_pipeline);
+    pass.setBindGroup(0, m_bind_group, 0, nullptr);
+    pass.draw(3, 1, 0, 0);
+    pass.end();
+    pass.release();
+}
+
+void UpscalePass::releaseTarget() {
+    if (m_bind_group) m_cache.release(m_bind_group);
+    if (m_target_view) {
+        m_target_view.release();
+        m_target_view = nullptr;
+    }
+    if (m_target) m_memory.release(m_target);
+    m_width = m_height = 0;
+}
@@ -0,0 +1,262 @@
+/*
+    frame_capture.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "frame_capture.h"
+#include "image_writer.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// copyTextureToBuffer rows must be 256 byte aligned
+inline static constexpr uint32_t ROW_ALIGNMENT = 256;
+
+struct FrameCapture::MapPayload {
+    std::shared_ptr<State> state;
+    uint32_t slot;
+};
+
+FrameCapture::FrameCapture(GpuMemoryTracker& memory, ThreadPool& pool):
+    m_memory(memory), m_pool(pool), m_state(std::make_shared<State>()) {}
+
+FrameCapture::~FrameCapture() {
+    {
+        std::unique_lock lock(m_state->mutex);
+        m_state->cv.wait(lock, [&]() { return m_state->workers == 0; });
+    }
+    // pending maps are aborted by the release and their callbacks only touch m_state
+    for (Slot& slot : m_slots) {
+        if (slot.buffer) m_memory.release(slot.buffer);
+    }
+}
+
+void FrameCapture::requestCapture(std::string path, CaptureFormat format) {
+    m_requests.emplace_back(std::move(path), format);
+    m_requested++;
+}
+
+void FrameCapture::startSequence(std::string prefix, CaptureFormat format, uint32_t interval) {
+    m_sequence_active = true;
+    m_sequence_prefix = std::move(prefix);
+    m_sequence_format = format;
+    m_sequence_interval = std::max(interval, 1u);
+}
+
+void FrameCapture::stopSequence() {
+    m_sequence_active = false;
+}
+
+bool FrameCapture::isCapturable(wgpu::TextureFormat format, bool& bgra) {
+    switch (format) {
+        case wgpu::TextureFormat::RGBA8Unorm:
+        case wgpu::TextureFormat::RGBA8UnormSrgb:
+            bgra = false;
+            return true;
+        case wgpu::TextureFormat::BGRA8Unorm:
+        case wgpu::TextureFormat::BGRA8UnormSrgb:
+            bgra = true;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void FrameCapture::encode(wgpu::CommandEncoder encoder, wgpu::Texture texture) {
+    uint64_t frame = m_frame++;
+    bool from_request = !m_requests.empty();
+    std::string path;
+    CaptureFormat format;
+    if (from_request) {
+        path = m_requests.front().first;
+        format = m_requests.front().second;
+    } else if (m_sequence_active && frame % m_sequence_interval == 0) {
+        format = m_sequence_format;
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), "_%06llu.%s", static_cast<unsigned long long>(frame),
+            format == CaptureFormat::Png ? "png" : "rgba");
+        path = m_sequence_prefix + suffix;
+        m_requested++;
+    } else {
+        return;
+    }
+
+    bool bgra = false;
+    if (!isCapturable(texture.getFormat(), bgra)) {
+        if (from_request) m_requests.erase(m_requests.begin());
+        m_dropped++;
+        return;
+    }
+
+    uint32_t index = SLOT_COUNT;
+    for (uint32_t i = 0; i < SLOT_COUNT; i++) {
+        uint32_t candidate = (m_next_slot + i) % SLOT_COUNT;
+        if (m_state->slot_state[candidate].load(std::memory_order_acquire) == FREE) {
+            index = candidate;
+            break;
+        }
+    }
+    if (index == SLOT_COUNT) {
+        // a single request waits for a slot, a sequence frame is gone
+        if (!from_request) m_dropped++;
+        return;
+    }
+    if (from_request) m_requests.erase(m_requests.begin());
+
+    Slot& slot = m_slots[index];
+    uint32_t width = texture.getWidth();
+    uint32_t height = texture.getHeight();
+    uint32_t row_pitch = (width * 4 + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT;
+    uint64_t size = static_cast<uint64_t>(row_pitch) * height;
+    if (slot.size < size) {
+        if (slot.buffer) m_memory.release(slot.buffer);
+        wgpu::BufferDescriptor readback_desc = {};
+        readback_desc.label = "Frame capture readback";
+        readback_desc.usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
+        readback_desc.size = size;
+        slot.buffer = m_memory.createBuffer(readback_desc, GpuMemoryCategory::Readback);
+        slot.size = slot.buffer ? size : 0;
+        if (!slot.buffer) {
+            m_dropped++;
+            return;
+        }
+    }
+    slot.width = width;
+    slot.height = height;
+    slot.row_pitch = row_pitch;
+    slot.bgra = bgra;
+    slot.format = format;
+    slot.path = std::move(path);
+
+    wgpu::ImageCopyTexture source = {};
+    source.texture = texture;
+    source.mipLevel = 0;
+    source.origin = { 0, 0, 0 };
+    source.aspect = wgpu::TextureAspect::All;
+    wgpu::ImageCopyBuffer destination = {};
+    destination.buffer = slot.buffer;
+    destination.layout.offset = 0;
+    destination.layout.bytesPerRow = row_pitch;
+    destination.layout.rowsPerImage = height;
+    encoder.copyTextureToBuffer(source, destination, { width, height, 1 });
+
+    m_state->slot_state[index].store(COPIED, std::memory_order_relaxed);
+    m_copied.push_back(index);
+    m_next_slot = (index + 1) % SLOT_COUNT;
+}
+
+void FrameCapture::submitted() {
+    for (uint32_t index : m_copied) {
+        Slot& slot = m_slots[index];
+        m_state->slot_state[index].store(MAPPING, std::memory_order_relaxed);
+        auto *payload = new MapPayload { m_state, index };
+        wgpuBufferMapAsync(slot.buffer, wgpu::MapMode::Read, 0, static_cast<size_t>(slot.row_pitch) * slot.height,
+            [](WGPUBufferMapAsyncStatus status, void *p_user_data) {
+                auto *payload = static_cast<MapPayload*>(p_user_data);
+                State& state = *payload->state;
+                if (status == WGPUBufferMapAsyncStatus_Success) {
+                    state.slot_state[payload->slot].store(MAPPED, std::memory_order_release);
+                } else {
+                    state.failed.fetch_add(1, std::memory_order_relaxed);
+                    state.slot_state[payload->slot].store(FREE, std::memory_order_release);
+                }
+                delete payload;
+            }, payload);
+    }
+    m_copied.clear();
+}
+
+void FrameCapture::poll() {
+    for (uint32_t index = 0; index < SLOT_COUNT; index++) {
+        Slot& slot = m_slots[index];
+        switch (m_state->slot_state[index].load(std::memory_order_acquire)) {
+            case MAPPED: {
+                const void *p_mapped = slot.buffer.getConstMappedRange(0, static_cast<size_t>(slot.row_pitch) * slot.height);
+                if (!p_mapped) {
+                    slot.buffer.unmap();
+                    m_state->failed.fetch_add(1, std::memory_order_relaxed);
+                    m_state->slot_state[index].store(FREE, std::memory_order_relaxed);
+                    break;
+                }
+                // the range stays mapped until the worker is done with it
+                m_state->slot_state[index].store(ENCODING, std::memory_order_relaxed);
+                {
+                    std::lock_guard lock(m_state->mutex);
+                    m_state->workers++;
+                }
+                m_pool.submit([state = m_state, index, job = slot, p_mapped]() mutable {
+                    encodeSlot(state, index, std::move(job), p_mapped);
+                });
+                break;
+            }
+            case ENCODED:
+                slot.buffer.unmap();
+                m_state->slot_state[index].store(FREE, std::memory_order_release);
+                break;
+            default: break;
+        }
+    }
+}
+
+void FrameCapture::encodeSlot(const std::shared_ptr<State>& state, uint32_t slot, Slot job, const void *p_mapped) {
+    TRACE_ZONE("FrameCapture::encodeSlot");
+    const auto *p_source = static_cast<const uint8_t*>(p_mapped);
+    const size_t row_bytes = static_cast<size_t>(job.width) * 4;
+    std::vector<uint8_t> rgba(row_bytes * job.height);
+    for (uint32_t y = 0; y < job.height; y++) {
+        const uint8_t *p_row = p_source + static_cast<size_t>(y) * job.row_pitch;
+        uint8_t *p_out = rgba.data() + y * row_bytes;
+        if (!job.bgra) {
+            std::memcpy(p_out, p_row, row_bytes);
+            continue;
+        }
+        for (uint32_t x = 0; x < job.width; x++) {
+            p_out[x * 4 + 0] = p_row[x * 4 + 2];
+            p_out[x * 4 + 1] = p_row[x * 4 + 1];
+            p_out[x * 4 + 2] = p_row[x * 4 + 0];
+            p_out[x * 4 + 3] = p_row[x * 4 + 3];
+        }
+    }
+    // done with the mapped memory, the main thread may unmap it now
+    state->slot_state[slot].store(ENCODED, std::memory_order_release);
+
+    bool ok;
+    if (job.format == CaptureFormat::Png) {
+        std::vector<uint8_t> png = encodePng(job.width, job.height, rgba.data(), row_bytes);
+        ok = writeFile(job.path, png.data(), png.size());
+    } else {
+        ok = writeFile(job.path, rgba.data(), rgba.size());
+    }
+    if (ok) {
+        state->written.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        std::fprintf(stderr, "Cannot write capture %s\n", job.path.c_str());
+        state->failed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    {
+        std::lock_guard lock(state->mutex);
+        state->workers--;
+    }
+    state->cv.notify_all();
+}
+
+FrameCaptureStats FrameCapture::stats() const {
+    FrameCaptureStats stats;
+    stats.requested = m_requested;
+    stats.written = m_state->written.load(std::memory_order_relaxed);
+    stats.dropped = m_dropped;
+    stats.failed = m_state->failed.load(std::memory_order_relaxed);
+    return stats;
+}
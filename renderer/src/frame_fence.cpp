@@ -0,0 +1,36 @@
+/*
+    frame_fence.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "frame_fence.h"
+
+struct FrameFence::Payload {
+    std::shared_ptr<State> state;
+    uint64_t serial;
+};
+
+FrameFence::FrameFence(): m_state(std::make_shared<State>()) {}
+
+void FrameFence::signal(wgpu::Queue queue) {
+    m_submitted++;
+    auto *payload = new Payload { m_state, m_submitted };
+    // a lost device reports a failing status, its work is as done as it will ever be
+    wgpuQueueOnSubmittedWorkDone(queue, [](WGPUQueueWorkDoneStatus /* status */, void *p_user_data) {
+        auto *payload = static_cast<Payload*>(p_user_data);
+        uint64_t current = payload->state->completed.load(std::memory_order_relaxed);
+        while (current < payload->serial &&
+            !payload->state->completed.compare_exchange_weak(current, payload->serial, std::memory_order_release)) {}
+        delete payload;
+    }, payload);
+}
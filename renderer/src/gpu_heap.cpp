@@ -0,0 +1,319 @@
+/*
+    gpu_heap.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "gpu_heap.h"
+#include "trace.hpp"
+#include <algorithm>
+
+static const char *usage_label(GpuHeapUsage usage) {
+    switch (usage) {
+        case GpuHeapUsage::Vertex: return "GPU heap vertex block";
+        case GpuHeapUsage::Index: return "GPU heap index block";
+        case GpuHeapUsage::Uniform: return "GPU heap uniform block";
+    }
+    return "GPU heap block";
+}
+
+static WGPUBufferUsageFlags usage_flags(GpuHeapUsage usage) {
+    // CopySrc lets compaction move ranges between blocks
+    switch (usage) {
+        case GpuHeapUsage::Vertex:
+            return wgpu::BufferUsage::Vertex | wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::CopySrc;
+        case GpuHeapUsage::Index:
+            return wgpu::BufferUsage::Index | wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::CopySrc;
+        case GpuHeapUsage::Uniform:
+            return wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::CopySrc;
+    }
+    return wgpu::BufferUsage::CopyDst;
+}
+
+static GpuMemoryCategory usage_category(GpuHeapUsage usage) {
+    return usage == GpuHeapUsage::Uniform ? GpuMemoryCategory::Uniform : GpuMemoryCategory::Geometry;
+}
+
+GpuHeap::GpuHeap(GpuMemoryTracker& memory, const FrameFence& fence, GpuHeapConfig config)
+    : m_memory(memory), m_fence(fence), m_config(config) {}
+
+GpuHeap::~GpuHeap() {
+    for (auto& pool : m_pools) {
+        for (auto& block : pool.blocks) {
+            m_memory.release(block.buffer);
+        }
+    }
+}
+
+uint64_t GpuHeap::granularity(GpuHeapUsage usage) {
+    // minUniformBufferOffsetAlignment defaults to 256, vertex and index
+    // offsets only need to be multiples of 4
+    return usage == GpuHeapUsage::Uniform ? 256 : 16;
+}
+
+uint32_t GpuHeap::createBlock(GpuHeapUsage usage, uint64_t size, bool dedicated) {
+    TRACE_ZONE("GpuHeap::createBlock");
+    wgpu::BufferDescriptor buffer_desc = {};
+    buffer_desc.nextInChain = nullptr;
+    buffer_desc.label = usage_label(usage);
+    buffer_desc.size = size;
+    buffer_desc.usage = usage_flags(usage);
+    buffer_desc.mappedAtCreation = false;
+    wgpu::Buffer buffer = m_memory.createBuffer(buffer_desc, usage_category(usage));
+    if (!buffer) {
+        return TlsfAllocator::NO_SPACE;
+    }
+
+    auto& blocks = m_pools[static_cast<size_t>(usage)].blocks;
+    Block block { buffer, TlsfAllocator(size), dedicated, false };
+    for (uint32_t i = 0; i < blocks.size(); i++) {
+        if (!blocks[i].buffer) {
+            blocks[i] = std::move(block);
+            return i;
+        }
+    }
+    blocks.push_back(std::move(block));
+    return static_cast<uint32_t>(blocks.size() - 1);
+}
+
+void GpuHeap::releaseBlock(GpuHeapUsage usage, uint32_t block) {
+    auto& entry = m_pools[static_cast<size_t>(usage)].blocks[block];
+    m_memory.release(entry.buffer);
+    entry = Block { nullptr, TlsfAllocator(0), false, false };
+}
+
+bool GpuHeap::allocateIn(GpuHeapUsage usage, uint64_t size, uint32_t exclude, Slot& slot) {
+    auto& blocks = m_pools[static_cast<size_t>(usage)].blocks;
+    for (uint32_t i = 0; i < blocks.size(); i++) {
+        Block& block = blocks[i];
+        if (i == exclude || !block.buffer || block.dedicated || block.evacuating) continue;
+        auto allocation = block.allocator.allocate(size);
+        if (allocation.node != TlsfAllocator::NO_SPACE) {
+            slot.block = i;
+            slot.node = allocation.node;
+            slot.offset = allocation.offset;
+            return true;
+        }
+    }
+    return false;
+}
+
+Result<GpuAllocation, void> GpuHeap::allocate(GpuHeapUsage usage, uint64_t size) {
+    if (size == 0) return Err{};
+    uint64_t align = granularity(usage);
+    uint64_t aligned_size = (size + align - 1) / align * align;
+
+    Slot slot {};
+    slot.usage = usage;
+    slot.size = size;
+    if (!allocateIn(usage, aligned_size, TlsfAllocator::NO_SPACE, slot)) {
+        uint64_t block_size = m_config.block_size[static_cast<size_t>(usage)];
+        bool dedicated = aligned_size > block_size;
+        uint32_t block = createBlock(usage, dedicated ? aligned_size : block_size, dedicated);
+        if (block == TlsfAllocator::NO_SPACE) return Err{};
+        auto allocation = m_pools[static_cast<size_t>(usage)].blocks[block].allocator.allocate(aligned_size);
+        slot.block = block;
+        slot.node = allocation.node;
+        slot.offset = allocation.offset;
+    }
+    slot.live = true;
+
+    uint32_t index;
+    if (m_free_slots.empty()) {
+        index = static_cast<uint32_t>(m_slots.size());
+        m_slots.push_back(slot);
+    } else {
+        index = m_free_slots.back();
+        m_free_slots.pop_back();
+        slot.generation = m_slots[index].generation;
+        m_slots[index] = slot;
+    }
+    return Ok { GpuAllocation { index, slot.generation } };
+}
+
+void GpuHeap::free(GpuAllocation allocation) {
+    if (!allocation.valid()) return;
+    Slot& slot = m_slots[allocation.slot];
+    if (!slot.live || slot.generation != allocation.generation) return;
+
+    auto& pool = m_pools[static_cast<size_t>(slot.usage)];
+    uint64_t node_size = pool.blocks[slot.block].allocator.nodeSize(slot.node);
+    m_pending_frees.push_back(PendingFree {
+        .serial = m_fence.pending(),
+        .size = node_size,
+        .block = slot.block,
+        .node = slot.node,
+        .usage = slot.usage
+    });
+    pool.pending_free_bytes += node_size;
+
+    slot.live = false;
+    slot.generation++;
+    m_free_slots.push_back(allocation.slot);
+}
+
+GpuRange GpuHeap::resolve(GpuAllocation allocation) const {
+    if (!allocation.valid()) return GpuRange {};
+    const Slot& slot = m_slots[allocation.slot];
+    if (!slot.live || slot.generation != allocation.generation) return GpuRange {};
+    return GpuRange {
+        .buffer = m_pools[static_cast<size_t>(slot.usage)].blocks[slot.block].buffer,
+        .offset = slot.offset,
+        .size = slot.size
+    };
+}
+
+void GpuHeap::write(wgpu::Queue queue, GpuAllocation allocation, const void *p_data, uint64_t size, uint64_t offset) {
+    GpuRange range = resolve(allocation);
+    if (!range.buffer || offset + size > range.size) return;
+    queue.writeBuffer(range.buffer, range.offset + offset, p_data, size);
+    m_upload_count++;
+    m_uploaded_bytes += size;
+}
+
+void GpuHeap::collect() {
+    TRACE_ZONE("GpuHeap::collect");
+    auto retired = std::partition(m_pending_frees.begin(), m_pending_frees.end(), [&](const PendingFree& pending) {
+        return !m_fence.isComplete(pending.serial);
+    });
+    for (auto it = retired; it != m_pending_frees.end(); it++) {
+        auto& pool = m_pools[static_cast<size_t>(it->usage)];
+        pool.blocks[it->block].allocator.free(it->node);
+        pool.pending_free_bytes -= it->size;
+    }
+    m_pending_frees.erase(retired, m_pending_frees.end());
+
+    for (size_t usage = 0; usage < GPU_HEAP_USAGE_COUNT; usage++) {
+        auto& blocks = m_pools[usage].blocks;
+        uint32_t shared_blocks = 0;
+        for (auto& block : blocks) {
+            if (block.buffer && !block.dedicated) shared_blocks++;
+        }
+        for (uint32_t i = 0; i < blocks.size(); i++) {
+            Block& block = blocks[i];
+            if (!block.buffer || block.allocator.allocationCount() != 0) continue;
+            // keep one shared block around so a pool does not thrash
+            if (block.dedicated || block.evacuating || shared_blocks > 1) {
+                if (!block.dedicated) shared_blocks--;
+                releaseBlock(static_cast<GpuHeapUsage>(usage), i);
+            }
+        }
+    }
+}
+
+void GpuHeap::compactPool(GpuHeapUsage usage, wgpu::CommandEncoder encoder, uint64_t& byte_budget) {
+    auto& blocks = m_pools[static_cast<size_t>(usage)].blocks;
+
+    uint32_t victim = TlsfAllocator::NO_SPACE;
+    for (uint32_t i = 0; i < blocks.size(); i++) {
+        if (blocks[i].buffer && blocks[i].evacuating) {
+            victim = i;
+            break;
+        }
+    }
+
+    if (victim == TlsfAllocator::NO_SPACE) {
+        uint64_t total_free = 0;
+        uint64_t largest_free = 0;
+        uint32_t shared_blocks = 0;
+        for (auto& block : blocks) {
+            if (!block.buffer || block.dedicated) continue;
+            shared_blocks++;
+            total_free += block.allocator.freeBytes();
+            largest_free = std::max(largest_free, block.allocator.largestFree());
+        }
+        if (shared_blocks < 2 || total_free == 0) return;
+        float fragmentation = 1.0f - static_cast<float>(largest_free) / static_cast<float>(total_free);
+        if (fragmentation <= m_config.compact_threshold) return;
+
+        // evacuate the emptiest block, provided the others can absorb it
+        uint64_t least_used = UINT64_MAX;
+        for (uint32_t i = 0; i < blocks.size(); i++) {
+            Block& block = blocks[i];
+            if (!block.buffer || block.dedicated) continue;
+            uint64_t used = block.allocator.size() - block.allocator.freeBytes();
+            if (used < least_used && used <= total_free - block.allocator.freeBytes()) {
+                least_used = used;
+                victim = i;
+            }
+        }
+        if (victim == TlsfAllocator::NO_SPACE) return;
+        blocks[victim].evacuating = true;
+    }
+
+    wgpu::Buffer source = blocks[victim].buffer;
+    for (uint32_t index = 0; index < m_slots.size() && byte_budget > 0; index++) {
+        Slot& slot = m_slots[index];
+        if (!slot.live || slot.usage != usage || slot.block != victim) continue;
+
+        uint64_t node_size = blocks[victim].allocator.nodeSize(slot.node);
+        if (node_size > byte_budget) {
+            byte_budget = 0;
+            break;
+        }
+        Slot moved = slot;
+        if (!allocateIn(usage, node_size, victim, moved)) {
+            // the other blocks filled up meanwhile, give up on this victim
+            blocks[victim].evacuating = false;
+            return;
+        }
+        encoder.copyBufferToBuffer(source, slot.offset, blocks[moved.block].buffer, moved.offset, node_size);
+        m_pending_frees.push_back(PendingFree {
+            .serial = m_fence.pending(),
+            .size = node_size,
+            .block = victim,
+            .node = slot.node,
+            .usage = usage
+        });
+        m_pools[static_cast<size_t>(usage)].pending_free_bytes += node_size;
+        slot = moved;
+        byte_budget -= node_size;
+    }
+}
+
+void GpuHeap::compact(wgpu::CommandEncoder encoder, uint64_t byte_budget) {
+    TRACE_ZONE("GpuHeap::compact");
+    for (size_t usage = 0; usage < GPU_HEAP_USAGE_COUNT && byte_budget > 0; usage++) {
+        compactPool(static_cast<GpuHeapUsage>(usage), encoder, byte_budget);
+    }
+}
+
+uint64_t GpuHeap::trim() {
+    uint64_t freed = 0;
+    for (size_t usage = 0; usage < GPU_HEAP_USAGE_COUNT; usage++) {
+        auto& blocks = m_pools[usage].blocks;
+        for (uint32_t i = 0; i < blocks.size(); i++) {
+            if (blocks[i].buffer && blocks[i].allocator.allocationCount() == 0) {
+                freed += blocks[i].allocator.size();
+                releaseBlock(static_cast<GpuHeapUsage>(usage), i);
+            }
+        }
+    }
+    return freed;
+}
+
+GpuHeapStats GpuHeap::stats(GpuHeapUsage usage) const {
+    GpuHeapStats stats {};
+    const auto& pool = m_pools[static_cast<size_t>(usage)];
+    for (auto& block : pool.blocks) {
+        if (!block.buffer) continue;
+        stats.block_count++;
+        stats.reserved_bytes += block.allocator.size();
+        stats.used_bytes += block.allocator.size() - block.allocator.freeBytes();
+    }
+    for (auto& slot : m_slots) {
+        if (slot.live && slot.usage == usage) stats.allocation_count++;
+    }
+    stats.pending_free_bytes = pool.pending_free_bytes;
+    stats.used_bytes -= pool.pending_free_bytes;
+    return stats;
+}
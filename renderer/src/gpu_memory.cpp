@@ -0,0 +1,292 @@
+/*
+    gpu_memory.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "gpu_memory.h"
+#include "trace.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+const char *gpuMemoryCategoryName(GpuMemoryCategory category) {
+    switch (category) {
+        case GpuMemoryCategory::Geometry: return "geometry";
+        case GpuMemoryCategory::Uniform: return "uniform";
+        case GpuMemoryCategory::Storage: return "storage";
+        case GpuMemoryCategory::Texture: return "texture";
+        case GpuMemoryCategory::RenderTarget: return "render target";
+        case GpuMemoryCategory::Readback: return "readback";
+        case GpuMemoryCategory::Query: return "query";
+        case GpuMemoryCategory::Other: return "other";
+    }
+    return "unknown";
+}
+
+struct TexelBlock {
+    uint32_t bytes;
+    uint32_t dim;
+};
+
+static TexelBlock texel_block(wgpu::TextureFormat format) {
+    switch (format) {
+        case wgpu::TextureFormat::R8Unorm:
+        case wgpu::TextureFormat::R8Snorm:
+        case wgpu::TextureFormat::R8Uint:
+        case wgpu::TextureFormat::R8Sint:
+        case wgpu::TextureFormat::Stencil8:
+            return { 1, 1 };
+        case wgpu::TextureFormat::R16Uint:
+        case wgpu::TextureFormat::R16Sint:
+        case wgpu::TextureFormat::R16Float:
+        case wgpu::TextureFormat::RG8Unorm:
+        case wgpu::TextureFormat::RG8Snorm:
+        case wgpu::TextureFormat::RG8Uint:
+        case wgpu::TextureFormat::RG8Sint:
+        case wgpu::TextureFormat::Depth16Unorm:
+            return { 2, 1 };
+        case wgpu::TextureFormat::RG32Float:
+        case wgpu::TextureFormat::RG32Uint:
+        case wgpu::TextureFormat::RG32Sint:
+        case wgpu::TextureFormat::RGBA16Uint:
+        case wgpu::TextureFormat::RGBA16Sint:
+        case wgpu::TextureFormat::RGBA16Float:
+        case wgpu::TextureFormat::Depth32FloatStencil8:
+            return { 8, 1 };
+        case wgpu::TextureFormat::RGBA32Float:
+        case wgpu::TextureFormat::RGBA32Uint:
+        case wgpu::TextureFormat::RGBA32Sint:
+            return { 16, 1 };
+        case wgpu::TextureFormat::BC1RGBAUnorm:
+        case wgpu::TextureFormat::BC1RGBAUnormSrgb:
+        case wgpu::TextureFormat::BC4RUnorm:
+        case wgpu::TextureFormat::BC4RSnorm:
+            return { 8, 4 };
+        case wgpu::TextureFormat::BC2RGBAUnorm:
+        case wgpu::TextureFormat::BC2RGBAUnormSrgb:
+        case wgpu::TextureFormat::BC3RGBAUnorm:
+        case wgpu::TextureFormat::BC3RGBAUnormSrgb:
+        case wgpu::TextureFormat::BC5RGUnorm:
+        case wgpu::TextureFormat::BC5RGSnorm:
+        case wgpu::TextureFormat::BC6HRGBUfloat:
+        case wgpu::TextureFormat::BC6HRGBFloat:
+        case wgpu::TextureFormat::BC7RGBAUnorm:
+        case wgpu::TextureFormat::BC7RGBAUnormSrgb:
+            return { 16, 4 };
+        default:
+            // the 32 bit formats, and a safe guess for anything exotic
+            return { 4, 1 };
+    }
+}
+
+uint64_t estimateTextureSize(const wgpu::TextureDescriptor& desc) {
+    TexelBlock block = texel_block(desc.format);
+    bool is_3d = desc.dimension == wgpu::TextureDimension::_3D;
+    uint64_t width = desc.size.width;
+    uint64_t height = desc.size.height;
+    uint64_t depth = is_3d ? desc.size.depthOrArrayLayers : 1;
+    uint64_t layers = is_3d ? 1 : desc.size.depthOrArrayLayers;
+    uint64_t total = 0;
+    for (uint32_t mip = 0; mip < std::max(desc.mipLevelCount, 1u); mip++) {
+        uint64_t blocks_x = (std::max<uint64_t>(width >> mip, 1) + block.dim - 1) / block.dim;
+        uint64_t blocks_y = (std::max<uint64_t>(height >> mip, 1) + block.dim - 1) / block.dim;
+        uint64_t slices = std::max<uint64_t>(depth >> mip, 1);
+        total += blocks_x * blocks_y * slices * block.bytes;
+    }
+    return total * layers * std::max(desc.sampleCount, 1u);
+}
+
+GpuMemoryTracker::GpuMemoryTracker(wgpu::Device device): m_device(device) {}
+
+bool GpuMemoryTracker::reserve(uint64_t size) {
+    uint64_t over;
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_budget == 0 || m_total.live_bytes + size <= m_budget) return true;
+        // an eviction callback that itself allocates must not recurse
+        if (m_evicting) return false;
+        over = m_total.live_bytes + size - m_budget;
+        m_evicting = true;
+    }
+
+    TRACE_ZONE("GpuMemoryTracker::evict");
+    std::vector<EvictionCallback> callbacks;
+    {
+        std::lock_guard lock(m_mutex);
+        for (auto& [id, callback] : m_eviction_callbacks) {
+            callbacks.push_back(callback);
+        }
+    }
+    uint64_t freed = 0;
+    for (auto& callback : callbacks) {
+        if (freed >= over) break;
+        freed += callback(over - freed);
+    }
+
+    std::lock_guard lock(m_mutex);
+    m_evicting = false;
+    return m_total.live_bytes + size <= m_budget;
+}
+
+void GpuMemoryTracker::track(const void *p_handle, const char *label, uint64_t size, GpuMemoryCategory category) {
+    std::lock_guard lock(m_mutex);
+    m_records.emplace(p_handle, Record { label ? label : "", size, category });
+    auto& stats = m_stats[static_cast<size_t>(category)];
+    stats.live_bytes += size;
+    stats.live_count++;
+    stats.peak_bytes = std::max(stats.peak_bytes, stats.live_bytes);
+    m_total.live_bytes += size;
+    m_total.live_count++;
+    m_total.peak_bytes = std::max(m_total.peak_bytes, m_total.live_bytes);
+}
+
+void GpuMemoryTracker::untrack(const void *p_handle) {
+    std::lock_guard lock(m_mutex);
+    auto it = m_records.find(p_handle);
+    if (it == m_records.end()) return;
+    auto& stats = m_stats[static_cast<size_t>(it->second.category)];
+    stats.live_bytes -= it->second.size;
+    stats.live_count--;
+    m_total.live_bytes -= it->second.size;
+    m_total.live_count--;
+    m_records.erase(it);
+}
+
+wgpu::Buffer GpuMemoryTracker::createBuffer(const wgpu::BufferDescriptor& desc, GpuMemoryCategory category) {
+    if (!reserve(desc.size)) {
+        std::cout << "GPU memory budget exceeded creating buffer " << (desc.label ? desc.label : "") << '\n';
+        return nullptr;
+    }
+    wgpu::Buffer buffer = m_device.createBuffer(desc);
+    if (buffer) {
+        track(static_cast<WGPUBuffer>(buffer), desc.label, desc.size, category);
+    }
+    return buffer;
+}
+
+wgpu::Texture GpuMemoryTracker::createTexture(const wgpu::TextureDescriptor& desc, GpuMemoryCategory category) {
+    uint64_t size = estimateTextureSize(desc);
+    if (!reserve(size)) {
+        std::cout << "GPU memory budget exceeded creating texture " << (desc.label ? desc.label : "") << '\n';
+        return nullptr;
+    }
+    wgpu::Texture texture = m_device.createTexture(desc);
+    if (texture) {
+        track(static_cast<WGPUTexture>(texture), desc.label, size, category);
+    }
+    return texture;
+}
+
+wgpu::QuerySet GpuMemoryTracker::createQuerySet(const wgpu::QuerySetDescriptor& desc, GpuMemoryCategory category) {
+    uint64_t size = uint64_t(desc.count) * sizeof(uint64_t);
+    if (!reserve(size)) {
+        std::cout << "GPU memory budget exceeded creating query set " << (desc.label ? desc.label : "") << '\n';
+        return nullptr;
+    }
+    wgpu::QuerySet query_set = m_device.createQuerySet(desc);
+    if (query_set) {
+        track(static_cast<WGPUQuerySet>(query_set), desc.label, size, category);
+    }
+    return query_set;
+}
+
+void GpuMemoryTracker::release(wgpu::Buffer& buffer) {
+    if (!buffer) return;
+    untrack(static_cast<WGPUBuffer>(buffer));
+    buffer.release();
+    buffer = nullptr;
+}
+
+void GpuMemoryTracker::release(wgpu::Texture& texture) {
+    if (!texture) return;
+    untrack(static_cast<WGPUTexture>(texture));
+    texture.release();
+    texture = nullptr;
+}
+
+void GpuMemoryTracker::release(wgpu::QuerySet& query_set) {
+    if (!query_set) return;
+    untrack(static_cast<WGPUQuerySet>(query_set));
+    query_set.release();
+    query_set = nullptr;
+}
+
+void GpuMemoryTracker::setBudget(uint64_t bytes) {
+    std::lock_guard lock(m_mutex);
+    m_budget = bytes;
+}
+
+uint32_t GpuMemoryTracker::addEvictionCallback(EvictionCallback callback) {
+    std::lock_guard lock(m_mutex);
+    uint32_t id = m_next_callback_id++;
+    m_eviction_callbacks.emplace_back(id, std::move(callback));
+    return id;
+}
+
+void GpuMemoryTracker::removeEvictionCallback(uint32_t id) {
+    std::lock_guard lock(m_mutex);
+    std::erase_if(m_eviction_callbacks, [id](const auto& entry) { return entry.first == id; });
+}
+
+GpuMemoryStats GpuMemoryTracker::stats(GpuMemoryCategory category) const {
+    std::lock_guard lock(m_mutex);
+    return m_stats[static_cast<size_t>(category)];
+}
+
+GpuMemoryStats GpuMemoryTracker::total() const {
+    std::lock_guard lock(m_mutex);
+    return m_total;
+}
+
+static double to_mib(uint64_t bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+void GpuMemoryTracker::report(std::ostream& out, size_t max_objects) const {
+    std::lock_guard lock(m_mutex);
+    auto flags = out.flags();
+    out << std::fixed << std::setprecision(2);
+    out << "GPU memory: " << to_mib(m_total.live_bytes) << " MiB live in " << m_total.live_count
+        << " objects, peak " << to_mib(m_total.peak_bytes) << " MiB";
+    if (m_budget) out << ", budget " << to_mib(m_budget) << " MiB";
+    out << '\n';
+
+    std::array<size_t, GPU_MEMORY_CATEGORY_COUNT> order;
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return m_stats[a].live_bytes > m_stats[b].live_bytes;
+    });
+    for (size_t i : order) {
+        if (m_stats[i].peak_bytes == 0) continue;
+        out << " - " << std::setw(14) << std::left << gpuMemoryCategoryName(static_cast<GpuMemoryCategory>(i))
+            << std::right << std::setw(10) << to_mib(m_stats[i].live_bytes) << " MiB in "
+            << m_stats[i].live_count << " objects, peak " << to_mib(m_stats[i].peak_bytes) << " MiB\n";
+    }
+
+    std::vector<const Record*> records;
+    records.reserve(m_records.size());
+    for (auto& [handle, record] : m_records) {
+        records.push_back(&record);
+    }
+    size_t shown = std::min(max_objects, records.size());
+    std::partial_sort(records.begin(), records.begin() + shown, records.end(), [](const Record* a, const Record* b) {
+        return a->size > b->size;
+    });
+    if (shown) out << "Largest objects:\n";
+    for (size_t i = 0; i < shown; i++) {
+        out << " - " << std::setw(10) << to_mib(records[i]->size) << " MiB  "
+            << gpuMemoryCategoryName(records[i]->category) << "  "
+            << (records[i]->label.empty() ? "(unlabeled)" : records[i]->label) << '\n';
+    }
+    out.flags(flags);
+}
@@ -0,0 +1,260 @@
+/*
+    gpu_object_cache.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "gpu_object_cache.h"
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+// Flattens descriptor fields into words. Entries are canonicalized by
+// binding so declaration order does not split the cache.
+class KeyWriter {
+public:
+    inline KeyWriter& operator<<(uint64_t value) {
+        m_words.push_back(value);
+        return *this;
+    }
+
+    inline KeyWriter& operator<<(const void *p_handle) {
+        m_words.push_back(reinterpret_cast<uintptr_t>(p_handle));
+        return *this;
+    }
+
+    inline KeyWriter& operator<<(float value) {
+        m_words.push_back(std::bit_cast<uint32_t>(value));
+        return *this;
+    }
+
+    inline std::vector<uint64_t>&& take() { return std::move(m_words); }
+
+private:
+    std::vector<uint64_t> m_words {};
+};
+
+template<typename Entry>
+std::vector<const Entry*> sortedByBinding(const Entry *p_entries, size_t count) {
+    std::vector<const Entry*> sorted(count);
+    for (size_t i = 0; i < count; i++) sorted[i] = &p_entries[i];
+    std::sort(sorted.begin(), sorted.end(), [](const Entry *a, const Entry *b) {
+        return a->binding < b->binding;
+    });
+    return sorted;
+}
+
+} // namespace
+
+GpuObjectCache::GpuObjectCache(wgpu::Device device, const FrameFence& fence, uint32_t keep_frames):
+    m_device(device), m_fence(fence), m_keep_frames(keep_frames) {}
+
+GpuObjectCache::~GpuObjectCache() {
+    // the owner is shutting down, whatever is still referenced goes too
+    for (size_t kind = 0; kind < POOL_COUNT; kind++) {
+        for (auto& [key, entry] : m_pools[kind].entries) {
+            destroy(static_cast<PoolKind>(kind), entry.p_handle);
+        }
+    }
+}
+
+GpuObjectCache::Key GpuObjectCache::makeKey(std::vector<uint64_t>&& words) {
+    // FNV-1a over the words
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (uint64_t word : words) {
+        hash = (hash ^ word) * 0x100000001b3ull;
+    }
+    return Key { std::move(words), hash };
+}
+
+void *GpuObjectCache::lookup(PoolKind kind, const Key& key) {
+    auto& pool = m_pools[kind];
+    auto it = pool.entries.find(key);
+    if (it == pool.entries.end()) {
+        m_stats.misses++;
+        return nullptr;
+    }
+    m_stats.hits++;
+    if (it->second.refs++ == 0) {
+        m_stats.idle--;
+    }
+    return it->second.p_handle;
+}
+
+void GpuObjectCache::insert(PoolKind kind, Key&& key, void *p_handle) {
+    auto& pool = m_pools[kind];
+    auto [it, inserted] = pool.entries.emplace(std::move(key), Entry { p_handle, 1, 0 });
+    pool.keys[p_handle] = &it->first;
+    m_stats.live++;
+}
+
+void GpuObjectCache::unref(PoolKind kind, void *p_handle) {
+    auto& pool = m_pools[kind];
+    auto key_it = pool.keys.find(p_handle);
+    if (key_it == pool.keys.end()) return;
+    Entry& entry = pool.entries.find(*key_it->second)->second;
+    if (entry.refs == 0) return;
+    if (--entry.refs == 0) {
+        // work being recorded now may still use it
+        entry.idle_since = m_fence.pending();
+        m_stats.idle++;
+    }
+}
+
+void GpuObjectCache::destroy(PoolKind kind, void *p_handle) {
+    switch (kind) {
+        case BIND_GROUP_LAYOUT: wgpu::BindGroupLayout(static_cast<WGPUBindGroupLayout>(p_handle)).release(); break;
+        case PIPELINE_LAYOUT: wgpu::PipelineLayout(static_cast<WGPUPipelineLayout>(p_handle)).release(); break;
+        case BIND_GROUP: wgpu::BindGroup(static_cast<WGPUBindGroup>(p_handle)).release(); break;
+        case SAMPLER: wgpu::Sampler(static_cast<WGPUSampler>(p_handle)).release(); break;
+        case POOL_COUNT: break;
+    }
+}
+
+wgpu::BindGroupLayout GpuObjectCache::acquire(const wgpu::BindGroupLayoutDescriptor& desc) {
+    KeyWriter writer;
+    // a chained descriptor gets a key nothing else can match
+    if (desc.nextInChain) writer << ~uint64_t(0) << m_uncached++;
+    for (const auto *p_entry : sortedByBinding(desc.entries, desc.entryCount)) {
+        const auto& entry = *p_entry;
+        writer << static_cast<uint64_t>(entry.binding) << static_cast<uint64_t>(entry.visibility)
+            << static_cast<uint64_t>(entry.buffer.type) << static_cast<uint64_t>(entry.buffer.hasDynamicOffset)
+            << entry.buffer.minBindingSize
+            << static_cast<uint64_t>(entry.sampler.type)
+            << static_cast<uint64_t>(entry.texture.sampleType) << static_cast<uint64_t>(entry.texture.viewDimension)
+            << static_cast<uint64_t>(entry.texture.multisampled)
+            << static_cast<uint64_t>(entry.storageTexture.access) << static_cast<uint64_t>(entry.storageTexture.format)
+            << static_cast<uint64_t>(entry.storageTexture.viewDimension);
+    }
+    Key key = makeKey(writer.take());
+
+    std::lock_guard lock(m_mutex);
+    if (void *p_handle = lookup(BIND_GROUP_LAYOUT, key)) {
+        return static_cast<WGPUBindGroupLayout>(p_handle);
+    }
+    wgpu::BindGroupLayout layout = m_device.createBindGroupLayout(desc);
+    if (layout) insert(BIND_GROUP_LAYOUT, std::move(key), static_cast<WGPUBindGroupLayout>(layout));
+    return layout;
+}
+
+wgpu::PipelineLayout GpuObjectCache::acquire(const wgpu::PipelineLayoutDescriptor& desc) {
+    KeyWriter writer;
+    if (desc.nextInChain) writer << ~uint64_t(0) << m_uncached++;
+    // group order is significant here
+    for (size_t i = 0; i < desc.bindGroupLayoutCount; i++) {
+        writer << static_cast<const void*>(desc.bindGroupLayouts[i]);
+    }
+    Key key = makeKey(writer.take());
+
+    std::lock_guard lock(m_mutex);
+    if (void *p_handle = lookup(PIPELINE_LAYOUT, key)) {
+        return static_cast<WGPUPipelineLayout>(p_handle);
+    }
+    wgpu::PipelineLayout layout = m_device.createPipelineLayout(desc);
+    if (layout) insert(PIPELINE_LAYOUT, std::move(key), static_cast<WGPUPipelineLayout>(layout));
+    return layout;
+}
+
+wgpu::BindGroup GpuObjectCache::acquire(const wgpu::BindGroupDescriptor& desc) {
+    KeyWriter writer;
+    if (desc.nextInChain) writer << ~uint64_t(0) << m_uncached++;
+    writer << static_cast<const void*>(desc.layout);
+    for (const auto *p_entry : sortedByBinding(desc.entries, desc.entryCount)) {
+        const auto& entry = *p_entry;
+        writer << static_cast<uint64_t>(entry.binding)
+            << static_cast<const void*>(entry.buffer) << entry.offset << entry.size
+            << static_cast<const void*>(entry.sampler)
+            << static_cast<const void*>(entry.textureView);
+    }
+    Key key = makeKey(writer.take());
+
+    std::lock_guard lock(m_mutex);
+    if (void *p_handle = lookup(BIND_GROUP, key)) {
+        return static_cast<WGPUBindGroup>(p_handle);
+    }
+    wgpu::BindGroup bind_group = m_device.createBindGroup(desc);
+    if (bind_group) insert(BIND_GROUP, std::move(key), static_cast<WGPUBindGroup>(bind_group));
+    return bind_group;
+}
+
+wgpu::Sampler GpuObjectCache::acquire(const wgpu::SamplerDescriptor& desc) {
+    KeyWriter writer;
+    if (desc.nextInChain) writer << ~uint64_t(0) << m_uncached++;
+    writer << static_cast<uint64_t>(desc.addressModeU) << static_cast<uint64_t>(desc.addressModeV)
+        << static_cast<uint64_t>(desc.addressModeW)
+        << static_cast<uint64_t>(desc.magFilter) << static_cast<uint64_t>(desc.minFilter)
+        << static_cast<uint64_t>(desc.mipmapFilter)
+        << desc.lodMinClamp << desc.lodMaxClamp
+        << static_cast<uint64_t>(desc.compare) << static_cast<uint64_t>(desc.maxAnisotropy);
+    Key key = makeKey(writer.take());
+
+    std::lock_guard lock(m_mutex);
+    if (void *p_handle = lookup(SAMPLER, key)) {
+        return static_cast<WGPUSampler>(p_handle);
+    }
+    wgpu::Sampler sampler = m_device.createSampler(desc);
+    if (sampler) insert(SAMPLER, std::move(key), static_cast<WGPUSampler>(sampler));
+    return sampler;
+}
+
+void GpuObjectCache::release(wgpu::BindGroupLayout& layout) {
+    std::lock_guard lock(m_mutex);
+    unref(BIND_GROUP_LAYOUT, static_cast<WGPUBindGroupLayout>(layout));
+    layout = nullptr;
+}
+
+void GpuObjectCache::release(wgpu::PipelineLayout& layout) {
+    std::lock_guard lock(m_mutex);
+    unref(PIPELINE_LAYOUT, static_cast<WGPUPipelineLayout>(layout));
+    layout = nullptr;
+}
+
+void GpuObjectCache::release(wgpu::BindGroup& bind_group) {
+    std::lock_guard lock(m_mutex);
+    unref(BIND_GROUP, static_cast<WGPUBindGroup>(bind_group));
+    bind_group = nullptr;
+}
+
+void GpuObjectCache::release(wgpu::Sampler& sampler) {
+    std::lock_guard lock(m_mutex);
+    unref(SAMPLER, static_cast<WGPUSampler>(sampler));
+    sampler = nullptr;
+}
+
+void GpuObjectCache::collect() {
+    std::lock_guard lock(m_mutex);
+    uint64_t submitted = m_fence.submitted();
+    for (size_t kind = 0; kind < POOL_COUNT; kind++) {
+        auto& pool = m_pools[kind];
+        for (auto it = pool.entries.begin(); it != pool.entries.end();) {
+            const Entry& entry = it->second;
+            bool expired = entry.refs == 0
+                && m_fence.isComplete(entry.idle_since)
+                && submitted >= entry.idle_since + m_keep_frames;
+            if (!expired) {
+                ++it;
+                continue;
+            }
+            destroy(static_cast<PoolKind>(kind), entry.p_handle);
+            pool.keys.erase(entry.p_handle);
+            it = pool.entries.erase(it);
+            m_stats.live--;
+            m_stats.idle--;
+        }
+    }
+}
+
+GpuObjectCacheStats GpuObjectCache::stats() const {
+    std::lock_guard lock(m_mutex);
+    return m_stats;
+}
@@ -0,0 +1,275 @@
+/*
+    gpu_skinning.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "gpu_skinning.h"
+#include "skinning.wgsl.h"
+#include "trace.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+// job count followed by padding, ahead of the job array
+inline static constexpr uint32_t JOB_HEADER_WORDS = 4;
+inline static constexpr uint32_t MAX_DISPATCH_GROUPS = 65535;
+
+GpuSkinning::GpuSkinning(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache, const FrameFence& fence,
+    const char *wgsl_source, GpuSkinningConfig config):
+    m_device(device), m_memory(memory), m_cache(cache), m_fence(fence), m_config(config),
+    m_source_allocator(config.max_source_vertices),
+    m_output_allocator(config.max_output_vertices),
+    m_joint_allocator(config.max_joints) {
+    static_assert(sizeof(Job) == sizeof(wgsl::skinning::Job));
+    static_assert(offsetof(Job, first_group) == offsetof(wgsl::skinning::Job, first_group));
+    static_assert(offsetof(Job, joint_offset) == offsetof(wgsl::skinning::Job, joint_offset));
+    static_assert(JOB_HEADER_WORDS * sizeof(uint32_t) == wgsl::skinning::JobTable::JOBS_OFFSET);
+    static_assert(WORKGROUP_SIZE == wgsl::skinning::cs_main::WORKGROUP_SIZE[0]);
+
+    wgpu::BufferDescriptor buffer_desc = {};
+    buffer_desc.label = "Skinning source vertices";
+    buffer_desc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
+    buffer_desc.size = static_cast<uint64_t>(m_config.max_source_vertices) * VERTEX_STRIDE;
+    m_source = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Geometry);
+    buffer_desc.label = "Skinning weights";
+    buffer_desc.size = static_cast<uint64_t>(m_config.max_source_vertices) * WEIGHT_STRIDE;
+    m_weights = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Geometry);
+    buffer_desc.label = "Skinning joint matrices";
+    buffer_desc.size = static_cast<uint64_t>(m_config.max_joints) * JOINT_FLOATS * sizeof(float);
+    m_joints = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    buffer_desc.label = "Skinning jobs";
+    buffer_desc.size = (JOB_HEADER_WORDS * sizeof(uint32_t)) + static_cast<uint64_t>(m_config.max_instances) * sizeof(Job);
+    m_jobs = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    buffer_desc.label = "Skinned vertices";
+    buffer_desc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::Vertex;
+    buffer_desc.size = static_cast<uint64_t>(m_config.max_output_vertices) * VERTEX_STRIDE;
+    m_output = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Geometry);
+    if (!m_source || !m_weights || !m_joints || !m_jobs || !m_output) return;
+
+    wgpu::ShaderModuleWGSLDescriptor shader_code_desc = {};
+    shader_code_desc.chain.next = nullptr;
+    shader_code_desc.chain.sType = wgpu::SType::ShaderModuleWGSLDescriptor;
+    shader_code_desc.code = wgsl_source;
+    wgpu::ShaderModuleDescriptor shader_module_desc = {};
+    shader_module_desc.nextInChain = &shader_code_desc.chain;
+    shader_module_desc.label = "Skinning shader";
+#ifdef WEBGPU_BACKEND_WGPU
+    shader_module_desc.hintCount = 0;
+    shader_module_desc.hints = nullptr;
+#endif
+    wgpu::ShaderModule shader_module = m_device.createShaderModule(shader_module_desc);
+
+    wgpu::BindGroupLayoutDescriptor bind_group_layout_desc = {};
+    bind_group_layout_desc.label = "Skinning bind group layout";
+    bind_group_layout_desc.entryCount = wgsl::skinning::group0::ENTRY_COUNT;
+    bind_group_layout_desc.entries = wgsl::skinning::group0::ENTRIES;
+    m_bind_group_layout = m_cache.acquire(bind_group_layout_desc);
+
+    WGPUBindGroupLayout bind_group_layouts[1] = { m_bind_group_layout };
+    wgpu::PipelineLayoutDescriptor pipeline_layout_desc = {};
+    pipeline_layout_desc.label = "Skinning pipeline layout";
+    pipeline_layout_desc.bindGroupLayoutCount = 1;
+    pipeline_layout_desc.bindGroupLayouts = bind_group_layouts;
+    wgpu::PipelineLayout pipeline_layout = m_cache.acquire(pipeline_layout_desc);
+
+    wgpu::ComputePipelineDescriptor pipeline_desc = {};
+    pipeline_desc.label = "Skinning pipeline";
+    pipeline_desc.layout = pipeline_layout;
+    pipeline_desc.compute.module = shader_module;
+    pipeline_desc.compute.entryPoint = wgsl::skinning::cs_main::ENTRY_POINT;
+    pipeline_desc.compute.constantCount = 0;
+    pipeline_desc.compute.constants = nullptr;
+    m_pipeline = m_device.createComputePipeline(pipeline_desc);
+
+    m_cache.release(pipeline_layout);
+    shader_module.release();
+
+    wgpu::BindGroupEntry bindings[5] = {{}, {}, {}, {}, {}};
+    const wgpu::Buffer buffers[5] = { m_source, m_weights, m_joints, m_jobs, m_output };
+    const uint32_t slots[5] = {
+        wgsl::skinning::group0::SOURCE, wgsl::skinning::group0::WEIGHTS, wgsl::skinning::group0::JOINTS,
+        wgsl::skinning::group0::TABLE, wgsl::skinning::group0::SKINNED,
+    };
+    for (uint32_t i = 0; i < 5; i++) {
+        bindings[i].binding = slots[i];
+        bindings[i].buffer = buffers[i];
+        bindings[i].offset = 0;
+        bindings[i].size = buffers[i].getSize();
+    }
+
+    wgpu::BindGroupDescriptor bind_group_desc = {};
+    bind_group_desc.label = "Skinning bind group";
+    bind_group_desc.layout = m_bind_group_layout;
+    bind_group_desc.entryCount = 5;
+    bind_group_desc.entries = bindings;
+    m_bind_group = m_cache.acquire(bind_group_desc);
+
+    m_joint_data.resize(static_cast<size_t>(m_config.max_joints) * JOINT_FLOATS);
+}
+
+GpuSkinning::~GpuSkinning() {
+    if (m_bind_group) m_cache.release(m_bind_group);
+    if (m_pipeline) m_pipeline.release();
+    if (m_bind_group_layout) m_cache.release(m_bind_group_layout);
+    for (wgpu::Buffer *p_buffer : { &m_source, &m_weights, &m_joints, &m_jobs, &m_output }) {
+        if (*p_buffer) m_memory.release(*p_buffer);
+    }
+}
+
+template<typename Slot>
+uint32_t GpuSkinning::claimSlot(std::vector<Slot>& slots, std::vector<uint32_t>& free_slots) {
+    if (!free_slots.empty()) {
+        uint32_t index = free_slots.back();
+        free_slots.pop_back();
+        return index;
+    }
+    slots.emplace_back();
+    return static_cast<uint32_t>(slots.size() - 1);
+}
+
+Result<uint32_t, void> GpuSkinning::addMesh(wgpu::Queue queue, const void *p_vertices, const void *p_weights, uint32_t vertex_count) {
+    if (!ready() || vertex_count == 0) return Err{};
+    TlsfAllocator::Allocation source = m_source_allocator.allocate(vertex_count);
+    if (source.node == TlsfAllocator::NO_SPACE) return Err{};
+
+    queue.writeBuffer(m_source, source.offset * VERTEX_STRIDE, p_vertices, static_cast<size_t>(vertex_count) * VERTEX_STRIDE);
+    queue.writeBuffer(m_weights, source.offset * WEIGHT_STRIDE, p_weights, static_cast<size_t>(vertex_count) * WEIGHT_STRIDE);
+
+    uint32_t id = claimSlot(m_meshes, m_free_meshes);
+    m_meshes[id] = Mesh { source, vertex_count, 0, true };
+    m_stats.meshes++;
+    return Ok { id };
+}
+
+void GpuSkinning::removeMesh(uint32_t mesh) {
+    if (mesh >= m_meshes.size() || !m_meshes[mesh].live || m_meshes[mesh].instance_count > 0) return;
+    m_pending_frees.push_back({ m_fence.pending(), &m_source_allocator, m_meshes[mesh].source.node });
+    m_meshes[mesh] = Mesh {};
+    m_free_meshes.push_back(mesh);
+    m_stats.meshes--;
+}
+
+Result<uint32_t, void> GpuSkinning::addInstance(uint32_t mesh, uint32_t joint_count) {
+    if (mesh >= m_meshes.size() || !m_meshes[mesh].live) return Err{};
+    if (joint_count == 0 || joint_count > MAX_INSTANCE_JOINTS) return Err{};
+    if (m_stats.instances >= m_config.max_instances) return Err{};
+
+    TlsfAllocator::Allocation output = m_output_allocator.allocate(m_meshes[mesh].vertex_count);
+    if (output.node == TlsfAllocator::NO_SPACE) return Err{};
+    TlsfAllocator::Allocation joints = m_joint_allocator.allocate(joint_count);
+    if (joints.node == TlsfAllocator::NO_SPACE) {
+        m_output_allocator.free(output.node);
+        return Err{};
+    }
+    // identity until the caller fills in a pose
+    for (uint32_t j = 0; j < joint_count; j++) {
+        float *p_matrix = &m_joint_data[(joints.offset + j) * JOINT_FLOATS];
+        std::memset(p_matrix, 0, JOINT_FLOATS * sizeof(float));
+        p_matrix[0] = p_matrix[5] = p_matrix[10] = 1.0f;
+    }
+
+    uint32_t id = claimSlot(m_instances, m_free_instances);
+    m_instances[id] = Instance { output, joints, mesh, joint_count, true };
+    m_meshes[mesh].instance_count++;
+    m_stats.instances++;
+    return Ok { id };
+}
+
+void GpuSkinning::removeInstance(uint32_t instance) {
+    if (instance >= m_instances.size() || !m_instances[instance].live) return;
+    Instance& slot = m_instances[instance];
+    uint64_t serial = m_fence.pending();
+    m_pending_frees.push_back({ serial, &m_output_allocator, slot.output.node });
+    m_pending_frees.push_back({ serial, &m_joint_allocator, slot.joints.node });
+    m_meshes[slot.mesh].instance_count--;
+    slot = Instance {};
+    m_free_instances.push_back(instance);
+    m_stats.instances--;
+}
+
+std::span<float> GpuSkinning::jointMatrices(uint32_t instance) {
+    if (instance >= m_instances.size() || !m_instances[instance].live) return {};
+    const Instance& slot = m_instances[instance];
+    return std::span<float>(&m_joint_data[slot.joints.offset * JOINT_FLOATS], static_cast<size_t>(slot.joint_count) * JOINT_FLOATS);
+}
+
+GpuRange GpuSkinning::output(uint32_t instance) const {
+    if (instance >= m_instances.size() || !m_instances[instance].live) return {};
+    const Instance& slot = m_instances[instance];
+    return GpuRange {
+        m_output,
+        slot.output.offset * VERTEX_STRIDE,
+        static_cast<uint64_t>(m_meshes[slot.mesh].vertex_count) * VERTEX_STRIDE,
+    };
+}
+
+void GpuSkinning::dispatch(wgpu::Queue queue, wgpu::CommandEncoder encoder) {
+    TRACE_ZONE("GpuSkinning::dispatch");
+    m_stats.vertices = 0;
+    m_stats.joints = 0;
+    if (!ready() || m_stats.instances == 0) return;
+
+    // each instance takes a run of workgroups, the shader finds its job by
+    // binary search over first_group
+    m_job_data.assign(JOB_HEADER_WORDS, 0);
+    uint32_t group_count = 0;
+    uint64_t joint_end = 0;
+    for (const Instance& instance : m_instances) {
+        if (!instance.live) continue;
+        const Mesh& mesh = m_meshes[instance.mesh];
+        Job job = {};
+        job.first_group = group_count;
+        job.vertex_count = mesh.vertex_count;
+        job.source_offset = static_cast<uint32_t>(mesh.source.offset);
+        job.output_offset = static_cast<uint32_t>(instance.output.offset);
+        job.joint_offset = static_cast<uint32_t>(instance.joints.offset);
+        const uint32_t *p_words = reinterpret_cast<const uint32_t*>(&job);
+        m_job_data.insert(m_job_data.end(), p_words, p_words + sizeof(Job) / sizeof(uint32_t));
+
+        group_count += (mesh.vertex_count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+        joint_end = std::max(joint_end, instance.joints.offset + instance.joint_count);
+        m_stats.vertices += mesh.vertex_count;
+        m_stats.joints += instance.joint_count;
+    }
+    m_job_data[0] = m_stats.instances;
+
+    queue.writeBuffer(m_jobs, 0, m_job_data.data(), m_job_data.size() * sizeof(uint32_t));
+    queue.writeBuffer(m_joints, 0, m_joint_data.data(), joint_end * JOINT_FLOATS * sizeof(float));
+
+    // fold into two dimensions past the per-dimension limit
+    uint32_t groups_x = std::min(group_count, MAX_DISPATCH_GROUPS);
+    uint32_t groups_y = (group_count + groups_x - 1) / groups_x;
+
+    wgpu::ComputePassDescriptor pass_desc = {};
+    pass_desc.label = "Skinning pass";
+    pass_desc.timestampWrites = nullptr;
+    wgpu::ComputePassEncoder pass = encoder.beginComputePass(pass_desc);
+    pass.setPipeline(m_pipeline);
+    pass.setBindGroup(0, m_bind_group, 0, nullptr);
+    pass.dispatchWorkgroups(groups_x, groups_y, 1);
+    pass.end();
+    pass.release();
+}
+
+void GpuSkinning::collect() {
+    auto retired = std::remove_if(m_pending_frees.begin(), m_pending_frees.end(), [this](const PendingFree& pending) {
+        if (!m_fence.isComplete(pending.serial)) return false;
+        pending.p_allocator->free(pending.node);
+        return true;
+    });
+    m_pending_frees.erase(retired, m_pending_frees.end());
+}
+
+GpuSkinningStats GpuSkinning::stats() const {
+    return m_stats;
+}
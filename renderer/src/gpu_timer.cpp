@@ -0,0 +1,176 @@
+/*
+    gpu_timer.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "gpu_timer.h"
+#include <algorithm>
+#include <chrono>
+
+// resolveQuerySet destinations must be 256 byte aligned
+inline static constexpr uint64_t RESOLVE_STRIDE = 256;
+inline static constexpr uint64_t TIMESTAMP_PAIR_SIZE = 2 * sizeof(uint64_t);
+
+struct GpuTimer::MapPayload {
+    std::shared_ptr<State> state;
+    WGPUBuffer buffer;
+    uint32_t slot;
+};
+
+struct GpuTimer::DonePayload {
+    std::shared_ptr<State> state;
+    uint64_t submit_ns;
+};
+
+static void publish(std::atomic<uint64_t>& latest, std::atomic<uint64_t>& count, uint64_t ns) {
+    latest.store(ns, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_release);
+}
+
+GpuTimer::GpuTimer(wgpu::Device device, GpuMemoryTracker& memory):
+    m_memory(memory), m_state(std::make_shared<State>()) {
+    if (!device.hasFeature(wgpu::FeatureName::TimestampQuery)) return;
+
+    wgpu::QuerySetDescriptor query_desc = {};
+    query_desc.label = "GPU timer queries";
+    query_desc.type = wgpu::QueryType::Timestamp;
+    query_desc.count = 2 * SLOT_COUNT;
+    m_query_set = m_memory.createQuerySet(query_desc, GpuMemoryCategory::Query);
+
+    wgpu::BufferDescriptor resolve_desc = {};
+    resolve_desc.label = "GPU timer resolve";
+    resolve_desc.usage = wgpu::BufferUsage::QueryResolve | wgpu::BufferUsage::CopySrc;
+    resolve_desc.size = RESOLVE_STRIDE * SLOT_COUNT;
+    m_resolve_buffer = m_memory.createBuffer(resolve_desc, GpuMemoryCategory::Query);
+
+    bool ok = m_query_set && m_resolve_buffer;
+    for (auto& readback : m_readback) {
+        wgpu::BufferDescriptor readback_desc = {};
+        readback_desc.label = "GPU timer readback";
+        readback_desc.usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
+        readback_desc.size = TIMESTAMP_PAIR_SIZE;
+        readback = m_memory.createBuffer(readback_desc, GpuMemoryCategory::Readback);
+        ok = ok && readback;
+    }
+    if (!ok) {
+        // over budget, fall back to completion callbacks
+        if (m_query_set) m_memory.release(m_query_set);
+        if (m_resolve_buffer) m_memory.release(m_resolve_buffer);
+        for (auto& readback : m_readback) {
+            if (readback) m_memory.release(readback);
+        }
+    }
+}
+
+GpuTimer::~GpuTimer() {
+    // pending maps are aborted by the release and their callbacks only touch m_state
+    if (m_query_set) m_memory.release(m_query_set);
+    if (m_resolve_buffer) m_memory.release(m_resolve_buffer);
+    for (auto& readback : m_readback) {
+        if (readback) m_memory.release(readback);
+    }
+}
+
+void GpuTimer::beginFrame(wgpu::CommandEncoder encoder) {
+    m_frame_slot.reset();
+    if (!usesTimestamps()) return;
+    uint32_t slot = m_next_slot;
+    if (m_state->slot_busy[slot].load(std::memory_order_acquire)) return;
+    m_frame_slot = slot;
+    m_next_slot = (slot + 1) % SLOT_COUNT;
+
+    // timestamps are only written at pass boundaries, the frame's first
+    // pass varies with what is enabled, so it opens with one of its own
+    wgpu::ComputePassTimestampWrites writes = {};
+    writes.querySet = m_query_set;
+    writes.beginningOfPassWriteIndex = 2 * slot;
+    writes.endOfPassWriteIndex = WGPU_QUERY_SET_INDEX_UNDEFINED;
+    wgpu::ComputePassDescriptor pass_desc = {};
+    pass_desc.label = "GPU timer frame start";
+    pass_desc.timestampWrites = &writes;
+    wgpu::ComputePassEncoder pass = encoder.beginComputePass(pass_desc);
+    pass.end();
+    pass.release();
+}
+
+const wgpu::RenderPassTimestampWrites *GpuTimer::passWrites(bool last_pass) {
+    if (!m_frame_slot || !last_pass) return nullptr;
+    m_writes = {};
+    m_writes.querySet = m_query_set;
+    m_writes.beginningOfPassWriteIndex = WGPU_QUERY_SET_INDEX_UNDEFINED;
+    m_writes.endOfPassWriteIndex = 2 * *m_frame_slot + 1;
+    return &m_writes;
+}
+
+void GpuTimer::endFrame(wgpu::CommandEncoder encoder) {
+    if (!m_frame_slot) return;
+    uint32_t slot = *m_frame_slot;
+    encoder.resolveQuerySet(m_query_set, 2 * slot, 2, m_resolve_buffer, RESOLVE_STRIDE * slot);
+    encoder.copyBufferToBuffer(m_resolve_buffer, RESOLVE_STRIDE * slot, m_readback[slot], 0, TIMESTAMP_PAIR_SIZE);
+}
+
+void GpuTimer::submitted(wgpu::Queue queue) {
+    if (usesTimestamps()) {
+        if (!m_frame_slot) return;
+        uint32_t slot = *m_frame_slot;
+        m_frame_slot.reset();
+        m_state->slot_busy[slot].store(true, std::memory_order_relaxed);
+        auto *payload = new MapPayload { m_state, m_readback[slot], slot };
+        wgpuBufferMapAsync(m_readback[slot], wgpu::MapMode::Read, 0, TIMESTAMP_PAIR_SIZE,
+            [](WGPUBufferMapAsyncStatus status, void *p_user_data) {
+                auto *payload = static_cast<MapPayload*>(p_user_data);
+                if (status == WGPUBufferMapAsyncStatus_Success) {
+                    wgpu::Buffer buffer = payload->buffer;
+                    const auto *p_stamps = static_cast<const uint64_t*>(buffer.getConstMappedRange(0, TIMESTAMP_PAIR_SIZE));
+                    // timestamps may be reset by the driver between passes
+                    if (p_stamps && p_stamps[1] > p_stamps[0]) {
+                        publish(payload->state->latest_ns, payload->state->sample_count, p_stamps[1] - p_stamps[0]);
+                    }
+                    buffer.unmap();
+                }
+                payload->state->slot_busy[payload->slot].store(false, std::memory_order_release);
+                delete payload;
+            }, payload);
+        return;
+    }
+
+    auto *payload = new DonePayload { m_state, nowNs() };
+    wgpuQueueOnSubmittedWorkDone(queue, [](WGPUQueueWorkDoneStatus status, void *p_user_data) {
+        auto *payload = static_cast<DonePayload*>(p_user_data);
+        uint64_t done_ns = nowNs();
+        State& state = *payload->state;
+        if (status == WGPUQueueWorkDoneStatus_Success) {
+            // the frame could not start before it was submitted nor before the
+            // previous one finished
+            uint64_t start_ns = std::max(payload->submit_ns, state.last_done_ns.load(std::memory_order_relaxed));
+            if (done_ns > start_ns) {
+                publish(state.latest_ns, state.sample_count, done_ns - start_ns);
+            }
+        }
+        state.last_done_ns.store(done_ns, std::memory_order_relaxed);
+        delete payload;
+    }, payload);
+}
+
+std::optional<double> GpuTimer::poll() {
+    uint64_t count = m_state->sample_count.load(std::memory_order_acquire);
+    if (count == m_seen_samples) return std::nullopt;
+    m_seen_samples = count;
+    return static_cast<double>(m_state->latest_ns.load(std::memory_order_relaxed)) / 1e6;
+}
+
+uint64_t GpuTimer::nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
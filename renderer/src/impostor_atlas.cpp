@@ -0,0 +1,384 @@
+/*
+    impostor_atlas.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "impostor_atlas.h"
+#include "impostor_bake.wgsl.h"
+#include "trace.hpp"
+#include <algorithm>
+
+// maxTextureDimension2D of the default limits
+inline static constexpr uint32_t MAX_ATLAS_SIZE = 8192;
+inline static constexpr wgpu::TextureFormat BAKE_DEPTH_FORMAT = wgpu::TextureFormat::Depth32Float;
+
+using BakeParams = wgsl::impostor_bake::Bake;
+
+namespace {
+
+wgpu::TextureView createLayerView(wgpu::Texture texture, const char *label, wgpu::TextureFormat format,
+    wgpu::TextureViewDimension dimension, uint32_t base_layer, uint32_t layer_count) {
+    wgpu::TextureViewDescriptor view_desc = {};
+    view_desc.label = label;
+    view_desc.format = format;
+    view_desc.dimension = dimension;
+    view_desc.baseMipLevel = 0;
+    view_desc.mipLevelCount = 1;
+    view_desc.baseArrayLayer = base_layer;
+    view_desc.arrayLayerCount = layer_count;
+    view_desc.aspect = wgpu::TextureAspect::All;
+    return texture.createView(view_desc);
+}
+
+wgpu::RenderPassColorAttachment clearedAttachment(wgpu::TextureView view) {
+    wgpu::RenderPassColorAttachment attachment = {};
+    attachment.nextInChain = nullptr;
+    attachment.view = view;
+    attachment.resolveTarget = nullptr;
+    attachment.loadOp = wgpu::LoadOp::Clear;
+    attachment.storeOp = wgpu::StoreOp::Store;
+    attachment.clearValue = wgpu::Color{ 0.0, 0.0, 0.0, 0.0 };
+#ifndef WEBGPU_BACKEND_WGPU
+    attachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
+#endif // NOT WEBGPU_BACKEND_WGPU
+    return attachment;
+}
+
+} // namespace
+
+ImpostorAtlas::ImpostorAtlas(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache,
+    const char *bake_wgsl_source, ImpostorAtlasConfig config):
+    m_device(device), m_memory(memory), m_cache(cache), m_config(config) {
+    m_config.frames_per_side = std::clamp(m_config.frames_per_side, 2u, 32u);
+    m_config.frame_size = std::clamp(m_config.frame_size, 8u, MAX_ATLAS_SIZE / m_config.frames_per_side);
+    m_config.max_layers = std::max(m_config.max_layers, 1u);
+    m_config.initial_layers = std::clamp(m_config.initial_layers, 1u, m_config.max_layers);
+
+    wgpu::ShaderModuleWGSLDescriptor shader_code_desc = {};
+    shader_code_desc.chain.next = nullptr;
+    shader_code_desc.chain.sType = wgpu::SType::ShaderModuleWGSLDescriptor;
+    shader_code_desc.code = bake_wgsl_source;
+    wgpu::ShaderModuleDescriptor shader_module_desc = {};
+    shader_module_desc.nextInChain = &shader_code_desc.chain;
+    shader_module_desc.label = "Impostor bake shader";
+#ifdef WEBGPU_BACKEND_WGPU
+    shader_module_desc.hintCount = 0;
+    shader_module_desc.hints = nullptr;
+#endif
+    wgpu::ShaderModule shader_module = m_device.createShaderModule(shader_module_desc);
+
+    wgpu::BindGroupLayoutDescriptor bind_group_layout_desc = {};
+    bind_group_layout_desc.label = "Impostor bake bind group layout";
+    bind_group_layout_desc.entryCount = wgsl::impostor_bake::group0::ENTRY_COUNT;
+    bind_group_layout_desc.entries = wgsl::impostor_bake::group0::ENTRIES;
+    m_bake_layout = m_cache.acquire(bind_group_layout_desc);
+
+    WGPUBindGroupLayout bind_group_layouts[1] = { m_bake_layout };
+    wgpu::PipelineLayoutDescriptor pipeline_layout_desc = {};
+    pipeline_layout_desc.label = "Impostor bake pipeline layout";
+    pipeline_layout_desc.bindGroupLayoutCount = 1;
+    pipeline_layout_desc.bindGroupLayouts = bind_group_layouts;
+    wgpu::PipelineLayout pipeline_layout = m_cache.acquire(pipeline_layout_desc);
+
+    wgpu::DepthStencilState depth_state = {};
+    depth_state.format = BAKE_DEPTH_FORMAT;
+    depth_state.depthWriteEnabled = true;
+    depth_state.depthCompare = wgpu::CompareFunction::Less;
+    depth_state.stencilFront.compare = wgpu::CompareFunction::Always;
+    depth_state.stencilBack.compare = wgpu::CompareFunction::Always;
+    depth_state.stencilReadMask = 0;
+    depth_state.stencilWriteMask = 0;
+    depth_state.depthBias = 0;
+    depth_state.depthBiasSlopeScale = 0.0f;
+    depth_state.depthBiasClamp = 0.0f;
+
+    wgpu::ColorTargetState color_targets[2] = {};
+    color_targets[0].format = COLOR_FORMAT;
+    color_targets[0].blend = nullptr;
+    color_targets[0].writeMask = wgpu::ColorWriteMask::All;
+    color_targets[1].format = NORMAL_DEPTH_FORMAT;
+    color_targets[1].blend = nullptr;
+    color_targets[1].writeMask = wgpu::ColorWriteMask::All;
+
+    wgpu::FragmentState frag_state = {};
+    frag_state.module = shader_module;
+    frag_state.entryPoint = wgsl::impostor_bake::fs_main::ENTRY_POINT;
+    frag_state.targetCount = 2;
+    frag_state.targets = color_targets;
+
+    wgpu::RenderPipelineDescriptor pipeline_desc = {};
+    pipeline_desc.label = "Impostor bake pipeline";
+    pipeline_desc.layout = pipeline_layout;
+    pipeline_desc.vertex.module = shader_module;
+    pipeline_desc.vertex.entryPoint = wgsl::impostor_bake::vs_main::ENTRY_POINT;
+    pipeline_desc.vertex.bufferCount = wgsl::impostor_bake::vs_main::BUFFER_COUNT;
+    pipeline_desc.vertex.buffers = wgsl::impostor_bake::vs_main::BUFFERS;
+    pipeline_desc.vertex.constantCount = 0;
+    pipeline_desc.vertex.constants = nullptr;
+    pipeline_desc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+    pipeline_desc.primitive.stripIndexFormat = wgpu::IndexFormat::Undefined;
+    pipeline_desc.primitive.frontFace = wgpu::FrontFace::CCW;
+    // seen from every side, as the model pipeline draws it
+    pipeline_desc.primitive.cullMode = wgpu::CullMode::None;
+    pipeline_desc.depthStencil = &depth_state;
+    pipeline_desc.fragment = &frag_state;
+    pipeline_desc.multisample.count = 1;
+    pipeline_desc.multisample.mask = ~0u;
+    pipeline_desc.multisample.alphaToCoverageEnabled = false;
+    m_bake_pipeline = m_device.createRenderPipeline(pipeline_desc);
+
+    m_cache.release(pipeline_layout);
+    shader_module.release();
+
+    wgpu::SamplerDescriptor sampler_desc = {};
+    sampler_desc.label = "Impostor sampler";
+    sampler_desc.addressModeU = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.addressModeV = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.addressModeW = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.magFilter = wgpu::FilterMode::Linear;
+    sampler_desc.minFilter = wgpu::FilterMode::Linear;
+    sampler_desc.mipmapFilter = wgpu::MipmapFilterMode::Nearest;
+    sampler_desc.lodMinClamp = 0.0f;
+    sampler_desc.lodMaxClamp = 1.0f;
+    sampler_desc.compare = wgpu::CompareFunction::Undefined;
+    sampler_desc.maxAnisotropy = 1;
+    m_sampler = m_cache.acquire(sampler_desc);
+
+    wgpu::BufferDescriptor buffer_desc = {};
+    buffer_desc.label = "Impostor bake params";
+    buffer_desc.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
+    buffer_desc.size = sizeof(BakeParams);
+    m_bake_params = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Uniform);
+    buffer_desc.label = "Impostor params";
+    buffer_desc.size = sizeof(GpuImpostorParams);
+    m_params = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Uniform);
+
+    m_params_data.frames_per_side = m_config.frames_per_side;
+    m_params_data.frame_size = m_config.frame_size;
+    if (m_params) m_device.getQueue().writeBuffer(m_params, 0, &m_params_data, sizeof(m_params_data));
+
+    createAtlas(m_config.initial_layers);
+}
+
+ImpostorAtlas::~ImpostorAtlas() {
+    if (m_color_view) m_color_view.release();
+    if (m_normal_depth_view) m_normal_depth_view.release();
+    if (m_color) m_memory.release(m_color);
+    if (m_normal_depth) m_memory.release(m_normal_depth);
+    for (wgpu::Buffer *p_buffer : { &m_bake_params, &m_params }) {
+        if (*p_buffer) m_memory.release(*p_buffer);
+    }
+    if (m_sampler) m_cache.release(m_sampler);
+    m_bake_pipeline.release();
+    m_cache.release(m_bake_layout);
+}
+
+bool ImpostorAtlas::createAtlas(uint32_t capacity) {
+    uint32_t size = m_config.frames_per_side * m_config.frame_size;
+    wgpu::TextureDescriptor desc = {};
+    desc.label = "Impostor color atlas";
+    // CopySrc so growing can carry the layers over
+    desc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding
+        | wgpu::TextureUsage::CopySrc | wgpu::TextureUsage::CopyDst;
+    desc.dimension = wgpu::TextureDimension::_2D;
+    desc.size = { size, size, capacity };
+    desc.format = COLOR_FORMAT;
+    desc.mipLevelCount = 1;
+    desc.sampleCount = 1;
+    desc.viewFormatCount = 0;
+    desc.viewFormats = nullptr;
+    wgpu::Texture color = m_memory.createTexture(desc, GpuMemoryCategory::Texture);
+    if (!color) return false;
+    desc.label = "Impostor normal and depth atlas";
+    desc.format = NORMAL_DEPTH_FORMAT;
+    wgpu::Texture normal_depth = m_memory.createTexture(desc, GpuMemoryCategory::Texture);
+    if (!normal_depth) {
+        m_memory.release(color);
+        return false;
+    }
+
+    if (m_color_view) m_color_view.release();
+    if (m_normal_depth_view) m_normal_depth_view.release();
+    if (m_color) m_memory.release(m_color);
+    if (m_normal_depth) m_memory.release(m_normal_depth);
+    m_color = color;
+    m_normal_depth = normal_depth;
+    m_color_view = createLayerView(m_color, "Impostor color atlas view", COLOR_FORMAT,
+        wgpu::TextureViewDimension::_2DArray, 0, capacity);
+    m_normal_depth_view = createLayerView(m_normal_depth, "Impostor normal and depth atlas view", NORMAL_DEPTH_FORMAT,
+        wgpu::TextureViewDimension::_2DArray, 0, capacity);
+    m_capacity = capacity;
+    m_binding_version++;
+    return true;
+}
+
+bool ImpostorAtlas::growAtlas(wgpu::Queue queue) {
+    TRACE_ZONE("ImpostorAtlas::growAtlas");
+    if (m_capacity >= m_config.max_layers) return false;
+    wgpu::Texture old_color = m_color;
+    wgpu::Texture old_normal_depth = m_normal_depth;
+    // keeps the old textures alive for the copy below
+    m_color = nullptr;
+    m_normal_depth = nullptr;
+    if (!createAtlas(std::min(m_capacity * 2, m_config.max_layers))) {
+        m_color = old_color;
+        m_normal_depth = old_normal_depth;
+        return false;
+    }
+
+    uint32_t size = m_config.frames_per_side * m_config.frame_size;
+    wgpu::CommandEncoderDescriptor encoder_desc = {};
+    encoder_desc.label = "Impostor atlas growth";
+    wgpu::CommandEncoder encoder = m_device.createCommandEncoder(encoder_desc);
+    for (auto [source_texture, destination_texture] : { std::pair { old_color, m_color }, std::pair { old_normal_depth, m_normal_depth } }) {
+        wgpu::ImageCopyTexture source = {};
+        source.texture = source_texture;
+        source.mipLevel = 0;
+        source.origin = { 0, 0, 0 };
+        source.aspect = wgpu::TextureAspect::All;
+        wgpu::ImageCopyTexture destination = source;
+        destination.texture = destination_texture;
+        encoder.copyTextureToTexture(source, destination, { size, size, m_layers });
+    }
+    wgpu::CommandBufferDescriptor command_desc = {};
+    wgpu::CommandBuffer commands = encoder.finish(command_desc);
+    queue.submit(commands);
+    commands.release();
+    encoder.release();
+
+    // destroying after the submit is fine, the copy keeps what it reads
+    m_memory.release(old_color);
+    m_memory.release(old_normal_depth);
+    return true;
+}
+
+Result<uint32_t, std::string> ImpostorAtlas::bake(wgpu::Queue queue, const ImpostorBakeSource& source) {
+    TRACE_ZONE("ImpostorAtlas::bake");
+    if (!ready() || !m_bake_pipeline) return Err { std::string("the impostor atlas could not be created") };
+    if (source.index_count == 0 || !source.vertices.buffer || !source.indices.buffer) {
+        return Err { std::string("nothing to bake") };
+    }
+    if (!source.albedo_array || !source.albedo_sampler) return Err { std::string("no albedo array to bind") };
+    if (!(source.radius > 0.0f)) return Err { std::string("empty bounds") };
+    if (m_layers == m_capacity && !growAtlas(queue)) return Err { std::string("the impostor atlas is full") };
+    uint32_t layer = m_layers;
+
+    BakeParams params {};
+    std::copy(std::begin(source.base_color), std::end(source.base_color), params.base_color);
+    std::copy(std::begin(source.center), std::end(source.center), params.center);
+    params.radius = source.radius;
+    params.frames_per_side = m_config.frames_per_side;
+    params.textured = source.albedo_layer != NO_TEXTURE;
+    params.albedo_layer = params.textured ? source.albedo_layer : 0;
+    queue.writeBuffer(m_bake_params, 0, &params, sizeof(params));
+
+    wgpu::BindGroupEntry entries[3] = {{}, {}, {}};
+    entries[0].binding = wgsl::impostor_bake::group0::BAKE;
+    entries[0].buffer = m_bake_params;
+    entries[0].offset = 0;
+    entries[0].size = sizeof(BakeParams);
+    entries[1].binding = wgsl::impostor_bake::group0::ALBEDO;
+    entries[1].textureView = source.albedo_array;
+    entries[2].binding = wgsl::impostor_bake::group0::ALBEDO_SAMPLER;
+    entries[2].sampler = source.albedo_sampler;
+    wgpu::BindGroupDescriptor bind_group_desc = {};
+    bind_group_desc.label = "Impostor bake bind group";
+    bind_group_desc.layout = m_bake_layout;
+    bind_group_desc.entryCount = 3;
+    bind_group_desc.entries = entries;
+    wgpu::BindGroup bind_group = m_cache.acquire(bind_group_desc);
+
+    uint32_t size = m_config.frames_per_side * m_config.frame_size;
+    wgpu::TextureDescriptor depth_desc = {};
+    depth_desc.label = "Impostor bake depth";
+    depth_desc.usage = wgpu::TextureUsage::RenderAttachment;
+    depth_desc.dimension = wgpu::TextureDimension::_2D;
+    depth_desc.size = { size, size, 1 };
+    depth_desc.format = BAKE_DEPTH_FORMAT;
+    depth_desc.mipLevelCount = 1;
+    depth_desc.sampleCount = 1;
+    depth_desc.viewFormatCount = 0;
+    depth_desc.viewFormats = nullptr;
+    wgpu::Texture depth = m_memory.createTexture(depth_desc, GpuMemoryCategory::RenderTarget);
+    if (!depth) {
+        m_cache.release(bind_group);
+        return Err { std::string("out of GPU memory for the bake depth") };
+    }
+    wgpu::TextureView depth_view = createLayerView(depth, "Impostor bake depth view", BAKE_DEPTH_FORMAT,
+        wgpu::TextureViewDimension::_2D, 0, 1);
+    wgpu::TextureView color_view = createLayerView(m_color, "Impostor bake color", COLOR_FORMAT,
+        wgpu::TextureViewDimension::_2D, layer, 1);
+    wgpu::TextureView normal_depth_view = createLayerView(m_normal_depth, "Impostor bake normal and depth",
+        NORMAL_DEPTH_FORMAT, wgpu::TextureViewDimension::_2D, layer, 1);
+
+    wgpu::CommandEncoderDescriptor encoder_desc = {};
+    encoder_desc.label = "Impostor bake";
+    wgpu::CommandEncoder encoder = m_device.createCommandEncoder(encoder_desc);
+
+    wgpu::RenderPassColorAttachment color_attachments[2] = {
+        clearedAttachment(color_view), clearedAttachment(normal_depth_view),
+    };
+    wgpu::RenderPassDepthStencilAttachment depth_attachment = {};
+    depth_attachment.view = depth_view;
+    depth_attachment.depthLoadOp = wgpu::LoadOp::Clear;
+    depth_attachment.depthStoreOp = wgpu::StoreOp::Discard;
+    depth_attachment.depthClearValue = 1.0f;
+    depth_attachment.depthReadOnly = false;
+    depth_attachment.stencilLoadOp = wgpu::LoadOp::Undefined;
+    depth_attachment.stencilStoreOp = wgpu::StoreOp::Undefined;
+    depth_attachment.stencilReadOnly = true;
+
+    wgpu::RenderPassDescriptor pass_desc = {};
+    pass_desc.label = "Impostor bake pass";
+    pass_desc.colorAttachmentCount = 2;
+    pass_desc.colorAttachments = color_attachments;
+    pass_desc.depthStencilAttachment = &depth_attachment;
+    pass_desc.timestampWrites = nullptr;
+
+    wgpu::RenderPassEncoder pass = encoder.beginRenderPass(pass_desc);
+    pass.setPipeline(m_bake_pipeline);
+    pass.setBindGroup(0, bind_group, 0, nullptr);
+    pass.setVertexBuffer(0, source.vertices.buffer, source.vertices.offset, source.vertices.size);
+    pass.setIndexBuffer(source.indices.buffer, source.index_format, source.indices.offset, source.indices.size);
+    // one tile per view, the shader reads the view from the instance index
+    uint32_t frames = m_config.frames_per_side * m_config.frames_per_side;
+    float frame_size = static_cast<float>(m_config.frame_size);
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        float x = static_cast<float>(frame % m_config.frames_per_side) * frame_size;
+        float y = static_cast<float>(frame / m_config.frames_per_side) * frame_size;
+        pass.setViewport(x, y, frame_size, frame_size, 0.0f, 1.0f);
+        pass.drawIndexed(source.index_count, 1, 0, 0, frame);
+    }
+    pass.end();
+    pass.release();
+
+    wgpu::CommandBufferDescriptor command_desc = {};
+    wgpu::CommandBuffer commands = encoder.finish(command_desc);
+    queue.submit(commands);
+    commands.release();
+    encoder.release();
+
+    color_view.release();
+    normal_depth_view.release();
+    depth_view.release();
+    m_memory.release(depth);
+    m_cache.release(bind_group);
+    m_layers++;
+    return Ok { layer };
+}
+
+void ImpostorAtlas::setFadeRange(wgpu::Queue queue, float fade_start, float fade_end) {
+    m_params_data.fade_start = std::max(fade_start, 0.0f);
+    m_params_data.fade_end = std::max(fade_end, m_params_data.fade_start);
+    if (m_params) queue.writeBuffer(m_params, 0, &m_params_data, sizeof(m_params_data));
+}
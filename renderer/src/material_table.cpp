@@ -0,0 +1,275 @@
+/*
+    material_table.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "material_table.h"
+#include "trace.hpp"
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+// bytes per texel of the formats sampled as texture_2d_array<f32>, 0 for the rest
+uint32_t texelSize(wgpu::TextureFormat format) {
+    switch (format) {
+        case wgpu::TextureFormat::R8Unorm: return 1;
+        case wgpu::TextureFormat::RG8Unorm: return 2;
+        case wgpu::TextureFormat::RGBA8Unorm:
+        case wgpu::TextureFormat::RGBA8UnormSrgb:
+        case wgpu::TextureFormat::BGRA8Unorm:
+        case wgpu::TextureFormat::BGRA8UnormSrgb: return 4;
+        case wgpu::TextureFormat::RGBA16Float: return 8;
+        default: return 0;
+    }
+}
+
+} // namespace
+
+MaterialTable::MaterialTable(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache,
+    MaterialTableConfig config):
+    m_device(device), m_memory(memory), m_cache(cache), m_config(config) {
+    m_config.max_layers = std::max(m_config.max_layers, 1u);
+    m_config.initial_layers = std::clamp(m_config.initial_layers, 1u, m_config.max_layers);
+    m_config.initial_materials = std::max(m_config.initial_materials, 1u);
+    m_config.initial_instances = std::max(m_config.initial_instances, 1u);
+
+    fitBuffer(m_materials_buffer, static_cast<uint64_t>(m_config.initial_materials) * sizeof(GpuMaterial), "Materials");
+    fitBuffer(m_instances_buffer, static_cast<uint64_t>(m_config.initial_instances) * sizeof(uint32_t), "Instance materials");
+
+    wgpu::TextureDescriptor placeholder_desc = {};
+    placeholder_desc.label = "Material placeholder";
+    placeholder_desc.usage = wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::CopyDst;
+    placeholder_desc.dimension = wgpu::TextureDimension::_2D;
+    placeholder_desc.size = { 1, 1, 1 };
+    placeholder_desc.format = wgpu::TextureFormat::RGBA8Unorm;
+    placeholder_desc.mipLevelCount = 1;
+    placeholder_desc.sampleCount = 1;
+    placeholder_desc.viewFormatCount = 0;
+    placeholder_desc.viewFormats = nullptr;
+    m_placeholder = m_memory.createTexture(placeholder_desc, GpuMemoryCategory::Texture);
+    if (m_placeholder) {
+        const uint8_t white[4] = { 255, 255, 255, 255 };
+        wgpu::ImageCopyTexture destination = {};
+        destination.texture = m_placeholder;
+        destination.mipLevel = 0;
+        destination.origin = { 0, 0, 0 };
+        destination.aspect = wgpu::TextureAspect::All;
+        wgpu::TextureDataLayout layout = {};
+        layout.offset = 0;
+        layout.bytesPerRow = 4;
+        layout.rowsPerImage = 1;
+        m_device.getQueue().writeTexture(destination, white, sizeof(white), layout, { 1, 1, 1 });
+
+        wgpu::TextureViewDescriptor view_desc = {};
+        view_desc.label = "Material placeholder view";
+        view_desc.format = placeholder_desc.format;
+        view_desc.dimension = wgpu::TextureViewDimension::_2DArray;
+        view_desc.baseMipLevel = 0;
+        view_desc.mipLevelCount = 1;
+        view_desc.baseArrayLayer = 0;
+        view_desc.arrayLayerCount = 1;
+        view_desc.aspect = wgpu::TextureAspect::All;
+        m_placeholder_view = m_placeholder.createView(view_desc);
+    }
+
+    wgpu::SamplerDescriptor sampler_desc = {};
+    sampler_desc.label = "Material sampler";
+    sampler_desc.addressModeU = wgpu::AddressMode::Repeat;
+    sampler_desc.addressModeV = wgpu::AddressMode::Repeat;
+    sampler_desc.addressModeW = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.magFilter = wgpu::FilterMode::Linear;
+    sampler_desc.minFilter = wgpu::FilterMode::Linear;
+    sampler_desc.mipmapFilter = wgpu::MipmapFilterMode::Linear;
+    sampler_desc.lodMinClamp = 0.0f;
+    sampler_desc.lodMaxClamp = 32.0f;
+    sampler_desc.compare = wgpu::CompareFunction::Undefined;
+    sampler_desc.maxAnisotropy = 1;
+    m_sampler = m_cache.acquire(sampler_desc);
+}
+
+MaterialTable::~MaterialTable() {
+    for (TextureArray& array : m_arrays) {
+        if (array.view) array.view.release();
+        if (array.texture) m_memory.release(array.texture);
+    }
+    if (m_placeholder_view) m_placeholder_view.release();
+    if (m_placeholder) m_memory.release(m_placeholder);
+    if (m_sampler) m_cache.release(m_sampler);
+    for (wgpu::Buffer *p_buffer : { &m_materials_buffer, &m_instances_buffer }) {
+        if (*p_buffer) m_memory.release(*p_buffer);
+    }
+}
+
+bool MaterialTable::createArray(TextureArray& array, uint32_t capacity) {
+    wgpu::TextureDescriptor desc = {};
+    desc.label = "Material texture array";
+    // CopySrc so growing can carry the layers over
+    desc.usage = wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::CopySrc;
+    desc.dimension = wgpu::TextureDimension::_2D;
+    desc.size = { array.width, array.height, capacity };
+    desc.format = array.format;
+    desc.mipLevelCount = 1;
+    desc.sampleCount = 1;
+    desc.viewFormatCount = 0;
+    desc.viewFormats = nullptr;
+    wgpu::Texture texture = m_memory.createTexture(desc, GpuMemoryCategory::Texture);
+    if (!texture) return false;
+
+    wgpu::TextureViewDescriptor view_desc = {};
+    view_desc.label = "Material texture array view";
+    view_desc.format = array.format;
+    view_desc.dimension = wgpu::TextureViewDimension::_2DArray;
+    view_desc.baseMipLevel = 0;
+    view_desc.mipLevelCount = 1;
+    view_desc.baseArrayLayer = 0;
+    view_desc.arrayLayerCount = capacity;
+    view_desc.aspect = wgpu::TextureAspect::All;
+    if (array.view) array.view.release();
+    if (array.texture) m_memory.release(array.texture);
+    array.texture = texture;
+    array.view = texture.createView(view_desc);
+    array.capacity = capacity;
+    m_binding_version++;
+    return true;
+}
+
+bool MaterialTable::growArray(wgpu::Queue queue, TextureArray& array) {
+    TRACE_ZONE("MaterialTable::growArray");
+    if (array.capacity >= m_config.max_layers) return false;
+    uint32_t capacity = std::min(array.capacity * 2, m_config.max_layers);
+    TextureArray grown = array;
+    grown.texture = nullptr;
+    grown.view = nullptr;
+    if (!createArray(grown, capacity)) return false;
+
+    wgpu::CommandEncoderDescriptor encoder_desc = {};
+    encoder_desc.label = "Material texture array growth";
+    wgpu::CommandEncoder encoder = m_device.createCommandEncoder(encoder_desc);
+    wgpu::ImageCopyTexture source = {};
+    source.texture = array.texture;
+    source.mipLevel = 0;
+    source.origin = { 0, 0, 0 };
+    source.aspect = wgpu::TextureAspect::All;
+    wgpu::ImageCopyTexture destination = source;
+    destination.texture = grown.texture;
+    encoder.copyTextureToTexture(source, destination, { array.width, array.height, array.layers });
+    wgpu::CommandBufferDescriptor command_desc = {};
+    wgpu::CommandBuffer commands = encoder.finish(command_desc);
+    queue.submit(commands);
+    commands.release();
+    encoder.release();
+
+    // destroying after the submit is fine, the copy keeps what it reads
+    if (array.view) array.view.release();
+    if (array.texture) m_memory.release(array.texture);
+    array = grown;
+    return true;
+}
+
+Result<uint32_t, std::string> MaterialTable::addTexture(wgpu::Queue queue, wgpu::TextureFormat format, uint32_t width,
+    uint32_t height, const void *p_pixels, uint32_t bytes_per_row) {
+    uint32_t texel_size = texelSize(format);
+    if (texel_size == 0) return Err { std::string("texture format cannot go into a material array") };
+    if (width == 0 || height == 0 || bytes_per_row < width * texel_size) return Err { std::string("bad texture size") };
+
+    // the first array of this format and size with room, or one that can grow
+    uint32_t slot = 0;
+    for (; slot < m_arrays.size(); slot++) {
+        TextureArray& array = m_arrays[slot];
+        if (array.format != format || array.width != width || array.height != height) continue;
+        if (array.layers < array.capacity || growArray(queue, array)) break;
+    }
+    if (slot == m_arrays.size()) {
+        if (m_arrays.size() >= MAX_TEXTURE_ARRAYS) {
+            return Err { std::string("every material texture array holds another format or size") };
+        }
+        TextureArray& array = m_arrays.emplace_back();
+        array.format = format;
+        array.width = width;
+        array.height = height;
+        if (!createArray(array, m_config.initial_layers)) {
+            m_arrays.pop_back();
+            return Err { std::string("out of GPU memory for a material texture array") };
+        }
+    }
+
+    TextureArray& array = m_arrays[slot];
+    uint32_t layer = array.layers++;
+    wgpu::ImageCopyTexture destination = {};
+    destination.texture = array.texture;
+    destination.mipLevel = 0;
+    destination.origin = { 0, 0, layer };
+    destination.aspect = wgpu::TextureAspect::All;
+    wgpu::TextureDataLayout layout = {};
+    layout.offset = 0;
+    layout.bytesPerRow = bytes_per_row;
+    layout.rowsPerImage = height;
+    queue.writeTexture(destination, p_pixels, static_cast<size_t>(bytes_per_row) * height, layout, { width, height, 1 });
+    return Ok { slot << LAYER_BITS | layer };
+}
+
+uint32_t MaterialTable::addMaterial(const GpuMaterial& material) {
+    uint32_t id = static_cast<uint32_t>(m_materials.size());
+    m_materials.push_back(material);
+    m_dirty_materials.add(id);
+    return id;
+}
+
+void MaterialTable::setMaterial(uint32_t material, const GpuMaterial& params) {
+    if (material >= m_materials.size()) return;
+    m_materials[material] = params;
+    m_dirty_materials.add(material);
+}
+
+void MaterialTable::setInstanceMaterial(uint32_t instance, uint32_t material) {
+    if (instance >= m_instance_materials.size()) m_instance_materials.resize(instance + 1, 0);
+    if (m_instance_materials[instance] == material) return;
+    m_instance_materials[instance] = material;
+    m_dirty_instances.add(instance);
+}
+
+bool MaterialTable::fitBuffer(wgpu::Buffer& buffer, uint64_t size, const char *label) {
+    if (buffer && buffer.getSize() >= size) return true;
+    wgpu::BufferDescriptor desc = {};
+    desc.label = label;
+    desc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
+    desc.size = buffer ? std::max(std::bit_ceil(size), buffer.getSize() * 2) : size;
+    wgpu::Buffer grown = m_memory.createBuffer(desc, GpuMemoryCategory::Storage);
+    if (!grown) return false;
+    if (buffer) m_memory.release(buffer);
+    buffer = grown;
+    m_binding_version++;
+    return true;
+}
+
+void MaterialTable::upload(wgpu::Queue queue) {
+    if (!ready()) return;
+    auto write = [&](wgpu::Buffer& buffer, Dirty& dirty, const void *p_data, size_t count, size_t stride, const char *label) {
+        if (dirty.first >= dirty.last) return;
+        uint64_t size = buffer.getSize();
+        if (!fitBuffer(buffer, count * stride, label)) return;
+        // a new buffer starts empty, everything goes up
+        if (buffer.getSize() != size) dirty = { 0, static_cast<uint32_t>(count) };
+        const auto *p_bytes = static_cast<const uint8_t*>(p_data);
+        queue.writeBuffer(buffer, dirty.first * stride, p_bytes + dirty.first * stride, (dirty.last - dirty.first) * stride);
+        dirty = {};
+    };
+    write(m_materials_buffer, m_dirty_materials, m_materials.data(), m_materials.size(), sizeof(GpuMaterial), "Materials");
+    write(m_instances_buffer, m_dirty_instances, m_instance_materials.data(), m_instance_materials.size(), sizeof(uint32_t),
+        "Instance materials");
+}
+
+wgpu::TextureView MaterialTable::arrayView(uint32_t slot) const {
+    return slot < m_arrays.size() && m_arrays[slot].view ? m_arrays[slot].view : m_placeholder_view;
+}
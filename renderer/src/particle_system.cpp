@@ -0,0 +1,429 @@
+/*
+    particle_system.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "particle_system.h"
+#include "mat4.hpp"
+#include "particle_draw.wgsl.h"
+#include "particles.wgsl.h"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+using GpuParticleFrame = wgsl::particles::Frame;
+using GpuParticle = wgsl::particles::Particle;
+using GpuSortStep = wgsl::particles::SortStep;
+using GpuIndirect = wgsl::particles::Indirect;
+
+// elements a workgroup sorts in workgroup memory, SORT_BLOCK in particles.wgsl
+inline static constexpr uint32_t SORT_BLOCK = 2 * ParticleSystem::WORKGROUP_SIZE;
+// the default minUniformBufferOffsetAlignment, between dynamic offsets
+inline static constexpr uint32_t STEP_STRIDE = 256;
+
+namespace {
+
+wgpu::ShaderModule createShader(wgpu::Device device, const char *source, const char *label) {
+    wgpu::ShaderModuleWGSLDescriptor shader_code_desc = {};
+    shader_code_desc.chain.next = nullptr;
+    shader_code_desc.chain.sType = wgpu::SType::ShaderModuleWGSLDescriptor;
+    shader_code_desc.code = source;
+    wgpu::ShaderModuleDescriptor shader_module_desc = {};
+    shader_module_desc.nextInChain = &shader_code_desc.chain;
+    shader_module_desc.label = label;
+#ifdef WEBGPU_BACKEND_WGPU
+    shader_module_desc.hintCount = 0;
+    shader_module_desc.hints = nullptr;
+#endif
+    return device.createShaderModule(shader_module_desc);
+}
+
+wgpu::BindGroupEntry bufferEntry(uint32_t binding, wgpu::Buffer buffer, uint64_t size) {
+    wgpu::BindGroupEntry entry = {};
+    entry.binding = binding;
+    entry.buffer = buffer;
+    entry.offset = 0;
+    entry.size = size;
+    return entry;
+}
+
+} // namespace
+
+ParticleSystem::ParticleSystem(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache,
+    const char *simulate_source, const char *draw_source, wgpu::TextureFormat color_format,
+    ParticleSystemConfig config):
+    m_device(device), m_memory(memory), m_cache(cache), m_config(config) {
+    static_assert(WORKGROUP_SIZE == wgsl::particles::cs_emit::WORKGROUP_SIZE[0]);
+    static_assert(WORKGROUP_SIZE == wgsl::particles::cs_simulate::WORKGROUP_SIZE[0]);
+    static_assert(WORKGROUP_SIZE == wgsl::particles::cs_sort_block::WORKGROUP_SIZE[0]);
+    static_assert(sizeof(GpuParticleFrame) == sizeof(wgsl::particle_draw::Frame));
+    static_assert(sizeof(GpuParticle) == sizeof(wgsl::particle_draw::Particle));
+    static_assert(sizeof(GpuSortStep) <= STEP_STRIDE);
+    // group 1 bindings are dense, ENTRIES is indexed by binding below
+    static_assert(wgsl::particles::group1::ARGS == 0 && wgsl::particles::group1::STEP == 1);
+    m_config.capacity = std::clamp(m_config.capacity, 1u, MAX_CAPACITY);
+    m_sort_capacity = SORT_BLOCK;
+    while (m_sort_capacity < m_config.capacity) m_sort_capacity <<= 1;
+
+    // the stages too wide for one block, in order: each stage's steps at
+    // least a block apart, then a merge of the rest
+    for (uint32_t k = SORT_BLOCK * 2; k <= m_sort_capacity; k <<= 1) {
+        for (uint32_t j = k / 2; j >= SORT_BLOCK; j >>= 1) {
+            uint32_t offset = static_cast<uint32_t>(m_sort_dispatches.size()) * STEP_STRIDE;
+            m_sort_dispatches.push_back({ SortKind::Step, k, j, offset });
+        }
+        uint32_t offset = static_cast<uint32_t>(m_sort_dispatches.size()) * STEP_STRIDE;
+        m_sort_dispatches.push_back({ SortKind::Merge, k, WORKGROUP_SIZE, offset });
+    }
+
+    const uint64_t capacity = m_config.capacity;
+    wgpu::BufferDescriptor buffer_desc = {};
+    buffer_desc.label = "Particle frame";
+    buffer_desc.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
+    buffer_desc.size = sizeof(GpuParticleFrame);
+    m_frame = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Uniform);
+    buffer_desc.label = "Particle sort steps";
+    buffer_desc.size = std::max<uint64_t>(m_sort_dispatches.size(), 1) * STEP_STRIDE;
+    m_steps = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Uniform);
+    buffer_desc.label = "Particles";
+    buffer_desc.usage = wgpu::BufferUsage::Storage;
+    buffer_desc.size = capacity * sizeof(GpuParticle);
+    m_particles = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    buffer_desc.label = "Dead particles";
+    buffer_desc.size = capacity * sizeof(uint32_t);
+    m_dead_list = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    buffer_desc.label = "Alive particles";
+    m_alive_lists[0] = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    m_alive_lists[1] = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    buffer_desc.label = "Particle sort keys";
+    buffer_desc.size = static_cast<uint64_t>(m_sort_capacity) * sizeof(float);
+    m_sort_keys = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    buffer_desc.label = "Particle sort values";
+    buffer_desc.size = static_cast<uint64_t>(m_sort_capacity) * sizeof(uint32_t);
+    m_sort_values = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    buffer_desc.label = "Particle counters";
+    buffer_desc.size = sizeof(wgsl::particles::Counters);
+    m_counters = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    buffer_desc.label = "Particle indirect arguments";
+    buffer_desc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::Indirect;
+    buffer_desc.size = sizeof(GpuIndirect);
+    m_args = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+    if (!m_frame || !m_steps || !m_particles || !m_dead_list || !m_alive_lists[0] || !m_alive_lists[1]
+        || !m_sort_keys || !m_sort_values || !m_counters || !m_args) return;
+
+    wgpu::BindGroupLayoutDescriptor bind_group_layout_desc = {};
+    bind_group_layout_desc.label = "Particle bind group layout";
+    bind_group_layout_desc.entryCount = wgsl::particles::group0::ENTRY_COUNT;
+    bind_group_layout_desc.entries = wgsl::particles::group0::ENTRIES;
+    m_layout = m_cache.acquire(bind_group_layout_desc);
+    // group 1 is either the arguments or a sorting step, never both: a
+    // dispatch may not read the arguments it can write
+    bind_group_layout_desc.label = "Particle arguments bind group layout";
+    bind_group_layout_desc.entryCount = 1;
+    bind_group_layout_desc.entries = &wgsl::particles::group1::ENTRIES[wgsl::particles::group1::ARGS];
+    m_args_layout = m_cache.acquire(bind_group_layout_desc);
+    WGPUBindGroupLayoutEntry step_entry = wgsl::particles::group1::ENTRIES[wgsl::particles::group1::STEP];
+    step_entry.buffer.hasDynamicOffset = true;
+    bind_group_layout_desc.label = "Particle sort step bind group layout";
+    bind_group_layout_desc.entries = &step_entry;
+    m_step_layout = m_cache.acquire(bind_group_layout_desc);
+    bind_group_layout_desc.label = "Particle draw bind group layout";
+    bind_group_layout_desc.entryCount = wgsl::particle_draw::group0::ENTRY_COUNT;
+    bind_group_layout_desc.entries = wgsl::particle_draw::group0::ENTRIES;
+    m_draw_layout = m_cache.acquire(bind_group_layout_desc);
+
+    WGPUBindGroupLayout bind_group_layouts[2] = { m_layout, m_args_layout };
+    wgpu::PipelineLayoutDescriptor pipeline_layout_desc = {};
+    pipeline_layout_desc.label = "Particle pipeline layout";
+    pipeline_layout_desc.bindGroupLayoutCount = 1;
+    pipeline_layout_desc.bindGroupLayouts = bind_group_layouts;
+    wgpu::PipelineLayout pipeline_layout = m_cache.acquire(pipeline_layout_desc);
+    pipeline_layout_desc.label = "Particle arguments pipeline layout";
+    pipeline_layout_desc.bindGroupLayoutCount = 2;
+    wgpu::PipelineLayout args_pipeline_layout = m_cache.acquire(pipeline_layout_desc);
+    bind_group_layouts[1] = m_step_layout;
+    pipeline_layout_desc.label = "Particle sort pipeline layout";
+    wgpu::PipelineLayout step_pipeline_layout = m_cache.acquire(pipeline_layout_desc);
+
+    wgpu::ShaderModule shader_module = createShader(m_device, simulate_source, "Particle simulation shader");
+    wgpu::ComputePipelineDescriptor pipeline_desc = {};
+    pipeline_desc.compute.module = shader_module;
+    pipeline_desc.compute.constantCount = 0;
+    pipeline_desc.compute.constants = nullptr;
+    auto createPipeline = [&](const char *label, wgpu::PipelineLayout layout, const char *entry_point) {
+        pipeline_desc.label = label;
+        pipeline_desc.layout = layout;
+        pipeline_desc.compute.entryPoint = entry_point;
+        return m_device.createComputePipeline(pipeline_desc);
+    };
+    m_init_pipeline = createPipeline("Particle init pipeline", pipeline_layout, wgsl::particles::cs_init::ENTRY_POINT);
+    m_begin_pipeline = createPipeline("Particle begin pipeline", args_pipeline_layout, wgsl::particles::cs_begin::ENTRY_POINT);
+    m_emit_pipeline = createPipeline("Particle emit pipeline", pipeline_layout, wgsl::particles::cs_emit::ENTRY_POINT);
+    m_simulate_pipeline = createPipeline("Particle simulate pipeline", pipeline_layout, wgsl::particles::cs_simulate::ENTRY_POINT);
+    m_finish_pipeline = createPipeline("Particle finish pipeline", args_pipeline_layout, wgsl::particles::cs_finish::ENTRY_POINT);
+    m_sort_keys_pipeline = createPipeline("Particle sort keys pipeline", pipeline_layout, wgsl::particles::cs_sort_keys::ENTRY_POINT);
+    m_sort_block_pipeline = createPipeline("Particle sort block pipeline", pipeline_layout, wgsl::particles::cs_sort_block::ENTRY_POINT);
+    m_sort_merge_pipeline = createPipeline("Particle sort merge pipeline", step_pipeline_layout, wgsl::particles::cs_sort_merge::ENTRY_POINT);
+    m_sort_step_pipeline = createPipeline("Particle sort step pipeline", step_pipeline_layout, wgsl::particles::cs_sort_step::ENTRY_POINT);
+    m_cache.release(pipeline_layout);
+    m_cache.release(args_pipeline_layout);
+    m_cache.release(step_pipeline_layout);
+    shader_module.release();
+
+    WGPUBindGroupLayout draw_bind_group_layouts[1] = { m_draw_layout };
+    pipeline_layout_desc.label = "Particle draw pipeline layout";
+    pipeline_layout_desc.bindGroupLayoutCount = 1;
+    pipeline_layout_desc.bindGroupLayouts = draw_bind_group_layouts;
+    wgpu::PipelineLayout draw_pipeline_layout = m_cache.acquire(pipeline_layout_desc);
+    shader_module = createShader(m_device, draw_source, "Particle draw shader");
+
+    wgpu::RenderPipelineDescriptor draw_pipeline_desc = {};
+    draw_pipeline_desc.label = "Particle draw pipeline";
+    draw_pipeline_desc.layout = draw_pipeline_layout;
+    draw_pipeline_desc.vertex.module = shader_module;
+    draw_pipeline_desc.vertex.entryPoint = wgsl::particle_draw::vs_main::ENTRY_POINT;
+    draw_pipeline_desc.vertex.bufferCount = wgsl::particle_draw::vs_main::BUFFER_COUNT;
+    draw_pipeline_desc.vertex.buffers = nullptr;
+    draw_pipeline_desc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+    draw_pipeline_desc.primitive.stripIndexFormat = wgpu::IndexFormat::Undefined;
+    draw_pipeline_desc.primitive.frontFace = wgpu::FrontFace::CCW;
+    draw_pipeline_desc.primitive.cullMode = wgpu::CullMode::None;
+
+    // fs_main outputs premultiplied color, added up or blended over
+    wgpu::BlendState blend = {};
+    blend.color.srcFactor = wgpu::BlendFactor::One;
+    blend.color.dstFactor = sorted() ? wgpu::BlendFactor::OneMinusSrcAlpha : wgpu::BlendFactor::One;
+    blend.color.operation = wgpu::BlendOperation::Add;
+    // destination alpha is left alone
+    blend.alpha.srcFactor = wgpu::BlendFactor::Zero;
+    blend.alpha.dstFactor = wgpu::BlendFactor::One;
+    blend.alpha.operation = wgpu::BlendOperation::Add;
+
+    wgpu::ColorTargetState color_target_state = {};
+    color_target_state.format = color_format;
+    color_target_state.blend = &blend;
+    color_target_state.writeMask = wgpu::ColorWriteMask::All;
+
+    wgpu::FragmentState frag_state = {};
+    frag_state.module = shader_module;
+    frag_state.entryPoint = wgsl::particle_draw::fs_main::ENTRY_POINT;
+    frag_state.targetCount = 1;
+    frag_state.targets = &color_target_state;
+    draw_pipeline_desc.fragment = &frag_state;
+    draw_pipeline_desc.depthStencil = nullptr;
+    draw_pipeline_desc.multisample.count = 1;
+    draw_pipeline_desc.multisample.mask = ~0u;
+    draw_pipeline_desc.multisample.alphaToCoverageEnabled = false;
+    m_draw_pipeline = m_device.createRenderPipeline(draw_pipeline_desc);
+    m_cache.release(draw_pipeline_layout);
+    shader_module.release();
+
+    wgpu::BindGroupDescriptor bind_group_desc = {};
+    for (uint32_t parity = 0; parity < 2; parity++) {
+        wgpu::BindGroupEntry bindings[8] = {
+            bufferEntry(wgsl::particles::group0::FRAME, m_frame, sizeof(GpuParticleFrame)),
+            bufferEntry(wgsl::particles::group0::PARTICLES, m_particles, m_particles.getSize()),
+            bufferEntry(wgsl::particles::group0::DEAD_LIST, m_dead_list, m_dead_list.getSize()),
+            bufferEntry(wgsl::particles::group0::ALIVE_LIST, m_alive_lists[parity], m_alive_lists[parity].getSize()),
+            bufferEntry(wgsl::particles::group0::NEXT_ALIVE_LIST, m_alive_lists[parity ^ 1], m_alive_lists[parity ^ 1].getSize()),
+            bufferEntry(wgsl::particles::group0::COUNTERS, m_counters, m_counters.getSize()),
+            bufferEntry(wgsl::particles::group0::SORT_KEYS, m_sort_keys, m_sort_keys.getSize()),
+            bufferEntry(wgsl::particles::group0::SORT_VALUES, m_sort_values, m_sort_values.getSize()),
+        };
+        static_assert(wgsl::particles::group0::ENTRY_COUNT == 8);
+        bind_group_desc.label = "Particle bind group";
+        bind_group_desc.layout = m_layout;
+        bind_group_desc.entryCount = 8;
+        bind_group_desc.entries = bindings;
+        m_bind_groups[parity] = m_cache.acquire(bind_group_desc);
+    }
+
+    wgpu::BindGroupEntry args_binding = bufferEntry(wgsl::particles::group1::ARGS, m_args, sizeof(GpuIndirect));
+    bind_group_desc.label = "Particle arguments bind group";
+    bind_group_desc.layout = m_args_layout;
+    bind_group_desc.entryCount = 1;
+    bind_group_desc.entries = &args_binding;
+    m_args_bind_group = m_cache.acquire(bind_group_desc);
+    wgpu::BindGroupEntry step_binding = bufferEntry(wgsl::particles::group1::STEP, m_steps, sizeof(GpuSortStep));
+    bind_group_desc.label = "Particle sort step bind group";
+    bind_group_desc.layout = m_step_layout;
+    bind_group_desc.entries = &step_binding;
+    m_step_bind_group = m_cache.acquire(bind_group_desc);
+
+    // the next alive list of either parity, then the sorted one
+    const wgpu::Buffer draw_lists[3] = { m_alive_lists[1], m_alive_lists[0], m_sort_values };
+    for (uint32_t i = 0; i < 3; i++) {
+        wgpu::BindGroupEntry bindings[3] = {
+            bufferEntry(wgsl::particle_draw::group0::FRAME, m_frame, sizeof(GpuParticleFrame)),
+            bufferEntry(wgsl::particle_draw::group0::PARTICLES, m_particles, m_particles.getSize()),
+            bufferEntry(wgsl::particle_draw::group0::DRAW_LIST, draw_lists[i], draw_lists[i].getSize()),
+        };
+        static_assert(wgsl::particle_draw::group0::ENTRY_COUNT == 3);
+        bind_group_desc.label = "Particle draw bind group";
+        bind_group_desc.layout = m_draw_layout;
+        bind_group_desc.entryCount = 3;
+        bind_group_desc.entries = bindings;
+        m_draw_bind_groups[i] = m_cache.acquire(bind_group_desc);
+    }
+
+    m_stats.capacity = m_config.capacity;
+}
+
+ParticleSystem::~ParticleSystem() {
+    for (wgpu::BindGroup *p_bind_group : { &m_bind_groups[0], &m_bind_groups[1], &m_args_bind_group, &m_step_bind_group,
+        &m_draw_bind_groups[0], &m_draw_bind_groups[1], &m_draw_bind_groups[2] }) {
+        if (*p_bind_group) m_cache.release(*p_bind_group);
+    }
+    for (wgpu::ComputePipeline *p_pipeline : { &m_init_pipeline, &m_begin_pipeline, &m_emit_pipeline, &m_simulate_pipeline,
+        &m_finish_pipeline, &m_sort_keys_pipeline, &m_sort_block_pipeline, &m_sort_merge_pipeline, &m_sort_step_pipeline }) {
+        if (*p_pipeline) p_pipeline->release();
+    }
+    if (m_draw_pipeline) m_draw_pipeline.release();
+    for (wgpu::BindGroupLayout *p_layout : { &m_layout, &m_args_layout, &m_step_layout, &m_draw_layout }) {
+        if (*p_layout) m_cache.release(*p_layout);
+    }
+    for (wgpu::Buffer *p_buffer : { &m_frame, &m_particles, &m_dead_list, &m_alive_lists[0], &m_alive_lists[1],
+        &m_counters, &m_sort_keys, &m_sort_values, &m_args, &m_steps }) {
+        if (*p_buffer) m_memory.release(*p_buffer);
+    }
+}
+
+void ParticleSystem::update(wgpu::Queue queue, wgpu::CommandEncoder encoder, const ParticleEmitter& emitter, float dt,
+    const ClusterView& view) {
+    TRACE_ZONE("ParticleSystem::update");
+    m_stats.emitted = 0;
+    m_stats.sort_dispatches = 0;
+    if (!ready()) return;
+    dt = std::max(dt, 0.0f);
+
+    if (!m_initialized) {
+        // never changes, written with the first frame
+        std::vector<uint8_t> steps(m_steps.getSize());
+        for (const SortDispatch& dispatch : m_sort_dispatches) {
+            GpuSortStep step = { dispatch.k, dispatch.j };
+            std::memcpy(&steps[dispatch.offset], &step, sizeof(step));
+        }
+        queue.writeBuffer(m_steps, 0, steps.data(), steps.size());
+    }
+
+    m_emit_carry += std::max(emitter.rate, 0.0f) * dt;
+    float emit_count = std::min(std::floor(m_emit_carry), static_cast<float>(m_config.capacity));
+    m_emit_carry = std::min(m_emit_carry - emit_count, 1.0f);
+
+    GpuParticleFrame frame = {};
+    mat4Multiply(view.projection, view.view, &frame.view_proj[0][0]);
+    for (int i = 0; i < 3; i++) {
+        // rows of the view rotation, and the eye by its inverse
+        frame.camera_right[i] = view.view[i * 4];
+        frame.camera_up[i] = view.view[i * 4 + 1];
+        frame.camera_position[i] = -(view.view[i * 4] * view.view[12] + view.view[i * 4 + 1] * view.view[13]
+            + view.view[i * 4 + 2] * view.view[14]);
+    }
+    frame.capacity = m_config.capacity;
+    std::copy_n(emitter.position, 3, frame.position);
+    frame.emit_count = static_cast<uint32_t>(emit_count);
+    float length = std::sqrt(emitter.direction[0] * emitter.direction[0] + emitter.direction[1] * emitter.direction[1]
+        + emitter.direction[2] * emitter.direction[2]);
+    for (int i = 0; i < 3; i++) frame.direction[i] = length > 0.0f ? emitter.direction[i] / length : (i == 1 ? 1.0f : 0.0f);
+    frame.spread_cos = std::cos(std::clamp(emitter.spread, 0.0f, 3.14159265f));
+    std::copy_n(emitter.gravity, 3, frame.gravity);
+    frame.drag = std::max(emitter.drag, 0.0f);
+    frame.speed[0] = emitter.speed_min;
+    frame.speed[1] = std::max(emitter.speed_max, emitter.speed_min);
+    frame.lifetime[0] = std::max(emitter.lifetime_min, 1e-3f);
+    frame.lifetime[1] = std::max(emitter.lifetime_max, frame.lifetime[0]);
+    frame.size[0] = emitter.size_start;
+    frame.size[1] = emitter.size_end;
+    frame.dt = dt;
+    frame.seed = m_seed++ * 0x9e3779b9u;
+    std::copy_n(emitter.color_start, 4, frame.color_start);
+    std::copy_n(emitter.color_end, 4, frame.color_end);
+    queue.writeBuffer(m_frame, 0, &frame, sizeof(frame));
+
+    wgpu::ComputePassDescriptor pass_desc = {};
+    pass_desc.timestampWrites = nullptr;
+    wgpu::BindGroup bind_group = m_bind_groups[m_parity];
+    const uint32_t capacity_groups = (m_config.capacity + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+
+    // a dispatch cannot read the arguments it may write, so the passes
+    // split wherever the next dispatch reads what the last one wrote
+    pass_desc.label = "Particle begin pass";
+    wgpu::ComputePassEncoder pass = encoder.beginComputePass(pass_desc);
+    pass.setBindGroup(0, bind_group, 0, nullptr);
+    if (!m_initialized) {
+        pass.setPipeline(m_init_pipeline);
+        pass.dispatchWorkgroups(capacity_groups, 1, 1);
+        m_initialized = true;
+    }
+    pass.setBindGroup(1, m_args_bind_group, 0, nullptr);
+    pass.setPipeline(m_begin_pipeline);
+    pass.dispatchWorkgroups(1, 1, 1);
+    pass.end();
+    pass.release();
+
+    pass_desc.label = "Particle simulation pass";
+    pass = encoder.beginComputePass(pass_desc);
+    pass.setBindGroup(0, bind_group, 0, nullptr);
+    pass.setPipeline(m_emit_pipeline);
+    pass.dispatchWorkgroupsIndirect(m_args, offsetof(GpuIndirect, emit));
+    pass.setPipeline(m_simulate_pipeline);
+    pass.dispatchWorkgroupsIndirect(m_args, offsetof(GpuIndirect, simulate));
+    pass.end();
+    pass.release();
+
+    pass_desc.label = "Particle finish pass";
+    pass = encoder.beginComputePass(pass_desc);
+    pass.setBindGroup(0, bind_group, 0, nullptr);
+    pass.setBindGroup(1, m_args_bind_group, 0, nullptr);
+    pass.setPipeline(m_finish_pipeline);
+    pass.dispatchWorkgroups(1, 1, 1);
+    pass.end();
+    pass.release();
+
+    if (sorted()) encodeSort(encoder);
+    m_draw_bind_group = sorted() ? 2 : m_parity;
+    m_parity ^= 1;
+    m_stats.emitted = frame.emit_count;
+    TRACE_COUNTER("particles emitted", frame.emit_count);
+}
+
+void ParticleSystem::encodeSort(wgpu::CommandEncoder encoder) {
+    wgpu::ComputePassDescriptor pass_desc = {};
+    pass_desc.label = "Particle sort pass";
+    pass_desc.timestampWrites = nullptr;
+    wgpu::ComputePassEncoder pass = encoder.beginComputePass(pass_desc);
+    pass.setBindGroup(0, m_bind_groups[m_parity], 0, nullptr);
+    pass.setPipeline(m_sort_keys_pipeline);
+    pass.dispatchWorkgroupsIndirect(m_args, offsetof(GpuIndirect, sort));
+    pass.setPipeline(m_sort_block_pipeline);
+    pass.dispatchWorkgroupsIndirect(m_args, offsetof(GpuIndirect, sort));
+    // every stage of the largest sort, the ones past this frame's size
+    // leave its entries where they are
+    for (const SortDispatch& dispatch : m_sort_dispatches) {
+        pass.setPipeline(dispatch.kind == SortKind::Step ? m_sort_step_pipeline : m_sort_merge_pipeline);
+        pass.setBindGroup(1, m_step_bind_group, 1, &dispatch.offset);
+        pass.dispatchWorkgroupsIndirect(m_args, offsetof(GpuIndirect, sort));
+    }
+    pass.end();
+    pass.release();
+    m_stats.sort_dispatches = static_cast<uint32_t>(m_sort_dispatches.size()) + 2;
+}
+
+void ParticleSystem::draw(wgpu::RenderPassEncoder pass) const {
+    if (!ready() || !m_initialized) return;
+    pass.setPipeline(m_draw_pipeline);
+    pass.setBindGroup(0, m_draw_bind_groups[m_draw_bind_group], 0, nullptr);
+    pass.drawIndirect(m_args, offsetof(GpuIndirect, draw));
+}
@@ -0,0 +1,551 @@
+/*
+    shadow_atlas.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "shadow_atlas.h"
+#include "mat4.hpp"
+#include "shadow.wgsl.h"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using GpuShadowView = wgsl::shadow::ShadowView;
+
+// minUniformBufferOffsetAlignment, every view has its own uniform slot
+inline static constexpr uint32_t UNIFORM_STRIDE = 256;
+inline static constexpr uint32_t POINT_FACES = 6;
+inline static constexpr wgpu::TextureFormat ATLAS_FORMAT = wgpu::TextureFormat::Depth32Float;
+
+static_assert(sizeof(GpuShadowView) <= UNIFORM_STRIDE);
+
+ShadowAtlas::TileAllocator::TileAllocator(uint32_t size, uint32_t min_tile):
+    m_size(size), m_min_tile(min_tile) {
+    m_free.resize(level(min_tile) + 1);
+    m_free[0].insert(key(0, 0));
+}
+
+uint32_t ShadowAtlas::TileAllocator::level(uint32_t size) const {
+    uint32_t l = 0;
+    for (uint32_t s = m_size; s > size; s >>= 1) l++;
+    return l;
+}
+
+uint32_t ShadowAtlas::TileAllocator::key(uint32_t x, uint32_t y) const {
+    return ((x / m_min_tile) << 16) | (y / m_min_tile);
+}
+
+bool ShadowAtlas::TileAllocator::allocate(uint32_t size, Tile& tile) {
+    const uint32_t target = level(size);
+    if (target >= m_free.size()) return false;
+    // smallest free block that fits, split down to the size asked for
+    int32_t l = static_cast<int32_t>(target);
+    while (l >= 0 && m_free[l].empty()) l--;
+    if (l < 0) return false;
+
+    // lowest key first keeps tiles packed towards the corner
+    uint32_t block_key = *m_free[l].begin();
+    m_free[l].erase(m_free[l].begin());
+    uint32_t x = (block_key >> 16) * m_min_tile;
+    uint32_t y = (block_key & 0xffff) * m_min_tile;
+    uint32_t block = m_size >> l;
+    while (static_cast<uint32_t>(l) < target) {
+        block >>= 1;
+        l++;
+        m_free[l].insert(key(x + block, y));
+        m_free[l].insert(key(x, y + block));
+        m_free[l].insert(key(x + block, y + block));
+    }
+    tile = Tile { x, y, block };
+    return true;
+}
+
+void ShadowAtlas::TileAllocator::free(const Tile& tile) {
+    uint32_t x = tile.x, y = tile.y, size = tile.size;
+    uint32_t l = level(size);
+    // merge while all four quarters of the parent are free
+    while (l > 0) {
+        uint32_t parent = size * 2;
+        uint32_t px = x & ~(parent - 1);
+        uint32_t py = y & ~(parent - 1);
+        uint32_t quarters[4] = { key(px, py), key(px + size, py), key(px, py + size), key(px + size, py + size) };
+        uint32_t self = key(x, y);
+        bool mergeable = true;
+        for (uint32_t quarter : quarters) {
+            if (quarter != self && !m_free[l].count(quarter)) mergeable = false;
+        }
+        if (!mergeable) break;
+        for (uint32_t quarter : quarters) m_free[l].erase(quarter);
+        x = px;
+        y = py;
+        size = parent;
+        l--;
+    }
+    m_free[l].insert(key(x, y));
+}
+
+bool ShadowAtlas::LightKey::operator==(const LightKey& other) const {
+    return type == other.type && range == other.range && outer_cone_cos == other.outer_cone_cos
+        && std::equal(position, position + 3, other.position) && std::equal(direction, direction + 3, other.direction);
+}
+
+ShadowAtlas::ShadowAtlas(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache,
+    const char *wgsl_source, ShadowAtlasConfig config):
+    m_device(device), m_memory(memory), m_cache(cache), m_config(config),
+    m_tiles(config.size, std::min(config.min_tile, config.size)) {
+    m_config.min_tile = std::min(m_config.min_tile, m_config.size);
+    m_config.max_tile = std::clamp(m_config.max_tile, m_config.min_tile, m_config.size);
+    m_config.max_views = std::max(m_config.max_views, POINT_FACES);
+    m_view_slots.resize(m_config.max_views);
+
+    wgpu::BufferDescriptor buffer_desc = {};
+    buffer_desc.label = "Shadow view uniforms";
+    buffer_desc.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
+    buffer_desc.size = static_cast<uint64_t>(m_config.max_views) * UNIFORM_STRIDE;
+    m_view_uniforms = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Uniform);
+    buffer_desc.label = "Shadow views";
+    buffer_desc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
+    buffer_desc.size = static_cast<uint64_t>(m_config.max_views) * sizeof(GpuShadowView);
+    m_views = m_memory.createBuffer(buffer_desc, GpuMemoryCategory::Storage);
+
+    wgpu::TextureDescriptor atlas_desc = {};
+    atlas_desc.label = "Shadow atlas";
+    atlas_desc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::CopyDst;
+    atlas_desc.dimension = wgpu::TextureDimension::_2D;
+    atlas_desc.size = { m_config.size, m_config.size, 1 };
+    atlas_desc.format = ATLAS_FORMAT;
+    atlas_desc.mipLevelCount = 1;
+    atlas_desc.sampleCount = 1;
+    atlas_desc.viewFormatCount = 0;
+    atlas_desc.viewFormats = nullptr;
+    m_atlas = m_memory.createTexture(atlas_desc, GpuMemoryCategory::RenderTarget);
+    atlas_desc.label = "Static shadow cache";
+    atlas_desc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::CopySrc;
+    m_static_atlas = m_memory.createTexture(atlas_desc, GpuMemoryCategory::RenderTarget);
+    if (!m_view_uniforms || !m_views || !m_atlas || !m_static_atlas) return;
+
+    wgpu::ShaderModuleWGSLDescriptor shader_code_desc = {};
+    shader_code_desc.chain.next = nullptr;
+    shader_code_desc.chain.sType = wgpu::SType::ShaderModuleWGSLDescriptor;
+    shader_code_desc.code = wgsl_source;
+    wgpu::ShaderModuleDescriptor shader_module_desc = {};
+    shader_module_desc.nextInChain = &shader_code_desc.chain;
+    shader_module_desc.label = "Shadow shader";
+#ifdef WEBGPU_BACKEND_WGPU
+    shader_module_desc.hintCount = 0;
+    shader_module_desc.hints = nullptr;
+#endif
+    wgpu::ShaderModule shader_module = m_device.createShaderModule(shader_module_desc);
+
+    wgpu::BindGroupLayoutDescriptor bind_group_layout_desc = {};
+    bind_group_layout_desc.label = "Shadow view bind group layout";
+    bind_group_layout_desc.entryCount = wgsl::shadow::group0::ENTRY_COUNT;
+    bind_group_layout_desc.entries = wgsl::shadow::group0::ENTRIES;
+    m_bind_group_layout = m_cache.acquire(bind_group_layout_desc);
+
+    WGPUBindGroupLayout bind_group_layouts[1] = { m_bind_group_layout };
+    wgpu::PipelineLayoutDescriptor pipeline_layout_desc = {};
+    pipeline_layout_desc.label = "Shadow pipeline layout";
+    pipeline_layout_desc.bindGroupLayoutCount = 1;
+    pipeline_layout_desc.bindGroupLayouts = bind_group_layouts;
+    wgpu::PipelineLayout pipeline_layout = m_cache.acquire(pipeline_layout_desc);
+
+    wgpu::DepthStencilState depth_state = {};
+    depth_state.format = ATLAS_FORMAT;
+    depth_state.depthWriteEnabled = true;
+    depth_state.depthCompare = wgpu::CompareFunction::Less;
+    depth_state.stencilFront.compare = wgpu::CompareFunction::Always;
+    depth_state.stencilBack.compare = wgpu::CompareFunction::Always;
+    depth_state.stencilReadMask = 0;
+    depth_state.stencilWriteMask = 0;
+    // slope-scaled, against acne on surfaces at grazing angles to the light
+    depth_state.depthBias = 2;
+    depth_state.depthBiasSlopeScale = 2.0f;
+    depth_state.depthBiasClamp = 0.0f;
+
+    // depth only, no fragment stage
+    wgpu::RenderPipelineDescriptor pipeline_desc = {};
+    pipeline_desc.label = "Shadow caster pipeline";
+    pipeline_desc.layout = pipeline_layout;
+    pipeline_desc.vertex.module = shader_module;
+    pipeline_desc.vertex.entryPoint = wgsl::shadow::vs_main::ENTRY_POINT;
+    pipeline_desc.vertex.bufferCount = wgsl::shadow::vs_main::BUFFER_COUNT;
+    pipeline_desc.vertex.buffers = wgsl::shadow::vs_main::BUFFERS;
+    pipeline_desc.vertex.constantCount = 0;
+    pipeline_desc.vertex.constants = nullptr;
+    pipeline_desc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+    pipeline_desc.primitive.stripIndexFormat = wgpu::IndexFormat::Undefined;
+    pipeline_desc.primitive.frontFace = wgpu::FrontFace::CCW;
+    pipeline_desc.primitive.cullMode = wgpu::CullMode::None;
+    pipeline_desc.depthStencil = &depth_state;
+    pipeline_desc.fragment = nullptr;
+    pipeline_desc.multisample.count = 1;
+    pipeline_desc.multisample.mask = ~0u;
+    pipeline_desc.multisample.alphaToCoverageEnabled = false;
+    m_caster_pipeline = m_device.createRenderPipeline(pipeline_desc);
+
+    wgpu::DepthStencilState clear_state = depth_state;
+    clear_state.depthCompare = wgpu::CompareFunction::Always;
+    clear_state.depthBias = 0;
+    clear_state.depthBiasSlopeScale = 0.0f;
+    pipeline_desc.label = "Shadow tile clear pipeline";
+    pipeline_desc.vertex.entryPoint = wgsl::shadow::vs_clear::ENTRY_POINT;
+    pipeline_desc.vertex.bufferCount = 0;
+    pipeline_desc.vertex.buffers = nullptr;
+    pipeline_desc.depthStencil = &clear_state;
+    m_clear_pipeline = m_device.createRenderPipeline(pipeline_desc);
+
+    m_cache.release(pipeline_layout);
+    shader_module.release();
+
+    m_view_bind_groups.resize(m_config.max_views, nullptr);
+    for (uint32_t i = 0; i < m_config.max_views; i++) {
+        wgpu::BindGroupEntry entry = {};
+        entry.binding = wgsl::shadow::group0::SHADOW_VIEW;
+        entry.buffer = m_view_uniforms;
+        entry.offset = static_cast<uint64_t>(i) * UNIFORM_STRIDE;
+        entry.size = sizeof(GpuShadowView);
+        wgpu::BindGroupDescriptor bind_group_desc = {};
+        bind_group_desc.label = "Shadow view bind group";
+        bind_group_desc.layout = m_bind_group_layout;
+        bind_group_desc.entryCount = 1;
+        bind_group_desc.entries = &entry;
+        m_view_bind_groups[i] = m_cache.acquire(bind_group_desc);
+    }
+
+    wgpu::SamplerDescriptor sampler_desc = {};
+    sampler_desc.label = "Shadow sampler";
+    sampler_desc.addressModeU = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.addressModeV = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.addressModeW = wgpu::AddressMode::ClampToEdge;
+    sampler_desc.magFilter = wgpu::FilterMode::Linear;
+    sampler_desc.minFilter = wgpu::FilterMode::Linear;
+    sampler_desc.mipmapFilter = wgpu::MipmapFilterMode::Nearest;
+    sampler_desc.lodMinClamp = 0.0f;
+    sampler_desc.lodMaxClamp = 1.0f;
+    sampler_desc.compare = wgpu::CompareFunction::Less;
+    sampler_desc.maxAnisotropy = 1;
+    m_sampler = m_cache.acquire(sampler_desc);
+
+    wgpu::TextureViewDescriptor view_desc = {};
+    view_desc.label = "Static shadow cache view";
+    view_desc.format = ATLAS_FORMAT;
+    view_desc.dimension = wgpu::TextureViewDimension::_2D;
+    view_desc.baseMipLevel = 0;
+    view_desc.mipLevelCount = 1;
+    view_desc.baseArrayLayer = 0;
+    view_desc.arrayLayerCount = 1;
+    view_desc.aspect = wgpu::TextureAspect::All;
+    m_static_view = m_static_atlas.createView(view_desc);
+    view_desc.label = "Shadow atlas view";
+    m_atlas_view = m_atlas.createView(view_desc);
+}
+
+ShadowAtlas::~ShadowAtlas() {
+    for (wgpu::BindGroup& bind_group : m_view_bind_groups) {
+        if (bind_group) m_cache.release(bind_group);
+    }
+    if (m_sampler) m_cache.release(m_sampler);
+    if (m_caster_pipeline) m_caster_pipeline.release();
+    if (m_clear_pipeline) m_clear_pipeline.release();
+    if (m_bind_group_layout) m_cache.release(m_bind_group_layout);
+    if (m_atlas_view) m_atlas_view.release();
+    if (m_static_view) m_static_view.release();
+    for (wgpu::Texture *p_texture : { &m_atlas, &m_static_atlas }) {
+        if (*p_texture) m_memory.release(*p_texture);
+    }
+    for (wgpu::Buffer *p_buffer : { &m_view_uniforms, &m_views }) {
+        if (*p_buffer) m_memory.release(*p_buffer);
+    }
+}
+
+void ShadowAtlas::invalidateStatic() {
+    for (View& view : m_view_slots) {
+        if (view.live) view.static_dirty = true;
+    }
+}
+
+void ShadowAtlas::invalidateStatic(const float min[3], const float max[3]) {
+    for (const ShadowLight& light : m_lights) {
+        if (!light.view_count) continue;
+        // distance from the light to the closest point of the box
+        float distance_squared = 0.0f;
+        for (int axis = 0; axis < 3; axis++) {
+            float p = light.key.position[axis];
+            float d = std::max({ min[axis] - p, p - max[axis], 0.0f });
+            distance_squared += d * d;
+        }
+        if (distance_squared > light.key.range * light.key.range) continue;
+        for (uint32_t v = 0; v < light.view_count; v++) m_view_slots[light.first_view + v].static_dirty = true;
+    }
+}
+
+bool ShadowAtlas::staticDirty() const {
+    return std::any_of(m_view_slots.begin(), m_view_slots.end(), [](const View& view) { return view.live && view.static_dirty; });
+}
+
+uint32_t ShadowAtlas::desiredTileSize(const Light& light, const ClusterView& camera, const float eye[3]) const {
+    if (!light.cast_shadows || light.range <= 0.0f) return 0;
+    // a light sphere entirely behind the camera cannot shadow anything visible
+    const float *p = light.position;
+    float view_z = camera.view[2] * p[0] + camera.view[6] * p[1] + camera.view[10] * p[2] + camera.view[14];
+    if (view_z > light.range) return 0;
+
+    // projected diameter of the light's sphere, the whole screen from inside it
+    float dx = p[0] - eye[0], dy = p[1] - eye[1], dz = p[2] - eye[2];
+    float distance = std::max(std::sqrt(dx * dx + dy * dy + dz * dz), light.range);
+    float pixels = light.range * camera.projection[5] * static_cast<float>(camera.height) / distance;
+
+    uint32_t size = m_config.min_tile;
+    while (size < m_config.max_tile && static_cast<float>(size) < pixels) size *= 2;
+    return size;
+}
+
+bool ShadowAtlas::allocateViews(uint32_t count, uint32_t tile_size, uint32_t& first_view) {
+    // point lights need their faces in consecutive views
+    uint32_t first = 0, run = 0;
+    for (uint32_t i = 0; i < m_view_slots.size() && run < count; i++) {
+        if (m_view_slots[i].live) {
+            run = 0;
+            first = i + 1;
+        } else {
+            run++;
+        }
+    }
+    if (run < count) return false;
+
+    for (uint32_t i = 0; i < count; i++) {
+        View& view = m_view_slots[first + i];
+        if (!m_tiles.allocate(tile_size, view.tile)) {
+            for (uint32_t j = 0; j < i; j++) m_tiles.free(m_view_slots[first + j].tile);
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        m_view_slots[first + i].live = true;
+        m_view_slots[first + i].static_dirty = true;
+    }
+    first_view = first;
+    return true;
+}
+
+void ShadowAtlas::freeViews(ShadowLight& light) {
+    for (uint32_t i = 0; i < light.view_count; i++) {
+        View& view = m_view_slots[light.first_view + i];
+        m_tiles.free(view.tile);
+        view = View {};
+    }
+    light.first_view = ClusteredLighting::NO_SHADOW;
+    light.view_count = 0;
+    light.tile_size = 0;
+}
+
+void ShadowAtlas::computeViews(const Light& light, const ShadowLight& shadow) {
+    const float near_plane = std::max(light.range * 0.01f, 0.01f);
+    float projection[16];
+    float view[16];
+    if (light.type == LightType::Spot) {
+        const float *d = light.direction;
+        float target[3] = { light.position[0] + d[0], light.position[1] + d[1], light.position[2] + d[2] };
+        float length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        bool vertical = length > 0.0f && std::fabs(d[1] / length) > 0.99f;
+        const float up[3] = { vertical ? 1.0f : 0.0f, vertical ? 0.0f : 1.0f, 0.0f };
+        float fov = 2.0f * std::acos(std::clamp(light.outer_cone_cos, -1.0f, 1.0f));
+        mat4Perspective(std::clamp(fov, 0.1f, 3.0f), 1.0f, near_plane, light.range, projection);
+        mat4LookAt(light.position, target, up, view);
+        mat4Multiply(projection, view, m_view_slots[shadow.first_view].view_proj);
+        return;
+    }
+
+    // +x -x +y -y +z -z, the order test.wgsl picks faces in
+    static const float FACES[POINT_FACES][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    static const float UPS[POINT_FACES][3] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 0, 0, 1 }, { 0, 1, 0 }, { 0, 1, 0 } };
+    mat4Perspective(3.14159265f * 0.5f, 1.0f, near_plane, light.range, projection);
+    for (uint32_t face = 0; face < POINT_FACES; face++) {
+        float target[3] = {
+            light.position[0] + FACES[face][0], light.position[1] + FACES[face][1], light.position[2] + FACES[face][2],
+        };
+        mat4LookAt(light.position, target, UPS[face], view);
+        mat4Multiply(projection, view, m_view_slots[shadow.first_view + face].view_proj);
+    }
+}
+
+void ShadowAtlas::update(std::span<const Light> lights, const ClusterView& camera) {
+    TRACE_ZONE("ShadowAtlas::update");
+    const uint32_t static_renders = m_stats.static_renders;
+    m_stats = {};
+    m_stats.static_renders = static_renders;
+    if (!ready()) return;
+
+    for (size_t i = lights.size(); i < m_lights.size(); i++) freeViews(m_lights[i]);
+    m_lights.resize(lights.size());
+    m_light_views.assign(lights.size(), ClusteredLighting::NO_SHADOW);
+
+    // camera position, -R^T t of the view matrix
+    const float *v = camera.view;
+    const float eye[3] = {
+        -(v[0] * v[12] + v[1] * v[13] + v[2] * v[14]),
+        -(v[4] * v[12] + v[5] * v[13] + v[6] * v[14]),
+        -(v[8] * v[12] + v[9] * v[13] + v[10] * v[14]),
+    };
+
+    // most important first, so the large tiles go to the closest lights
+    std::vector<std::pair<uint32_t, uint32_t>> order;
+    for (uint32_t i = 0; i < lights.size(); i++) {
+        uint32_t desired = desiredTileSize(lights[i], camera, eye);
+        ShadowLight& shadow = m_lights[i];
+        uint32_t count = lights[i].type == LightType::Point ? POINT_FACES : 1;
+        // shrinking and dropped lights make room before anything grows
+        if (shadow.view_count && (desired < shadow.tile_size || shadow.view_count != count)) freeViews(shadow);
+        if (desired > 0) order.emplace_back(desired, i);
+    }
+    std::stable_sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    for (const auto& [desired, i] : order) {
+        const Light& light = lights[i];
+        ShadowLight& shadow = m_lights[i];
+        const uint32_t count = light.type == LightType::Point ? POINT_FACES : 1;
+        uint32_t first_view = 0;
+        bool moved = false;
+        if (shadow.view_count && desired > shadow.tile_size) {
+            // a growing light keeps its tiles until larger ones are found
+            if (allocateViews(count, desired, first_view)) {
+                freeViews(shadow);
+                shadow.first_view = first_view;
+                shadow.view_count = count;
+                shadow.tile_size = desired;
+                moved = true;
+            }
+        } else if (!shadow.view_count) {
+            for (uint32_t size = desired; size >= m_config.min_tile; size /= 2) {
+                if (allocateViews(count, size, first_view)) {
+                    shadow.first_view = first_view;
+                    shadow.view_count = count;
+                    shadow.tile_size = size;
+                    moved = true;
+                    break;
+                }
+            }
+        }
+        if (!shadow.view_count) {
+            m_stats.dropped++;
+            continue;
+        }
+
+        LightKey key;
+        key.type = light.type;
+        std::copy_n(light.position, 3, key.position);
+        std::copy_n(light.direction, 3, key.direction);
+        key.range = light.range;
+        key.outer_cone_cos = light.outer_cone_cos;
+        if (moved || !(key == shadow.key)) {
+            shadow.key = key;
+            computeViews(light, shadow);
+            for (uint32_t v = 0; v < shadow.view_count; v++) m_view_slots[shadow.first_view + v].static_dirty = true;
+        }
+
+        m_light_views[i] = shadow.first_view;
+        m_stats.lights++;
+        m_stats.views += shadow.view_count;
+        m_stats.used_texels += static_cast<uint64_t>(shadow.tile_size) * shadow.tile_size * shadow.view_count;
+    }
+    TRACE_COUNTER("shadow views", m_stats.views);
+}
+
+void ShadowAtlas::encodeTiles(wgpu::CommandEncoder encoder, wgpu::TextureView target, bool static_pass,
+    const ShadowCasterDraw& draw) {
+    wgpu::RenderPassDepthStencilAttachment depth_attachment = {};
+    depth_attachment.view = target;
+    // tiles not drawn this pass keep their depth
+    depth_attachment.depthLoadOp = wgpu::LoadOp::Load;
+    depth_attachment.depthStoreOp = wgpu::StoreOp::Store;
+    depth_attachment.depthClearValue = 1.0f;
+    depth_attachment.depthReadOnly = false;
+    depth_attachment.stencilLoadOp = wgpu::LoadOp::Undefined;
+    depth_attachment.stencilStoreOp = wgpu::StoreOp::Undefined;
+    depth_attachment.stencilReadOnly = true;
+
+    wgpu::RenderPassDescriptor pass_desc = {};
+    pass_desc.label = static_pass ? "Static shadow pass" : "Dynamic shadow pass";
+    pass_desc.colorAttachmentCount = 0;
+    pass_desc.colorAttachments = nullptr;
+    pass_desc.depthStencilAttachment = &depth_attachment;
+    pass_desc.timestampWrites = nullptr;
+
+    wgpu::RenderPassEncoder pass = encoder.beginRenderPass(pass_desc);
+    for (uint32_t i = 0; i < m_view_slots.size(); i++) {
+        View& view = m_view_slots[i];
+        if (!view.live || (static_pass && !view.static_dirty)) continue;
+        const float size = static_cast<float>(view.tile.size);
+        pass.setViewport(static_cast<float>(view.tile.x), static_cast<float>(view.tile.y), size, size, 0.0f, 1.0f);
+        pass.setScissorRect(view.tile.x, view.tile.y, view.tile.size, view.tile.size);
+        pass.setBindGroup(0, m_view_bind_groups[i], 0, nullptr);
+        if (static_pass) {
+            pass.setPipeline(m_clear_pipeline);
+            pass.draw(3, 1, 0, 0);
+            view.static_dirty = false;
+            m_stats.static_renders++;
+        }
+        pass.setPipeline(m_caster_pipeline);
+        draw(pass, static_pass ? ShadowCasters::Static : ShadowCasters::Dynamic);
+    }
+    pass.end();
+    pass.release();
+}
+
+void ShadowAtlas::encode(wgpu::Queue queue, wgpu::CommandEncoder encoder, const ShadowCasterDraw& draw) {
+    TRACE_ZONE("ShadowAtlas::encode");
+    m_stats.static_renders = 0;
+    if (!ready()) return;
+
+    uint32_t view_end = 0;
+    bool static_dirty = false;
+    for (uint32_t i = 0; i < m_view_slots.size(); i++) {
+        if (!m_view_slots[i].live) continue;
+        view_end = i + 1;
+        static_dirty |= m_view_slots[i].static_dirty;
+    }
+    if (view_end == 0) return;
+
+    m_uniform_data.assign(static_cast<size_t>(view_end) * UNIFORM_STRIDE, 0);
+    m_view_data.assign(static_cast<size_t>(view_end) * sizeof(GpuShadowView), 0);
+    const float atlas_size = static_cast<float>(m_config.size);
+    for (uint32_t i = 0; i < view_end; i++) {
+        const View& view = m_view_slots[i];
+        if (!view.live) continue;
+        GpuShadowView gpu = {};
+        std::memcpy(gpu.view_proj, view.view_proj, sizeof(gpu.view_proj));
+        gpu.rect[0] = view.tile.x / atlas_size;
+        gpu.rect[1] = view.tile.y / atlas_size;
+        gpu.rect[2] = gpu.rect[3] = view.tile.size / atlas_size;
+        std::memcpy(m_uniform_data.data() + static_cast<size_t>(i) * UNIFORM_STRIDE, &gpu, sizeof(gpu));
+        std::memcpy(m_view_data.data() + static_cast<size_t>(i) * sizeof(gpu), &gpu, sizeof(gpu));
+    }
+    queue.writeBuffer(m_view_uniforms, 0, m_uniform_data.data(), m_uniform_data.size());
+    queue.writeBuffer(m_views, 0, m_view_data.data(), m_view_data.size());
+
+    if (static_dirty) encodeTiles(encoder, m_static_view, true, draw);
+
+    // depth copies must cover the whole texture, a per-tile copy is not allowed
+    wgpu::ImageCopyTexture source = {};
+    source.texture = m_static_atlas;
+    source.mipLevel = 0;
+    source.origin = { 0, 0, 0 };
+    source.aspect = wgpu::TextureAspect::All;
+    wgpu::ImageCopyTexture destination = source;
+    destination.texture = m_atlas;
+    encoder.copyTextureToTexture(source, destination, { m_config.size, m_config.size, 1 });
+
+    encodeTiles(encoder, m_atlas_view, false, draw);
+}
@@ -0,0 +1,182 @@
+/*
+    tlsf_allocator.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "tlsf_allocator.h"
+#include <algorithm>
+#include <bit>
+
+TlsfAllocator::TlsfAllocator(uint64_t size): m_size(size), m_free_bytes(size) {
+    for (auto& fl : m_heads) {
+        std::fill(std::begin(fl), std::end(fl), NO_SPACE);
+    }
+    if (size > 0) {
+        insertFree(newNode(0, size));
+    }
+}
+
+void TlsfAllocator::mapping(uint64_t size, uint32_t& fl, uint32_t& sl) {
+    if (size < SL_COUNT) {
+        fl = 0;
+        sl = static_cast<uint32_t>(size);
+    } else {
+        uint32_t msb = std::bit_width(size) - 1;
+        fl = msb - SL_BITS + 1;
+        sl = static_cast<uint32_t>(size >> (msb - SL_BITS)) - SL_COUNT;
+    }
+}
+
+uint32_t TlsfAllocator::newNode(uint64_t offset, uint64_t size) {
+    uint32_t node;
+    if (m_unused_nodes.empty()) {
+        node = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.emplace_back();
+    } else {
+        node = m_unused_nodes.back();
+        m_unused_nodes.pop_back();
+        m_nodes[node] = Node {};
+    }
+    m_nodes[node].offset = offset;
+    m_nodes[node].size = size;
+    return node;
+}
+
+void TlsfAllocator::insertFree(uint32_t node) {
+    uint32_t fl, sl;
+    mapping(m_nodes[node].size, fl, sl);
+    uint32_t head = m_heads[fl][sl];
+    m_nodes[node].prev_free = NO_SPACE;
+    m_nodes[node].next_free = head;
+    if (head != NO_SPACE) {
+        m_nodes[head].prev_free = node;
+    }
+    m_heads[fl][sl] = node;
+    m_sl_bitmap[fl] |= 1u << sl;
+    m_fl_bitmap |= 1ull << fl;
+}
+
+void TlsfAllocator::removeFree(uint32_t node) {
+    Node& n = m_nodes[node];
+    if (n.prev_free != NO_SPACE) {
+        m_nodes[n.prev_free].next_free = n.next_free;
+    } else {
+        uint32_t fl, sl;
+        mapping(n.size, fl, sl);
+        m_heads[fl][sl] = n.next_free;
+        if (n.next_free == NO_SPACE) {
+            m_sl_bitmap[fl] &= ~(1u << sl);
+            if (m_sl_bitmap[fl] == 0) {
+                m_fl_bitmap &= ~(1ull << fl);
+            }
+        }
+    }
+    if (n.next_free != NO_SPACE) {
+        m_nodes[n.next_free].prev_free = n.prev_free;
+    }
+    n.prev_free = n.next_free = NO_SPACE;
+}
+
+uint32_t TlsfAllocator::findFree(uint64_t size) const {
+    // round up to the next bin so that any block in it is large enough
+    if (size >= SL_COUNT) {
+        uint32_t msb = std::bit_width(size) - 1;
+        size += (1ull << (msb - SL_BITS)) - 1;
+    }
+    uint32_t fl, sl;
+    mapping(size, fl, sl);
+    if (fl >= FL_COUNT) return NO_SPACE;
+
+    uint32_t sl_map = m_sl_bitmap[fl] & (~0u << sl);
+    if (sl_map == 0) {
+        if (fl + 1 >= FL_COUNT) return NO_SPACE;
+        uint64_t fl_map = m_fl_bitmap & (~0ull << (fl + 1));
+        if (fl_map == 0) return NO_SPACE;
+        fl = std::countr_zero(fl_map);
+        sl_map = m_sl_bitmap[fl];
+    }
+    sl = std::countr_zero(sl_map);
+    return m_heads[fl][sl];
+}
+
+TlsfAllocator::Allocation TlsfAllocator::allocate(uint64_t size) {
+    if (size == 0 || size > m_free_bytes) {
+        return Allocation { 0, NO_SPACE };
+    }
+    uint32_t node = findFree(size);
+    if (node == NO_SPACE) {
+        return Allocation { 0, NO_SPACE };
+    }
+    removeFree(node);
+
+    uint64_t remain = m_nodes[node].size - size;
+    if (remain > 0) {
+        uint32_t rest = newNode(m_nodes[node].offset + size, remain);
+        // newNode may have grown m_nodes, so index again instead of holding a reference
+        m_nodes[rest].prev_phys = node;
+        m_nodes[rest].next_phys = m_nodes[node].next_phys;
+        if (m_nodes[node].next_phys != NO_SPACE) {
+            m_nodes[m_nodes[node].next_phys].prev_phys = rest;
+        }
+        m_nodes[node].next_phys = rest;
+        m_nodes[node].size = size;
+        insertFree(rest);
+    }
+
+    m_nodes[node].used = true;
+    m_free_bytes -= size;
+    m_allocation_count++;
+    return Allocation { m_nodes[node].offset, node };
+}
+
+void TlsfAllocator::free(uint32_t node) {
+    m_nodes[node].used = false;
+    m_free_bytes += m_nodes[node].size;
+    m_allocation_count--;
+
+    uint32_t prev = m_nodes[node].prev_phys;
+    if (prev != NO_SPACE && !m_nodes[prev].used) {
+        removeFree(prev);
+        m_nodes[prev].size += m_nodes[node].size;
+        m_nodes[prev].next_phys = m_nodes[node].next_phys;
+        if (m_nodes[node].next_phys != NO_SPACE) {
+            m_nodes[m_nodes[node].next_phys].prev_phys = prev;
+        }
+        m_unused_nodes.push_back(node);
+        node = prev;
+    }
+
+    uint32_t next = m_nodes[node].next_phys;
+    if (next != NO_SPACE && !m_nodes[next].used) {
+        removeFree(next);
+        m_nodes[node].size += m_nodes[next].size;
+        m_nodes[node].next_phys = m_nodes[next].next_phys;
+        if (m_nodes[next].next_phys != NO_SPACE) {
+            m_nodes[m_nodes[next].next_phys].prev_phys = node;
+        }
+        m_unused_nodes.push_back(next);
+    }
+
+    insertFree(node);
+}
+
+uint64_t TlsfAllocator::largestFree() const {
+    if (m_fl_bitmap == 0) return 0;
+    uint32_t fl = 63 - std::countl_zero(m_fl_bitmap);
+    uint32_t sl = 31 - std::countl_zero(m_sl_bitmap[fl]);
+    uint64_t largest = 0;
+    for (uint32_t node = m_heads[fl][sl]; node != NO_SPACE; node = m_nodes[node].next_free) {
+        largest = std::max(largest, m_nodes[node].size);
+    }
+    return largest;
+}
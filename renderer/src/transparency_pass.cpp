@@ -0,0 +1,251 @@
+/*
+    transparency_pass.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "transparency_pass.h"
+#include "oit_composite.wgsl.h"
+#include <algorithm>
+
+namespace {
+
+wgpu::Texture createTarget(GpuMemoryTracker& memory, const char *label, wgpu::TextureFormat format,
+    uint32_t width, uint32_t height) {
+    wgpu::TextureDescriptor target_desc = {};
+    target_desc.label = label;
+    target_desc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding;
+    target_desc.dimension = wgpu::TextureDimension::_2D;
+    target_desc.size = { width, height, 1 };
+    target_desc.format = format;
+    target_desc.mipLevelCount = 1;
+    target_desc.sampleCount = 1;
+    target_desc.viewFormatCount = 0;
+    target_desc.viewFormats = nullptr;
+    return memory.createTexture(target_desc, GpuMemoryCategory::RenderTarget);
+}
+
+wgpu::TextureView createTargetView(wgpu::Texture texture, const char *label, wgpu::TextureFormat format) {
+    wgpu::TextureViewDescriptor view_desc = {};
+    view_desc.label = label;
+    view_desc.format = format;
+    view_desc.dimension = wgpu::TextureViewDimension::_2D;
+    view_desc.baseMipLevel = 0;
+    view_desc.mipLevelCount = 1;
+    view_desc.baseArrayLayer = 0;
+    view_desc.arrayLayerCount = 1;
+    view_desc.aspect = wgpu::TextureAspect::All;
+    return texture.createView(view_desc);
+}
+
+wgpu::RenderPassColorAttachment targetAttachment(wgpu::TextureView view, wgpu::LoadOp load_op, wgpu::Color clear_value) {
+    wgpu::RenderPassColorAttachment attachment = {};
+    attachment.nextInChain = nullptr;
+    attachment.view = view;
+    attachment.resolveTarget = nullptr;
+    attachment.loadOp = load_op;
+    attachment.storeOp = wgpu::StoreOp::Store;
+    attachment.clearValue = clear_value;
+#ifndef WEBGPU_BACKEND_WGPU
+    attachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
+#endif // NOT WEBGPU_BACKEND_WGPU
+    return attachment;
+}
+
+} // namespace
+
+TransparencyPass::TransparencyPass(wgpu::Device device, GpuMemoryTracker& memory, GpuObjectCache& cache,
+    const char *wgsl_source, wgpu::TextureFormat color_format):
+    m_device(device), m_memory(memory), m_cache(cache) {
+    // accumulation sums every channel
+    m_blends[0].color.srcFactor = wgpu::BlendFactor::One;
+    m_blends[0].color.dstFactor = wgpu::BlendFactor::One;
+    m_blends[0].color.operation = wgpu::BlendOperation::Add;
+    m_blends[0].alpha = m_blends[0].color;
+    // revealage is multiplied by (1 - alpha) of each fragment
+    m_blends[1].color.srcFactor = wgpu::BlendFactor::Zero;
+    m_blends[1].color.dstFactor = wgpu::BlendFactor::OneMinusSrc;
+    m_blends[1].color.operation = wgpu::BlendOperation::Add;
+    m_blends[1].alpha = m_blends[1].color;
+
+    m_targets[0].format = ACCUM_FORMAT;
+    m_targets[0].blend = &m_blends[0];
+    m_targets[0].writeMask = wgpu::ColorWriteMask::All;
+    m_targets[1].format = REVEALAGE_FORMAT;
+    m_targets[1].blend = &m_blends[1];
+    m_targets[1].writeMask = wgpu::ColorWriteMask::Red;
+
+    wgpu::ShaderModuleWGSLDescriptor shader_code_desc = {};
+    shader_code_desc.chain.next = nullptr;
+    shader_code_desc.chain.sType = wgpu::SType::ShaderModuleWGSLDescriptor;
+    shader_code_desc.code = wgsl_source;
+    wgpu::ShaderModuleDescriptor shader_module_desc = {};
+    shader_module_desc.nextInChain = &shader_code_desc.chain;
+    shader_module_desc.label = "OIT composite shader";
+#ifdef WEBGPU_BACKEND_WGPU
+    shader_module_desc.hintCount = 0;
+    shader_module_desc.hints = nullptr;
+#endif
+    wgpu::ShaderModule shader_module = m_device.createShaderModule(shader_module_desc);
+
+    wgpu::BindGroupLayoutDescriptor bind_group_layout_desc = {};
+    bind_group_layout_desc.label = "OIT composite bind group layout";
+    bind_group_layout_desc.entryCount = wgsl::oit_composite::group0::ENTRY_COUNT;
+    bind_group_layout_desc.entries = wgsl::oit_composite::group0::ENTRIES;
+    m_bind_group_layout = m_cache.acquire(bind_group_layout_desc);
+
+    WGPUBindGroupLayout bind_group_layouts[1] = { m_bind_group_layout };
+    wgpu::PipelineLayoutDescriptor pipeline_layout_desc = {};
+    pipeline_layout_desc.label = "OIT composite pipeline layout";
+    pipeline_layout_desc.bindGroupLayoutCount = 1;
+    pipeline_layout_desc.bindGroupLayouts = bind_group_layouts;
+    wgpu::PipelineLayout pipeline_layout = m_cache.acquire(pipeline_layout_desc);
+
+    wgpu::RenderPipelineDescriptor pipeline_desc = {};
+    pipeline_desc.label = "OIT composite pipeline";
+    pipeline_desc.layout = pipeline_layout;
+    pipeline_desc.vertex.module = shader_module;
+    pipeline_desc.vertex.entryPoint = wgsl::oit_composite::vs_main::ENTRY_POINT;
+    pipeline_desc.vertex.bufferCount = 0;
+    pipeline_desc.vertex.buffers = nullptr;
+    pipeline_desc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+    pipeline_desc.primitive.stripIndexFormat = wgpu::IndexFormat::Undefined;
+    pipeline_desc.primitive.frontFace = wgpu::FrontFace::CCW;
+    pipeline_desc.primitive.cullMode = wgpu::CullMode::None;
+
+    // the average color weighted by what the transparent layers cover,
+    // destination alpha is left alone
+    wgpu::BlendState composite_blend = {};
+    composite_blend.color.srcFactor = wgpu::BlendFactor::OneMinusSrcAlpha;
+    composite_blend.color.dstFactor = wgpu::BlendFactor::SrcAlpha;
+    composite_blend.color.operation = wgpu::BlendOperation::Add;
+    composite_blend.alpha.srcFactor = wgpu::BlendFactor::Zero;
+    composite_blend.alpha.dstFactor = wgpu::BlendFactor::One;
+    composite_blend.alpha.operation = wgpu::BlendOperation::Add;
+
+    wgpu::ColorTargetState color_target_state = {};
+    color_target_state.format = color_format;
+    color_target_state.blend = &composite_blend;
+    color_target_state.writeMask = wgpu::ColorWriteMask::All;
+
+    wgpu::FragmentState frag_state = {};
+    frag_state.module = shader_module;
+    frag_state.entryPoint = wgsl::oit_composite::fs_main::ENTRY_POINT;
+    frag_state.targetCount = 1;
+    frag_state.targets = &color_target_state;
+    pipeline_desc.fragment = &frag_state;
+    pipeline_desc.depthStencil = nullptr;
+    pipeline_desc.multisample.count = 1;
+    pipeline_desc.multisample.mask = ~0u;
+    pipeline_desc.multisample.alphaToCoverageEnabled = false;
+    m_composite_pipeline = m_device.createRenderPipeline(pipeline_desc);
+
+    m_cache.release(pipeline_layout);
+    shader_module.release();
+}
+
+TransparencyPass::~TransparencyPass() {
+    releaseTargets();
+    m_composite_pipeline.release();
+    m_cache.release(m_bind_group_layout);
+}
+
+bool TransparencyPass::resize(uint32_t width, uint32_t height) {
+    releaseTargets();
+    width = std::max(width, 1u);
+    height = std::max(height, 1u);
+
+    m_accum = createTarget(m_memory, "OIT accumulation", ACCUM_FORMAT, width, height);
+    m_revealage = createTarget(m_memory, "OIT revealage", REVEALAGE_FORMAT, width, height);
+    if (!m_accum || !m_revealage) {
+        releaseTargets();
+        return false;
+    }
+    m_accum_view = createTargetView(m_accum, "OIT accumulation view", ACCUM_FORMAT);
+    m_revealage_view = createTargetView(m_revealage, "OIT revealage view", REVEALAGE_FORMAT);
+    m_width = width;
+    m_height = height;
+
+    wgpu::BindGroupEntry entries[2] = {{}, {}};
+    entries[0].binding = wgsl::oit_composite::group0::ACCUM;
+    entries[0].textureView = m_accum_view;
+    entries[1].binding = wgsl::oit_composite::group0::REVEALAGE;
+    entries[1].textureView = m_revealage_view;
+
+    wgpu::BindGroupDescriptor bind_group_desc = {};
+    bind_group_desc.label = "OIT composite bind group";
+    bind_group_desc.layout = m_bind_group_layout;
+    bind_group_desc.entryCount = 2;
+    bind_group_desc.entries = entries;
+    m_bind_group = m_cache.acquire(bind_group_desc);
+    return true;
+}
+
+void TransparencyPass::encode(wgpu::CommandEncoder encoder, wgpu::TextureView color_view, uint32_t width, uint32_t height,
+    const TransparentDraw& draw, const wgpu::RenderPassTimestampWrites *p_timestamp_writes) {
+    if (!m_bind_group) return;
+    width = std::clamp(width, 1u, m_width);
+    height = std::clamp(height, 1u, m_height);
+
+    {
+        // nothing accumulated, everything revealed
+        wgpu::RenderPassColorAttachment attachments[TARGET_COUNT] = {
+            targetAttachment(m_accum_view, wgpu::LoadOp::Clear, wgpu::Color{ 0.0, 0.0, 0.0, 0.0 }),
+            targetAttachment(m_revealage_view, wgpu::LoadOp::Clear, wgpu::Color{ 1.0, 0.0, 0.0, 0.0 }),
+        };
+        wgpu::RenderPassDescriptor pass_desc = {};
+        pass_desc.label = "OIT accumulation pass";
+        pass_desc.colorAttachmentCount = TARGET_COUNT;
+        pass_desc.colorAttachments = attachments;
+        pass_desc.depthStencilAttachment = nullptr;
+        pass_desc.timestampWrites = nullptr;
+
+        wgpu::RenderPassEncoder pass = encoder.beginRenderPass(pass_desc);
+        pass.setViewport(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height), 0.0f, 1.0f);
+        pass.setScissorRect(0, 0, width, height);
+        draw(pass);
+        pass.end();
+        pass.release();
+    }
+
+    wgpu::RenderPassColorAttachment color_attachment = targetAttachment(color_view, wgpu::LoadOp::Load, wgpu::Color{});
+    wgpu::RenderPassDescriptor pass_desc = {};
+    pass_desc.label = "OIT composite pass";
+    pass_desc.colorAttachmentCount = 1;
+    pass_desc.colorAttachments = &color_attachment;
+    pass_desc.depthStencilAttachment = nullptr;
+    pass_desc.timestampWrites = p_timestamp_writes;
+
+    wgpu::RenderPassEncoder pass = encoder.beginRenderPass(pass_desc);
+    pass.setViewport(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height), 0.0f, 1.0f);
+    pass.setScissorRect(0, 0, width, height);
+    pass.setPipeline(m_composite_pipeline);
+    pass.setBindGroup(0, m_bind_group, 0, nullptr);
+    pass.draw(3, 1, 0, 0);
+    pass.end();
+    pass.release();
+}
+
+void TransparencyPass::releaseTargets() {
+    if (m_bind_group) m_cache.release(m_bind_group);
+    if (m_accum_view) {
+        m_accum_view.release();
+        m_accum_view = nullptr;
+    }
+    if (m_revealage_view) {
+        m_revealage_view.release();
+        m_revealage_view = nullptr;
+    }
+    if (m_accum) m_memory.release(m_accum);
+    if (m_revealage) m_memory.release(m_revealage);
+    m_width = m_height = 0;
+}
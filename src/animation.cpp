@@ -0,0 +1,133 @@
+/*
+    animation.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "animation.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// a * b with an implicit (0, 0, 0, 1) bottom row
+JointMatrix multiply(const JointMatrix& a, const JointMatrix& b) {
+    JointMatrix out;
+    for (int r = 0; r < 3; r++) {
+        const float *row = &a.m[r * 4];
+        for (int c = 0; c < 4; c++) {
+            out.m[r * 4 + c] = row[0] * b.m[c] + row[1] * b.m[4 + c] + row[2] * b.m[8 + c];
+        }
+        out.m[r * 4 + 3] += row[3];
+    }
+    return out;
+}
+
+} // namespace
+
+void sampleClip(const AnimationClip& clip, float time, bool loop, Pose& pose) {
+    const uint32_t joint_count = clip.joint_count;
+    pose.resize(joint_count);
+    if (clip.frame_count == 0 || joint_count == 0) return;
+
+    // the last frame repeats the first for looping clips, so wrap at it
+    float last = static_cast<float>(clip.frame_count - 1);
+    float frame = time * clip.sample_rate;
+    if (loop && clip.frame_count > 1) {
+        frame = std::fmod(frame, last);
+        if (frame < 0.0f) frame += last;
+    } else {
+        frame = std::clamp(frame, 0.0f, last);
+    }
+    uint32_t f0 = std::min(static_cast<uint32_t>(frame), clip.frame_count - 1);
+    uint32_t f1 = std::min(f0 + 1, clip.frame_count - 1);
+    const float t = frame - static_cast<float>(f0);
+
+    for (uint32_t channel : { POSE_TX, POSE_TY, POSE_TZ, POSE_SX, POSE_SY, POSE_SZ }) {
+        const float *a = clip.channel(f0, channel);
+        const float *b = clip.channel(f1, channel);
+        float *out = pose.channels[channel].data();
+        for (uint32_t j = 0; j < joint_count; j++) {
+            out[j] = a[j] + (b[j] - a[j]) * t;
+        }
+    }
+
+    const float *ax = clip.channel(f0, POSE_QX), *bx = clip.channel(f1, POSE_QX);
+    const float *ay = clip.channel(f0, POSE_QY), *by = clip.channel(f1, POSE_QY);
+    const float *az = clip.channel(f0, POSE_QZ), *bz = clip.channel(f1, POSE_QZ);
+    const float *aw = clip.channel(f0, POSE_QW), *bw = clip.channel(f1, POSE_QW);
+    float *qx = pose.channels[POSE_QX].data();
+    float *qy = pose.channels[POSE_QY].data();
+    float *qz = pose.channels[POSE_QZ].data();
+    float *qw = pose.channels[POSE_QW].data();
+    // branch free so it vectorizes across joints
+    for (uint32_t j = 0; j < joint_count; j++) {
+        float dot = ax[j] * bx[j] + ay[j] * by[j] + az[j] * bz[j] + aw[j] * bw[j];
+        float sign = dot < 0.0f ? -1.0f : 1.0f;
+        float x = ax[j] + (sign * bx[j] - ax[j]) * t;
+        float y = ay[j] + (sign * by[j] - ay[j]) * t;
+        float z = az[j] + (sign * bz[j] - az[j]) * t;
+        float w = aw[j] + (sign * bw[j] - aw[j]) * t;
+        float inv_length = 1.0f / std::sqrt(std::max(x * x + y * y + z * z + w * w, 1e-12f));
+        qx[j] = x * inv_length;
+        qy[j] = y * inv_length;
+        qz[j] = z * inv_length;
+        qw[j] = w * inv_length;
+    }
+}
+
+void computeSkinMatrices(const Skeleton& skeleton, const Pose& pose, PoseScratch& scratch, std::span<JointMatrix> out) {
+    const uint32_t joint_count = std::min({ skeleton.jointCount(), pose.jointCount(), static_cast<uint32_t>(out.size()) });
+    for (auto& element : scratch.local) element.resize(joint_count);
+    scratch.model.resize(joint_count);
+
+    const float *tx = pose.channels[POSE_TX].data();
+    const float *ty = pose.channels[POSE_TY].data();
+    const float *tz = pose.channels[POSE_TZ].data();
+    const float *qx = pose.channels[POSE_QX].data();
+    const float *qy = pose.channels[POSE_QY].data();
+    const float *qz = pose.channels[POSE_QZ].data();
+    const float *qw = pose.channels[POSE_QW].data();
+    const float *sx = pose.channels[POSE_SX].data();
+    const float *sy = pose.channels[POSE_SY].data();
+    const float *sz = pose.channels[POSE_SZ].data();
+    float *m[12];
+    for (int i = 0; i < 12; i++) m[i] = scratch.local[i].data();
+
+    // translation * rotation * scale, independent per joint
+    for (uint32_t j = 0; j < joint_count; j++) {
+        float xx = qx[j] * qx[j], yy = qy[j] * qy[j], zz = qz[j] * qz[j];
+        float xy = qx[j] * qy[j], xz = qx[j] * qz[j], yz = qy[j] * qz[j];
+        float wx = qw[j] * qx[j], wy = qw[j] * qy[j], wz = qw[j] * qz[j];
+        m[0][j] = (1.0f - 2.0f * (yy + zz)) * sx[j];
+        m[1][j] = 2.0f * (xy - wz) * sy[j];
+        m[2][j] = 2.0f * (xz + wy) * sz[j];
+        m[3][j] = tx[j];
+        m[4][j] = 2.0f * (xy + wz) * sx[j];
+        m[5][j] = (1.0f - 2.0f * (xx + zz)) * sy[j];
+        m[6][j] = 2.0f * (yz - wx) * sz[j];
+        m[7][j] = ty[j];
+        m[8][j] = 2.0f * (xz - wy) * sx[j];
+        m[9][j] = 2.0f * (yz + wx) * sy[j];
+        m[10][j] = (1.0f - 2.0f * (xx + yy)) * sz[j];
+        m[11][j] = tz[j];
+    }
+
+    // the hierarchy walk is serial, parents come first
+    for (uint32_t j = 0; j < joint_count; j++) {
+        JointMatrix local;
+        for (int i = 0; i < 12; i++) local.m[i] = m[i][j];
+        int32_t parent = skeleton.parents[j];
+        scratch.model[j] = parent < 0 ? local : multiply(scratch.model[parent], local);
+        out[j] = multiply(scratch.model[j], skeleton.inverse_bind[j]);
+    }
+}
@@ -0,0 +1,94 @@
+/*
+    animation.hpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// Row-major 3x4 affine transform, the per-joint layout the skinning pass reads.
+struct JointMatrix {
+    float m[12];
+};
+
+inline constexpr JointMatrix JOINT_MATRIX_IDENTITY {{
+    1.0f, 0.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f, 0.0f,
+    0.0f, 0.0f, 1.0f, 0.0f,
+}};
+
+// Local joint transform channels. A pose stores one array per channel so
+// evaluation runs down contiguous joints.
+enum PoseChannel : uint32_t {
+    POSE_TX, POSE_TY, POSE_TZ,
+    POSE_QX, POSE_QY, POSE_QZ, POSE_QW,
+    POSE_SX, POSE_SY, POSE_SZ,
+    POSE_CHANNEL_COUNT,
+};
+
+struct Pose {
+    std::array<std::vector<float>, POSE_CHANNEL_COUNT> channels {};
+
+    inline uint32_t jointCount() const { return static_cast<uint32_t>(channels[POSE_TX].size()); }
+
+    inline void resize(uint32_t joint_count) {
+        for (auto& channel : channels) channel.resize(joint_count);
+    }
+};
+
+// Joints are ordered so that every parent precedes its children.
+struct Skeleton {
+    std::vector<int32_t> parents {};
+    std::vector<std::string> names {};
+    std::vector<JointMatrix> inverse_bind {};
+    // local transforms for joints an animation does not drive
+    Pose rest {};
+
+    inline uint32_t jointCount() const { return static_cast<uint32_t>(parents.size()); }
+};
+
+// Resampled to a fixed rate at import, so sampling is a lerp between two
+// frames per channel instead of a key search per joint. Samples are laid
+// out [frame][channel][joint].
+struct AnimationClip {
+    std::string name {};
+    float duration { 0.0f };
+    float sample_rate { 30.0f };
+    uint32_t frame_count { 0 };
+    uint32_t joint_count { 0 };
+    std::vector<float> samples {};
+
+    inline const float *channel(uint32_t frame, uint32_t channel) const {
+        return samples.data() + (static_cast<size_t>(frame) * POSE_CHANNEL_COUNT + channel) * joint_count;
+    }
+};
+
+// Scratch reused across evaluations of one skeleton, one per thread.
+struct PoseScratch {
+    // local matrices, one array per element
+    std::array<std::vector<float>, 12> local {};
+    std::vector<JointMatrix> model {};
+};
+
+// Samples `clip` at `time` seconds into `pose`, wrapping when `loop` is set
+// and clamping otherwise. Rotations are normalized-lerped along the short arc.
+void sampleClip(const AnimationClip& clip, float time, bool loop, Pose& pose);
+
+// Model space joint transforms times the inverse bind matrices, ready for
+// upload. `out` holds one matrix per joint.
+void computeSkinMatrices(const Skeleton& skeleton, const Pose& pose, PoseScratch& scratch, std::span<JointMatrix> out);
@@ -15,16 +15,67 @@
 
 #pragma once
 
+#include "batch_import.hpp"
+#include "bvh.hpp"
+#include "camera.hpp"
+#include "clustered_lighting.h"
+#include "draw_queue.h"
+#include "dynamic_resolution.h"
+#include "frame_capture.h"
+#include "gpu_heap.h"
+#include "gpu_memory.h"
+#include "gpu_object_cache.h"
+#include "gpu_skinning.h"
+#include "glb_reader.hpp"
+#include "impostor_atlas.h"
+#include "particle_system.h"
+#include "gpu_timer.h"
+#include "mesh_codec.hpp"
+#include "metrics.hpp"
+#include "metrics_server.hpp"
+#include "frame_fence.h"
+#include "mapped_file.hpp"
+#include "material_table.h"
 #include "model_loader.hpp"
 #include "renderer.h"
+#include "scene_graph.hpp"
+#include "shadow.wgsl.h"
+#include "shadow_atlas.h"
+#include "simulation.hpp"
+#include "task_graph.hpp"
+#include "test.wgsl.h"
+#include "thread_pool.hpp"
+#include "triple_buffer.hpp"
+#include "trace.hpp"
+#include "transparency_pass.h"
 #include "webgpu/webgpu.hpp"
 #include "window.hpp"
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <stdlib.h>
+#include <thread>
+#include <unordered_map>
 
 extern "C" const char _binary_assets_wgsl_test_wgsl_start[];
+extern "C" const char _binary_assets_wgsl_upscale_wgsl_start[];
+extern "C" const char _binary_assets_wgsl_skinning_wgsl_start[];
+extern "C" const char _binary_assets_wgsl_clustered_lights_wgsl_start[];
+extern "C" const char _binary_assets_wgsl_shadow_wgsl_start[];
+extern "C" const char _binary_assets_wgsl_oit_composite_wgsl_start[];
+extern "C" const char _binary_assets_wgsl_impostor_bake_wgsl_start[];
+extern "C" const char _binary_assets_wgsl_particles_wgsl_start[];
+extern "C" const char _binary_assets_wgsl_particle_draw_wgsl_start[];
 
 extern "C" const char _binary_assets_model_monkey_head_obj_start[];
 extern "C" const char _binary_assets_model_monkey_head_obj_end[];
@@ -95,27 +146,804 @@ inline static wgpu::Surface crateSurfacefromWindow(wgpu::Instance instance, cons
             surface_descriptor.label = nullptr;
             return instance.createSurface(surface_descriptor);
         }
+        case WindowDisplay::Type::None: {
+            return wgpu::Surface { nullptr };
+        }
     }
 }
 
+struct StartupOptions {
+    // print what inspectAdapter() and inspectDevice() find
+    bool dump_gpu_info { false };
+    // print the startup timeline and the time to the first presented frame
+    bool print_timeline { false };
+};
+
+// skinned output is drawn with the same vertex layout as static meshes
+static_assert(sizeof(Vertex) == GpuSkinning::VERTEX_STRIDE);
+static_assert(sizeof(SkinWeights) == GpuSkinning::WEIGHT_STRIDE);
+
+// the model pipeline takes its vertex layout from test.wgsl as reflected at build time
+static_assert(sizeof(Vertex) == sizeof(wgsl::test::VertexIn));
+static_assert(offsetof(Vertex, position) == offsetof(wgsl::test::VertexIn, position));
+static_assert(offsetof(Vertex, normal) == offsetof(wgsl::test::VertexIn, normal));
+static_assert(offsetof(Vertex, uv) == offsetof(wgsl::test::VertexIn, uv));
+static_assert(sizeof(WorldMatrix) == sizeof(wgsl::test::InstanceIn));
+static_assert(sizeof(GpuMaterial) == sizeof(wgsl::test::Material));
+static_assert(offsetof(GpuMaterial, emissive) == offsetof(wgsl::test::Material, emissive));
+static_assert(offsetof(GpuMaterial, albedo_texture) == offsetof(wgsl::test::Material, albedo_texture));
+static_assert(sizeof(GpuImpostorParams) == sizeof(wgsl::test::Impostors));
+static_assert(offsetof(GpuImpostorParams, frames_per_side) == offsetof(wgsl::test::Impostors, frames_per_side));
+static_assert(offsetof(GpuImpostorParams, frame_size) == offsetof(wgsl::test::Impostors, frame_size));
+// shadow casters are drawn from the same buffers
+static_assert(wgsl::shadow::vs_main::INSTANCE_SLOT == wgsl::test::vs_main::INSTANCE_SLOT);
+
 class Application {
 public:
+    inline static constexpr uint64_t COMPACT_BYTES_PER_FRAME = 4ull << 20;
+    inline static constexpr uint32_t MAIN_PASS = 0;
+    // casters ShadowAtlas caches, and the ones it draws every frame
+    inline static constexpr uint32_t SHADOW_STATIC_PASS = 1;
+    inline static constexpr uint32_t SHADOW_DYNAMIC_PASS = 2;
+    // frames a node must stay put before its shadow is cached again
+    inline static constexpr uint8_t SHADOW_SETTLE_FRAMES = 30;
+    // unsorted, accumulated by TransparencyPass after MAIN_PASS
+    inline static constexpr uint32_t TRANSPARENT_PASS = 3;
+    // camera distance, in world units, over which nodes turn into impostors
+    inline static constexpr float IMPOSTOR_FADE_START = 30.0f;
+    inline static constexpr float IMPOSTOR_FADE_END = 36.0f;
+    // seconds, longer frames slow the particles down instead
+    inline static constexpr float MAX_PARTICLE_STEP = 0.1f;
+    // vertex buffer slot of the per-node world matrices
+    inline static constexpr uint32_t INSTANCE_SLOT = wgsl::test::vs_main::INSTANCE_SLOT;
+    // SDL_BUTTON_LEFT
+    inline static constexpr uint8_t LEFT_MOUSE_BUTTON = 1;
+
     Application() = default;
 
-    inline void initialize(std::unique_ptr<Window>&& window) {
-        m_window = std::move(window);
-        wgpu::InstanceDescriptor inst_desc = {};
-        inst_desc.nextInChain = nullptr;
-        m_instance = wgpu::createInstance(inst_desc);
-        m_surface = crateSurfacefromWindow(m_instance, *m_window);
-        wgpu::RequestAdapterOptions adapter_opts = {};
-        adapter_opts.powerPreference = wgpu::PowerPreference::HighPerformance;
-        wgpu::Adapter adapter = m_instance.requestAdapter(adapter_opts);
-        inspectAdapter(adapter);
+    inline void initialize(std::unique_ptr<Window>&& window, StartupOptions options = {}) {
+        initialize([&]() { return std::move(window); }, options);
+    }
+
+    // Startup runs as a task graph: the model is imported on the pool while
+    // the window, adapter and device come up on this thread, and the render
+    // pipeline compiles asynchronously while the model uploads.
+    inline void initialize(const std::function<std::unique_ptr<Window>()>& create_window, StartupOptions options = {}) {
+        TRACE_ZONE("Application::initialize");
+        m_startup_begin = std::chrono::steady_clock::now();
+        registerMetrics();
+        wgpu::Adapter adapter { nullptr };
+        Model model;
+
+        using Affinity = TaskGraph::Affinity;
+        TaskGraph startup;
+        // WebGPU and the window system are only touched from this thread
+        auto window_task = startup.add("create window", [&]() {
+            m_window = create_window();
+        }, {}, Affinity::Main);
+        auto instance_task = startup.add("create instance", [&]() {
+            wgpu::InstanceDescriptor inst_desc = {};
+            inst_desc.nextInChain = nullptr;
+            m_instance = wgpu::createInstance(inst_desc);
+        }, {}, Affinity::Main);
+        auto import_task = startup.add("import model", [&]() {
+            model.loadModelFromMemory(
+                (const void *)_binary_assets_model_monkey_head_obj_start,
+                _binary_assets_model_monkey_head_obj_end - _binary_assets_model_monkey_head_obj_start,
+                "obj"
+            );
+        });
+        auto surface_task = startup.add("create surface", [&]() {
+            m_surface = crateSurfacefromWindow(m_instance, *m_window);
+        }, { window_task, instance_task }, Affinity::Main);
+        auto adapter_task = startup.add("request adapter", [&]() {
+            wgpu::RequestAdapterOptions adapter_opts = {};
+            adapter_opts.powerPreference = wgpu::PowerPreference::HighPerformance;
+            adapter = m_instance.requestAdapter(adapter_opts);
+        }, { instance_task }, Affinity::Main);
+        auto device_task = startup.add("request device", [&]() {
+            requestDevice(adapter);
+        }, { adapter_task }, Affinity::Main);
+        auto services_task = startup.add("create gpu services", [&]() {
+            initializeGpuServices();
+        }, { device_task }, Affinity::Main);
+        auto configure_task = startup.add("configure surface", [&]() {
+            configureSurface(adapter);
+        }, { surface_task, services_task }, Affinity::Main);
+        auto pipeline_task = startup.add("compile pipeline", [&]() {
+            initializeRenderPipline();
+        }, { configure_task, services_task }, Affinity::Main);
+        auto upload_task = startup.add("upload model", [&]() {
+            initializeBuffer(model);
+        }, { import_task, services_task }, Affinity::Main);
+        auto await_task = startup.add("await pipeline", [&]() {
+            awaitRenderPipeline();
+        }, { pipeline_task, upload_task }, Affinity::Main);
+        startup.add("register draws", [&]() {
+            registerDraws();
+        }, { await_task }, Affinity::Main);
+        if (options.dump_gpu_info) {
+            // kept off the critical path, they only print
+            startup.add("inspect adapter", [&]() { inspectAdapter(adapter); }, { adapter_task, await_task }, Affinity::Main);
+            startup.add("inspect device", [&]() { inspectDevice(m_device); }, { device_task, await_task }, Affinity::Main);
+        }
+
+        startup.run(ThreadPool::global());
+        adapter.release();
+
+        m_report_first_frame = options.print_timeline;
+        if (options.print_timeline) {
+            startup.report(std::cout);
+        }
+    }
+
+    // One frame on this thread: events, the simulation steps that are due,
+    // then rendering.
+    inline void mainLoop() {
+        pollEvents(false);
+        if (m_need_close) return;
+        stepSimulation();
+        renderFrame();
+    }
+
+    // Runs until the window closes. Threaded, this thread polls events and
+    // steps the simulation while a render thread encodes and presents from
+    // the latest snapshot, so a present waiting on vsync holds up neither.
+    // Otherwise mainLoop() over and over. WebGPU is only used by the
+    // render thread until it is joined.
+    inline void run(bool threaded = true) {
+#ifdef __EMSCRIPTEN__
+        threaded = false;
+#endif
+        if (!threaded) {
+            while (!needClose()) mainLoop();
+            return;
+        }
+        std::thread render_thread([this]() {
+            TRACE_THREAD_NAME("render");
+            while (!needClose()) {
+                handleForwardedEvents();
+                renderFrame();
+            }
+        });
+        while (!needClose()) {
+            pollEvents(true);
+            stepSimulation();
+            std::this_thread::sleep_until(m_simulation.nextStep());
+        }
+        render_thread.join();
+    }
+
+    // Encodes, submits and presents one frame from the newest snapshot.
+    inline void renderFrame() {
+        TRACE_ZONE("frame");
+        auto frame_begin = std::chrono::steady_clock::now();
+        if (m_last_frame_begin != std::chrono::steady_clock::time_point {}) {
+            m_frame_metrics.p_frame->observe(secondsSince(m_last_frame_begin, frame_begin));
+        }
+        m_last_frame_begin = frame_begin;
+
+        // get the surface texture, or the offscreen target without a display
+        // both the acquire and the present below may block on the display
+        double present_wait = 0.0;
+        wgpu::Texture texture = m_offscreen_target;
+        if (m_surface) {
+            TRACE_ZONE("acquire surface texture");
+            auto acquire_begin = std::chrono::steady_clock::now();
+            wgpu::SurfaceTexture surface_texture;
+            m_surface.getCurrentTexture(&surface_texture);
+            texture = surface_texture.texture;
+            present_wait += secondsSince(acquire_begin);
+        }
+        if (!texture) {
+            m_need_close = true;
+            return;
+        }
+        // Create a view for this surface texture
+        wgpu::TextureViewDescriptor texture_view_desc = {};
+        texture_view_desc.nextInChain = nullptr;
+        texture_view_desc.label = "Surface texture view";
+        texture_view_desc.format = texture.getFormat();
+        texture_view_desc.dimension = wgpu::TextureViewDimension::_2D;
+        texture_view_desc.baseMipLevel = 0;
+        texture_view_desc.mipLevelCount = 1;
+        texture_view_desc.baseArrayLayer = 0;
+        texture_view_desc.arrayLayerCount = 1;
+        texture_view_desc.aspect = wgpu::TextureAspect::All;
+        wgpu::TextureView target_view = texture.createView(texture_view_desc);
+
+        if(!target_view) {
+            m_need_close = true;
+            return;
+        }
+
+        auto encode_begin = std::chrono::steady_clock::now();
+        wgpu::CommandBuffer cmd_buf = encodeFrame(texture, target_view);
+        m_frame_metrics.p_encode->observe(secondsSince(encode_begin));
+        {
+            TRACE_ZONE("submit");
+            auto submit_begin = std::chrono::steady_clock::now();
+            m_queue.submit(cmd_buf);
+            m_frame_metrics.p_submit->observe(secondsSince(submit_begin));
+        }
+        cmd_buf.release();
+        m_frame_fence.signal(m_queue);
+        m_gpu_timer->submitted(m_queue);
+        if (m_capture) m_capture->submitted();
+
+        target_view.release();
+        if (m_surface) {
+#ifndef __EMSCRIPTEN__
+            {
+                TRACE_ZONE("present");
+                auto present_begin = std::chrono::steady_clock::now();
+                m_surface.present();
+                present_wait += secondsSince(present_begin);
+            }
+#endif
+#ifndef WEBGPU_BACKEND_WGPU
+            // We no longer need the texture, only its view
+            // (NB: with wgpu-native, surface textures must not be manually released)
+            texture.release();
+#endif // WEBGPU_BACKEND_WGPU
+        }
+
+        pumpDevice();
+
+        if (m_report_first_frame) {
+            m_report_first_frame = false;
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - m_startup_begin;
+            std::cout << "first frame presented after " << elapsed.count() << " ms\n";
+        }
+
+        if (m_capture) m_capture->poll();
+        m_gpu_heap->collect();
+        m_skinning->collect();
+        m_object_cache->collect();
+        updateRenderScale();
+        recordFrameMetrics(present_wait);
+    }
+
+    inline bool needClose() const {
+        return m_need_close.load(std::memory_order_relaxed);
+    }
+
+    // 0 lifts the budget
+    inline void setGpuMemoryBudget(uint64_t bytes) {
+        m_gpu_memory->setBudget(bytes);
+    }
+
+    inline void reportGpuMemory(std::ostream& out) const {
+        m_gpu_memory->report(out);
+    }
+
+    // Renders into an offscreen target scaled to keep the measured GPU frame
+    // time near the configured target, then upscales onto the surface.
+    inline void enableDynamicResolution(const DynamicResolutionConfig& config = {}) {
+        m_dynamic_resolution.emplace(config);
+        m_upscale = std::make_unique<UpscalePass>(m_device, *m_gpu_memory, *m_object_cache,
+            _binary_assets_wgsl_upscale_wgsl_start, m_surface_format);
+        if (!m_upscale->resize(m_dynamic_resolution->maxScaled(m_surface_width), m_dynamic_resolution->maxScaled(m_surface_height))) {
+            std::cout << "Dynamic resolution disabled: cannot allocate the render target\n";
+            disableDynamicResolution();
+            return;
+        }
+        resizeTransparency();
+        applyRenderScale();
+    }
+
+    inline void disableDynamicResolution() {
+        m_upscale.reset();
+        m_dynamic_resolution.reset();
+        resizeTransparency();
+    }
+
+    // Simulates and draws particles on the GPU, emitted by `emitter` at
+    // the pace of the scene clock.
+    inline void enableParticles(const ParticleSystemConfig& config = {}, const ParticleEmitter& emitter = {}) {
+        m_particles = std::make_unique<ParticleSystem>(m_device, *m_gpu_memory, *m_object_cache,
+            _binary_assets_wgsl_particles_wgsl_start, _binary_assets_wgsl_particle_draw_wgsl_start,
+            m_surface_format, config);
+        if (!m_particles->ready()) {
+            std::cout << "Particles disabled: cannot allocate " << config.capacity << " particles\n";
+            m_particles.reset();
+            return;
+        }
+        m_particle_emitter = emitter;
+        m_particle_time = m_scene_time;
+    }
+
+    inline void setParticleEmitter(const ParticleEmitter& emitter) {
+        m_particle_emitter = emitter;
+    }
+
+    // Reconfigures the surface so frames can be copied out. Captures are
+    // read back a few frames later and written from the pool.
+    inline void enableFrameCapture() {
+        if (m_capture) return;
+        m_capture = std::make_unique<FrameCapture>(*m_gpu_memory, ThreadPool::global());
+        m_surface_copy_src = true;
+        applySurfaceConfig();
+    }
+
+    inline void captureFrame(std::string path, CaptureFormat format = CaptureFormat::Png) {
+        enableFrameCapture();
+        m_capture->requestCapture(std::move(path), format);
+    }
+
+    inline void startCaptureSequence(std::string prefix, CaptureFormat format = CaptureFormat::Png, uint32_t interval = 1) {
+        enableFrameCapture();
+        m_capture->startSequence(std::move(prefix), format, interval);
+    }
+
+    inline void stopCaptureSequence() {
+        if (m_capture) m_capture->stopSequence();
+    }
+
+    // Imports the sources on the pool and uploads each distinct mesh once,
+    // also across calls. The manifest's mesh ids are DrawQueue mesh ids,
+    // ready for DrawKey::make(); sources with equal content share one.
+    inline std::vector<ManifestEntry> importMeshes(std::span<const ImportSource> sources) {
+        TRACE_ZONE("Application::importMeshes");
+        BatchImport batch = importBatch(sources, ThreadPool::global());
+        std::vector<uint32_t> draw_mesh_of(batch.meshes.size(), ManifestEntry::NO_MESH);
+        uint32_t reused = 0;
+        for (size_t mesh = 0; mesh < batch.meshes.size(); mesh++) {
+            const Model& model = *batch.meshes[mesh];
+            // earlier batches are matched by both hashes and the sizes, their
+            // content is gone
+            std::vector<ImportedMesh>& candidates = m_imported_meshes[batch.hashes[mesh]];
+            auto match = std::find_if(candidates.begin(), candidates.end(), [&](const ImportedMesh& imported) {
+                return imported.check_hash == batch.check_hashes[mesh]
+                    && imported.vertex_count == model.m_vertices.size() && imported.index_count == model.m_indices.size();
+            });
+            if (match != candidates.end()) {
+                draw_mesh_of[mesh] = match->draw_mesh;
+                reused++;
+                continue;
+            }
+
+            auto vertices = m_gpu_heap->allocate(GpuHeapUsage::Vertex, model.m_vertices.size_bytes());
+            if (vertices.is_err()) continue;
+            DrawMesh draw_mesh { std::move(vertices).unwrap(), {}, wgpu::IndexFormat::Uint32 };
+            auto indices = m_gpu_heap->allocate(GpuHeapUsage::Index, model.m_indices.size_bytes());
+            if (indices.is_err()) {
+                m_gpu_heap->free(draw_mesh.vertices);
+                continue;
+            }
+            draw_mesh.indices = std::move(indices).unwrap();
+            auto id = m_draw_queue.registerMesh(draw_mesh);
+            if (id.is_err()) {
+                m_gpu_heap->free(draw_mesh.vertices);
+                m_gpu_heap->free(draw_mesh.indices);
+                continue;
+            }
+            m_gpu_heap->write(m_queue, draw_mesh.vertices, model.m_vertices.data(), model.m_vertices.size_bytes());
+            m_gpu_heap->write(m_queue, draw_mesh.indices, model.m_indices.data(), model.m_indices.size_bytes());
+            draw_mesh_of[mesh] = std::move(id).unwrap();
+            candidates.push_back({ batch.check_hashes[mesh], model.m_vertices.size(), model.m_indices.size(), draw_mesh_of[mesh] });
+        }
+
+        for (ManifestEntry& entry : batch.manifest) {
+            if (entry.mesh == ManifestEntry::NO_MESH) continue;
+            uint32_t draw_mesh = draw_mesh_of[entry.mesh];
+            entry.mesh = draw_mesh;
+            if (draw_mesh == ManifestEntry::NO_MESH) entry.error = "out of GPU memory for the mesh";
+        }
+        std::cout << "Imported " << sources.size() << " sources: " << batch.meshes.size() << " distinct meshes, "
+            << batch.duplicates << " duplicates, " << reused << " already uploaded\n";
+        return std::move(batch.manifest);
+    }
+
+    // Maps a GLB and uploads its mesh, straight from the mapping wherever the
+    // file already stores Vertex layout and 16 or 32 bit indices. Returns
+    // the DrawQueue mesh id.
+    inline Result<uint32_t, std::string> importGlb(const std::string& path) {
+        TRACE_ZONE("Application::importGlb");
+        auto file = MappedFile::open(path);
+        if (file.is_err()) return Err { std::move(file).unwrap_err() };
+        MappedFile mapping = std::move(file).unwrap();
+        auto parsed = readGlb(mapping.bytes());
+        if (parsed.is_err()) return Err { path + ": " + std::move(parsed).unwrap_err() };
+        GlbMesh mesh = std::move(parsed).unwrap();
+
+        auto vertices = m_gpu_heap->allocate(GpuHeapUsage::Vertex, alignTo4(mesh.vertices.size()));
+        if (vertices.is_err()) return Err { path + ": out of GPU memory for the vertices" };
+        DrawMesh draw_mesh { std::move(vertices).unwrap(), {}, mesh.index_type == GlbIndexType::Uint16
+            ? wgpu::IndexFormat::Uint16 : wgpu::IndexFormat::Uint32 };
+        auto indices = m_gpu_heap->allocate(GpuHeapUsage::Index, alignTo4(mesh.indices.size()));
+        if (indices.is_err()) {
+            m_gpu_heap->free(draw_mesh.vertices);
+            return Err { path + ": out of GPU memory for the indices" };
+        }
+        draw_mesh.indices = std::move(indices).unwrap();
+        auto id = m_draw_queue.registerMesh(draw_mesh);
+        if (id.is_err()) {
+            m_gpu_heap->free(draw_mesh.vertices);
+            m_gpu_heap->free(draw_mesh.indices);
+            return Err { path + ": the draw queue has no room for the mesh" };
+        }
+        // the queue copies out of the mapping before writeBuffer returns
+        writeUnaligned(draw_mesh.vertices, mesh.vertices);
+        writeUnaligned(draw_mesh.indices, mesh.indices);
+        std::cout << "Imported " << path << ": vertices " << (mesh.verticesInPlace() ? "in place" : "converted")
+            << ", indices " << (mesh.indicesInPlace() ? "in place" : "converted") << '\n';
+        return Ok { std::move(id).unwrap() };
+    }
+
+    // Maps a compressed mesh and decodes it into the upload staging buffer,
+    // with 16-bit indices where the vertex count allows. Returns the
+    // DrawQueue mesh id.
+    inline Result<uint32_t, std::string> importEncodedMesh(const std::string& path) {
+        TRACE_ZONE("Application::importEncodedMesh");
+        auto file = MappedFile::open(path);
+        if (file.is_err()) return Err { std::move(file).unwrap_err() };
+        MappedFile mapping = std::move(file).unwrap();
+        auto read = readEncodedMesh(mapping.bytes());
+        if (read.is_err()) return Err { path + ": " + std::move(read).unwrap_err() };
+        EncodedMesh mesh = std::move(read).unwrap();
+        if (mesh.vertex_size != sizeof(Vertex)) return Err { path + ": vertex layout is not Vertex" };
+
+        uint32_t index_size = mesh.indexSize();
+        size_t vertex_bytes = mesh.vertexBytes();
+        size_t index_bytes = mesh.indexBytes(index_size);
+        m_upload_staging.resize(alignTo4(vertex_bytes) + alignTo4(index_bytes));
+        std::span<std::byte> vertex_staging(m_upload_staging.data(), vertex_bytes);
+        std::span<std::byte> index_staging(m_upload_staging.data() + alignTo4(vertex_bytes), index_bytes);
+        auto vertices_decoded = decodeVertexBuffer(vertex_staging, mesh.vertex_count, mesh.vertex_size, mesh.vertices);
+        if (vertices_decoded.is_err()) return Err { path + ": " + std::move(vertices_decoded).unwrap_err() };
+        auto indices_decoded = decodeIndexBuffer(index_staging, mesh.index_count, index_size, mesh.vertex_count, mesh.indices);
+        if (indices_decoded.is_err()) return Err { path + ": " + std::move(indices_decoded).unwrap_err() };
+
+        auto vertices = m_gpu_heap->allocate(GpuHeapUsage::Vertex, alignTo4(vertex_bytes));
+        if (vertices.is_err()) return Err { path + ": out of GPU memory for the vertices" };
+        DrawMesh draw_mesh { std::move(vertices).unwrap(), {}, index_size == 2 ? wgpu::IndexFormat::Uint16 : wgpu::IndexFormat::Uint32 };
+        auto indices = m_gpu_heap->allocate(GpuHeapUsage::Index, alignTo4(index_bytes));
+        if (indices.is_err()) {
+            m_gpu_heap->free(draw_mesh.vertices);
+            return Err { path + ": out of GPU memory for the indices" };
+        }
+        draw_mesh.indices = std::move(indices).unwrap();
+        auto id = m_draw_queue.registerMesh(draw_mesh);
+        if (id.is_err()) {
+            m_gpu_heap->free(draw_mesh.vertices);
+            m_gpu_heap->free(draw_mesh.indices);
+            return Err { path + ": the draw queue has no room for the mesh" };
+        }
+        writeUnaligned(draw_mesh.vertices, vertex_staging);
+        writeUnaligned(draw_mesh.indices, index_staging);
+        std::cout << "Imported " << path << ": " << mapping.bytes().size() << " bytes decoded to "
+            << vertex_bytes + index_bytes << '\n';
+        return Ok { std::move(id).unwrap() };
+    }
+
+    // Serves the metrics for scraping until the application goes away, see
+    // MetricsServer::start() for the endpoint syntax.
+    inline bool serveMetrics(std::string_view endpoint) {
+        auto server = MetricsServer::start(m_metrics, endpoint);
+        if (server.is_err()) {
+            std::cout << "Cannot serve metrics on " << endpoint << ": " << std::move(server).unwrap_err() << '\n';
+            return false;
+        }
+        m_metrics_server = std::move(server).unwrap();
+        return true;
+    }
+
+    // The scene node whose bounds the ray through window position (x, y)
+    // enters first, as of the last frame.
+    inline std::optional<SceneGraph::NodeId> pick(float x, float y) const {
+        if (m_surface_width == 0 || m_surface_height == 0) return std::nullopt;
+        float view[16], projection[16], view_projection[16], inverse[16];
+        m_camera.viewMatrix(view);
+        m_camera.projectionMatrix(static_cast<float>(m_surface_width) / static_cast<float>(m_surface_height), projection);
+        mat4Multiply(projection, view, view_projection);
+        mat4Invert(view_projection, inverse);
+
+        // the pixel on the near and far planes, y points down in the window
+        float ndc_x = 2.0f * x / static_cast<float>(m_surface_width) - 1.0f;
+        float ndc_y = 1.0f - 2.0f * y / static_cast<float>(m_surface_height);
+        float ends[2][3];
+        for (int end = 0; end < 2; end++) {
+            const float clip[4] = { ndc_x, ndc_y, static_cast<float>(end), 1.0f };
+            float world[4];
+            for (int r = 0; r < 4; r++) {
+                world[r] = inverse[r] * clip[0] + inverse[4 + r] * clip[1] + inverse[8 + r] * clip[2] + inverse[12 + r] * clip[3];
+            }
+            for (int i = 0; i < 3; i++) ends[end][i] = world[i] / world[3];
+        }
+        Ray ray;
+        for (int i = 0; i < 3; i++) {
+            ray.origin[i] = ends[0][i];
+            ray.direction[i] = ends[1][i] - ends[0][i];
+        }
+        ray.t_max = 1.0f;
+        RayHit hit = m_instance_bvh.raycast(ray);
+        if (!hit.hit()) return std::nullopt;
+        return hit.primitive;
+    }
+
+    // Scene nodes whose bounds touch the camera's frustum, for culling and
+    // for tools that work on what is on screen.
+    inline void visibleNodes(std::vector<SceneGraph::NodeId>& out) const {
+        float view[16], projection[16], view_projection[16];
+        float aspect = m_surface_height > 0 ? static_cast<float>(m_surface_width) / static_cast<float>(m_surface_height) : 1.0f;
+        m_camera.viewMatrix(view);
+        m_camera.projectionMatrix(aspect, projection);
+        mat4Multiply(projection, view, view_projection);
+        m_instance_bvh.queryFrustum(Frustum::fromMatrix(view_projection), out);
+    }
+
+    // Draws `node` with a material of materials(), 0 being the default.
+    // Materials whose base color alpha is below 1 draw in the transparent
+    // pass, in no particular order.
+    inline void setNodeMaterial(SceneGraph::NodeId node, uint32_t material) {
+        m_materials->setInstanceMaterial(node, material);
+    }
+
+    inline MaterialTable& materials() { return *m_materials; }
+
+    inline bool nodeTransparent(SceneGraph::NodeId node) const {
+        uint32_t material = m_materials->instanceMaterial(node);
+        return material < m_materials->materialCount() && m_materials->material(material).base_color[3] < 1.0f;
+    }
+
+    // Nodes whose origin is between `fade_start` and `fade_end` from the
+    // camera dissolve from the model into its impostor, beyond they are only
+    // the impostor. Does nothing for models without one.
+    inline void setImpostorRange(float fade_start, float fade_end) {
+        if (m_model_impostor) m_impostors->setFadeRange(m_queue, fade_start, fade_end);
+    }
+
+    // 1 while rendering straight into the surface
+    inline float renderScale() const {
+        return m_dynamic_resolution ? m_dynamic_resolution->scale() : 1.0f;
+    }
+
+    inline ~Application() {
+        m_capture.reset();
+        m_upscale.reset();
+        m_transparency.reset();
+        m_particles.reset();
+        m_skinning.reset();
+        m_render_pipeline.release();
+        m_transparent_pipeline.release();
+        m_impostor_pipeline.release();
+        m_object_cache->release(m_pipeline_layout);
+        if (m_lighting_bind_group) m_object_cache->release(m_lighting_bind_group);
+        m_object_cache->release(m_lighting_layout);
+        m_lighting.reset();
+        m_shadows.reset();
+        m_materials.reset();
+        m_impostors.reset();
+        m_object_cache.reset();
+        m_gpu_timer.reset();
+        m_gpu_heap->free(m_model_vertices);
+        m_gpu_heap->free(m_model_indices);
+        m_gpu_heap->free(m_instance_matrices);
+        m_gpu_heap->free(m_impostor_instances);
+        m_gpu_heap->free(m_impostor_quad);
+        m_gpu_heap.reset();
+        if (m_offscreen_target) m_gpu_memory->release(m_offscreen_target);
+        m_gpu_memory.reset();
+        m_queue.release();
+        if (m_surface) m_surface.release();
+        m_device.release();
+        m_instance.release();
+    }
+
+private:
+
+    // Drains the window's events. The ones that touch render state are
+    // handled here, or queued for the render thread when `forward` is set.
+    inline void pollEvents(bool forward) {
+        TRACE_ZONE("poll events");
+        // drained every frame, scripted windows count frames by it
+        for (auto event = m_window->pollEvent(); event.type != WindowEventType::None; event = m_window->pollEvent()) {
+            switch (event.type) {
+                case WindowEventType::Close: {
+                    m_need_close = true;
+                    return;
+                }
+                case WindowEventType::Resize:
+                case WindowEventType::MouseButton: {
+                    if (!forward) {
+                        handleEvent(event);
+                        break;
+                    }
+                    std::lock_guard lock(m_forwarded_mutex);
+                    m_forwarded_events.push_back(event);
+                    break;
+                }
+                default: break;
+            }
+        }
+    }
+
+    inline void handleForwardedEvents() {
+        {
+            std::lock_guard lock(m_forwarded_mutex);
+            m_forwarded_events.swap(m_handled_events);
+        }
+        for (const WindowEvent& event : m_handled_events) handleEvent(event);
+        m_handled_events.clear();
+    }
+
+    inline void handleEvent(const WindowEvent& event) {
+        if (event.type == WindowEventType::Resize) {
+            resize(event.resize_info.w, event.resize_info.h);
+        } else if (event.type == WindowEventType::MouseButton) {
+            if (event.button_info.button == LEFT_MOUSE_BUTTON && event.button_info.down) {
+                reportPick(event.button_info.x, event.button_info.y);
+            }
+        }
+    }
+
+    // Runs the steps that are due and publishes the result for rendering.
+    inline void stepSimulation() {
+        if (m_simulation.advance(std::chrono::steady_clock::now()) == 0) return;
+        m_simulation.snapshot(m_snapshots.back());
+        m_snapshots.publish();
+    }
+
+    // Takes the newest snapshot and blends it to this frame: the lights and
+    // the clock the skins are sampled at.
+    inline void applySnapshot() {
+        TRACE_ZONE("apply snapshot");
+        m_snapshots.acquire();
+        const SceneSnapshot& snapshot = m_snapshots.front();
+        float t = blendFactor(snapshot, std::chrono::steady_clock::now());
+        blendLights(snapshot, t, m_lights);
+        m_scene_time = static_cast<float>(snapshot.previous_time + (snapshot.time - snapshot.previous_time) * t);
+    }
+
+    inline wgpu::CommandBuffer encodeFrame(wgpu::Texture target, wgpu::TextureView target_view) {
+        TRACE_ZONE("encode");
+        wgpu::CommandEncoderDescriptor cmd_encoder_desc = {};
+        cmd_encoder_desc.nextInChain = nullptr;
+        cmd_encoder_desc.label = "My command encoder";
+        wgpu::CommandEncoder cmd_encoder = m_device.createCommandEncoder(cmd_encoder_desc);
+        // times every pass of the frame, compute included
+        m_gpu_timer->beginFrame(cmd_encoder);
+
+        // moves ranges before anything below writes or resolves them
+        compactHeap();
+
+        updateScene();
+        updateMaterials();
+        applySnapshot();
+
+        // skinned once here, every pass below draws the same output
+        animateSkins();
+        m_skinning->dispatch(m_queue, cmd_encoder);
+
+        // binned against this frame's camera before anything shades
+        ClusterView view = updateView();
+        m_shadows->update(m_lights, view);
+        m_lighting->dispatch(m_queue, cmd_encoder, m_lights, m_shadows->lightViews());
+        if (m_particles) {
+            // the scene clock stalls and jumps with the simulation, so
+            // does the particles' step
+            float dt = std::clamp(m_scene_time - m_particle_time, 0.0f, MAX_PARTICLE_STEP);
+            m_particle_time = m_scene_time;
+            m_particles->update(m_queue, cmd_encoder, m_particle_emitter, dt, view);
+        }
+
+        m_draw_queue.begin();
+        bool has_transparent = false;
+        {
+            TRACE_ZONE("collect draws");
+            has_transparent = collectModelDraws(view);
+            collectShadowDraws();
+        }
+        {
+            TRACE_ZONE("sort draws");
+            m_draw_queue.sort();
+        }
+
+        // draws pick their node's matrix through first_instance
+        GpuRange instances = m_gpu_heap->resolve(m_instance_matrices);
+        {
+            TRACE_ZONE("shadows");
+            m_shadows->encode(m_queue, cmd_encoder, [&](wgpu::RenderPassEncoder pass, ShadowCasters casters) {
+                pass.setVertexBuffer(INSTANCE_SLOT, instances.buffer, instances.offset, instances.size);
+                m_draw_queue.encode(pass, *m_gpu_heap, casters == ShadowCasters::Static ? SHADOW_STATIC_PASS : SHADOW_DYNAMIC_PASS);
+            });
+            TRACE_COUNTER("shadow static renders", m_shadows->stats().static_renders);
+        }
+
+        bool upscaled = m_upscale != nullptr;
+
+        wgpu::RenderPassDescriptor render_pass_desc = {};
+        render_pass_desc.nextInChain = nullptr;
+        render_pass_desc.label = "My render pass";
+
+        wgpu::RenderPassColorAttachment render_pass_color_attachment = {};
+        
+        render_pass_color_attachment.nextInChain = nullptr;
+        render_pass_color_attachment.view = upscaled ? m_upscale->targetView() : target_view;
+        render_pass_color_attachment.resolveTarget = nullptr;
+        render_pass_color_attachment.loadOp = wgpu::LoadOp::Clear;
+        render_pass_color_attachment.storeOp = wgpu::StoreOp::Store;
+        // render_pass_color_attachment.clearValue = wgpu::Color{ 0xf3 / 255.0, 0x59 / 255.0, 0x7c / 255.0, 1.0 };
+        render_pass_color_attachment.clearValue = wgpu::Color{ 0.15, 0.15, 0.15, 1.0 };
+#ifndef WEBGPU_BACKEND_WGPU
+        render_pass_color_attachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
+#endif // NOT WEBGPU_BACKEND_WGPU
+
+        render_pass_desc.colorAttachmentCount = 1;
+        render_pass_desc.colorAttachments = &render_pass_color_attachment;
+        render_pass_desc.depthStencilAttachment = nullptr;
+        render_pass_desc.timestampWrites = m_gpu_timer->passWrites(!upscaled && !has_transparent);
+
+        wgpu::RenderPassEncoder render_pass_encoder = cmd_encoder.beginRenderPass(render_pass_desc);
+        if (upscaled) {
+            uint32_t width = m_upscale->renderWidth();
+            uint32_t height = m_upscale->renderHeight();
+            render_pass_encoder.setViewport(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height), 0.0f, 1.0f);
+            render_pass_encoder.setScissorRect(0, 0, width, height);
+        }
+
+        render_pass_encoder.setVertexBuffer(INSTANCE_SLOT, instances.buffer, instances.offset, instances.size);
+        m_draw_queue.encode(render_pass_encoder, *m_gpu_heap, MAIN_PASS);
+        if (m_particles) m_particles->draw(render_pass_encoder);
+        TRACE_COUNTER("draws", m_draw_queue.stats().draws);
+        TRACE_COUNTER("pipeline binds", m_draw_queue.stats().pipeline_binds);
+        render_pass_encoder.end();
+        render_pass_encoder.release();
+
+        if (has_transparent) {
+            TRACE_ZONE("transparency");
+            uint32_t width = upscaled ? m_upscale->renderWidth() : m_surface_width;
+            uint32_t height = upscaled ? m_upscale->renderHeight() : m_surface_height;
+            m_transparency->encode(cmd_encoder, upscaled ? m_upscale->targetView() : target_view, width, height,
+                [&](wgpu::RenderPassEncoder pass) {
+                    pass.setVertexBuffer(INSTANCE_SLOT, instances.buffer, instances.offset, instances.size);
+                    m_draw_queue.encode(pass, *m_gpu_heap, TRANSPARENT_PASS);
+                }, m_gpu_timer->passWrites(!upscaled));
+        }
+
+        if (upscaled) {
+            TRACE_ZONE("upscale");
+            m_upscale->encode(cmd_encoder, target_view, m_gpu_timer->passWrites(true));
+        }
+        m_gpu_timer->endFrame(cmd_encoder);
+        if (m_capture) m_capture->encode(cmd_encoder, target);
+
+        wgpu::CommandBufferDescriptor cmd_buf_desc = {};
+        cmd_buf_desc.nextInChain = nullptr;
+        cmd_buf_desc.label = "Command buffer";
+        wgpu::CommandBuffer cmd_buf = cmd_encoder.finish(cmd_buf_desc);
+        cmd_encoder.release();
+        return cmd_buf;
+    }
+
+    // Compaction moves a range as soon as its copy is recorded, so a write()
+    // later this frame already targets the new offset. Queue writes run
+    // ahead of the next submit, the copies therefore go in a command buffer
+    // of their own, submitted before any of them.
+    inline void compactHeap() {
+        wgpu::CommandEncoderDescriptor encoder_desc = {};
+        encoder_desc.nextInChain = nullptr;
+        encoder_desc.label = "Heap compaction encoder";
+        wgpu::CommandEncoder encoder = m_device.createCommandEncoder(encoder_desc);
+        m_gpu_heap->compact(encoder, COMPACT_BYTES_PER_FRAME);
+        wgpu::CommandBufferDescriptor cmd_buf_desc = {};
+        cmd_buf_desc.nextInChain = nullptr;
+        cmd_buf_desc.label = "Heap compaction";
+        wgpu::CommandBuffer cmd_buf = encoder.finish(cmd_buf_desc);
+        encoder.release();
+        m_queue.submit(cmd_buf);
+        cmd_buf.release();
+    }
+
+    inline void requestDevice(wgpu::Adapter adapter) {
         wgpu::DeviceDescriptor dev_desc = {};
         dev_desc.nextInChain = nullptr;
         dev_desc.label = "My Device";
-        dev_desc.requiredFeatureCount = 0; // we do not require any specific feature
+        // timestamps only sharpen GPU frame timing, GpuTimer copes without them
+        WGPUFeatureName required_features[1] = { WGPUFeatureName_TimestampQuery };
+        dev_desc.requiredFeatureCount = adapter.hasFeature(wgpu::FeatureName::TimestampQuery) ? 1 : 0;
+        dev_desc.requiredFeatures = required_features;
         dev_desc.requiredLimits = nullptr; // we do not require any specific limit
         dev_desc.defaultQueue.nextInChain = nullptr;
         dev_desc.defaultQueue.label = "The default queue";
@@ -123,13 +951,17 @@ public:
 #ifdef WEBGPU_BACKEND_DAWN
         wgpu::DeviceLostCallbackInfo dev_lost_callback_info = {};
         dev_lost_callback_info.nextInChain = nullptr;
-        dev_lost_callback_info.callback = [](const WGPUDevice *device, WGPUDeviceLostReason reason, const char *message, void * /* p_user_data */) {
+        dev_lost_callback_info.callback = [](const WGPUDevice *device, WGPUDeviceLostReason reason, const char *message, void *p_user_data) {
             std::cout << "Device lost: reason " << reason;
             if (message) std::cout << " (" << message << ")";
             std::cout << '\n';
+            auto *app = static_cast<Application*>(p_user_data);
+            if (reason != WGPUDeviceLostReason_Destroyed && app->m_gpu_memory) {
+                app->m_gpu_memory->report(std::cout);
+            }
         };
         dev_lost_callback_info.mode = wgpu::CallbackMode::AllowProcessEvents;
-        dev_lost_callback_info.userdata = nullptr;
+        dev_lost_callback_info.userdata = this;
         dev_desc.deviceLostCallbackInfo = dev_lost_callback_info;
 
         wgpu::DawnTogglesDescriptor toggles;
@@ -141,11 +973,16 @@ public:
         toggles.enabledToggles = &toggle_name;
         dev_desc.nextInChain = &toggles.chain;
 #else
-        dev_desc.deviceLostCallback = [](WGPUDeviceLostReason reason, const char *message, void * /* p_user_data */) {
+        dev_desc.deviceLostCallback = [](WGPUDeviceLostReason reason, const char *message, void *p_user_data) {
             std::cout << "Device lost: reason " << reason;
             if (message) std::cout << " (" << message << ")";
             std::cout << '\n';
+            auto *app = static_cast<Application*>(p_user_data);
+            if (app->m_gpu_memory) {
+                app->m_gpu_memory->report(std::cout);
+            }
         };
+        dev_desc.deviceLostUserdata = this;
 #endif // WEBGPU_BACKEND_DAWN
 
         m_device = adapter.requestDevice(dev_desc);
@@ -157,117 +994,383 @@ public:
             abort();
         };
         m_device_err_callback_holder = m_device.setUncapturedErrorCallback(std::move(on_dev_error));
+        m_queue = m_device.getQueue();
+    }
+
+    inline void configureSurface(wgpu::Adapter adapter) {
+        auto config = m_window->getConfig();
+        m_surface_width = config.w;
+        m_surface_height = config.h;
+        m_surface_format = wgpu::TextureFormat::RGBA8Unorm;
+        if (m_surface) m_surface_format = m_surface.getPreferredFormat(adapter);
+        applySurfaceConfig();
+    }
 
-        inspectDevice(m_device);
+    inline void resize(int w, int h) {
+        if (w <= 0 || h <= 0) return;
+        m_surface_width = static_cast<uint32_t>(w);
+        m_surface_height = static_cast<uint32_t>(h);
+        applySurfaceConfig();
+        if (m_upscale && !m_upscale->resize(m_dynamic_resolution->maxScaled(m_surface_width), m_dynamic_resolution->maxScaled(m_surface_height))) {
+            std::cout << "Dynamic resolution disabled: cannot allocate the render target\n";
+            disableDynamicResolution();
+        } else if (m_upscale) {
+            applyRenderScale();
+        }
+        resizeTransparency();
+    }
+
+    // The transparency targets match whatever the main pass draws into.
+    inline void resizeTransparency() {
+        if (!m_transparency) return;
+        uint32_t width = m_upscale ? m_upscale->targetWidth() : m_surface_width;
+        uint32_t height = m_upscale ? m_upscale->targetHeight() : m_surface_height;
+        if (!m_transparency->resize(width, height)) {
+            std::cout << "Cannot allocate the transparency targets\n";
+        }
+    }
 
+    inline void applySurfaceConfig() {
+        if (!m_surface) {
+            createOffscreenTarget();
+            return;
+        }
         wgpu::SurfaceConfiguration surface_config = {};
-        auto config = m_window->getConfig();
-        surface_config.width = config.w;
-        surface_config.height = config.h;
-        surface_config.format = m_surface_format = m_surface.getPreferredFormat(adapter);
-        surface_config.usage = wgpu::TextureUsage::RenderAttachment;
+        surface_config.width = m_surface_width;
+        surface_config.height = m_surface_height;
+        surface_config.format = m_surface_format;
+        // copies out of the surface are only asked for while capturing
+        surface_config.usage = m_surface_copy_src
+            ? wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::CopySrc
+            : wgpu::TextureUsage::RenderAttachment;
         surface_config.viewFormatCount = 0;
         surface_config.viewFormats = nullptr;
         surface_config.device = m_device;
         surface_config.presentMode = wgpu::PresentMode::Fifo;
         surface_config.alphaMode = wgpu::CompositeAlphaMode::Auto;
         m_surface.configure(surface_config);
+    }
 
-        adapter.release();
+    // Stands in for the surface of a window without a display. Capture can
+    // always copy from it.
+    inline void createOffscreenTarget() {
+        if (m_offscreen_target) m_gpu_memory->release(m_offscreen_target);
+        wgpu::TextureDescriptor target_desc = {};
+        target_desc.label = "Offscreen target";
+        target_desc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::CopySrc;
+        target_desc.dimension = wgpu::TextureDimension::_2D;
+        target_desc.size = { std::max(m_surface_width, 1u), std::max(m_surface_height, 1u), 1 };
+        target_desc.format = m_surface_format;
+        target_desc.mipLevelCount = 1;
+        target_desc.sampleCount = 1;
+        target_desc.viewFormatCount = 0;
+        target_desc.viewFormats = nullptr;
+        m_offscreen_target = m_gpu_memory->createTexture(target_desc, GpuMemoryCategory::RenderTarget);
+    }
 
-        m_queue = m_device.getQueue();
+    inline void initializeGpuServices() {
+        m_gpu_memory = std::make_unique<GpuMemoryTracker>(m_device);
+        m_gpu_heap = std::make_unique<GpuHeap>(*m_gpu_memory, m_frame_fence);
+        m_gpu_memory->addEvictionCallback([this](uint64_t /* bytes */) {
+            return m_gpu_heap->trim();
+        });
+        m_gpu_timer = std::make_unique<GpuTimer>(m_device, *m_gpu_memory);
+        m_object_cache = std::make_unique<GpuObjectCache>(m_device, m_frame_fence);
+        m_skinning = std::make_unique<GpuSkinning>(m_device, *m_gpu_memory, *m_object_cache, m_frame_fence,
+            _binary_assets_wgsl_skinning_wgsl_start);
+        m_lighting = std::make_unique<ClusteredLighting>(m_device, *m_gpu_memory, *m_object_cache,
+            _binary_assets_wgsl_clustered_lights_wgsl_start);
+        m_shadows = std::make_unique<ShadowAtlas>(m_device, *m_gpu_memory, *m_object_cache,
+            _binary_assets_wgsl_shadow_wgsl_start);
+        m_materials = std::make_unique<MaterialTable>(m_device, *m_gpu_memory, *m_object_cache);
+        m_impostors = std::make_unique<ImpostorAtlas>(m_device, *m_gpu_memory, *m_object_cache,
+            _binary_assets_wgsl_impostor_bake_wgsl_start);
+    }
 
-        initializeRenderPipline();
+    // Recomputes moved transforms and uploads the changed matrices, or the
+    // whole array when it outgrew the instance buffer.
+    inline void updateScene() {
+        m_scene.update(ThreadPool::global());
+        std::span<const WorldMatrix> worlds = m_scene.worldMatrices();
+        if (worlds.size() > m_instance_capacity) {
+            uint32_t capacity = std::max<uint32_t>(static_cast<uint32_t>(worlds.size()), std::max(m_instance_capacity * 2, 64u));
+            m_gpu_heap->free(m_instance_matrices);
+            m_instance_matrices = m_gpu_heap->allocate(GpuHeapUsage::Vertex, capacity * sizeof(WorldMatrix))
+                .expect("cannot allocate instance matrices");
+            m_instance_capacity = capacity;
+            m_gpu_heap->write(m_queue, m_instance_matrices, worlds.data(), worlds.size_bytes());
+            updateShadowCasters();
+            updateInstanceBvh();
+            return;
+        }
+        m_scene.forEachChangedRun([&](uint32_t first, uint32_t count) {
+            m_gpu_heap->write(m_queue, m_instance_matrices, &worlds[first], count * sizeof(WorldMatrix), first * sizeof(WorldMatrix));
+        });
+        updateShadowCasters();
+        updateInstanceBvh();
+    }
 
-        initializeBuffer();
+    // A node that moves becomes a dynamic caster until it has stayed put for
+    // SHADOW_SETTLE_FRAMES. Cached views are rendered again only for the
+    // lights reaching a static caster that starts moving, whose old shadow
+    // the cache still holds, or a dynamic one that settles, which the cache
+    // does not hold yet. Reads the bounds before updateInstanceBvh() moves
+    // them.
+    inline void updateShadowCasters() {
+        m_caster_motion.resize(m_scene.worldMatrices().size(), 0);
+        // a skinned model moves every frame, it is never cached
+        if (!m_skins.empty()) return;
+        auto invalidate = [&](SceneGraph::NodeId node) {
+            if (node < m_instance_bounds.size() && !m_instance_bounds[node].empty()) {
+                m_shadows->invalidateStatic(m_instance_bounds[node].min, m_instance_bounds[node].max);
+            }
+        };
+        m_scene.forEachChangedRun([&](uint32_t node, uint32_t) {
+            if (m_caster_motion[node] == 0) {
+                invalidate(node);
+                m_dynamic_casters.push_back(node);
+            }
+            // one frame of which is counted off below
+            m_caster_motion[node] = SHADOW_SETTLE_FRAMES + 1;
+        }, 0);
+        // a settled node has not moved since its bounds were last computed
+        std::erase_if(m_dynamic_casters, [&](SceneGraph::NodeId node) {
+            if (--m_caster_motion[node] > 0) return false;
+            if (m_scene.alive(node)) invalidate(node);
+            return true;
+        });
     }
 
-    inline void mainLoop() {
-        auto event = m_window->pollEvent();
-        switch (event.type) {
-            case WindowEventType::Close: {
-                m_need_close = true;
-                return;
+    // A shadow draw per node within reach of a light with a tile: the
+    // dynamic casters every frame, the static ones only when a cached view
+    // is rendered again. Lights only see the shadow views, so nodes off
+    // screen still cast.
+    inline void collectShadowDraws() {
+        const bool static_dirty = m_shadows->staticDirty();
+        m_shadow_casters.clear();
+        if (static_dirty || !m_dynamic_casters.empty() || !m_skins.empty()) {
+            std::span<const uint32_t> light_views = m_shadows->lightViews();
+            for (size_t i = 0; i < m_lights.size(); i++) {
+                if (light_views[i] == ClusteredLighting::NO_SHADOW) continue;
+                const Light& light = m_lights[i];
+                Aabb reach;
+                for (int axis = 0; axis < 3; axis++) {
+                    reach.min[axis] = light.position[axis] - light.range;
+                    reach.max[axis] = light.position[axis] + light.range;
+                }
+                m_instance_bvh.queryAabb(reach, m_shadow_casters);
             }
-            default: break;
+            std::sort(m_shadow_casters.begin(), m_shadow_casters.end());
+            m_shadow_casters.erase(std::unique(m_shadow_casters.begin(), m_shadow_casters.end()), m_shadow_casters.end());
         }
 
-        // get the surface texture
-        wgpu::SurfaceTexture surface_texture;
-        m_surface.getCurrentTexture(&surface_texture);
-        wgpu::Texture texture = surface_texture.texture;
-        // Create a view for this surface texture
-        wgpu::TextureViewDescriptor texture_view_desc = {};
-        texture_view_desc.nextInChain = nullptr;
-        texture_view_desc.label = "Surface texture view";
-        texture_view_desc.format = texture.getFormat();
-        texture_view_desc.dimension = wgpu::TextureViewDimension::_2D;
-        texture_view_desc.baseMipLevel = 0;
-        texture_view_desc.mipLevelCount = 1;
-        texture_view_desc.baseArrayLayer = 0;
-        texture_view_desc.arrayLayerCount = 1;
-        texture_view_desc.aspect = wgpu::TextureAspect::All;
-        wgpu::TextureView target_view = texture.createView(texture_view_desc);
+        DrawCommand shadow_draw {};
+        shadow_draw.index_count = m_index_count;
+        for (SceneGraph::NodeId node : m_shadow_casters) {
+            if (!m_scene.alive(node)) continue;
+            bool dynamic = !m_skins.empty() || (node < m_caster_motion.size() && m_caster_motion[node] > 0);
+            if (!dynamic && !static_dirty) continue;
+            shadow_draw.first_instance = node;
+            uint32_t pass = dynamic ? SHADOW_DYNAMIC_PASS : SHADOW_STATIC_PASS;
+            m_draw_queue.push(DrawKey::make(pass, m_shadow_pipeline_id, DrawQueue::NO_BIND_GROUP, m_model_mesh_id, 0.0f), shadow_draw);
+        }
+    }
 
-        if(!target_view) {
-            m_need_close = true;
+    // A draw per visible node near the camera, and one instanced draw of
+    // the impostor for every node far enough away; both while a node fades
+    // from one to the other. Returns whether any draw is transparent.
+    inline bool collectModelDraws(const ClusterView& view) {
+        float view_projection[16];
+        mat4Multiply(view.projection, view.view, view_projection);
+        m_visible_nodes.clear();
+        m_instance_bvh.queryFrustum(Frustum::fromMatrix(view_projection), m_visible_nodes);
+
+        std::span<const WorldMatrix> worlds = m_scene.worldMatrices();
+        const GpuImpostorParams& fade = m_impostors->params();
+        bool has_transparent = false;
+        m_impostor_batch.clear();
+        DrawCommand model_draw {};
+        model_draw.index_count = m_index_count;
+        for (SceneGraph::NodeId node : m_visible_nodes) {
+            if (!m_scene.alive(node)) continue;
+            model_draw.first_instance = node;
+            // blending needs the whole mesh, it never turns into an impostor
+            if (nodeTransparent(node)) {
+                m_draw_queue.push(DrawKey::make(TRANSPARENT_PASS, m_transparent_pipeline_id, m_lighting_bind_group_id, m_model_mesh_id, 0.0f), model_draw);
+                has_transparent = true;
+                continue;
+            }
+            // as instanceFade() in test.wgsl, from the node's origin
+            const float *p_world = worlds[node].m;
+            float dx = p_world[12] - m_camera.eye[0];
+            float dy = p_world[13] - m_camera.eye[1];
+            float dz = p_world[14] - m_camera.eye[2];
+            float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            if (m_model_impostor && distance >= fade.fade_start) {
+                wgsl::test::ImpostorIn& impostor = m_impostor_batch.emplace_back();
+                std::memcpy(impostor.world0, &p_world[0], sizeof(impostor.world0));
+                std::memcpy(impostor.world1, &p_world[4], sizeof(impostor.world1));
+                std::memcpy(impostor.world2, &p_world[8], sizeof(impostor.world2));
+                std::memcpy(impostor.world3, &p_world[12], sizeof(impostor.world3));
+                std::memcpy(impostor.sphere, m_model_sphere, sizeof(impostor.sphere));
+                impostor.layer = *m_model_impostor;
+                if (distance >= fade.fade_end) continue;
+            }
+            m_draw_queue.push(DrawKey::make(MAIN_PASS, m_model_pipeline_id, m_lighting_bind_group_id, m_model_mesh_id, 0.0f), model_draw);
+        }
+        if (!m_impostor_batch.empty() && uploadImpostorBatch()) {
+            DrawCommand impostor_draw {};
+            impostor_draw.index_count = 6;
+            impostor_draw.instance_count = static_cast<uint32_t>(m_impostor_batch.size());
+            m_draw_queue.push(DrawKey::make(MAIN_PASS, m_impostor_pipeline_id, m_lighting_bind_group_id, m_impostor_mesh_id, 0.0f), impostor_draw);
+        }
+        TRACE_COUNTER("impostors", m_impostor_batch.size());
+        return has_transparent;
+    }
+
+    // Writes this frame's impostor instances, growing their buffer first.
+    inline bool uploadImpostorBatch() {
+        uint32_t count = static_cast<uint32_t>(m_impostor_batch.size());
+        if (count > m_impostor_capacity) {
+            uint32_t capacity = std::max(count, m_impostor_capacity * 2);
+            auto instances = m_gpu_heap->allocate(GpuHeapUsage::Vertex, static_cast<uint64_t>(capacity) * sizeof(wgsl::test::ImpostorIn));
+            if (instances.is_err()) return false;
+            m_gpu_heap->free(m_impostor_instances);
+            m_impostor_instances = std::move(instances).unwrap();
+            m_impostor_capacity = capacity;
+            m_draw_queue.replaceMesh(m_impostor_mesh_id, DrawMesh { m_impostor_instances, m_impostor_quad, wgpu::IndexFormat::Uint16 });
+        }
+        m_gpu_heap->write(m_queue, m_impostor_instances, m_impostor_batch.data(), count * sizeof(wgsl::test::ImpostorIn));
+        return true;
+    }
+
+    // Keeps the instance BVH on the scene's world bounds: rebuilt when ids
+    // were added, refitted along the changed ids otherwise.
+    inline void updateInstanceBvh() {
+        TRACE_ZONE("update instance bvh");
+        std::span<const WorldMatrix> worlds = m_scene.worldMatrices();
+        auto bounds = [&](SceneGraph::NodeId node) {
+            return m_scene.alive(node) ? transformAabb(m_model_bounds, worlds[node].m) : Aabb {};
+        };
+        if (m_instance_bounds.size() != worlds.size()) {
+            m_instance_bounds.resize(worlds.size());
+            for (uint32_t node = 0; node < worlds.size(); node++) m_instance_bounds[node] = bounds(node);
+            m_instance_bvh.build(m_instance_bounds, ThreadPool::global());
             return;
         }
+        m_moved_instances.clear();
+        m_scene.forEachChangedRun([&](uint32_t first, uint32_t count) {
+            for (uint32_t node = first; node < first + count; node++) {
+                m_instance_bounds[node] = bounds(node);
+                m_moved_instances.push_back(node);
+            }
+        });
+        if (!m_moved_instances.empty()) m_instance_bvh.refit(m_instance_bounds, m_moved_instances);
+    }
 
-        wgpu::CommandEncoderDescriptor cmd_encoder_desc = {};
-        cmd_encoder_desc.nextInChain = nullptr;
-        cmd_encoder_desc.label = "My command encoder";
-        wgpu::CommandEncoder cmd_encoder = m_device.createCommandEncoder(cmd_encoder_desc);
+    // Samples each skinned instance's clip and writes its joint matrices.
+    // Instances are independent, so they spread over the pool.
+    inline void animateSkins() {
+        if (m_skins.empty()) return;
+        TRACE_ZONE("animate skins");
+        ThreadPool::global().parallelFor(m_skins.size(), [&](size_t i) {
+            SkinnedInstance& skin = m_skins[i];
+            if (skin.clip < m_animations.size()) {
+                sampleClip(m_animations[skin.clip], m_scene_time, true, skin.pose);
+            } else {
+                skin.pose = m_skeleton.rest;
+            }
+            std::span<float> matrices = m_skinning->jointMatrices(skin.instance);
+            computeSkinMatrices(m_skeleton, skin.pose, skin.scratch, std::span<JointMatrix>(
+                reinterpret_cast<JointMatrix*>(matrices.data()), matrices.size() / GpuSkinning::JOINT_FLOATS));
+        });
+    }
 
-        wgpu::RenderPassDescriptor render_pass_desc = {};
-        render_pass_desc.nextInChain = nullptr;
-        render_pass_desc.label = "My render pass";
+    // The frame's camera, at the extent the main pass renders to.
+    inline ClusterView updateView() {
+        ClusterView view {};
+        view.width = m_upscale ? m_upscale->renderWidth() : m_surface_width;
+        view.height = m_upscale ? m_upscale->renderHeight() : m_surface_height;
+        float aspect = view.height > 0 ? static_cast<float>(view.width) / static_cast<float>(view.height) : 1.0f;
+        m_camera.viewMatrix(view.view);
+        m_camera.projectionMatrix(aspect, view.projection);
+        view.near_plane = m_camera.near_plane;
+        view.far_plane = m_camera.far_plane;
+        m_lighting->setView(view);
+        return view;
+    }
 
-        wgpu::RenderPassColorAttachment render_pass_color_attachment = {};
-        
-        render_pass_color_attachment.nextInChain = nullptr;
-        render_pass_color_attachment.view = target_view;
-        render_pass_color_attachment.resolveTarget = nullptr;
-        render_pass_color_attachment.loadOp = wgpu::LoadOp::Clear;
-        render_pass_color_attachment.storeOp = wgpu::StoreOp::Store;
-        // render_pass_color_attachment.clearValue = wgpu::Color{ 0xf3 / 255.0, 0x59 / 255.0, 0x7c / 255.0, 1.0 };
-        render_pass_color_attachment.clearValue = wgpu::Color{ 0.15, 0.15, 0.15, 1.0 };
-#ifndef WEBGPU_BACKEND_WGPU
-        render_pass_color_attachment.depthSlice = WGPU_DEPTH_SLICE_UNDEFINED;
-#endif // NOT WEBGPU_BACKEND_WGPU
+    inline static double secondsSince(std::chrono::steady_clock::time_point begin,
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now()) {
+        return std::chrono::duration<double>(end - begin).count();
+    }
 
-        render_pass_desc.colorAttachmentCount = 1;
-        render_pass_desc.colorAttachments = &render_pass_color_attachment;
-        render_pass_desc.depthStencilAttachment = nullptr;
-        render_pass_desc.timestampWrites = nullptr;
+    inline void registerMetrics() {
+        const auto buckets = std::span<const double>(metrics::FRAME_SECONDS_BUCKETS);
+        m_frame_metrics.p_frame = &m_metrics.histogram("nocturne_frame_seconds",
+            "Time between the starts of consecutive frames.", buckets);
+        m_frame_metrics.p_encode = &m_metrics.histogram("nocturne_encode_seconds",
+            "CPU time recording a frame's commands.", buckets);
+        m_frame_metrics.p_submit = &m_metrics.histogram("nocturne_submit_seconds",
+            "CPU time in queue submit.", buckets);
+        m_frame_metrics.p_present_wait = &m_metrics.histogram("nocturne_present_wait_seconds",
+            "Time blocked acquiring and presenting surface textures.", buckets);
+        m_frame_metrics.p_gpu_frame = &m_metrics.histogram("nocturne_gpu_frame_seconds",
+            "GPU time of a frame, from timestamp queries.", buckets);
+        m_frame_metrics.p_frames = &m_metrics.counter("nocturne_frames_total", "Frames submitted.");
+        m_frame_metrics.p_draws = &m_metrics.counter("nocturne_draws_total", "Draws queued, over every pass.");
+        m_frame_metrics.p_triangles = &m_metrics.counter("nocturne_triangles_total", "Triangles drawn, over every pass.");
+        m_frame_metrics.p_uploads = &m_metrics.counter("nocturne_uploads_total", "Writes into the GPU heap.");
+        m_frame_metrics.p_upload_bytes = &m_metrics.counter("nocturne_upload_bytes_total", "Bytes written into the GPU heap.");
+        for (size_t i = 0; i < GPU_MEMORY_CATEGORY_COUNT; i++) {
+            std::string labels = std::string("category=\"") + gpuMemoryCategoryName(static_cast<GpuMemoryCategory>(i)) + "\"";
+            m_frame_metrics.p_memory[i] = &m_metrics.gauge("nocturne_gpu_memory_bytes",
+                "Bytes of live GPU buffers, textures and query sets.", labels);
+        }
+    }
 
-        wgpu::RenderPassEncoder render_pass_encoder = cmd_encoder.beginRenderPass(render_pass_desc);
+    // Rounds a byte count up to what writeBuffer accepts.
+    inline static uint64_t alignTo4(uint64_t size) {
+        return (size + 3) & ~uint64_t(3);
+    }
 
-        render_pass_encoder.setPipeline(m_render_pipeline);
-        render_pass_encoder.setVertexBuffer(0, m_model_vertices_buffer, 0, m_model_vertices_buffer.getSize());
-        render_pass_encoder.setIndexBuffer(m_model_indices_buffer, wgpu::IndexFormat::Uint32, 0, m_model_indices_buffer.getSize());
-        render_pass_encoder.drawIndexed(m_index_count, 1, 0, 0, 0);
-        render_pass_encoder.end();
-        render_pass_encoder.release();
+    // Uploads any byte count, a tail short of four bytes is zero padded.
+    inline void writeUnaligned(GpuAllocation allocation, std::span<const std::byte> data) {
+        uint64_t aligned = data.size() & ~uint64_t(3);
+        if (aligned > 0) m_gpu_heap->write(m_queue, allocation, data.data(), aligned);
+        if (aligned == data.size()) return;
+        std::byte tail[4] {};
+        std::memcpy(tail, data.data() + aligned, data.size() - aligned);
+        m_gpu_heap->write(m_queue, allocation, tail, sizeof(tail), aligned);
+    }
 
-        wgpu::CommandBufferDescriptor cmd_buf_desc = {};
-        cmd_buf_desc.nextInChain = nullptr;
-        cmd_buf_desc.label = "Command buffer";
-        wgpu::CommandBuffer cmd_buf = cmd_encoder.finish(cmd_buf_desc);
-        cmd_encoder.release();
-        m_queue.submit(cmd_buf);
-        cmd_buf.release();
+    // Prints the scene node under a click, or that there is none.
+    inline void reportPick(float x, float y) {
+        if (auto node = pick(x, y)) {
+            std::cout << "Picked scene node " << *node << '\n';
+        } else {
+            std::cout << "Picked nothing\n";
+        }
+    }
 
-        target_view.release();
-#ifndef __EMSCRIPTEN__
-        m_surface.present();
-#endif
-#ifndef WEBGPU_BACKEND_WGPU
-        // We no longer need the texture, only its view
-        // (NB: with wgpu-native, surface textures must not be manually released)
-        texture.release();
-#endif // WEBGPU_BACKEND_WGPU
+    // Publishes the frame's counts. Only atomics are touched, a scrape in
+    // flight never holds this thread up.
+    inline void recordFrameMetrics(double present_wait) {
+        if (m_surface) m_frame_metrics.p_present_wait->observe(present_wait);
+        m_frame_metrics.p_frames->add();
+        m_frame_metrics.p_draws->add(m_draw_queue.stats().draws);
+        m_frame_metrics.p_triangles->add(m_draw_queue.stats().triangles);
+        m_frame_metrics.p_uploads->add(m_gpu_heap->uploadCount() - m_frame_metrics.reported_uploads);
+        m_frame_metrics.p_upload_bytes->add(m_gpu_heap->uploadedBytes() - m_frame_metrics.reported_upload_bytes);
+        m_frame_metrics.reported_uploads = m_gpu_heap->uploadCount();
+        m_frame_metrics.reported_upload_bytes = m_gpu_heap->uploadedBytes();
+        for (size_t i = 0; i < GPU_MEMORY_CATEGORY_COUNT; i++) {
+            m_frame_metrics.p_memory[i]->set(static_cast<double>(m_gpu_memory->stats(static_cast<GpuMemoryCategory>(i)).live_bytes));
+        }
+    }
 
+    // Processes pending callbacks, waiting a little where the backend needs it.
+    inline void pumpDevice() {
 #if defined(WEBGPU_BACKEND_DAWN)
         m_device.tick();
 #elif defined(WEBGPU_BACKEND_WGPU)
@@ -275,26 +1378,29 @@ public:
 #elif defined(WEBGPU_BACKEND_EMSCRIPTEN)
         emscripten_sleep(100);
 #endif
-
     }
 
-    inline bool needClose() const {
-        return m_need_close;
+    inline void updateRenderScale() {
+        std::optional<double> gpu_ms = m_gpu_timer->poll();
+        if (!gpu_ms) return;
+        TRACE_COUNTER("gpu frame ms", *gpu_ms);
+        m_frame_metrics.p_gpu_frame->observe(*gpu_ms * 1e-3);
+        if (m_dynamic_resolution && m_dynamic_resolution->update(*gpu_ms)) {
+            applyRenderScale();
+        }
     }
 
-    inline ~Application() {
-        m_model_vertices_buffer.release();
-        m_model_indices_buffer.release();
-        m_render_pipeline.release();
-        m_queue.release();
-        m_surface.release();
-        m_device.release();
-        m_instance.release();
+    inline void applyRenderScale() {
+        TRACE_COUNTER("render scale", m_dynamic_resolution->scale());
+        m_upscale->setRenderExtent(
+            m_queue,
+            m_dynamic_resolution->scaled(m_surface_width),
+            m_dynamic_resolution->scaled(m_surface_height)
+        );
     }
 
-private:
-
     inline void initializeRenderPipline() {
+        TRACE_ZONE("initializeRenderPipline");
         wgpu::ShaderModuleDescriptor shader_module_desc = {};
 #ifdef WEBGPU_BACKEND_WGPU
         shader_module_desc.hintCount = 0;
@@ -312,22 +1418,12 @@ private:
 
         wgpu::RenderPipelineDescriptor render_pipline_desc = {};
 
-        wgpu::VertexBufferLayout vertex_buffer_layout[1] = {{}};
-        wgpu::VertexAttribute vertex_attr[1] = {{}};
-        vertex_attr[0].format = wgpu::VertexFormat::Float32x3;
-        vertex_attr[0].offset = 0;
-        vertex_attr[0].shaderLocation = 0;
-
-        vertex_buffer_layout[0].attributeCount = 1;
-        vertex_buffer_layout[0].attributes = vertex_attr;
-        vertex_buffer_layout[0].arrayStride = 3*sizeof(float);
-        vertex_buffer_layout[0].stepMode = wgpu::VertexStepMode::Vertex;
-
-        render_pipline_desc.vertex.bufferCount = 1;
-        render_pipline_desc.vertex.buffers = vertex_buffer_layout;
+        // per-vertex attributes and the per-instance world matrix columns
+        render_pipline_desc.vertex.bufferCount = wgsl::test::vs_main::BUFFER_COUNT;
+        render_pipline_desc.vertex.buffers = wgsl::test::vs_main::BUFFERS;
 
         render_pipline_desc.vertex.module = shader_module;
-        render_pipline_desc.vertex.entryPoint = "vs_main";
+        render_pipline_desc.vertex.entryPoint = wgsl::test::vs_main::ENTRY_POINT;
         render_pipline_desc.vertex.constantCount = 0;
         render_pipline_desc.vertex.constants = nullptr;
 
@@ -338,7 +1434,7 @@ private:
 
         wgpu::FragmentState frag_state = {};
         frag_state.module = shader_module;
-        frag_state.entryPoint = "fs_main";
+        frag_state.entryPoint = wgsl::test::fs_main::ENTRY_POINT;
         frag_state.constantCount = 0;
         frag_state.constants = nullptr;
 
@@ -365,50 +1461,474 @@ private:
         render_pipline_desc.multisample.mask = ~0u;
 
         render_pipline_desc.multisample.alphaToCoverageEnabled = false;
-        render_pipline_desc.layout = nullptr;
+        // the camera and the clustered light lists
+        wgpu::BindGroupLayoutDescriptor bind_group_layout_desc = {};
+        bind_group_layout_desc.label = "Model lighting bind group layout";
+        bind_group_layout_desc.entryCount = wgsl::test::group0::ENTRY_COUNT;
+        bind_group_layout_desc.entries = wgsl::test::group0::ENTRIES;
+        m_lighting_layout = m_object_cache->acquire(bind_group_layout_desc);
+
+        WGPUBindGroupLayout bind_group_layouts[1] = { m_lighting_layout };
+        wgpu::PipelineLayoutDescriptor pipeline_layout_desc = {};
+        pipeline_layout_desc.label = "Model pipeline layout";
+        pipeline_layout_desc.bindGroupLayoutCount = 1;
+        pipeline_layout_desc.bindGroupLayouts = bind_group_layouts;
+        m_pipeline_layout = m_object_cache->acquire(pipeline_layout_desc);
+        render_pipline_desc.layout = m_pipeline_layout;
+        createRenderPipelineAsync(render_pipline_desc, m_render_pipeline);
+
+        // the same geometry and bindings, blended into the OIT targets
+        m_transparency = std::make_unique<TransparencyPass>(m_device, *m_gpu_memory, *m_object_cache,
+            _binary_assets_wgsl_oit_composite_wgsl_start, m_surface_format);
+        resizeTransparency();
+        wgpu::FragmentState transparent_frag_state = frag_state;
+        transparent_frag_state.entryPoint = wgsl::test::fs_transparent::ENTRY_POINT;
+        transparent_frag_state.targetCount = TransparencyPass::TARGET_COUNT;
+        transparent_frag_state.targets = m_transparency->targets();
+        render_pipline_desc.fragment = &transparent_frag_state;
+        createRenderPipelineAsync(render_pipline_desc, m_transparent_pipeline);
 
-        m_render_pipeline = m_device.createRenderPipeline(render_pipline_desc);
+        // far nodes, a quad each out of the per-instance buffer alone
+        render_pipline_desc.vertex.bufferCount = wgsl::test::vs_impostor::BUFFER_COUNT;
+        render_pipline_desc.vertex.buffers = wgsl::test::vs_impostor::BUFFERS;
+        render_pipline_desc.vertex.entryPoint = wgsl::test::vs_impostor::ENTRY_POINT;
+        wgpu::FragmentState impostor_frag_state = frag_state;
+        impostor_frag_state.entryPoint = wgsl::test::fs_impostor::ENTRY_POINT;
+        render_pipline_desc.fragment = &impostor_frag_state;
+        createRenderPipelineAsync(render_pipline_desc, m_impostor_pipeline);
 
         shader_module.release();
     }
 
-    inline void initializeBuffer() {
-        Model model;
-        model.loadModelFromMemory(
-            (const void *)_binary_assets_model_monkey_head_obj_start, 
-            _binary_assets_model_monkey_head_obj_end - _binary_assets_model_monkey_head_obj_start
-        );
+    // Compiles in the background into `target`, awaitRenderPipeline()
+    // waits for it.
+    inline void createRenderPipelineAsync(const wgpu::RenderPipelineDescriptor& desc, wgpu::RenderPipeline& target) {
+        wgpuDeviceCreateRenderPipelineAsync(m_device, &desc, [](WGPUCreatePipelineAsyncStatus status, WGPURenderPipeline pipeline, const char *message, void *p_user_data) {
+            if (status != WGPUCreatePipelineAsyncStatus_Success) {
+                std::cout << "Cannot create render pipeline: status " << status;
+                if (message) std::cout << " (" << message << ")";
+                std::cout << '\n';
+                abort();
+            }
+            *static_cast<wgpu::RenderPipeline*>(p_user_data) = pipeline;
+        }, &target);
+    }
 
-        wgpu::BufferDescriptor buffer_desc = {};
-        buffer_desc.size = sizeof(vertex_data);
-        buffer_desc.usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Vertex;
-        buffer_desc.mappedAtCreation = false;
+    inline void awaitRenderPipeline() {
+        while (!m_render_pipeline || !m_transparent_pipeline || !m_impostor_pipeline) {
+            pumpDevice();
+        }
+    }
 
-        buffer_desc.size = model.m_vertices.size() * sizeof(model.m_vertices[0]);
-        buffer_desc.label = "Model vertices";
-        m_model_vertices_buffer = m_device.createBuffer(buffer_desc);
-        m_queue.writeBuffer(m_model_vertices_buffer, 0, model.m_vertices.data(), buffer_desc.size);
+    inline void initializeBuffer(const Model& model) {
+        TRACE_ZONE("initializeBuffer");
+        if (!model.m_skin_weights.empty()) {
+            initializeSkin(model);
+        }
+        if (m_skins.empty()) {
+            uint64_t vertices_size = model.m_vertices.size() * sizeof(model.m_vertices[0]);
+            m_model_vertices = m_gpu_heap->allocate(GpuHeapUsage::Vertex, vertices_size)
+                .expect("cannot allocate model vertices");
+            m_gpu_heap->write(m_queue, m_model_vertices, model.m_vertices.data(), vertices_size);
+        }
 
-        buffer_desc.size = model.m_indices.size() * sizeof(model.m_indices[0]);
-        buffer_desc.label = "Model indices";
-        buffer_desc.usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Index;
-        m_model_indices_buffer = m_device.createBuffer(buffer_desc);
-        m_queue.writeBuffer(m_model_indices_buffer, 0, model.m_indices.data(), buffer_desc.size);
+        uint64_t indices_size = model.m_indices.size() * sizeof(model.m_indices[0]);
+        m_model_indices = m_gpu_heap->allocate(GpuHeapUsage::Index, indices_size)
+            .expect("cannot allocate model indices");
+        m_gpu_heap->write(m_queue, m_model_indices, model.m_indices.data(), indices_size);
 
         m_index_count = model.m_indices.size();
+        // the bind pose for skinned models, picking does not follow the animation
+        m_model_bounds = {};
+        for (const Vertex& vertex : model.m_vertices) m_model_bounds.extend(vertex.position);
+    }
+
+    // Falls back to drawing the bind pose from the heap when the skinner
+    // has no room for the model.
+    inline void initializeSkin(const Model& model) {
+        auto mesh = m_skinning->addMesh(m_queue, model.m_vertices.data(), model.m_skin_weights.data(),
+            static_cast<uint32_t>(model.m_vertices.size()));
+        if (mesh.is_err()) {
+            std::cout << "Cannot skin the model on the GPU, drawing its bind pose\n";
+            return;
+        }
+        uint32_t mesh_id = std::move(mesh).unwrap();
+        auto instance = m_skinning->addInstance(mesh_id, model.m_skeleton.jointCount());
+        if (instance.is_err()) {
+            m_skinning->removeMesh(mesh_id);
+            std::cout << "Cannot skin the model on the GPU, drawing its bind pose\n";
+            return;
+        }
+        m_skeleton = model.m_skeleton;
+        m_animations = model.m_animations;
+        SkinnedInstance& skin = m_skins.emplace_back();
+        skin.instance = std::move(instance).unwrap();
+        skin.clip = 0;
     }
 
+    inline void registerDraws() {
+        m_model_node = m_scene.createNode();
+        m_model_pipeline_id = m_draw_queue.registerPipeline(m_render_pipeline)
+            .expect("cannot register model pipeline");
+        m_transparent_pipeline_id = m_draw_queue.registerPipeline(m_transparent_pipeline)
+            .expect("cannot register transparent pipeline");
+        DrawMesh mesh { m_model_vertices, m_model_indices, wgpu::IndexFormat::Uint32 };
+        if (!m_skins.empty()) {
+            mesh.vertex_range = m_skinning->output(m_skins.front().instance);
+        }
+        m_model_mesh_id = m_draw_queue.registerMesh(mesh)
+            .expect("cannot register model mesh");
+        m_shadow_pipeline_id = m_draw_queue.registerPipeline(m_shadows->casterPipeline())
+            .expect("cannot register shadow caster pipeline");
+        registerMaterials();
+        registerImpostors();
+        registerLighting();
+    }
+
+    // Bakes the model's impostor, drawn for nodes past the fade range.
+    // Skinned models stay meshes, no single pose stands for them.
+    inline void registerImpostors() {
+        if (!m_impostors->ready()) {
+            std::cout << "Cannot create the impostor atlas\n";
+            abort();
+        }
+        // corners of the quad, see vs_impostor
+        const uint16_t quad[6] = { 0, 1, 2, 2, 1, 3 };
+        m_impostor_quad = m_gpu_heap->allocate(GpuHeapUsage::Index, sizeof(quad))
+            .expect("cannot allocate the impostor quad");
+        m_gpu_heap->write(m_queue, m_impostor_quad, quad, sizeof(quad));
+        m_impostor_mesh_id = m_draw_queue.registerMesh(DrawMesh { m_impostor_instances, m_impostor_quad, wgpu::IndexFormat::Uint16 })
+            .expect("cannot register impostor mesh");
+        m_impostor_pipeline_id = m_draw_queue.registerPipeline(m_impostor_pipeline)
+            .expect("cannot register impostor pipeline");
+        if (!m_skins.empty() || m_model_bounds.empty()) return;
+
+        ImpostorBakeSource source {};
+        source.vertices = m_gpu_heap->resolve(m_model_vertices);
+        source.indices = m_gpu_heap->resolve(m_model_indices);
+        source.index_format = wgpu::IndexFormat::Uint32;
+        source.index_count = m_index_count;
+        float radius_squared = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            source.center[i] = 0.5f * (m_model_bounds.min[i] + m_model_bounds.max[i]);
+            float half = 0.5f * (m_model_bounds.max[i] - m_model_bounds.min[i]);
+            radius_squared += half * half;
+        }
+        source.radius = std::sqrt(radius_squared);
+        const GpuMaterial& material = m_materials->material(m_materials->instanceMaterial(m_model_node));
+        std::memcpy(source.base_color, material.base_color, sizeof(source.base_color));
+        uint32_t texture = material.albedo_texture;
+        bool textured = texture != MaterialTable::NO_TEXTURE;
+        source.albedo_array = m_materials->arrayView(textured ? texture >> MaterialTable::LAYER_BITS : 0);
+        source.albedo_sampler = m_materials->sampler();
+        source.albedo_layer = textured ? texture & ((1u << MaterialTable::LAYER_BITS) - 1) : ImpostorAtlas::NO_TEXTURE;
+
+        auto layer = m_impostors->bake(m_queue, source);
+        if (layer.is_err()) {
+            std::cout << "Impostors disabled: " << std::move(layer).unwrap_err() << '\n';
+            return;
+        }
+        m_model_impostor = std::move(layer).unwrap();
+        std::memcpy(m_model_sphere, source.center, sizeof(source.center));
+        m_model_sphere[3] = source.radius;
+        m_impostors->setFadeRange(m_queue, IMPOSTOR_FADE_START, IMPOSTOR_FADE_END);
+    }
+
+    // Material 0 is what every node without one is drawn with, the model
+    // node gets a checker texture on top.
+    inline void registerMaterials() {
+        if (!m_materials->ready()) {
+            std::cout << "Cannot create the material table\n";
+            abort();
+        }
+        GpuMaterial plain {};
+        plain.base_color[0] = 0.0f;
+        plain.base_color[1] = 0.4f;
+        plain.base_color[2] = 0.8f;
+        m_materials->addMaterial(plain);
+
+        constexpr uint32_t CHECKER_SIZE = 64;
+        constexpr uint32_t CHECKER_CELL = 8;
+        std::vector<uint8_t> checker(CHECKER_SIZE * CHECKER_SIZE * 4);
+        for (uint32_t y = 0; y < CHECKER_SIZE; y++) {
+            for (uint32_t x = 0; x < CHECKER_SIZE; x++) {
+                uint8_t value = ((x / CHECKER_CELL) ^ (y / CHECKER_CELL)) & 1 ? 255 : 160;
+                uint8_t *p_texel = &checker[(y * CHECKER_SIZE + x) * 4];
+                p_texel[0] = p_texel[1] = p_texel[2] = value;
+                p_texel[3] = 255;
+            }
+        }
+        auto texture = m_materials->addTexture(m_queue, wgpu::TextureFormat::RGBA8Unorm, CHECKER_SIZE, CHECKER_SIZE,
+            checker.data(), CHECKER_SIZE * 4);
+        if (texture.is_err()) {
+            std::cout << "Cannot upload the checker texture: " << std::move(texture).unwrap_err() << "\n";
+            return;
+        }
+        GpuMaterial textured = plain;
+        textured.albedo_texture = std::move(texture).unwrap();
+        setNodeMaterial(m_model_node, m_materials->addMaterial(textured));
+    }
+
+    // Uploads material edits, and rebinds when the table recreated a
+    // buffer or texture array to grow.
+    inline void updateMaterials() {
+        m_materials->upload(m_queue);
+        if (m_materials->bindingVersion() == m_material_binding_version
+            && m_impostors->bindingVersion() == m_impostor_binding_version) return;
+        m_material_binding_version = m_materials->bindingVersion();
+        m_impostor_binding_version = m_impostors->bindingVersion();
+        if (m_lighting_bind_group) m_object_cache->release(m_lighting_bind_group);
+        m_lighting_bind_group = createModelBindGroup();
+        m_draw_queue.replaceBindGroup(m_lighting_bind_group_id, DrawBindGroup { 0, m_lighting_bind_group });
+    }
+
+    // Everything group 0 of test.wgsl binds: the lighting lists, the shadow
+    // atlas, the material table and the impostor atlas.
+    inline wgpu::BindGroup createModelBindGroup() {
+        constexpr uint32_t ENTRY_COUNT = wgsl::test::group0::ENTRY_COUNT;
+        std::array<wgpu::BindGroupEntry, ENTRY_COUNT> bindings {};
+        const wgpu::Buffer buffers[7] = {
+            m_lighting->frameBuffer(), m_lighting->lightBuffer(), m_lighting->clusterBuffer(), m_lighting->indexBuffer(),
+            m_shadows->viewBuffer(), m_materials->materialBuffer(), m_materials->instanceBuffer(),
+        };
+        const uint32_t slots[7] = {
+            wgsl::test::group0::FRAME, wgsl::test::group0::LIGHTS,
+            wgsl::test::group0::CLUSTERS, wgsl::test::group0::LIGHT_INDICES,
+            wgsl::test::group0::SHADOW_VIEWS, wgsl::test::group0::MATERIALS, wgsl::test::group0::INSTANCE_MATERIALS,
+        };
+        for (uint32_t i = 0; i < 7; i++) {
+            bindings[i].binding = slots[i];
+            bindings[i].buffer = buffers[i];
+            bindings[i].offset = 0;
+            bindings[i].size = buffers[i].getSize();
+        }
+        bindings[7].binding = wgsl::test::group0::SHADOW_ATLAS;
+        bindings[7].textureView = m_shadows->atlasView();
+        bindings[8].binding = wgsl::test::group0::SHADOW_SAMPLER;
+        bindings[8].sampler = m_shadows->sampler();
+        bindings[9].binding = wgsl::test::group0::MATERIAL_SAMPLER;
+        bindings[9].sampler = m_materials->sampler();
+        const uint32_t texture_slots[MaterialTable::MAX_TEXTURE_ARRAYS] = {
+            wgsl::test::group0::MATERIAL_TEXTURES0, wgsl::test::group0::MATERIAL_TEXTURES1,
+            wgsl::test::group0::MATERIAL_TEXTURES2, wgsl::test::group0::MATERIAL_TEXTURES3,
+        };
+        for (uint32_t i = 0; i < MaterialTable::MAX_TEXTURE_ARRAYS; i++) {
+            bindings[10 + i].binding = texture_slots[i];
+            bindings[10 + i].textureView = m_materials->arrayView(i);
+        }
+        const uint32_t impostor_base = 10 + MaterialTable::MAX_TEXTURE_ARRAYS;
+        bindings[impostor_base].binding = wgsl::test::group0::IMPOSTORS;
+        bindings[impostor_base].buffer = m_impostors->paramsBuffer();
+        bindings[impostor_base].offset = 0;
+        bindings[impostor_base].size = sizeof(GpuImpostorParams);
+        bindings[impostor_base + 1].binding = wgsl::test::group0::IMPOSTOR_COLOR;
+        bindings[impostor_base + 1].textureView = m_impostors->colorView();
+        bindings[impostor_base + 2].binding = wgsl::test::group0::IMPOSTOR_NORMAL_DEPTH;
+        bindings[impostor_base + 2].textureView = m_impostors->normalDepthView();
+        bindings[impostor_base + 3].binding = wgsl::test::group0::IMPOSTOR_SAMPLER;
+        bindings[impostor_base + 3].sampler = m_impostors->sampler();
+        static_assert(ENTRY_COUNT == 14 + MaterialTable::MAX_TEXTURE_ARRAYS);
+        wgpu::BindGroupDescriptor bind_group_desc = {};
+        bind_group_desc.label = "Model bind group";
+        bind_group_desc.layout = m_lighting_layout;
+        bind_group_desc.entryCount = ENTRY_COUNT;
+        bind_group_desc.entries = bindings.data();
+        return m_object_cache->acquire(bind_group_desc);
+    }
+
+    // Binds the lists ClusteredLighting builds, the shadow atlas and the
+    // material table to the model pipeline and scatters the demo lights around the model.
+    inline void registerLighting() {
+        if (!m_lighting->ready()) {
+            std::cout << "Cannot create the clustered lighting buffers\n";
+            abort();
+        }
+        if (!m_shadows->ready()) {
+            std::cout << "Cannot create the shadow atlas\n";
+            abort();
+        }
+        // uploaded first so the table's buffers are their final size
+        m_materials->upload(m_queue);
+        m_material_binding_version = m_materials->bindingVersion();
+        m_impostor_binding_version = m_impostors->bindingVersion();
+        m_lighting_bind_group = createModelBindGroup();
+        m_lighting_bind_group_id = m_draw_queue.registerBindGroup(DrawBindGroup { 0, m_lighting_bind_group })
+            .expect("cannot register lighting bind group");
+
+        // golden-angle spiral over a few shells, one in eight a spot light;
+        // a few of them cast shadows and half of those stand still, so the
+        // atlas keeps their cached depth
+        constexpr uint32_t DEMO_LIGHTS = 2048;
+        std::vector<Light> lights(DEMO_LIGHTS);
+        std::vector<LightOrbit> orbits(DEMO_LIGHTS);
+        for (uint32_t i = 0; i < DEMO_LIGHTS; i++) {
+            float t = (static_cast<float>(i) + 0.5f) / DEMO_LIGHTS;
+            LightOrbit& orbit = orbits[i];
+            orbit.radius = 1.2f + 1.5f * static_cast<float>(i % 4) / 3.0f;
+            orbit.height = (t * 2.0f - 1.0f) * 1.5f;
+            orbit.phase = static_cast<float>(i) * 2.39996f;
+            orbit.speed = 0.2f + 0.3f * static_cast<float>(i % 7) / 6.0f;
+
+            Light& light = lights[i];
+            light.type = i % 8 == 0 ? LightType::Spot : LightType::Point;
+            light.range = 0.5f;
+            light.intensity = 0.6f;
+            float hue = t * 6.2831853f;
+            light.color[0] = 0.5f + 0.5f * std::cos(hue);
+            light.color[1] = 0.5f + 0.5f * std::cos(hue - 2.0944f);
+            light.color[2] = 0.5f + 0.5f * std::cos(hue + 2.0944f);
+            if (light.type == LightType::Spot) {
+                light.range = 2.0f;
+                light.intensity = 2.0f;
+                light.inner_cone_cos = 0.97f;
+                light.outer_cone_cos = 0.9f;
+            }
+            light.cast_shadows = i % 256 == 0 || i % 256 == 4;
+            if (light.cast_shadows && i % 512 < 256) orbit.speed = 0.0f;
+        }
+        // the simulation moves them from here on, the first frame draws step 0
+        m_simulation.reset(std::move(lights), std::move(orbits), std::chrono::steady_clock::now());
+        m_simulation.snapshot(m_snapshots.back());
+        m_snapshots.publish();
+    }
+
+private:
+    // series in m_metrics, registered before the first frame
+    struct FrameMetrics {
+        metrics::Histogram *p_frame { nullptr };
+        metrics::Histogram *p_encode { nullptr };
+        metrics::Histogram *p_submit { nullptr };
+        metrics::Histogram *p_present_wait { nullptr };
+        metrics::Histogram *p_gpu_frame { nullptr };
+        metrics::Counter *p_frames { nullptr };
+        metrics::Counter *p_draws { nullptr };
+        metrics::Counter *p_triangles { nullptr };
+        metrics::Counter *p_uploads { nullptr };
+        metrics::Counter *p_upload_bytes { nullptr };
+        std::array<metrics::Gauge*, GPU_MEMORY_CATEGORY_COUNT> p_memory {};
+        // GpuHeap totals already added to the counters
+        uint64_t reported_uploads { 0 };
+        uint64_t reported_upload_bytes { 0 };
+    };
+
+    // a mesh uploaded by importMeshes()
+    struct ImportedMesh {
+        uint64_t check_hash { 0 };
+        size_t vertex_count { 0 };
+        size_t index_count { 0 };
+        uint32_t draw_mesh { 0 };
+    };
+
+    struct SkinnedInstance {
+        uint32_t instance { 0 };
+        // index into m_animations, the rest pose when out of range
+        uint32_t clip { 0 };
+        Pose pose {};
+        PoseScratch scratch {};
+    };
+
 private:
     std::unique_ptr<Window> m_window { nullptr };
     std::unique_ptr<wgpu::ErrorCallback> m_device_err_callback_holder { nullptr };
     wgpu::Instance m_instance { nullptr };
     wgpu::Device m_device { nullptr };
     wgpu::Surface m_surface { nullptr };
+    // rendered into instead of m_surface when the window has no display
+    wgpu::Texture m_offscreen_target { nullptr };
     wgpu::Queue m_queue { nullptr };
     wgpu::RenderPipeline m_render_pipeline { nullptr };
+    wgpu::RenderPipeline m_transparent_pipeline { nullptr };
+    wgpu::RenderPipeline m_impostor_pipeline { nullptr };
+    wgpu::PipelineLayout m_pipeline_layout { nullptr };
     wgpu::TextureFormat m_surface_format { wgpu::TextureFormat::Undefined };
-    wgpu::Buffer m_model_vertices_buffer { nullptr };
-    wgpu::Buffer m_model_indices_buffer { nullptr };
+    FrameFence m_frame_fence {};
+    std::unique_ptr<GpuMemoryTracker> m_gpu_memory { nullptr };
+    std::unique_ptr<GpuHeap> m_gpu_heap { nullptr };
+    std::unique_ptr<GpuTimer> m_gpu_timer { nullptr };
+    std::unique_ptr<GpuObjectCache> m_object_cache { nullptr };
+    std::optional<DynamicResolution> m_dynamic_resolution {};
+    std::unique_ptr<UpscalePass> m_upscale { nullptr };
+    std::unique_ptr<TransparencyPass> m_transparency { nullptr };
+    std::unique_ptr<FrameCapture> m_capture { nullptr };
+    bool m_surface_copy_src { false };
+    std::unique_ptr<GpuSkinning> m_skinning { nullptr };
+    Skeleton m_skeleton {};
+    std::vector<AnimationClip> m_animations {};
+    std::vector<SkinnedInstance> m_skins {};
+    std::unique_ptr<ClusteredLighting> m_lighting { nullptr };
+    wgpu::BindGroupLayout m_lighting_layout { nullptr };
+    wgpu::BindGroup m_lighting_bind_group { nullptr };
+    uint32_t m_lighting_bind_group_id { DrawQueue::NO_BIND_GROUP };
+    // blended from the snapshot each frame
+    std::vector<Light> m_lights {};
+    // owned by the thread calling stepSimulation(), seen by rendering only
+    // through m_snapshots
+    Simulation m_simulation {};
+    TripleBuffer<SceneSnapshot> m_snapshots {};
+    // simulated seconds the frame is drawn at
+    float m_scene_time { 0.0f };
+    std::unique_ptr<ParticleSystem> m_particles { nullptr };
+    ParticleEmitter m_particle_emitter {};
+    // m_scene_time the particles were last stepped to
+    float m_particle_time { 0.0f };
+    // events for the render thread, swapped out under the mutex
+    std::mutex m_forwarded_mutex {};
+    std::vector<WindowEvent> m_forwarded_events {};
+    std::vector<WindowEvent> m_handled_events {};
+    std::unique_ptr<ShadowAtlas> m_shadows { nullptr };
+    std::unique_ptr<MaterialTable> m_materials { nullptr };
+    // of the table when m_lighting_bind_group was created
+    uint32_t m_material_binding_version { 0 };
+    std::unique_ptr<ImpostorAtlas> m_impostors { nullptr };
+    // of the atlas when m_lighting_bind_group was created
+    uint32_t m_impostor_binding_version { 0 };
+    // the model's atlas layer and mesh space bounding sphere, no layer for
+    // models that stay meshes
+    std::optional<uint32_t> m_model_impostor {};
+    float m_model_sphere[4] {};
+    // per-instance data of this frame's impostor draw
+    std::vector<wgsl::test::ImpostorIn> m_impostor_batch {};
+    GpuAllocation m_impostor_instances {};
+    uint32_t m_impostor_capacity { 0 };
+    GpuAllocation m_impostor_quad {};
+    uint32_t m_impostor_pipeline_id { 0 };
+    uint32_t m_impostor_mesh_id { 0 };
+    std::vector<SceneGraph::NodeId> m_visible_nodes {};
+    Camera m_camera {};
+    SceneGraph m_scene {};
+    SceneGraph::NodeId m_model_node { 0 };
+    // the model's local bounds, every scene node is an instance of it
+    Aabb m_model_bounds {};
+    // world bounds by node id, empty for unused ids
+    std::vector<Aabb> m_instance_bounds {};
+    std::vector<uint32_t> m_moved_instances {};
+    // by node id, frames left as a dynamic shadow caster, 0 when cached
+    std::vector<uint8_t> m_caster_motion {};
+    std::vector<SceneGraph::NodeId> m_dynamic_casters {};
+    std::vector<SceneGraph::NodeId> m_shadow_casters {};
+    Bvh m_instance_bvh {};
+    GpuAllocation m_instance_matrices {};
+    uint32_t m_instance_capacity { 0 };
+    uint32_t m_surface_width { 0 };
+    uint32_t m_surface_height { 0 };
+    GpuAllocation m_model_vertices {};
+    GpuAllocation m_model_indices {};
     unsigned m_index_count = 0;
-    bool m_need_close { false };
+    DrawQueue m_draw_queue {};
+    uint32_t m_model_pipeline_id { 0 };
+    uint32_t m_transparent_pipeline_id { 0 };
+    uint32_t m_model_mesh_id { 0 };
+    // by content hash, see importMeshes()
+    std::unordered_map<uint64_t, std::vector<ImportedMesh>> m_imported_meshes {};
+    // compressed meshes decode here, writeBuffer copies out of it
+    std::vector<std::byte> m_upload_staging {};
+    uint32_t m_shadow_pipeline_id { 0 };
+    std::atomic<bool> m_need_close { false };
+    std::chrono::steady_clock::time_point m_startup_begin {};
+    bool m_report_first_frame { false };
+    std::chrono::steady_clock::time_point m_last_frame_begin {};
+    metrics::Registry m_metrics {};
+    FrameMetrics m_frame_metrics {};
+    // declared after m_metrics, so it stops before the registry goes away
+    std::unique_ptr<MetricsServer> m_metrics_server { nullptr };
 };
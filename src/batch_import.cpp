@@ -0,0 +1,220 @@
+/*
+    batch_import.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "batch_import.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+struct HashKeys {
+    uint64_t seed;
+    uint64_t k1;
+    uint64_t k2;
+    int rotation;
+};
+
+constexpr HashKeys CONTENT_KEYS { 0x9e3779b97f4a7c15ull, 0x87c37b91114253d5ull, 0x4cf5ad432745937full, 31 };
+// xxHash64's primes, unrelated to the content keys so a collision of one
+// hash says nothing about the other
+constexpr HashKeys CHECK_KEYS { 0x27d4eb2f165667c5ull, 0x9e3779b185ebca87ull, 0xc2b2ae3d27d4eb4full, 27 };
+
+inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Murmur3's finalizer, spreads every input bit over the whole word.
+inline uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// A word at a time, the tail zero padded; the length goes in last so a
+// trailing zero byte still changes the hash.
+uint64_t hashBytes(const HashKeys& keys, uint64_t h, const void *p_data, size_t size) {
+    const auto *p_bytes = static_cast<const unsigned char*>(p_data);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, p_bytes + i, 8);
+        h = rotl(h ^ (word * keys.k1), keys.rotation) * keys.k2;
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        std::memcpy(&word, p_bytes + i, size - i);
+        h = rotl(h ^ (word * keys.k1), keys.rotation) * keys.k2;
+    }
+    return mix(h ^ size);
+}
+
+template<typename T>
+inline uint64_t hashSpan(const HashKeys& keys, uint64_t h, std::span<const T> values) {
+    return hashBytes(keys, h, values.data(), values.size_bytes());
+}
+
+template<typename T>
+inline bool sameBytes(std::span<const T> a, std::span<const T> b) {
+    return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size_bytes()) == 0);
+}
+
+std::string formatHint(const ImportSource& source) {
+    if (!source.format_hint.empty()) return source.format_hint;
+    size_t dot = source.name.rfind('.');
+    if (dot == std::string::npos || source.name.find('/', dot) != std::string::npos) return {};
+    std::string hint = source.name.substr(dot + 1);
+    std::transform(hint.begin(), hint.end(), hint.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return hint;
+}
+
+bool readFile(const std::string& path, std::vector<std::byte>& out) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    std::streamsize size = file.tellg();
+    if (size < 0) return false;
+    out.resize(static_cast<size_t>(size));
+    file.seekg(0);
+    return file.read(reinterpret_cast<char*>(out.data()), size).good() || size == 0;
+}
+
+uint64_t hashMesh(const HashKeys& keys, const Model& model) {
+    uint64_t h = keys.seed;
+    h = hashSpan<Vertex>(keys, h, model.m_vertices);
+    h = hashSpan<uint32_t>(keys, h, model.m_indices);
+    if (!model.m_skin_weights.empty()) {
+        h = hashSpan<SkinWeights>(keys, h, model.m_skin_weights);
+        h = hashSpan<int32_t>(keys, h, model.m_skeleton.parents);
+        h = hashSpan<JointMatrix>(keys, h, model.m_skeleton.inverse_bind);
+    }
+    return h;
+}
+
+} // namespace
+
+uint64_t hashMesh(const Model& model) {
+    return hashMesh(CONTENT_KEYS, model);
+}
+
+uint64_t checkHashMesh(const Model& model) {
+    return hashMesh(CHECK_KEYS, model);
+}
+
+bool sameMesh(const Model& a, const Model& b) {
+    if (!sameBytes<Vertex>(a.m_vertices, b.m_vertices) || !sameBytes<uint32_t>(a.m_indices, b.m_indices)) return false;
+    if (!sameBytes<SkinWeights>(a.m_skin_weights, b.m_skin_weights)) return false;
+    if (a.m_skin_weights.empty()) return true;
+    // equal weights are only the same mesh on the same rig with the same clips
+    return sameBytes<int32_t>(a.m_skeleton.parents, b.m_skeleton.parents)
+        && sameBytes<JointMatrix>(a.m_skeleton.inverse_bind, b.m_skeleton.inverse_bind)
+        && a.m_skeleton.names == b.m_skeleton.names
+        && a.m_animations.size() == b.m_animations.size()
+        && std::equal(a.m_animations.begin(), a.m_animations.end(), b.m_animations.begin(),
+            [](const AnimationClip& x, const AnimationClip& y) { return x.name == y.name && x.samples == y.samples; });
+}
+
+BatchImport importBatch(std::span<const ImportSource> sources, ThreadPool& pool) {
+    TRACE_ZONE("importBatch");
+    struct Unique {
+        std::unique_ptr<Model> model;
+        uint64_t hash;
+        // lowest source index holding it, orders the output
+        uint32_t first_source;
+    };
+    std::mutex mutex;
+    std::vector<Unique> uniques;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> by_hash;
+    // by source: index into `uniques`, or NO_MESH with the error
+    std::vector<uint32_t> unique_of(sources.size(), ManifestEntry::NO_MESH);
+    std::vector<std::string> errors(sources.size());
+
+    pool.parallelFor(sources.size(), [&](size_t i) {
+        TRACE_ZONE("import source");
+        const ImportSource& source = sources[i];
+        std::vector<std::byte> file;
+        std::span<const std::byte> data = source.data;
+        if (data.empty()) {
+            if (!readFile(source.name, file)) {
+                errors[i] = "cannot read file";
+                return;
+            }
+            data = file;
+        }
+
+        auto model = std::make_unique<Model>();
+        model->loadModelFromMemory(data.data(), data.size(), formatHint(source));
+        if (model->m_vertices.empty() || model->m_indices.empty()) {
+            errors[i] = "no geometry";
+            return;
+        }
+        uint64_t hash = hashMesh(*model);
+
+        // the content compare only runs on a hash match, which is nearly
+        // always a true duplicate, so holding the lock over it is fine
+        std::lock_guard lock(mutex);
+        std::vector<uint32_t>& candidates = by_hash[hash];
+        for (uint32_t candidate : candidates) {
+            if (sameMesh(*uniques[candidate].model, *model)) {
+                uniques[candidate].first_source = std::min(uniques[candidate].first_source, static_cast<uint32_t>(i));
+                unique_of[i] = candidate;
+                return;
+            }
+        }
+        unique_of[i] = static_cast<uint32_t>(uniques.size());
+        candidates.push_back(unique_of[i]);
+        uniques.push_back({ std::move(model), hash, static_cast<uint32_t>(i) });
+    });
+
+    // number the meshes by their first source, so the result does not
+    // depend on which worker finished first
+    std::vector<uint32_t> order(uniques.size());
+    for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return uniques[a].first_source < uniques[b].first_source; });
+    std::vector<uint32_t> mesh_of(uniques.size());
+    BatchImport batch;
+    batch.meshes.reserve(uniques.size());
+    batch.hashes.reserve(uniques.size());
+    for (uint32_t mesh = 0; mesh < order.size(); mesh++) {
+        Unique& unique = uniques[order[mesh]];
+        mesh_of[order[mesh]] = mesh;
+        batch.meshes.push_back(std::move(unique.model));
+        batch.hashes.push_back(unique.hash);
+    }
+    batch.check_hashes.resize(batch.meshes.size());
+    pool.parallelFor(batch.meshes.size(), [&](size_t mesh) {
+        batch.check_hashes[mesh] = checkHashMesh(*batch.meshes[mesh]);
+    });
+
+    batch.manifest.resize(sources.size());
+    for (size_t i = 0; i < sources.size(); i++) {
+        ManifestEntry& entry = batch.manifest[i];
+        entry.source = sources[i].name;
+        if (unique_of[i] == ManifestEntry::NO_MESH) {
+            entry.error = std::move(errors[i]);
+            continue;
+        }
+        entry.mesh = mesh_of[unique_of[i]];
+        if (uniques[unique_of[i]].first_source != i) batch.duplicates++;
+    }
+    TRACE_COUNTER("imported meshes", batch.meshes.size());
+    return batch;
+}
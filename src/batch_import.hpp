@@ -0,0 +1,72 @@
+/*
+    batch_import.hpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "model_loader.hpp"
+#include "thread_pool.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+struct ImportSource {
+    // reported in the manifest, and the path read when `data` is empty
+    std::string name {};
+    // an archive entry or other buffer already in memory, kept alive by the
+    // caller until the import returns
+    std::span<const std::byte> data {};
+    // taken from the name's extension when empty
+    std::string format_hint {};
+};
+
+struct ManifestEntry {
+    inline static constexpr uint32_t NO_MESH = 0xffffffff;
+
+    std::string source {};
+    // index into BatchImport::meshes, NO_MESH when the source failed
+    uint32_t mesh { NO_MESH };
+    std::string error {};
+};
+
+struct BatchImport {
+    // distinct meshes, in the order of the first source holding each
+    std::vector<std::unique_ptr<Model>> meshes {};
+    std::vector<uint64_t> hashes {};
+    // checkHashMesh() of each mesh, for matching once the content is gone
+    std::vector<uint64_t> check_hashes {};
+    // by source, in the order given
+    std::vector<ManifestEntry> manifest {};
+    // sources that resolved to a mesh seen earlier in the batch
+    uint32_t duplicates { 0 };
+};
+
+// Content hash over the vertices and indices. Skinned meshes also hash their
+// weights and skeleton, so two rigs never share a mesh.
+uint64_t hashMesh(const Model& model);
+
+// Hash of the same content under unrelated keys. Meshes kept only by their
+// hashes are matched on both, which a 64-bit collision alone does not pass.
+uint64_t checkHashMesh(const Model& model);
+
+// Whether two meshes hold the same content, the check behind a hash match.
+bool sameMesh(const Model& a, const Model& b);
+
+// Reads and parses the sources across `pool` and collapses meshes of equal
+// content into one entry. A duplicate's Model is dropped as soon as it is
+// matched, so memory follows the distinct meshes rather than the sources.
+BatchImport importBatch(std::span<const ImportSource> sources, ThreadPool& pool);
@@ -0,0 +1,884 @@
+/*
+    bvh.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "bvh.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BVH_SSE 1
+#endif
+
+namespace {
+
+constexpr uint32_t MAX_BINS = 32;
+// Past this binary depth ranges are split at the median instead, which
+// bounds the tree depth and with it the fixed traversal stacks below.
+constexpr uint32_t MAX_SAH_DEPTH = 48;
+constexpr uint32_t STACK_SIZE = 256;
+// primitives per pool task while binning or bounding a range
+constexpr uint32_t BUILD_CHUNK = 8192;
+// SAH cost of visiting a node, relative to testing one primitive
+constexpr float TRAVERSAL_COST = 1.0f;
+// refit() walks every node when more primitives than this share moved
+constexpr uint32_t PARTIAL_REFIT_DIVISOR = 4;
+
+struct PreparedRay {
+    float origin[3];
+    float inv[3];
+    // the near plane of a slab is its max along negative directions
+    bool negative[3];
+};
+
+PreparedRay prepare(const Ray& ray) {
+    PreparedRay prepared;
+    for (int i = 0; i < 3; i++) {
+        prepared.origin[i] = ray.origin[i];
+        // finite, so (plane - origin) * inv is never 0 * inf
+        float d = ray.direction[i];
+        if (std::fabs(d) < 1e-30f) d = std::signbit(d) ? -1e-30f : 1e-30f;
+        prepared.inv[i] = 1.0f / d;
+        prepared.negative[i] = d < 0.0f;
+    }
+    return prepared;
+}
+
+// Children of `node` the ray enters within [0, t_max], as a bit mask, with
+// their entry distances. Empty slots have inverted boxes and never pass.
+template<typename Node>
+uint32_t intersectNode(const Node& node, const PreparedRay& ray, float t_max, float t_near[4]) {
+    const float *near_x = ray.negative[0] ? node.max_x : node.min_x;
+    const float *far_x = ray.negative[0] ? node.min_x : node.max_x;
+    const float *near_y = ray.negative[1] ? node.max_y : node.min_y;
+    const float *far_y = ray.negative[1] ? node.min_y : node.max_y;
+    const float *near_z = ray.negative[2] ? node.max_z : node.min_z;
+    const float *far_z = ray.negative[2] ? node.min_z : node.max_z;
+#ifdef BVH_SSE
+    const __m128 ox = _mm_set1_ps(ray.origin[0]), oy = _mm_set1_ps(ray.origin[1]), oz = _mm_set1_ps(ray.origin[2]);
+    const __m128 ix = _mm_set1_ps(ray.inv[0]), iy = _mm_set1_ps(ray.inv[1]), iz = _mm_set1_ps(ray.inv[2]);
+    __m128 t0 = _mm_max_ps(
+        _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(near_x), ox), ix), _mm_mul_ps(_mm_sub_ps(_mm_load_ps(near_y), oy), iy)),
+        _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(near_z), oz), iz), _mm_setzero_ps()));
+    __m128 t1 = _mm_min_ps(
+        _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(far_x), ox), ix), _mm_mul_ps(_mm_sub_ps(_mm_load_ps(far_y), oy), iy)),
+        _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(far_z), oz), iz), _mm_set1_ps(t_max)));
+    _mm_storeu_ps(t_near, t0);
+    return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(t0, t1)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < 4; i++) {
+        float t0 = std::max(std::max((near_x[i] - ray.origin[0]) * ray.inv[0], (near_y[i] - ray.origin[1]) * ray.inv[1]),
+            std::max((near_z[i] - ray.origin[2]) * ray.inv[2], 0.0f));
+        float t1 = std::min(std::min((far_x[i] - ray.origin[0]) * ray.inv[0], (far_y[i] - ray.origin[1]) * ray.inv[1]),
+            std::min((far_z[i] - ray.origin[2]) * ray.inv[2], t_max));
+        t_near[i] = t0;
+        mask |= static_cast<uint32_t>(t0 <= t1) << i;
+    }
+    return mask;
+#endif
+}
+
+bool intersectBox(const Aabb& box, const PreparedRay& ray, float t_max, float& t_near) {
+    float t0 = 0.0f;
+    float t1 = t_max;
+    for (int i = 0; i < 3; i++) {
+        float near_plane = ray.negative[i] ? box.max[i] : box.min[i];
+        float far_plane = ray.negative[i] ? box.min[i] : box.max[i];
+        t0 = std::max(t0, (near_plane - ray.origin[i]) * ray.inv[i]);
+        t1 = std::min(t1, (far_plane - ray.origin[i]) * ray.inv[i]);
+    }
+    t_near = t0;
+    return t0 <= t1;
+}
+
+// Bit i of `outside` when child i is wholly behind a plane, of `inside` when
+// it is wholly in front of all of them. Lanes are independent, the compiler
+// vectorizes the inner loops.
+template<typename Node>
+void classifyNode(const Node& node, const Frustum& frustum, uint32_t& outside, uint32_t& inside) {
+    bool out[4] = { false, false, false, false };
+    bool in[4] = { true, true, true, true };
+    for (const float *plane : frustum.planes) {
+        // the corner furthest along the plane normal, and the one opposite
+        const float *pos_x = plane[0] >= 0.0f ? node.max_x : node.min_x;
+        const float *neg_x = plane[0] >= 0.0f ? node.min_x : node.max_x;
+        const float *pos_y = plane[1] >= 0.0f ? node.max_y : node.min_y;
+        const float *neg_y = plane[1] >= 0.0f ? node.min_y : node.max_y;
+        const float *pos_z = plane[2] >= 0.0f ? node.max_z : node.min_z;
+        const float *neg_z = plane[2] >= 0.0f ? node.min_z : node.max_z;
+        for (int i = 0; i < 4; i++) {
+            float far = plane[0] * pos_x[i] + plane[1] * pos_y[i] + plane[2] * pos_z[i] + plane[3];
+            float near = plane[0] * neg_x[i] + plane[1] * neg_y[i] + plane[2] * neg_z[i] + plane[3];
+            out[i] = out[i] || !(far >= 0.0f);
+            in[i] = in[i] && near >= 0.0f;
+        }
+    }
+    outside = inside = 0;
+    for (int i = 0; i < 4; i++) {
+        outside |= static_cast<uint32_t>(out[i]) << i;
+        inside |= static_cast<uint32_t>(in[i] && !out[i]) << i;
+    }
+}
+
+bool outsideFrustum(const Aabb& box, const Frustum& frustum) {
+    for (const float *plane : frustum.planes) {
+        float far = plane[3];
+        for (int i = 0; i < 3; i++) far += plane[i] * (plane[i] >= 0.0f ? box.max[i] : box.min[i]);
+        if (!(far >= 0.0f)) return true;
+    }
+    return false;
+}
+
+// overlap and containment of each child against `box`
+template<typename Node>
+void overlapNode(const Node& node, const Aabb& box, uint32_t& overlap, uint32_t& contained) {
+    overlap = contained = 0;
+    for (int i = 0; i < 4; i++) {
+        bool touches = node.min_x[i] <= box.max[0] && node.max_x[i] >= box.min[0]
+            && node.min_y[i] <= box.max[1] && node.max_y[i] >= box.min[1]
+            && node.min_z[i] <= box.max[2] && node.max_z[i] >= box.min[2];
+        bool within = node.min_x[i] >= box.min[0] && node.max_x[i] <= box.max[0]
+            && node.min_y[i] >= box.min[1] && node.max_y[i] <= box.max[1]
+            && node.min_z[i] >= box.min[2] && node.max_z[i] <= box.max[2];
+        overlap |= static_cast<uint32_t>(touches) << i;
+        contained |= static_cast<uint32_t>(touches && within) << i;
+    }
+}
+
+bool overlaps(const Aabb& a, const Aabb& b) {
+    for (int i = 0; i < 3; i++) {
+        if (a.min[i] > b.max[i] || a.max[i] < b.min[i]) return false;
+    }
+    return true;
+}
+
+// squared distance from `point` to each child, infinite for empty slots
+template<typename Node>
+void distanceNode(const Node& node, const float point[3], float distance_sq[4]) {
+    for (int i = 0; i < 4; i++) {
+        float dx = std::max(std::max(node.min_x[i] - point[0], point[0] - node.max_x[i]), 0.0f);
+        float dy = std::max(std::max(node.min_y[i] - point[1], point[1] - node.max_y[i]), 0.0f);
+        float dz = std::max(std::max(node.min_z[i] - point[2], point[2] - node.max_z[i]), 0.0f);
+        distance_sq[i] = dx * dx + dy * dy + dz * dz;
+    }
+}
+
+float distanceSq(const Aabb& box, const float point[3]) {
+    float sum = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        float d = std::max(std::max(box.min[i] - point[i], point[i] - box.max[i]), 0.0f);
+        sum += d * d;
+    }
+    return sum;
+}
+
+inline void cross(const float a[3], const float b[3], float out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+inline float dot(const float a[3], const float b[3]) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Runs f(begin, end) over [first, first + count) in BUILD_CHUNK pieces, on
+// the pool once the range is long enough.
+template<typename Func>
+void forChunks(ThreadPool& pool, uint32_t first, uint32_t count, uint32_t parallel_threshold, Func&& f) {
+    uint32_t chunks = (count + BUILD_CHUNK - 1) / BUILD_CHUNK;
+    if (count < parallel_threshold || chunks < 2) {
+        f(0u, first, first + count);
+        return;
+    }
+    pool.parallelFor(chunks, [&](size_t chunk) {
+        uint32_t begin = first + static_cast<uint32_t>(chunk) * BUILD_CHUNK;
+        f(static_cast<uint32_t>(chunk), begin, std::min(begin + BUILD_CHUNK, first + count));
+    });
+}
+
+} // namespace
+
+Aabb transformAabb(const Aabb& local, const float matrix[16]) {
+    if (local.empty()) return local;
+    Aabb out;
+    for (int r = 0; r < 3; r++) {
+        out.min[r] = out.max[r] = matrix[12 + r];
+        for (int c = 0; c < 3; c++) {
+            float a = matrix[c * 4 + r] * local.min[c];
+            float b = matrix[c * 4 + r] * local.max[c];
+            out.min[r] += std::min(a, b);
+            out.max[r] += std::max(a, b);
+        }
+    }
+    return out;
+}
+
+Frustum Frustum::fromMatrix(const float view_proj[16]) {
+    // rows of the column-major matrix
+    float row[4][4];
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) row[r][c] = view_proj[c * 4 + r];
+    }
+    Frustum frustum;
+    for (int c = 0; c < 4; c++) {
+        frustum.planes[0][c] = row[3][c] + row[0][c];
+        frustum.planes[1][c] = row[3][c] - row[0][c];
+        frustum.planes[2][c] = row[3][c] + row[1][c];
+        frustum.planes[3][c] = row[3][c] - row[1][c];
+        // clip depth runs 0..w
+        frustum.planes[4][c] = row[2][c];
+        frustum.planes[5][c] = row[3][c] - row[2][c];
+    }
+    for (float *plane : frustum.planes) {
+        float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (length > 0.0f) {
+            for (int c = 0; c < 4; c++) plane[c] /= length;
+        }
+    }
+    return frustum;
+}
+
+struct Bvh::BuildNode {
+    Aabb bounds {};
+    // children are left and left + 1
+    uint32_t left { 0 };
+    uint32_t first { 0 };
+    // non-zero for leaves
+    uint32_t count { 0 };
+};
+
+struct Bvh::Builder {
+    struct Bin {
+        Aabb bounds {};
+        uint32_t count { 0 };
+    };
+    using Bins = std::array<std::array<Bin, MAX_BINS>, 3>;
+
+    std::span<const Aabb> bounds;
+    std::vector<float> centroids {};
+    std::vector<uint32_t>& indices;
+    std::vector<BuildNode> nodes {};
+    std::atomic<uint32_t> node_count { 1 };
+    ThreadPool& pool;
+    BvhConfig config;
+
+    Builder(std::span<const Aabb> bounds, std::vector<uint32_t>& indices, ThreadPool& pool, BvhConfig config):
+        bounds(bounds), indices(indices), pool(pool), config(config) {}
+
+    inline const float *centroid(uint32_t primitive) const { return &centroids[primitive * 3]; }
+
+    void rangeBounds(uint32_t first, uint32_t count, Aabb& box, Aabb& centroid_box) {
+        uint32_t chunks = (count + BUILD_CHUNK - 1) / BUILD_CHUNK;
+        std::vector<std::pair<Aabb, Aabb>> partial(chunks);
+        forChunks(pool, first, count, config.parallel_threshold, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                partial[chunk].first.extend(bounds[indices[i]]);
+                partial[chunk].second.extend(centroid(indices[i]));
+            }
+        });
+        for (const auto& [chunk_box, chunk_centroids] : partial) {
+            box.extend(chunk_box);
+            centroid_box.extend(chunk_centroids);
+        }
+    }
+
+    inline uint32_t binOf(uint32_t primitive, int axis, const Aabb& centroid_box, float scale) const {
+        float offset = (centroid(primitive)[axis] - centroid_box.min[axis]) * scale;
+        return std::min(static_cast<uint32_t>(std::max(offset, 0.0f)), config.bins - 1);
+    }
+
+    // Best binned SAH split, false when a leaf is cheaper or nothing splits.
+    bool sahSplit(uint32_t first, uint32_t count, const Aabb& box, const Aabb& centroid_box, uint32_t& mid) {
+        float scale[3];
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = centroid_box.max[axis] - centroid_box.min[axis];
+            scale[axis] = extent > 0.0f ? static_cast<float>(config.bins) / extent : 0.0f;
+        }
+
+        uint32_t chunks = (count + BUILD_CHUNK - 1) / BUILD_CHUNK;
+        std::vector<Bins> partial(chunks);
+        forChunks(pool, first, count, config.parallel_threshold, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+            Bins& bins = partial[chunk];
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t primitive = indices[i];
+                for (int axis = 0; axis < 3; axis++) {
+                    Bin& bin = bins[axis][binOf(primitive, axis, centroid_box, scale[axis])];
+                    bin.bounds.extend(bounds[primitive]);
+                    bin.count++;
+                }
+            }
+        });
+        Bins bins = partial[0];
+        for (uint32_t chunk = 1; chunk < chunks; chunk++) {
+            for (int axis = 0; axis < 3; axis++) {
+                for (uint32_t b = 0; b < config.bins; b++) {
+                    bins[axis][b].bounds.extend(partial[chunk][axis][b].bounds);
+                    bins[axis][b].count += partial[chunk][axis][b].count;
+                }
+            }
+        }
+
+        float best_cost = BVH_INFINITY;
+        int best_axis = -1;
+        uint32_t best_bin = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            if (scale[axis] == 0.0f) continue;
+            // right side costs for a split after bin b, swept from the end
+            float right_cost[MAX_BINS];
+            Aabb right;
+            uint32_t right_count = 0;
+            for (uint32_t b = config.bins - 1; b > 0; b--) {
+                right.extend(bins[axis][b].bounds);
+                right_count += bins[axis][b].count;
+                right_cost[b - 1] = right_count ? right.halfArea() * static_cast<float>(right_count) : BVH_INFINITY;
+            }
+            Aabb left;
+            uint32_t left_count = 0;
+            for (uint32_t b = 0; b + 1 < config.bins; b++) {
+                left.extend(bins[axis][b].bounds);
+                left_count += bins[axis][b].count;
+                if (left_count == 0 || left_count == count) continue;
+                float cost = left.halfArea() * static_cast<float>(left_count) + right_cost[b];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = b;
+                }
+            }
+        }
+        if (best_axis < 0) return false;
+        float leaf_cost = box.halfArea() * static_cast<float>(count);
+        if (count <= COUNT_MASK && leaf_cost <= TRAVERSAL_COST * box.halfArea() + best_cost) return false;
+
+        auto begin = indices.begin() + first;
+        auto split = std::partition(begin, begin + count, [&](uint32_t primitive) {
+            return binOf(primitive, best_axis, centroid_box, scale[best_axis]) <= best_bin;
+        });
+        mid = static_cast<uint32_t>(split - indices.begin());
+        return true;
+    }
+
+    void build(uint32_t node, uint32_t first, uint32_t count, uint32_t depth) {
+        Aabb box, centroid_box;
+        rangeBounds(first, count, box, centroid_box);
+        nodes[node].bounds = box;
+        if (count <= config.max_leaf) {
+            nodes[node].first = first;
+            nodes[node].count = count;
+            return;
+        }
+
+        uint32_t mid = 0;
+        bool split = depth < MAX_SAH_DEPTH && sahSplit(first, count, box, centroid_box, mid);
+        if (!split) {
+            float extent[3] = {
+                centroid_box.max[0] - centroid_box.min[0],
+                centroid_box.max[1] - centroid_box.min[1],
+                centroid_box.max[2] - centroid_box.min[2],
+            };
+            // SAH found no split worth it and a leaf can take the range
+            if (depth < MAX_SAH_DEPTH && count <= COUNT_MASK) {
+                nodes[node].first = first;
+                nodes[node].count = count;
+                return;
+            }
+            int axis = static_cast<int>(std::max_element(extent, extent + 3) - extent);
+            mid = first + count / 2;
+            std::nth_element(indices.begin() + first, indices.begin() + mid, indices.begin() + first + count,
+                [&](uint32_t a, uint32_t b) { return centroid(a)[axis] < centroid(b)[axis]; });
+        }
+
+        uint32_t left = node_count.fetch_add(2, std::memory_order_relaxed);
+        nodes[node].left = left;
+        const uint32_t ranges[2][2] = { { first, mid - first }, { mid, first + count - mid } };
+        if (count >= config.parallel_threshold) {
+            pool.parallelFor(2, [&](size_t i) { build(left + static_cast<uint32_t>(i), ranges[i][0], ranges[i][1], depth + 1); });
+        } else {
+            build(left, ranges[0][0], ranges[0][1], depth + 1);
+            build(left + 1, ranges[1][0], ranges[1][1], depth + 1);
+        }
+    }
+};
+
+void Bvh::setSlot(Node& node, uint32_t slot, const Aabb& box) {
+    node.min_x[slot] = box.min[0];
+    node.min_y[slot] = box.min[1];
+    node.min_z[slot] = box.min[2];
+    node.max_x[slot] = box.max[0];
+    node.max_y[slot] = box.max[1];
+    node.max_z[slot] = box.max[2];
+}
+
+Aabb Bvh::slotBounds(const Node& node, uint32_t slot) const {
+    Aabb box;
+    box.min[0] = node.min_x[slot];
+    box.min[1] = node.min_y[slot];
+    box.min[2] = node.min_z[slot];
+    box.max[0] = node.max_x[slot];
+    box.max[1] = node.max_y[slot];
+    box.max[2] = node.max_z[slot];
+    return box;
+}
+
+Aabb Bvh::nodeBounds(const Node& node) const {
+    Aabb box;
+    for (uint32_t slot = 0; slot < 4; slot++) box.extend(slotBounds(node, slot));
+    return box;
+}
+
+Aabb Bvh::leafBounds(uint32_t child) const {
+    Aabb box;
+    uint32_t first = (child & ~LEAF_BIT) >> COUNT_BITS;
+    uint32_t count = child & COUNT_MASK;
+    for (uint32_t i = first; i < first + count; i++) box.extend(m_bounds[m_primitives[i]]);
+    return box;
+}
+
+void Bvh::build(std::span<const Aabb> bounds, ThreadPool& pool, BvhConfig config) {
+    TRACE_ZONE("Bvh::build");
+    config.bins = std::clamp(config.bins, 2u, MAX_BINS);
+    config.max_leaf = std::clamp(config.max_leaf, 1u, COUNT_MASK);
+    const uint32_t count = static_cast<uint32_t>(bounds.size());
+    m_nodes.clear();
+    m_parents.clear();
+    m_bounds.assign(bounds.begin(), bounds.end());
+    m_primitives.resize(count);
+    m_primitive_slots.assign(count, NO_PARENT);
+    if (count == 0) return;
+
+    Builder builder(m_bounds, m_primitives, pool, config);
+    // a binary tree over n primitives has at most 2n - 1 nodes
+    builder.nodes.resize(static_cast<size_t>(count) * 2);
+    builder.centroids.resize(static_cast<size_t>(count) * 3);
+    forChunks(pool, 0, count, config.parallel_threshold, [&](uint32_t, uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            m_primitives[i] = i;
+            for (int axis = 0; axis < 3; axis++) {
+                // empty boxes sort to the origin, they are never hit anyway
+                builder.centroids[i * 3 + axis] = bounds[i].empty() ? 0.0f : (bounds[i].min[axis] + bounds[i].max[axis]) * 0.5f;
+            }
+        }
+    });
+    builder.build(0, 0, count, 0);
+
+    // Collapse into 4-wide nodes: each takes a binary node's children and
+    // keeps opening the largest inner one until it has four. Parents are
+    // emitted before their children.
+    struct Pending {
+        uint32_t build_node;
+        uint32_t node;
+        uint32_t slot;
+    };
+    std::vector<Pending> pending;
+    auto emit = [&](uint32_t build_node, uint32_t parent) {
+        uint32_t index = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.emplace_back();
+        m_parents.push_back(parent);
+        uint32_t children[4] = { build_node, 0, 0, 0 };
+        uint32_t child_count = 1;
+        if (builder.nodes[build_node].count == 0) {
+            children[0] = builder.nodes[build_node].left;
+            children[1] = builder.nodes[build_node].left + 1;
+            child_count = 2;
+        }
+        while (child_count < 4) {
+            int widest = -1;
+            float widest_area = -1.0f;
+            for (uint32_t i = 0; i < child_count; i++) {
+                const BuildNode& child = builder.nodes[children[i]];
+                if (child.count == 0 && child.bounds.halfArea() > widest_area) {
+                    widest = static_cast<int>(i);
+                    widest_area = child.bounds.halfArea();
+                }
+            }
+            if (widest < 0) break;
+            uint32_t left = builder.nodes[children[widest]].left;
+            children[widest] = left;
+            children[child_count++] = left + 1;
+        }
+        for (uint32_t slot = 0; slot < 4; slot++) {
+            Node& node = m_nodes[index];
+            if (slot < child_count) {
+                setSlot(node, slot, builder.nodes[children[slot]].bounds);
+                pending.push_back({ children[slot], index, slot });
+            } else {
+                setSlot(node, slot, Aabb {});
+                node.child[slot] = EMPTY_CHILD;
+            }
+        }
+        return index;
+    };
+    emit(0, NO_PARENT);
+    while (!pending.empty()) {
+        Pending entry = pending.back();
+        pending.pop_back();
+        const BuildNode& build_node = builder.nodes[entry.build_node];
+        if (build_node.count > 0) {
+            m_nodes[entry.node].child[entry.slot] = LEAF_BIT | build_node.first << COUNT_BITS | build_node.count;
+            for (uint32_t i = build_node.first; i < build_node.first + build_node.count; i++) {
+                m_primitive_slots[m_primitives[i]] = entry.node << 2 | entry.slot;
+            }
+        } else {
+            uint32_t child = emit(entry.build_node, entry.node << 2 | entry.slot);
+            m_nodes[entry.node].child[entry.slot] = child;
+        }
+    }
+    TRACE_COUNTER("bvh nodes", m_nodes.size());
+}
+
+bool Bvh::refitSlot(uint32_t node, uint32_t slot) {
+    uint32_t child = m_nodes[node].child[slot];
+    Aabb box = child & LEAF_BIT ? leafBounds(child) : nodeBounds(m_nodes[child]);
+    Aabb old = slotBounds(m_nodes[node], slot);
+    if (std::memcmp(&box, &old, sizeof(Aabb)) == 0) return false;
+    setSlot(m_nodes[node], slot, box);
+    return true;
+}
+
+void Bvh::refit(std::span<const Aabb> bounds) {
+    TRACE_ZONE("Bvh::refit");
+    if (bounds.size() != m_bounds.size()) return;
+    m_bounds.assign(bounds.begin(), bounds.end());
+    // children always come after their parent
+    for (uint32_t node = static_cast<uint32_t>(m_nodes.size()); node-- > 0;) {
+        for (uint32_t slot = 0; slot < 4; slot++) {
+            if (m_nodes[node].child[slot] != EMPTY_CHILD) refitSlot(node, slot);
+        }
+    }
+}
+
+void Bvh::refit(std::span<const Aabb> bounds, std::span<const uint32_t> moved) {
+    if (bounds.size() != m_bounds.size()) return;
+    if (moved.size() > m_bounds.size() / PARTIAL_REFIT_DIVISOR) {
+        refit(bounds);
+        return;
+    }
+    TRACE_ZONE("Bvh::refit partial");
+    for (uint32_t primitive : moved) {
+        if (primitive < m_bounds.size()) m_bounds[primitive] = bounds[primitive];
+    }
+    // up from each leaf until a box stops changing; a second primitive of
+    // an already refitted leaf stops right away
+    for (uint32_t primitive : moved) {
+        if (primitive >= m_bounds.size()) continue;
+        for (uint32_t entry = m_primitive_slots[primitive]; entry != NO_PARENT; entry = m_parents[entry >> 2]) {
+            if (!refitSlot(entry >> 2, entry & 3)) break;
+        }
+    }
+}
+
+template<typename Leaf>
+void Bvh::traverseRay(const Ray& ray, RayHit& best, Leaf&& leaf) const {
+    if (m_nodes.empty()) return;
+    const PreparedRay prepared = prepare(ray);
+    struct Entry {
+        uint32_t child;
+        float t;
+    };
+    Entry stack[STACK_SIZE];
+    uint32_t size = 0;
+    stack[size++] = { 0, 0.0f };
+    while (size > 0) {
+        Entry entry = stack[--size];
+        if (entry.t > best.t) continue;
+        if (entry.child & LEAF_BIT) {
+            leaf(prepared, ray, (entry.child & ~LEAF_BIT) >> COUNT_BITS, entry.child & COUNT_MASK, best);
+            continue;
+        }
+        const Node& node = m_nodes[entry.child];
+        float t_near[4];
+        uint32_t mask = intersectNode(node, prepared, best.t, t_near);
+        // farthest first onto the stack, so the nearest is popped next
+        Entry hits[4];
+        uint32_t hit_count = 0;
+        for (uint32_t slot = 0; slot < 4; slot++) {
+            if (!(mask >> slot & 1) || node.child[slot] == EMPTY_CHILD) continue;
+            Entry hit { node.child[slot], t_near[slot] };
+            uint32_t i = hit_count++;
+            for (; i > 0 && hits[i - 1].t < hit.t; i--) hits[i] = hits[i - 1];
+            hits[i] = hit;
+        }
+        for (uint32_t i = 0; i < hit_count; i++) stack[size++] = hits[i];
+    }
+}
+
+template<typename Leaf>
+void Bvh::traversePacket(std::span<const Ray> rays, std::span<RayHit> hits, Leaf&& leaf) const {
+    const size_t ray_count = std::min(rays.size(), hits.size());
+    for (size_t base = 0; base < ray_count; base += PACKET_SIZE) {
+        const uint32_t packet = static_cast<uint32_t>(std::min<size_t>(PACKET_SIZE, ray_count - base));
+        PreparedRay prepared[PACKET_SIZE];
+        for (uint32_t r = 0; r < packet; r++) {
+            prepared[r] = prepare(rays[base + r]);
+            hits[base + r] = RayHit {};
+            hits[base + r].t = rays[base + r].t_max;
+        }
+        if (m_nodes.empty()) continue;
+
+        // a node is visited once for every ray of the packet still entering it
+        struct Entry {
+            uint32_t child;
+            uint32_t rays;
+        };
+        Entry stack[STACK_SIZE];
+        uint32_t size = 0;
+        stack[size++] = { 0, (1u << packet) - 1 };
+        while (size > 0) {
+            Entry entry = stack[--size];
+            if (entry.child & LEAF_BIT) {
+                for (uint32_t active = entry.rays; active; active &= active - 1) {
+                    uint32_t r = static_cast<uint32_t>(std::countr_zero(active));
+                    leaf(prepared[r], rays[base + r], (entry.child & ~LEAF_BIT) >> COUNT_BITS, entry.child & COUNT_MASK, hits[base + r]);
+                }
+                continue;
+            }
+            const Node& node = m_nodes[entry.child];
+            uint32_t child_rays[4] = { 0, 0, 0, 0 };
+            float t_near[4];
+            for (uint32_t active = entry.rays; active; active &= active - 1) {
+                uint32_t r = static_cast<uint32_t>(std::countr_zero(active));
+                uint32_t mask = intersectNode(node, prepared[r], hits[base + r].t, t_near);
+                for (uint32_t slot = 0; slot < 4; slot++) child_rays[slot] |= (mask >> slot & 1) << r;
+            }
+            for (uint32_t slot = 4; slot-- > 0;) {
+                if (child_rays[slot] && node.child[slot] != EMPTY_CHILD) stack[size++] = { node.child[slot], child_rays[slot] };
+            }
+        }
+    }
+}
+
+namespace {
+
+// instance leaves: the nearest primitive box entered
+auto boxLeaf(std::span<const uint32_t> primitives, std::span<const Aabb> bounds) {
+    return [primitives, bounds](const PreparedRay& prepared, const Ray&, uint32_t first, uint32_t count, RayHit& best) {
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t primitive = primitives[i];
+            float t = 0.0f;
+            if (intersectBox(bounds[primitive], prepared, best.t, t) && (!best.hit() || t < best.t)) {
+                best.primitive = primitive;
+                best.t = t;
+            }
+        }
+    };
+}
+
+} // namespace
+
+RayHit Bvh::raycast(const Ray& ray) const {
+    RayHit best;
+    best.t = ray.t_max;
+    traverseRay(ray, best, boxLeaf(m_primitives, m_bounds));
+    return best;
+}
+
+void Bvh::raycastPacket(std::span<const Ray> rays, std::span<RayHit> hits) const {
+    traversePacket(rays, hits, boxLeaf(m_primitives, m_bounds));
+}
+
+void Bvh::collectSubtree(uint32_t child, std::vector<uint32_t>& out) const {
+    uint32_t stack[STACK_SIZE];
+    uint32_t size = 0;
+    stack[size++] = child;
+    while (size > 0) {
+        uint32_t entry = stack[--size];
+        if (entry & LEAF_BIT) {
+            uint32_t first = (entry & ~LEAF_BIT) >> COUNT_BITS;
+            out.insert(out.end(), m_primitives.begin() + first, m_primitives.begin() + first + (entry & COUNT_MASK));
+            continue;
+        }
+        for (uint32_t slot : m_nodes[entry].child) {
+            if (slot != EMPTY_CHILD) stack[size++] = slot;
+        }
+    }
+}
+
+void Bvh::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out) const {
+    if (m_nodes.empty()) return;
+    uint32_t stack[STACK_SIZE];
+    uint32_t size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+        const Node& node = m_nodes[stack[--size]];
+        uint32_t outside = 0, inside = 0;
+        classifyNode(node, frustum, outside, inside);
+        for (uint32_t slot = 0; slot < 4; slot++) {
+            uint32_t child = node.child[slot];
+            if (child == EMPTY_CHILD || (outside >> slot & 1)) continue;
+            if (inside >> slot & 1) {
+                collectSubtree(child, out);
+            } else if (child & LEAF_BIT) {
+                uint32_t first = (child & ~LEAF_BIT) >> COUNT_BITS;
+                for (uint32_t i = first; i < first + (child & COUNT_MASK); i++) {
+                    if (!outsideFrustum(m_bounds[m_primitives[i]], frustum)) out.push_back(m_primitives[i]);
+                }
+            } else {
+                stack[size++] = child;
+            }
+        }
+    }
+}
+
+void Bvh::queryAabb(const Aabb& box, std::vector<uint32_t>& out) const {
+    if (m_nodes.empty() || box.empty()) return;
+    uint32_t stack[STACK_SIZE];
+    uint32_t size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+        const Node& node = m_nodes[stack[--size]];
+        uint32_t overlap = 0, contained = 0;
+        overlapNode(node, box, overlap, contained);
+        for (uint32_t slot = 0; slot < 4; slot++) {
+            uint32_t child = node.child[slot];
+            if (child == EMPTY_CHILD || !(overlap >> slot & 1)) continue;
+            if (contained >> slot & 1) {
+                collectSubtree(child, out);
+            } else if (child & LEAF_BIT) {
+                uint32_t first = (child & ~LEAF_BIT) >> COUNT_BITS;
+                for (uint32_t i = first; i < first + (child & COUNT_MASK); i++) {
+                    if (overlaps(m_bounds[m_primitives[i]], box)) out.push_back(m_primitives[i]);
+                }
+            } else {
+                stack[size++] = child;
+            }
+        }
+    }
+}
+
+NearestHit Bvh::nearest(const float point[3], float max_distance) const {
+    NearestHit best;
+    if (m_nodes.empty()) return best;
+    float best_sq = max_distance * max_distance;
+    struct Entry {
+        uint32_t child;
+        float distance_sq;
+    };
+    Entry stack[STACK_SIZE];
+    uint32_t size = 0;
+    stack[size++] = { 0, 0.0f };
+    while (size > 0) {
+        Entry entry = stack[--size];
+        if (entry.distance_sq > best_sq) continue;
+        if (entry.child & LEAF_BIT) {
+            uint32_t first = (entry.child & ~LEAF_BIT) >> COUNT_BITS;
+            for (uint32_t i = first; i < first + (entry.child & COUNT_MASK); i++) {
+                float d = distanceSq(m_bounds[m_primitives[i]], point);
+                if (d <= best_sq && (best.primitive == RayHit::NO_HIT || d < best_sq)) {
+                    best.primitive = m_primitives[i];
+                    best_sq = d;
+                }
+            }
+            continue;
+        }
+        const Node& node = m_nodes[entry.child];
+        float distance_sq[4];
+        distanceNode(node, point, distance_sq);
+        // closest popped first
+        Entry near[4];
+        uint32_t near_count = 0;
+        for (uint32_t slot = 0; slot < 4; slot++) {
+            if (node.child[slot] == EMPTY_CHILD || distance_sq[slot] > best_sq) continue;
+            Entry child { node.child[slot], distance_sq[slot] };
+            uint32_t i = near_count++;
+            for (; i > 0 && near[i - 1].distance_sq < child.distance_sq; i--) near[i] = near[i - 1];
+            near[i] = child;
+        }
+        for (uint32_t i = 0; i < near_count; i++) stack[size++] = near[i];
+    }
+    if (best.primitive != RayHit::NO_HIT) best.distance = std::sqrt(best_sq);
+    return best;
+}
+
+void MeshBvh::build(std::span<const Vertex> vertices, std::span<const uint32_t> indices, ThreadPool& pool,
+    BvhConfig config) {
+    TRACE_ZONE("MeshBvh::build");
+    const uint32_t count = static_cast<uint32_t>(indices.size() / 3);
+    m_triangles.resize(count);
+    std::vector<Aabb> bounds(count);
+    forChunks(pool, 0, count, config.parallel_threshold, [&](uint32_t, uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            Triangle& triangle = m_triangles[i];
+            const uint32_t *corner = &indices[i * 3];
+            if (corner[0] >= vertices.size() || corner[1] >= vertices.size() || corner[2] >= vertices.size()) {
+                // never hit: zero edges make the determinant zero
+                triangle = {};
+                continue;
+            }
+            const float *p0 = vertices[corner[0]].position;
+            const float *p1 = vertices[corner[1]].position;
+            const float *p2 = vertices[corner[2]].position;
+            for (int axis = 0; axis < 3; axis++) {
+                triangle.v0[axis] = p0[axis];
+                triangle.e1[axis] = p1[axis] - p0[axis];
+                triangle.e2[axis] = p2[axis] - p0[axis];
+            }
+            bounds[i].extend(p0);
+            bounds[i].extend(p1);
+            bounds[i].extend(p2);
+        }
+    });
+    m_bvh.build(bounds, pool, config);
+}
+
+// Moller-Trumbore, both faces
+bool MeshBvh::intersect(const Triangle& triangle, const Ray& ray, RayHit& best, uint32_t primitive) const {
+    float p[3];
+    cross(ray.direction, triangle.e2, p);
+    float det = dot(triangle.e1, p);
+    if (std::fabs(det) < 1e-12f) return false;
+    float inv_det = 1.0f / det;
+    float s[3] = { ray.origin[0] - triangle.v0[0], ray.origin[1] - triangle.v0[1], ray.origin[2] - triangle.v0[2] };
+    float u = dot(s, p) * inv_det;
+    if (u < 0.0f || u > 1.0f) return false;
+    float q[3];
+    cross(s, triangle.e1, q);
+    float v = dot(ray.direction, q) * inv_det;
+    if (v < 0.0f || u + v > 1.0f) return false;
+    float t = dot(triangle.e2, q) * inv_det;
+    if (t < 0.0f || t > best.t || (best.hit() && t >= best.t)) return false;
+    best.primitive = primitive;
+    best.t = t;
+    best.u = u;
+    best.v = v;
+    return true;
+}
+
+RayHit MeshBvh::raycast(const Ray& ray) const {
+    RayHit best;
+    best.t = ray.t_max;
+    m_bvh.traverseRay(ray, best, [&](const auto&, const Ray& r, uint32_t first, uint32_t count, RayHit& hit) {
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t primitive = m_bvh.m_primitives[i];
+            intersect(m_triangles[primitive], r, hit, primitive);
+        }
+    });
+    return best;
+}
+
+void MeshBvh::raycastPacket(std::span<const Ray> rays, std::span<RayHit> hits) const {
+    m_bvh.traversePacket(rays, hits, [&](const auto&, const Ray& r, uint32_t first, uint32_t count, RayHit& hit) {
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t primitive = m_bvh.m_primitives[i];
+            intersect(m_triangles[primitive], r, hit, primitive);
+        }
+    });
+}
@@ -0,0 +1,210 @@
+/*
+    bvh.hpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "thread_pool.hpp"
+#include "vertex.hpp"
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+inline constexpr float BVH_INFINITY = std::numeric_limits<float>::infinity();
+
+// Default constructed empty, so extending it by anything gives that thing.
+struct Aabb {
+    float min[3] { BVH_INFINITY, BVH_INFINITY, BVH_INFINITY };
+    float max[3] { -BVH_INFINITY, -BVH_INFINITY, -BVH_INFINITY };
+
+    inline bool empty() const { return min[0] > max[0] || min[1] > max[1] || min[2] > max[2]; }
+
+    inline void extend(const float p[3]) {
+        for (int i = 0; i < 3; i++) {
+            min[i] = p[i] < min[i] ? p[i] : min[i];
+            max[i] = p[i] > max[i] ? p[i] : max[i];
+        }
+    }
+
+    inline void extend(const Aabb& other) {
+        for (int i = 0; i < 3; i++) {
+            min[i] = other.min[i] < min[i] ? other.min[i] : min[i];
+            max[i] = other.max[i] > max[i] ? other.max[i] : max[i];
+        }
+    }
+
+    // half the surface area, all SAH needs
+    inline float halfArea() const {
+        if (empty()) return 0.0f;
+        float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+        return dx * dy + dy * dz + dz * dx;
+    }
+};
+
+// Bounds of `local` transformed by a column-major affine matrix.
+Aabb transformAabb(const Aabb& local, const float matrix[16]);
+
+struct Ray {
+    float origin[3] { 0.0f, 0.0f, 0.0f };
+    // need not be normalized, t is in its units
+    float direction[3] { 0.0f, 0.0f, -1.0f };
+    float t_max { BVH_INFINITY };
+};
+
+struct RayHit {
+    inline static constexpr uint32_t NO_HIT = 0xffffffff;
+
+    uint32_t primitive { NO_HIT };
+    float t { BVH_INFINITY };
+    // barycentrics of the hit, triangles only
+    float u { 0.0f };
+    float v { 0.0f };
+
+    inline bool hit() const { return primitive != NO_HIT; }
+};
+
+struct NearestHit {
+    uint32_t primitive { RayHit::NO_HIT };
+    float distance { BVH_INFINITY };
+};
+
+// Six inward planes, ax + by + cz + d >= 0 inside.
+struct Frustum {
+    float planes[6][4];
+
+    // From a column-major view-projection with WebGPU's 0..1 clip depth.
+    static Frustum fromMatrix(const float view_proj[16]);
+};
+
+struct BvhConfig {
+    // SAH bins per axis
+    uint32_t bins { 16 };
+    // primitives per leaf, at most 15
+    uint32_t max_leaf { 4 };
+    // ranges at least this long bin and recurse on the pool
+    uint32_t parallel_threshold { 4096 };
+};
+
+// Bounding volume hierarchy over boxes, with four children per node stored
+// as structure of arrays so one ray, plane or box is tested against all four
+// at once. Built top-down by binned SAH as a binary tree, which is then
+// collapsed into the 4-wide nodes.
+//
+// Primitives are identified by their index in the span given to build().
+// Moving primitives are handled by refit(), which keeps the topology; a tree
+// refitted far from where it was built answers correctly but slower, and is
+// best rebuilt.
+class Bvh {
+public:
+    inline static constexpr uint32_t PACKET_SIZE = 8;
+
+    void build(std::span<const Aabb> bounds, ThreadPool& pool, BvhConfig config = {});
+
+    // Every node, with `bounds` as long as the span given to build().
+    void refit(std::span<const Aabb> bounds);
+    // Only the paths from the leaves holding `moved` to the root.
+    void refit(std::span<const Aabb> bounds, std::span<const uint32_t> moved);
+
+    // Nearest primitive box the ray enters, t = 0 when it starts inside.
+    RayHit raycast(const Ray& ray) const;
+    // Same as raycast() for each ray, in packets of PACKET_SIZE that share
+    // one traversal. Pays off for coherent rays, like a tile of pixels.
+    void raycastPacket(std::span<const Ray> rays, std::span<RayHit> hits) const;
+
+    // Appends the primitives whose boxes touch the frustum or box. Boxes
+    // outside a frustum plane are culled, so some near a corner pass.
+    void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out) const;
+    void queryAabb(const Aabb& box, std::vector<uint32_t>& out) const;
+
+    // Primitive whose box is closest to `point`, 0 from inside a box.
+    NearestHit nearest(const float point[3], float max_distance = BVH_INFINITY) const;
+
+    inline bool empty() const { return m_nodes.empty(); }
+    inline uint32_t primitiveCount() const { return static_cast<uint32_t>(m_bounds.size()); }
+    inline uint32_t nodeCount() const { return static_cast<uint32_t>(m_nodes.size()); }
+
+private:
+    friend class MeshBvh;
+
+    // child codes: a node index, or LEAF_BIT | first primitive << COUNT_BITS | count
+    inline static constexpr uint32_t LEAF_BIT = 0x80000000;
+    inline static constexpr uint32_t COUNT_BITS = 4;
+    inline static constexpr uint32_t COUNT_MASK = (1u << COUNT_BITS) - 1;
+    // a slot without a child, a leaf of no primitives
+    inline static constexpr uint32_t EMPTY_CHILD = LEAF_BIT;
+    inline static constexpr uint32_t NO_PARENT = 0xffffffff;
+
+    struct alignas(16) Node {
+        float min_x[4], min_y[4], min_z[4];
+        float max_x[4], max_y[4], max_z[4];
+        uint32_t child[4];
+    };
+
+    struct BuildNode;
+    struct Builder;
+
+    void setSlot(Node& node, uint32_t slot, const Aabb& box);
+    Aabb slotBounds(const Node& node, uint32_t slot) const;
+    Aabb nodeBounds(const Node& node) const;
+    Aabb leafBounds(uint32_t child) const;
+    // recomputes a slot from what it holds, false when it did not change
+    bool refitSlot(uint32_t node, uint32_t slot);
+    void collectSubtree(uint32_t child, std::vector<uint32_t>& out) const;
+
+    // Nearest-first traversal. `leaf(first, count, best)` tests the
+    // primitives m_primitives[first, first + count) and narrows `best`.
+    template<typename Leaf>
+    void traverseRay(const Ray& ray, RayHit& best, Leaf&& leaf) const;
+    template<typename Leaf>
+    void traversePacket(std::span<const Ray> rays, std::span<RayHit> hits, Leaf&& leaf) const;
+
+private:
+    std::vector<Node> m_nodes {};
+    // primitive indices in leaf order, leaves point into it
+    std::vector<uint32_t> m_primitives {};
+    std::vector<Aabb> m_bounds {};
+    // node << 2 | slot of each node's parent entry and each primitive's leaf
+    std::vector<uint32_t> m_parents {};
+    std::vector<uint32_t> m_primitive_slots {};
+};
+
+// Triangles of one mesh, such as a Model's m_vertices and m_indices, with
+// exact ray hits. The positions are copied, the mesh may go away.
+class MeshBvh {
+public:
+    void build(std::span<const Vertex> vertices, std::span<const uint32_t> indices, ThreadPool& pool,
+        BvhConfig config = {});
+
+    // primitive is the triangle, indices[3 * primitive] its first corner
+    RayHit raycast(const Ray& ray) const;
+    void raycastPacket(std::span<const Ray> rays, std::span<RayHit> hits) const;
+
+    // box queries over the triangles' bounds
+    inline const Bvh& bvh() const { return m_bvh; }
+
+private:
+    // a corner and the two edges leaving it
+    struct Triangle {
+        float v0[3];
+        float e1[3];
+        float e2[3];
+    };
+
+    bool intersect(const Triangle& triangle, const Ray& ray, RayHit& best, uint32_t primitive) const;
+
+private:
+    Bvh m_bvh {};
+    std::vector<Triangle> m_triangles {};
+};
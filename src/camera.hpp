@@ -0,0 +1,38 @@
+/*
+    camera.hpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "mat4.hpp"
+
+// Right-handed, looking down -z in view space, WebGPU's 0..1 clip depth.
+// Matrices are column-major like WorldMatrix.
+struct Camera {
+    float eye[3] { 0.0f, 0.0f, 3.0f };
+    float target[3] { 0.0f, 0.0f, 0.0f };
+    float up[3] { 0.0f, 1.0f, 0.0f };
+    // vertical, in radians
+    float fov_y { 1.0f };
+    float near_plane { 0.1f };
+    float far_plane { 100.0f };
+
+    inline void viewMatrix(float out[16]) const {
+        mat4LookAt(eye, target, up, out);
+    }
+
+    inline void projectionMatrix(float aspect, float out[16]) const {
+        mat4Perspective(fov_y, aspect, near_plane, far_plane, out);
+    }
+};
@@ -0,0 +1,519 @@
+/*
+    glb_reader.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "glb_reader.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+// glTF stores everything little-endian, the in-place path hands it to the
+// GPU untouched
+static_assert(std::endian::native == std::endian::little);
+
+namespace {
+
+constexpr uint32_t GLB_MAGIC = 0x46546c67; // "glTF"
+constexpr uint32_t GLB_VERSION = 2;
+constexpr uint32_t CHUNK_JSON = 0x4e4f534a;
+constexpr uint32_t CHUNK_BIN = 0x004e4942;
+constexpr uint32_t MODE_TRIANGLES = 4;
+constexpr uint32_t MAX_JSON_DEPTH = 64;
+
+enum ComponentType : uint32_t {
+    BYTE = 5120, UNSIGNED_BYTE = 5121, SHORT = 5122, UNSIGNED_SHORT = 5123, UNSIGNED_INT = 5125, FLOAT = 5126,
+};
+
+inline uint32_t readU32(const std::byte *p_data) {
+    uint32_t value;
+    std::memcpy(&value, p_data, 4);
+    return value;
+}
+
+// Just enough JSON for the glTF header: a tree of values, members kept in
+// file order.
+struct Json {
+    enum class Type : uint8_t {
+        Null, Bool, Number, String, Array, Object,
+    };
+
+    Type type { Type::Null };
+    bool boolean { false };
+    double number { 0.0 };
+    std::string string {};
+    std::vector<Json> items {};
+    std::vector<std::pair<std::string, Json>> members {};
+
+    inline const Json *find(std::string_view key) const {
+        if (type != Type::Object) return nullptr;
+        for (const auto& [name, value] : members) {
+            if (name == key) return &value;
+        }
+        return nullptr;
+    }
+
+    inline const Json *at(size_t index) const {
+        return type == Type::Array && index < items.size() ? &items[index] : nullptr;
+    }
+
+    // a non-negative integer member, `fallback` when it is absent
+    inline bool index(std::string_view key, uint64_t fallback, uint64_t& out) const {
+        const Json *value = find(key);
+        if (!value) {
+            out = fallback;
+            return true;
+        }
+        if (value->type != Type::Number || value->number < 0.0 || value->number != std::floor(value->number)
+            || value->number > 9007199254740992.0) return false;
+        out = static_cast<uint64_t>(value->number);
+        return true;
+    }
+};
+
+class JsonParser {
+public:
+    JsonParser(std::string_view text): m_p(text.data()), m_end(text.data() + text.size()) {}
+
+    bool parseDocument(Json& out) {
+        if (!parseValue(out, 0)) return false;
+        skipSpace();
+        return m_p == m_end;
+    }
+
+private:
+    void skipSpace() {
+        while (m_p < m_end && (*m_p == ' ' || *m_p == '\t' || *m_p == '\n' || *m_p == '\r')) m_p++;
+    }
+
+    bool literal(std::string_view word) {
+        if (static_cast<size_t>(m_end - m_p) < word.size() || std::string_view(m_p, word.size()) != word) return false;
+        m_p += word.size();
+        return true;
+    }
+
+    bool parseValue(Json& out, uint32_t depth) {
+        if (depth > MAX_JSON_DEPTH) return false;
+        skipSpace();
+        if (m_p == m_end) return false;
+        switch (*m_p) {
+            case '{': return parseObject(out, depth);
+            case '[': return parseArray(out, depth);
+            case '"': {
+                out.type = Json::Type::String;
+                return parseString(out.string);
+            }
+            case 't': {
+                out.type = Json::Type::Bool;
+                out.boolean = true;
+                return literal("true");
+            }
+            case 'f': {
+                out.type = Json::Type::Bool;
+                return literal("false");
+            }
+            case 'n': return literal("null");
+            default: return parseNumber(out);
+        }
+    }
+
+    bool parseObject(Json& out, uint32_t depth) {
+        out.type = Json::Type::Object;
+        m_p++;
+        skipSpace();
+        if (m_p < m_end && *m_p == '}') {
+            m_p++;
+            return true;
+        }
+        while (true) {
+            skipSpace();
+            auto& [key, value] = out.members.emplace_back();
+            if (m_p == m_end || *m_p != '"' || !parseString(key)) return false;
+            skipSpace();
+            if (m_p == m_end || *m_p++ != ':') return false;
+            if (!parseValue(value, depth + 1)) return false;
+            skipSpace();
+            if (m_p == m_end) return false;
+            char c = *m_p++;
+            if (c == '}') return true;
+            if (c != ',') return false;
+        }
+    }
+
+    bool parseArray(Json& out, uint32_t depth) {
+        out.type = Json::Type::Array;
+        m_p++;
+        skipSpace();
+        if (m_p < m_end && *m_p == ']') {
+            m_p++;
+            return true;
+        }
+        while (true) {
+            if (!parseValue(out.items.emplace_back(), depth + 1)) return false;
+            skipSpace();
+            if (m_p == m_end) return false;
+            char c = *m_p++;
+            if (c == ']') return true;
+            if (c != ',') return false;
+        }
+    }
+
+    bool parseString(std::string& out) {
+        m_p++;
+        while (m_p < m_end && *m_p != '"') {
+            char c = *m_p++;
+            if (c != '\\') {
+                out.push_back(c);
+                continue;
+            }
+            if (m_p == m_end) return false;
+            switch (char e = *m_p++) {
+                case '"': case '\\': case '/': out.push_back(e); break;
+                case 'b': out.push_back('\b'); break;
+                case 'f': out.push_back('\f'); break;
+                case 'n': out.push_back('\n'); break;
+                case 'r': out.push_back('\r'); break;
+                case 't': out.push_back('\t'); break;
+                case 'u': {
+                    if (m_end - m_p < 4) return false;
+                    uint32_t code = 0;
+                    for (int i = 0; i < 4; i++) {
+                        char h = *m_p++;
+                        uint32_t digit = h >= '0' && h <= '9' ? h - '0' : h >= 'a' && h <= 'f' ? h - 'a' + 10 : h >= 'A' && h <= 'F' ? h - 'A' + 10 : 16;
+                        if (digit > 15) return false;
+                        code = code << 4 | digit;
+                    }
+                    // names in glTF are matched, never shown, surrogate
+                    // halves are encoded one by one
+                    if (code < 0x80) {
+                        out.push_back(static_cast<char>(code));
+                    } else if (code < 0x800) {
+                        out.push_back(static_cast<char>(0xc0 | code >> 6));
+                        out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+                    } else {
+                        out.push_back(static_cast<char>(0xe0 | code >> 12));
+                        out.push_back(static_cast<char>(0x80 | (code >> 6 & 0x3f)));
+                        out.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+                    }
+                    break;
+                }
+                default: return false;
+            }
+        }
+        if (m_p == m_end) return false;
+        m_p++;
+        return true;
+    }
+
+    bool parseNumber(Json& out) {
+        const char *start = m_p;
+        if (m_p < m_end && *m_p == '-') m_p++;
+        while (m_p < m_end && ((*m_p >= '0' && *m_p <= '9') || *m_p == '.' || *m_p == 'e' || *m_p == 'E' || *m_p == '+' || *m_p == '-')) m_p++;
+        if (m_p == start) return false;
+        // strtod wants a terminated string, numbers are short
+        std::string text(start, m_p);
+        char *end = nullptr;
+        out.type = Json::Type::Number;
+        out.number = std::strtod(text.c_str(), &end);
+        return end == text.c_str() + text.size();
+    }
+
+private:
+    const char *m_p;
+    const char *m_end;
+};
+
+struct Accessor {
+    const std::byte *p_data { nullptr };
+    uint32_t count { 0 };
+    uint32_t stride { 0 };
+    uint32_t component_type { 0 };
+    uint32_t components { 0 };
+    bool normalized { false };
+    // which view it reads and where in it, for the in-place test
+    uint64_t view { 0 };
+    uint64_t offset { 0 };
+    // as written in the file, 0 when the view has none
+    uint32_t view_stride { 0 };
+};
+
+uint32_t componentSize(uint64_t type) {
+    switch (type) {
+        case BYTE: case UNSIGNED_BYTE: return 1;
+        case SHORT: case UNSIGNED_SHORT: return 2;
+        case UNSIGNED_INT: case FLOAT: return 4;
+        default: return 0;
+    }
+}
+
+uint32_t componentCount(std::string_view type) {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    return 0;
+}
+
+Result<Accessor, std::string> resolveAccessor(const Json& root, uint64_t index, std::span<const std::byte> bin) {
+    const Json *accessors = root.find("accessors");
+    const Json *accessor = accessors ? accessors->at(index) : nullptr;
+    if (!accessor) return Err { "accessor " + std::to_string(index) + " does not exist" };
+    if (accessor->find("sparse")) return Err { std::string("sparse accessors are not supported") };
+
+    Accessor out;
+    uint64_t count = 0, component_type = 0, view_index = 0, offset = 0;
+    const Json *type = accessor->find("type");
+    if (!accessor->index("count", 0, count) || !accessor->index("componentType", 0, component_type)
+        || !accessor->index("bufferView", ~0ull, view_index) || !accessor->index("byteOffset", 0, offset)
+        || !type || type->type != Json::Type::String) {
+        return Err { "accessor " + std::to_string(index) + " is malformed" };
+    }
+    if (view_index == ~0ull) return Err { "accessor " + std::to_string(index) + " has no buffer view" };
+    out.component_type = static_cast<uint32_t>(component_type);
+    out.components = componentCount(type->string);
+    uint32_t component_size = componentSize(component_type);
+    if (out.components == 0 || component_size == 0 || count > 0xffffffffull) {
+        return Err { "accessor " + std::to_string(index) + " has an unknown layout" };
+    }
+    if (const Json *normalized = accessor->find("normalized")) out.normalized = normalized->boolean;
+
+    const Json *views = root.find("bufferViews");
+    const Json *view = views ? views->at(view_index) : nullptr;
+    uint64_t buffer = 0, view_offset = 0, view_length = 0, view_stride = 0;
+    if (!view || !view->index("buffer", 0, buffer) || !view->index("byteOffset", 0, view_offset)
+        || !view->index("byteLength", ~0ull, view_length) || !view->index("byteStride", 0, view_stride)) {
+        return Err { "buffer view " + std::to_string(view_index) + " is malformed" };
+    }
+    const Json *buffers = root.find("buffers");
+    const Json *buffer_json = buffers ? buffers->at(buffer) : nullptr;
+    if (buffer != 0 || !buffer_json || buffer_json->find("uri")) {
+        return Err { std::string("only the GLB's embedded buffer is supported") };
+    }
+    if (view_offset > bin.size() || view_length > bin.size() - view_offset) {
+        return Err { "buffer view " + std::to_string(view_index) + " runs past the binary chunk" };
+    }
+
+    uint32_t element_size = out.components * component_size;
+    out.stride = view_stride ? static_cast<uint32_t>(view_stride) : element_size;
+    if (view_stride != 0 && (view_stride < element_size || view_stride > 252 || view_stride % component_size)) {
+        return Err { "buffer view " + std::to_string(view_index) + " has a bad stride" };
+    }
+    if (offset % component_size || (view_offset + offset) % component_size) {
+        return Err { "accessor " + std::to_string(index) + " is misaligned" };
+    }
+    if (count > 0 && (offset > view_length || (count - 1) * out.stride + element_size > view_length - offset)) {
+        return Err { "accessor " + std::to_string(index) + " runs past its buffer view" };
+    }
+    out.p_data = bin.data() + view_offset + offset;
+    out.count = static_cast<uint32_t>(count);
+    out.view = view_index;
+    out.offset = offset;
+    out.view_stride = static_cast<uint32_t>(view_stride);
+    return Ok { out };
+}
+
+float readComponent(const std::byte *p_data, uint32_t type, bool normalized) {
+    switch (type) {
+        case FLOAT: {
+            float value;
+            std::memcpy(&value, p_data, 4);
+            return value;
+        }
+        case UNSIGNED_BYTE: {
+            uint8_t value = static_cast<uint8_t>(*p_data);
+            return normalized ? value / 255.0f : value;
+        }
+        case BYTE: {
+            int8_t value = static_cast<int8_t>(*p_data);
+            return normalized ? std::max(value / 127.0f, -1.0f) : value;
+        }
+        case UNSIGNED_SHORT: {
+            uint16_t value;
+            std::memcpy(&value, p_data, 2);
+            return normalized ? value / 65535.0f : value;
+        }
+        case SHORT: {
+            int16_t value;
+            std::memcpy(&value, p_data, 2);
+            return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+        }
+        case UNSIGNED_INT: {
+            uint32_t value;
+            std::memcpy(&value, p_data, 4);
+            return static_cast<float>(value);
+        }
+        default: return 0.0f;
+    }
+}
+
+// Writes `components` floats of each element into the vertex at `offset`.
+void convertAttribute(const Accessor& accessor, uint32_t components, size_t offset, std::vector<Vertex>& vertices) {
+    uint32_t component_size = componentSize(accessor.component_type);
+    for (uint32_t i = 0; i < accessor.count; i++) {
+        const std::byte *p_element = accessor.p_data + static_cast<size_t>(i) * accessor.stride;
+        float *p_out = reinterpret_cast<float*>(reinterpret_cast<std::byte*>(&vertices[i]) + offset);
+        for (uint32_t c = 0; c < components; c++) {
+            p_out[c] = readComponent(p_element + c * component_size, accessor.component_type, accessor.normalized);
+        }
+    }
+}
+
+// Index buffers are not bounds checked on every backend, one past the
+// vertices would read whatever follows them.
+template <typename T>
+bool indicesInRange(std::span<const std::byte> indices, uint32_t vertex_count) {
+    for (size_t i = 0; i + sizeof(T) <= indices.size(); i += sizeof(T)) {
+        T value;
+        std::memcpy(&value, indices.data() + i, sizeof(T));
+        if (value >= vertex_count) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool looksLikeGlb(const void *p_data, size_t length) {
+    if (length < 12) return false;
+    const auto *p_bytes = static_cast<const std::byte*>(p_data);
+    return readU32(p_bytes) == GLB_MAGIC && readU32(p_bytes + 4) == GLB_VERSION;
+}
+
+Result<GlbMesh, std::string> readGlb(std::span<const std::byte> file) {
+    TRACE_ZONE("readGlb");
+    if (!looksLikeGlb(file.data(), file.size())) return Err { std::string("not a glTF 2.0 binary") };
+    uint32_t total = readU32(file.data() + 8);
+    if (total > file.size() || total < 20) return Err { std::string("truncated GLB") };
+    file = file.first(total);
+
+    // a JSON chunk, then an optional binary one, each 4-byte aligned
+    std::string_view json_text;
+    std::span<const std::byte> bin;
+    size_t cursor = 12;
+    for (int chunk = 0; cursor + 8 <= file.size(); chunk++) {
+        uint32_t length = readU32(file.data() + cursor);
+        uint32_t type = readU32(file.data() + cursor + 4);
+        cursor += 8;
+        if (length > file.size() - cursor) return Err { std::string("GLB chunk runs past the file") };
+        if (chunk == 0 && type == CHUNK_JSON) {
+            json_text = { reinterpret_cast<const char*>(file.data() + cursor), length };
+        } else if (chunk == 1 && type == CHUNK_BIN) {
+            bin = file.subspan(cursor, length);
+        } else if (chunk == 0) {
+            return Err { std::string("GLB does not start with a JSON chunk") };
+        }
+        cursor += (length + 3) & ~3u;
+    }
+
+    Json root;
+    if (!JsonParser(json_text).parseDocument(root) || root.type != Json::Type::Object) {
+        return Err { std::string("GLB JSON chunk does not parse") };
+    }
+    const Json *meshes = root.find("meshes");
+    const Json *mesh = meshes ? meshes->at(0) : nullptr;
+    const Json *primitives = mesh ? mesh->find("primitives") : nullptr;
+    const Json *primitive = primitives ? primitives->at(0) : nullptr;
+    const Json *attributes = primitive ? primitive->find("attributes") : nullptr;
+    if (!attributes) return Err { std::string("GLB has no mesh primitive") };
+    uint64_t mode = 0;
+    if (!primitive->index("mode", MODE_TRIANGLES, mode) || mode != MODE_TRIANGLES) {
+        return Err { std::string("only triangle lists are supported") };
+    }
+
+    auto attribute = [&](std::string_view name) -> Result<std::optional<Accessor>, std::string> {
+        uint64_t index = 0;
+        if (!attributes->index(name, ~0ull, index)) return Err { std::string(name) + " is malformed" };
+        if (index == ~0ull) return Ok { std::optional<Accessor> {} };
+        auto accessor = resolveAccessor(root, index, bin);
+        if (accessor.is_err()) return Err { std::move(accessor).unwrap_err() };
+        return Ok { std::optional<Accessor> { std::move(accessor).unwrap() } };
+    };
+    auto position_result = attribute("POSITION");
+    if (position_result.is_err()) return Err { std::move(position_result).unwrap_err() };
+    auto normal_result = attribute("NORMAL");
+    if (normal_result.is_err()) return Err { std::move(normal_result).unwrap_err() };
+    auto uv_result = attribute("TEXCOORD_0");
+    if (uv_result.is_err()) return Err { std::move(uv_result).unwrap_err() };
+    std::optional<Accessor> position = std::move(position_result).unwrap();
+    std::optional<Accessor> normal = std::move(normal_result).unwrap();
+    std::optional<Accessor> uv = std::move(uv_result).unwrap();
+
+    if (!position || position->component_type != FLOAT || position->components != 3) {
+        return Err { std::string("POSITION must be float VEC3") };
+    }
+    if (position->count == 0) return Err { std::string("GLB mesh has no vertices") };
+    if ((normal && (normal->count != position->count || normal->components != 3))
+        || (uv && (uv->count != position->count || uv->components != 2))) {
+        return Err { std::string("NORMAL or TEXCOORD_0 does not match POSITION") };
+    }
+
+    GlbMesh out;
+    out.vertex_count = position->count;
+    // already a Vertex array: all three interleaved at Vertex's offsets in
+    // one view with its stride
+    auto at = [&](const std::optional<Accessor>& accessor, size_t offset) {
+        return accessor && accessor->component_type == FLOAT && accessor->view == position->view
+            && accessor->view_stride == sizeof(Vertex) && accessor->offset == position->offset + offset;
+    };
+    if (at(position, offsetof(Vertex, position)) && at(normal, offsetof(Vertex, normal)) && at(uv, offsetof(Vertex, uv))) {
+        out.vertices = { position->p_data, static_cast<size_t>(position->count) * sizeof(Vertex) };
+    } else {
+        TRACE_ZONE("convert vertices");
+        out.converted_vertices.assign(position->count, Vertex {});
+        convertAttribute(*position, 3, offsetof(Vertex, position), out.converted_vertices);
+        if (normal) convertAttribute(*normal, 3, offsetof(Vertex, normal), out.converted_vertices);
+        if (uv) convertAttribute(*uv, 2, offsetof(Vertex, uv), out.converted_vertices);
+        out.vertices = std::as_bytes(std::span<const Vertex>(out.converted_vertices));
+    }
+
+    uint64_t indices_index = 0;
+    if (!primitive->index("indices", ~0ull, indices_index)) return Err { std::string("indices is malformed") };
+    if (indices_index == ~0ull) {
+        // unindexed, every three vertices are a triangle
+        out.converted_indices.resize(position->count);
+        for (uint32_t i = 0; i < position->count; i++) out.converted_indices[i] = i;
+    } else {
+        auto indices_result = resolveAccessor(root, indices_index, bin);
+        if (indices_result.is_err()) return Err { std::move(indices_result).unwrap_err() };
+        Accessor indices = std::move(indices_result).unwrap();
+        if (indices.components != 1 || indices.view_stride != 0
+            || (indices.component_type != UNSIGNED_BYTE && indices.component_type != UNSIGNED_SHORT && indices.component_type != UNSIGNED_INT)) {
+            return Err { std::string("indices must be tightly packed unsigned scalars") };
+        }
+        if (indices.component_type == UNSIGNED_BYTE) {
+            // no 8-bit index format on the GPU
+            out.converted_indices.resize(indices.count);
+            for (uint32_t i = 0; i < indices.count; i++) out.converted_indices[i] = static_cast<uint8_t>(indices.p_data[i]);
+        } else {
+            out.index_type = indices.component_type == UNSIGNED_SHORT ? GlbIndexType::Uint16 : GlbIndexType::Uint32;
+            out.index_count = indices.count;
+            out.indices = { indices.p_data, static_cast<size_t>(indices.count) * indices.stride };
+        }
+    }
+    if (!out.converted_indices.empty()) {
+        out.index_type = GlbIndexType::Uint32;
+        out.index_count = static_cast<uint32_t>(out.converted_indices.size());
+        out.indices = std::as_bytes(std::span<const uint32_t>(out.converted_indices));
+    }
+    if (out.index_count % 3 != 0) return Err { std::string("index count is not a multiple of three") };
+    bool in_range = out.index_type == GlbIndexType::Uint16
+        ? indicesInRange<uint16_t>(out.indices, out.vertex_count)
+        : indicesInRange<uint32_t>(out.indices, out.vertex_count);
+    if (!in_range) return Err { std::string("an index is past the last vertex") };
+    return Ok { std::move(out) };
+}
@@ -0,0 +1,58 @@
+/*
+    glb_reader.hpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "result.hpp"
+#include "vertex.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+enum class GlbIndexType : uint8_t {
+    Uint16, Uint32,
+};
+
+// The first triangle primitive of the first mesh, in the Vertex layout.
+// Where the file already stores it that way, `vertices` and `indices` point
+// straight into the GLB's binary chunk and nothing is copied; otherwise they
+// point at the converted arrays below. Either way they stay valid while the
+// file data and this struct live, moves included.
+struct GlbMesh {
+    std::span<const std::byte> vertices {};
+    uint32_t vertex_count { 0 };
+    std::span<const std::byte> indices {};
+    GlbIndexType index_type { GlbIndexType::Uint32 };
+    uint32_t index_count { 0 };
+
+    // only filled for accessors whose layout differs from Vertex or that
+    // have no 16 or 32 bit index form
+    std::vector<Vertex> converted_vertices {};
+    std::vector<uint32_t> converted_indices {};
+
+    inline bool verticesInPlace() const { return converted_vertices.empty(); }
+    inline bool indicesInPlace() const { return converted_indices.empty(); }
+};
+
+// Checks the 12-byte header for the glTF magic and version 2.
+bool looksLikeGlb(const void *p_data, size_t length);
+
+// Parses a binary glTF 2.0 file. Only the embedded binary chunk is read,
+// external and data URI buffers are rejected, as are sparse accessors and
+// primitives other than triangle lists. Every accessor the mesh uses is
+// bounds checked against its buffer view and the chunk.
+Result<GlbMesh, std::string> readGlb(std::span<const std::byte> file);
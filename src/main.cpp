@@ -14,14 +14,51 @@
 */
 
 #include "application.hpp"
+#include "event_script.hpp"
+#include "mapped_file.hpp"
+#include "mesh_codec.hpp"
+#include "model_loader.hpp"
 #include "result.hpp"
+#include "trace.hpp"
 #include "window.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
 
 using namespace std::string_literals;
 
+// Writes `in` as a compressed mesh, for shipping instead of the source format.
+static int compressMesh(const std::string& in, const std::string& out) {
+    auto file = MappedFile::open(in);
+    if (file.is_err()) {
+        std::cout << std::move(file).unwrap_err() << '\n';
+        return 1;
+    }
+    MappedFile mapping = std::move(file).unwrap();
+    size_t dot = in.rfind('.');
+    std::string hint = dot == std::string::npos ? std::string() : in.substr(dot + 1);
+    Model model;
+    model.loadModelFromMemory(mapping.bytes().data(), mapping.bytes().size(), hint);
+    if (model.m_vertices.empty()) {
+        std::cout << in << ": no mesh\n";
+        return 1;
+    }
+    std::vector<std::byte> encoded = encodeMesh(model.m_vertices, model.m_indices);
+    std::ofstream stream(out, std::ios::binary);
+    if (!stream.write(reinterpret_cast<const char*>(encoded.data()), static_cast<std::streamsize>(encoded.size()))) {
+        std::cout << out << ": cannot write\n";
+        return 1;
+    }
+    size_t raw = model.m_vertices.size_bytes() + model.m_indices.size_bytes();
+    std::cout << in << ": " << raw << " bytes of geometry, " << encoded.size() << " compressed\n";
+    return 0;
+}
+
 int main(int argc, char* const argv[]) {
-    auto window_sys = WindowSystemFactory::create(WindowType::SDL3)
-        .expect("cannot create window system");
+    TRACE_THREAD_NAME("main");
     WindowConfig config {
         .title = "hello",
         .w = 800,
@@ -29,14 +66,102 @@ int main(int argc, char* const argv[]) {
         .flags = WindowFlags::RESIZEABLE
     };
 
+    StartupOptions options {};
+    const char *capture_path = nullptr;
+    const char *capture_prefix = nullptr;
+    const char *replay_path = nullptr;
+    const char *record_path = nullptr;
+    const char *metrics_endpoint = nullptr;
+    std::vector<ImportSource> imports;
+    std::vector<std::string> glb_imports;
+    std::vector<std::string> mesh_imports;
+    uint32_t particle_count = 0;
+    // GPU frame time dynamic resolution aims for, off when 0
+    float target_gpu_ms = 0.0f;
+    bool single_thread = false;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--gpu-info") options.dump_gpu_info = true;
+        else if (arg == "--startup-report") options.print_timeline = true;
+        else if (arg == "--single-thread") single_thread = true;
+        else if (arg == "--capture" && i + 1 < argc) capture_path = argv[++i];
+        else if (arg == "--capture-sequence" && i + 1 < argc) capture_prefix = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replay_path = argv[++i];
+        else if (arg == "--record-events" && i + 1 < argc) record_path = argv[++i];
+        else if (arg == "--metrics" && i + 1 < argc) metrics_endpoint = argv[++i];
+        else if (arg == "--import" && i + 1 < argc) imports.push_back({ .name = argv[++i] });
+        else if (arg == "--import-glb" && i + 1 < argc) glb_imports.push_back(argv[++i]);
+        else if (arg == "--import-mesh" && i + 1 < argc) mesh_imports.push_back(argv[++i]);
+        else if (arg == "--dynamic-resolution") {
+            // the target is optional, 14 ms leaves headroom under 60 Hz
+            char *number_end = nullptr;
+            float ms = i + 1 < argc ? std::strtof(argv[i + 1], &number_end) : 0.0f;
+            if (number_end && *number_end == '\0' && ms > 0.0f) i++;
+            else ms = 14.0f;
+            target_gpu_ms = ms;
+        }
+        else if (arg == "--particles" && i + 1 < argc) particle_count = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--compress-mesh" && i + 2 < argc) return compressMesh(argv[i + 1], argv[i + 2]);
+    }
+
+    // a replay runs headless on the null window system
+    auto window_sys = (replay_path
+        ? WindowSystemFactory::createNull(EventScript::load(replay_path).expect("cannot load event script"))
+        : WindowSystemFactory::create(WindowType::SDL3)
+    ).expect("cannot create window system");
+
     {
-        auto window = window_sys->create(config).expect("cannot create window");
         Application app;
-        app.initialize(std::move(window));
-        while(!app.needClose()) {
-            app.mainLoop();
+        app.initialize([&]() {
+            auto window = window_sys->create(config).expect("cannot create window");
+            if (record_path) window = std::make_unique<EventRecorder>(std::move(window), record_path);
+            return window;
+        }, options);
+        if (target_gpu_ms > 0.0f) {
+            app.enableDynamicResolution({ .min_scale = 0.5f, .max_scale = 1.0f, .target_gpu_ms = target_gpu_ms });
+        }
+        if (particle_count > 0) {
+            // a fountain above the model, emitting as fast as particles die
+            ParticleEmitter fountain {
+                .position = { 0.0f, 1.5f, 0.0f },
+                .rate = static_cast<float>(particle_count) / 2.0f,
+                .spread = 0.35f,
+                .speed_min = 3.0f,
+                .speed_max = 5.0f,
+                .lifetime_min = 1.5f,
+                .lifetime_max = 2.5f,
+                .size_start = 0.03f,
+                .size_end = 0.01f,
+                .color_start = { 1.0f, 0.6f, 0.2f, 1.0f },
+                .color_end = { 0.6f, 0.1f, 0.05f, 0.0f },
+            };
+            app.enableParticles({ .capacity = particle_count }, fountain);
+        }
+        if (capture_path) app.captureFrame(capture_path);
+        if (capture_prefix) app.startCaptureSequence(capture_prefix);
+        if (metrics_endpoint) app.serveMetrics(metrics_endpoint);
+        for (const std::string& path : glb_imports) {
+            auto mesh = app.importGlb(path);
+            if (mesh.is_err()) std::cout << std::move(mesh).unwrap_err() << '\n';
+            else std::cout << path << " -> mesh " << std::move(mesh).unwrap() << '\n';
         }
+        for (const std::string& path : mesh_imports) {
+            auto mesh = app.importEncodedMesh(path);
+            if (mesh.is_err()) std::cout << std::move(mesh).unwrap_err() << '\n';
+            else std::cout << path << " -> mesh " << std::move(mesh).unwrap() << '\n';
+        }
+        if (!imports.empty()) {
+            for (const ManifestEntry& entry : app.importMeshes(imports)) {
+                if (entry.mesh == ManifestEntry::NO_MESH) std::cout << entry.source << ": " << entry.error << '\n';
+                else std::cout << entry.source << " -> mesh " << entry.mesh << '\n';
+            }
+        }
+        // recording and replay stay on one thread, the script counts frames
+        // by polls and both must poll once per rendered frame
+        app.run(!single_thread && !replay_path && !record_path);
     }
 
+    TRACE_FLUSH("nocturne.trace.json");
+
     return 0;
 }
\ No newline at end of file
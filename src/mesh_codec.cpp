@@ -0,0 +1,636 @@
+/*
+    mesh_codec.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "mesh_codec.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MESH_CODEC_SSE2 1
+#endif
+
+// pshufb places the escaped bytes without a loop; MSVC only says so
+// through the AVX macros
+#if defined(MESH_CODEC_SSE2) && (defined(__SSSE3__) || defined(__AVX__))
+#include <tmmintrin.h>
+#define MESH_CODEC_SSSE3 1
+#endif
+
+namespace {
+
+constexpr char MESH_MAGIC[4] = { 'N', 'M', 'S', 'H' };
+constexpr uint32_t MESH_VERSION = 1;
+
+struct MeshHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t vertex_size;
+    uint32_t index_count;
+    uint32_t vertex_bytes;
+    uint32_t index_bytes;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(MeshHeader) == 32);
+
+constexpr uint32_t GROUP_SIZE = 16;
+// the transposed block stays in L1 while it is decoded
+constexpr uint32_t BLOCK_BYTES = 8192;
+constexpr uint32_t MAX_BLOCK_VERTICES = 256;
+// the longest a SIMD group decode reads: 8 packed bytes and 16 escapes
+constexpr ptrdiff_t SIMD_GROUP_READ = 32;
+
+enum GroupMode : uint8_t {
+    GROUP_ZERO = 0, GROUP_BITS2 = 1, GROUP_BITS4 = 2, GROUP_BYTES = 3,
+};
+
+constexpr uint32_t EDGE_FIFO = 16;
+constexpr uint32_t VERTEX_FIFO = 16;
+// code nibbles: edge distances 0..14, 15 for a triangle without a known edge
+constexpr uint8_t NO_EDGE = 15;
+// vertex references: next unseen vertex, FIFO distances 1..14, explicit delta
+constexpr uint8_t REF_NEXT = 0;
+constexpr uint8_t REF_EXPLICIT = 15;
+constexpr uint32_t REF_FIFO_DEPTH = 14;
+constexpr uint32_t NO_VERTEX = 0xffffffff;
+
+uint32_t blockVertices(uint32_t vertex_size) {
+    return std::clamp((BLOCK_BYTES / vertex_size) & ~(GROUP_SIZE - 1), GROUP_SIZE, MAX_BLOCK_VERTICES);
+}
+
+inline uint8_t zigzag8(uint8_t delta) {
+    return static_cast<uint8_t>((delta << 1) ^ static_cast<uint8_t>(static_cast<int8_t>(delta) >> 7));
+}
+
+inline uint8_t unzigzag8(uint8_t value) {
+    return static_cast<uint8_t>((value >> 1) ^ -(value & 1));
+}
+
+// --- vertex streams ---
+
+void encodeGroup(const uint8_t *p_deltas, std::vector<std::byte>& out, uint8_t& mode) {
+    uint32_t escapes2 = 0, escapes4 = 0;
+    bool zero = true;
+    for (uint32_t i = 0; i < GROUP_SIZE; i++) {
+        zero &= p_deltas[i] == 0;
+        escapes2 += p_deltas[i] >= 3;
+        escapes4 += p_deltas[i] >= 15;
+    }
+    uint32_t bits = 8;
+    if (zero) bits = 0;
+    else if (4 + escapes2 <= 8 + escapes4 && 4 + escapes2 < GROUP_SIZE) bits = 2;
+    else if (8 + escapes4 < GROUP_SIZE) bits = 4;
+
+    if (bits == 0) {
+        mode = GROUP_ZERO;
+        return;
+    }
+    if (bits == 8) {
+        mode = GROUP_BYTES;
+        for (uint32_t i = 0; i < GROUP_SIZE; i++) out.push_back(std::byte { p_deltas[i] });
+        return;
+    }
+    // most significant bits first, the order the SIMD unpack produces
+    uint8_t sentinel = static_cast<uint8_t>((1u << bits) - 1);
+    uint32_t per_byte = 8 / bits;
+    size_t packed = out.size();
+    out.resize(packed + GROUP_SIZE / per_byte, std::byte { 0 });
+    for (uint32_t i = 0; i < GROUP_SIZE; i++) {
+        uint8_t value = std::min(p_deltas[i], sentinel);
+        uint32_t shift = 8 - bits * (i % per_byte + 1);
+        out[packed + i / per_byte] |= std::byte { static_cast<uint8_t>(value << shift) };
+    }
+    for (uint32_t i = 0; i < GROUP_SIZE; i++) {
+        if (p_deltas[i] >= sentinel) out.push_back(std::byte { p_deltas[i] });
+    }
+    mode = bits == 2 ? GROUP_BITS2 : GROUP_BITS4;
+}
+
+// One byte stream of a block: a 2-bit mode per group, then the groups.
+void encodeByteStream(const uint8_t *p_deltas, uint32_t count, std::vector<std::byte>& out) {
+    uint32_t groups = count / GROUP_SIZE;
+    size_t header = out.size();
+    out.resize(header + (groups + 3) / 4, std::byte { 0 });
+    for (uint32_t g = 0; g < groups; g++) {
+        uint8_t mode = GROUP_ZERO;
+        encodeGroup(p_deltas + g * GROUP_SIZE, out, mode);
+        out[header + g / 4] |= std::byte { static_cast<uint8_t>(mode << (g % 4 * 2)) };
+    }
+}
+
+const uint8_t *decodeGroupScalar(const uint8_t *p, const uint8_t *p_end, uint8_t mode, uint8_t *p_out) {
+    if (mode == GROUP_ZERO) {
+        std::memset(p_out, 0, GROUP_SIZE);
+        return p;
+    }
+    if (mode == GROUP_BYTES) {
+        if (p_end - p < static_cast<ptrdiff_t>(GROUP_SIZE)) return nullptr;
+        std::memcpy(p_out, p, GROUP_SIZE);
+        return p + GROUP_SIZE;
+    }
+    uint32_t bits = mode == GROUP_BITS2 ? 2 : 4;
+    uint32_t per_byte = 8 / bits;
+    uint8_t sentinel = static_cast<uint8_t>((1u << bits) - 1);
+    const uint8_t *p_escapes = p + GROUP_SIZE / per_byte;
+    if (p_escapes > p_end) return nullptr;
+    for (uint32_t i = 0; i < GROUP_SIZE; i++) {
+        uint8_t value = (p[i / per_byte] >> (8 - bits * (i % per_byte + 1))) & sentinel;
+        if (value == sentinel) {
+            if (p_escapes == p_end) return nullptr;
+            value = *p_escapes++;
+        }
+        p_out[i] = value;
+    }
+    return p_escapes;
+}
+
+#ifdef MESH_CODEC_SSSE3
+// for each 8-lane escape mask, the escape byte every lane takes, 0x80 for
+// lanes that keep their packed value
+constexpr std::array<std::array<uint8_t, 8>, 256> ESCAPE_SHUFFLE = []() {
+    std::array<std::array<uint8_t, 8>, 256> table {};
+    for (uint32_t mask = 0; mask < 256; mask++) {
+        uint8_t next = 0;
+        for (uint32_t lane = 0; lane < 8; lane++) {
+            table[mask][lane] = mask & (1u << lane) ? next++ : 0x80;
+        }
+    }
+    return table;
+}();
+#endif
+
+#ifdef MESH_CODEC_SSE2
+// Lanes set in `mask` take the next escape bytes.
+inline const uint8_t *fillEscapes(__m128i& values, __m128i mask, const uint8_t *p_escapes) {
+    uint32_t mask16 = static_cast<uint32_t>(_mm_movemask_epi8(mask));
+    if (mask16 == 0) return p_escapes;
+#ifdef MESH_CODEC_SSSE3
+    uint32_t mask0 = mask16 & 0xff, mask1 = mask16 >> 8;
+    __m128i shuffle0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(ESCAPE_SHUFFLE[mask0].data()));
+    __m128i shuffle1 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(ESCAPE_SHUFFLE[mask1].data()));
+    // the upper lanes continue after the lower lanes' escapes, 0x80 stays negative
+    shuffle1 = _mm_add_epi8(shuffle1, _mm_set1_epi8(static_cast<char>(std::popcount(mask0))));
+    __m128i escapes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_escapes));
+    __m128i placed = _mm_shuffle_epi8(escapes, _mm_unpacklo_epi64(shuffle0, shuffle1));
+    values = _mm_or_si128(placed, _mm_andnot_si128(mask, values));
+    return p_escapes + std::popcount(mask16);
+#else
+    alignas(16) uint8_t lanes[GROUP_SIZE];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), values);
+    for (; mask16; mask16 &= mask16 - 1) lanes[std::countr_zero(mask16)] = *p_escapes++;
+    values = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes));
+    return p_escapes;
+#endif
+}
+
+// Needs SIMD_GROUP_READ readable bytes at `p`.
+inline const uint8_t *decodeGroupSse(const uint8_t *p, uint8_t mode, __m128i& values) {
+    switch (mode) {
+        case GROUP_ZERO:
+            values = _mm_setzero_si128();
+            return p;
+        case GROUP_BITS2: {
+            int32_t word;
+            std::memcpy(&word, p, sizeof(word));
+            __m128i packed = _mm_cvtsi32_si128(word);
+            // spread each 2-bit field to a byte, high bits first
+            __m128i nibbles = _mm_unpacklo_epi8(_mm_srli_epi16(packed, 4), packed);
+            __m128i fields = _mm_unpacklo_epi8(_mm_srli_epi16(nibbles, 2), nibbles);
+            values = _mm_and_si128(fields, _mm_set1_epi8(3));
+            return fillEscapes(values, _mm_cmpeq_epi8(values, _mm_set1_epi8(3)), p + 4);
+        }
+        case GROUP_BITS4: {
+            __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+            __m128i fields = _mm_unpacklo_epi8(_mm_srli_epi16(packed, 4), packed);
+            values = _mm_and_si128(fields, _mm_set1_epi8(15));
+            return fillEscapes(values, _mm_cmpeq_epi8(values, _mm_set1_epi8(15)), p + 8);
+        }
+        default:
+            values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            return p + GROUP_SIZE;
+    }
+}
+
+// Zigzagged deltas to bytes: an inclusive prefix sum over the lanes on top
+// of `carry`, which becomes the last lane broadcast.
+inline __m128i integrateGroup(__m128i z, __m128i& carry) {
+    __m128i half = _mm_and_si128(_mm_srli_epi16(z, 1), _mm_set1_epi8(0x7f));
+    __m128i sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(z, _mm_set1_epi8(1)));
+    __m128i x = _mm_xor_si128(half, sign);
+    x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+    x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+    x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+    x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+    x = _mm_add_epi8(x, carry);
+    carry = _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_unpackhi_epi8(x, x), 0xff), 0xff);
+    return x;
+}
+#endif
+
+// Decodes one byte stream of a block and integrates it from `last`.
+const uint8_t *decodeByteStream(const uint8_t *p, const uint8_t *p_end, uint8_t *p_out, uint32_t count, uint8_t& last) {
+    uint32_t groups = count / GROUP_SIZE;
+    const uint8_t *p_header = p;
+    p += (groups + 3) / 4;
+    if (p > p_end) return nullptr;
+#ifdef MESH_CODEC_SSE2
+    __m128i carry = _mm_set1_epi8(static_cast<char>(last));
+#endif
+    for (uint32_t g = 0; g < groups; g++) {
+        uint8_t mode = (p_header[g / 4] >> (g % 4 * 2)) & 3;
+        uint8_t *p_group = p_out + g * GROUP_SIZE;
+#ifdef MESH_CODEC_SSE2
+        __m128i deltas;
+        if (p_end - p >= SIMD_GROUP_READ) {
+            p = decodeGroupSse(p, mode, deltas);
+        } else {
+            p = decodeGroupScalar(p, p_end, mode, p_group);
+            if (!p) return nullptr;
+            deltas = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_group));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_group), integrateGroup(deltas, carry));
+#else
+        p = decodeGroupScalar(p, p_end, mode, p_group);
+        if (!p) return nullptr;
+        for (uint32_t i = 0; i < GROUP_SIZE; i++) p_group[i] = last = static_cast<uint8_t>(last + unzigzag8(p_group[i]));
+#endif
+    }
+#ifdef MESH_CODEC_SSE2
+    last = static_cast<uint8_t>(_mm_cvtsi128_si32(carry));
+#endif
+    return p;
+}
+
+// Interleaves the `vertex_size` byte streams, `stride` apart, into vertices.
+void transpose(const uint8_t *p_streams, uint32_t stride, uint32_t count, uint32_t vertex_size, uint8_t *p_out) {
+#ifdef MESH_CODEC_SSE2
+    for (uint32_t first = 0; first < count; first += GROUP_SIZE) {
+        uint32_t group = std::min(GROUP_SIZE, count - first);
+        uint8_t *p_group = p_out + static_cast<size_t>(first) * vertex_size;
+        uint32_t k = 0;
+        // 16 streams into 16 whole rows of 16 bytes, widening the lanes
+        // from one byte to the full row in four unpack rounds
+        for (; k + 16 <= vertex_size; k += 16) {
+            __m128i pairs[8][2], quads[4][4], octets[2][8];
+            for (uint32_t j = 0; j < 8; j++) {
+                const uint8_t *p_k = p_streams + static_cast<size_t>(k + 2 * j) * stride + first;
+                __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_k));
+                __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_k + stride));
+                pairs[j][0] = _mm_unpacklo_epi8(r0, r1);
+                pairs[j][1] = _mm_unpackhi_epi8(r0, r1);
+            }
+            for (uint32_t q = 0; q < 4; q++) {
+                for (uint32_t h = 0; h < 2; h++) {
+                    quads[q][h * 2] = _mm_unpacklo_epi16(pairs[2 * q][h], pairs[2 * q + 1][h]);
+                    quads[q][h * 2 + 1] = _mm_unpackhi_epi16(pairs[2 * q][h], pairs[2 * q + 1][h]);
+                }
+            }
+            for (uint32_t o = 0; o < 2; o++) {
+                for (uint32_t quarter = 0; quarter < 4; quarter++) {
+                    octets[o][quarter * 2] = _mm_unpacklo_epi32(quads[2 * o][quarter], quads[2 * o + 1][quarter]);
+                    octets[o][quarter * 2 + 1] = _mm_unpackhi_epi32(quads[2 * o][quarter], quads[2 * o + 1][quarter]);
+                }
+            }
+            for (uint32_t pair = 0; pair < 8; pair++) {
+                __m128i rows[2] = {
+                    _mm_unpacklo_epi64(octets[0][pair], octets[1][pair]),
+                    _mm_unpackhi_epi64(octets[0][pair], octets[1][pair]),
+                };
+                for (uint32_t i = pair * 2; i < std::min(pair * 2 + 2, group); i++) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(p_group + i * vertex_size + k), rows[i - pair * 2]);
+                }
+            }
+        }
+        // the rest four streams at a time
+        for (; k < vertex_size; k += 4) {
+            const uint8_t *p_k = p_streams + static_cast<size_t>(k) * stride + first;
+            __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_k));
+            __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_k + stride));
+            __m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_k + 2 * stride));
+            __m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_k + 3 * stride));
+            __m128i low01 = _mm_unpacklo_epi8(r0, r1), high01 = _mm_unpackhi_epi8(r0, r1);
+            __m128i low23 = _mm_unpacklo_epi8(r2, r3), high23 = _mm_unpackhi_epi8(r2, r3);
+            // four bytes of one vertex per 32-bit lane
+            alignas(16) uint32_t words[GROUP_SIZE];
+            _mm_store_si128(reinterpret_cast<__m128i*>(words), _mm_unpacklo_epi16(low01, low23));
+            _mm_store_si128(reinterpret_cast<__m128i*>(words + 4), _mm_unpackhi_epi16(low01, low23));
+            _mm_store_si128(reinterpret_cast<__m128i*>(words + 8), _mm_unpacklo_epi16(high01, high23));
+            _mm_store_si128(reinterpret_cast<__m128i*>(words + 12), _mm_unpackhi_epi16(high01, high23));
+            for (uint32_t i = 0; i < group; i++) std::memcpy(p_group + i * vertex_size + k, &words[i], 4);
+        }
+    }
+#else
+    for (uint32_t i = 0; i < count; i++) {
+        for (uint32_t k = 0; k < vertex_size; k++) p_out[static_cast<size_t>(i) * vertex_size + k] = p_streams[k * stride + i];
+    }
+#endif
+}
+
+bool validVertexSize(uint32_t vertex_size) {
+    return vertex_size > 0 && vertex_size % 4 == 0 && vertex_size <= MESH_CODEC_MAX_VERTEX_SIZE;
+}
+
+// --- index stream ---
+
+struct TriangleFifos {
+    std::array<std::array<uint32_t, 2>, EDGE_FIFO> edges;
+    std::array<uint32_t, VERTEX_FIFO> vertices;
+    uint32_t edge_head { 0 };
+    uint32_t vertex_head { 0 };
+    // the vertex a REF_NEXT names, and the base of explicit deltas
+    uint32_t next { 0 };
+    uint32_t last { 0 };
+
+    TriangleFifos() {
+        edges.fill({ NO_VERTEX, NO_VERTEX });
+        vertices.fill(NO_VERTEX);
+    }
+
+    inline int32_t findEdge(uint32_t a, uint32_t b) const {
+        for (uint32_t i = 0; i < NO_EDGE; i++) {
+            const auto& edge = edges[(edge_head - 1 - i) % EDGE_FIFO];
+            if (edge[0] == a && edge[1] == b) return static_cast<int32_t>(i);
+        }
+        return -1;
+    }
+
+    inline std::array<uint32_t, 2> edge(uint32_t distance) const {
+        return edges[(edge_head - 1 - distance) % EDGE_FIFO];
+    }
+
+    inline void pushEdge(uint32_t a, uint32_t b) {
+        edges[edge_head++ % EDGE_FIFO] = { a, b };
+    }
+
+    inline int32_t findVertex(uint32_t v) const {
+        for (uint32_t i = 0; i < REF_FIFO_DEPTH; i++) {
+            if (vertices[(vertex_head - 1 - i) % VERTEX_FIFO] == v) return static_cast<int32_t>(i);
+        }
+        return -1;
+    }
+
+    inline uint32_t vertex(uint32_t distance) const {
+        return vertices[(vertex_head - 1 - distance) % VERTEX_FIFO];
+    }
+
+    inline void pushVertex(uint32_t v) {
+        vertices[vertex_head++ % VERTEX_FIFO] = v;
+    }
+};
+
+void writeVarint(std::vector<std::byte>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(std::byte { static_cast<uint8_t>(value | 0x80) });
+        value >>= 7;
+    }
+    out.push_back(std::byte { static_cast<uint8_t>(value) });
+}
+
+inline bool readVarint(const uint8_t *&p, const uint8_t *p_end, uint32_t& value) {
+    value = 0;
+    for (uint32_t shift = 0; shift < 35; shift += 7) {
+        if (p == p_end) return false;
+        uint8_t byte = *p++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+uint8_t encodeReference(TriangleFifos& fifos, uint32_t v, std::vector<std::byte>& data) {
+    if (v == fifos.next) {
+        fifos.next++;
+        fifos.pushVertex(v);
+        return REF_NEXT;
+    }
+    int32_t distance = fifos.findVertex(v);
+    if (distance >= 0) return static_cast<uint8_t>(distance + 1);
+    int32_t delta = static_cast<int32_t>(v - fifos.last);
+    writeVarint(data, (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31));
+    fifos.last = v;
+    fifos.pushVertex(v);
+    return REF_EXPLICIT;
+}
+
+inline bool decodeReference(TriangleFifos& fifos, uint8_t code, const uint8_t *&p, const uint8_t *p_end, uint32_t& v) {
+    if (code == REF_NEXT) {
+        v = fifos.next++;
+        fifos.pushVertex(v);
+        return true;
+    }
+    if (code != REF_EXPLICIT) {
+        v = fifos.vertex(code - 1u);
+        return true;
+    }
+    uint32_t zigzag;
+    if (!readVarint(p, p_end, zigzag)) return false;
+    v = fifos.last + ((zigzag >> 1) ^ (0u - (zigzag & 1)));
+    fifos.last = v;
+    fifos.pushVertex(v);
+    return true;
+}
+
+} // namespace
+
+std::vector<std::byte> encodeVertexBuffer(std::span<const std::byte> vertices, uint32_t vertex_size) {
+    TRACE_ZONE("encodeVertexBuffer");
+    std::vector<std::byte> out;
+    if (!validVertexSize(vertex_size)) return out;
+    uint32_t count = static_cast<uint32_t>(vertices.size() / vertex_size);
+    uint32_t block = blockVertices(vertex_size);
+    const auto *p_vertices = reinterpret_cast<const uint8_t*>(vertices.data());
+    std::array<uint8_t, MESH_CODEC_MAX_VERTEX_SIZE> last {};
+    std::vector<uint8_t> deltas(block);
+    out.reserve(vertices.size() / 2);
+    for (uint32_t first = 0; first < count; first += block) {
+        uint32_t n = std::min(block, count - first);
+        uint32_t padded = (n + GROUP_SIZE - 1) & ~(GROUP_SIZE - 1);
+        for (uint32_t k = 0; k < vertex_size; k++) {
+            uint8_t previous = last[k];
+            for (uint32_t i = 0; i < n; i++) {
+                uint8_t value = p_vertices[static_cast<size_t>(first + i) * vertex_size + k];
+                deltas[i] = zigzag8(static_cast<uint8_t>(value - previous));
+                previous = value;
+            }
+            std::fill(deltas.begin() + n, deltas.begin() + padded, uint8_t { 0 });
+            last[k] = previous;
+            encodeByteStream(deltas.data(), padded, out);
+        }
+    }
+    return out;
+}
+
+Result<void, std::string> decodeVertexBuffer(std::span<std::byte> out, uint32_t vertex_count, uint32_t vertex_size,
+    std::span<const std::byte> encoded) {
+    TRACE_ZONE("decodeVertexBuffer");
+    if (!validVertexSize(vertex_size)) return Err { std::string("unsupported vertex size") };
+    if (out.size() != static_cast<size_t>(vertex_count) * vertex_size) return Err { std::string("output size mismatch") };
+    uint32_t block = blockVertices(vertex_size);
+    const auto *p = reinterpret_cast<const uint8_t*>(encoded.data());
+    const uint8_t *p_end = p + encoded.size();
+    auto *p_out = reinterpret_cast<uint8_t*>(out.data());
+    std::array<uint8_t, MESH_CODEC_MAX_VERTEX_SIZE> last {};
+    // one stream per vertex byte, `block` apart
+    std::vector<uint8_t> streams(static_cast<size_t>(vertex_size) * block);
+    for (uint32_t first = 0; first < vertex_count; first += block) {
+        uint32_t n = std::min(block, vertex_count - first);
+        uint32_t padded = (n + GROUP_SIZE - 1) & ~(GROUP_SIZE - 1);
+        for (uint32_t k = 0; k < vertex_size; k++) {
+            uint8_t *p_stream = streams.data() + static_cast<size_t>(k) * block;
+            // padding deltas are zero, so the carry is the last real vertex
+            p = decodeByteStream(p, p_end, p_stream, padded, last[k]);
+            if (!p) return Err { std::string("vertex stream is truncated") };
+        }
+        transpose(streams.data(), block, n, vertex_size, p_out + static_cast<size_t>(first) * vertex_size);
+    }
+    if (p != p_end) return Err { std::string("vertex stream has trailing bytes") };
+    return Ok {};
+}
+
+std::vector<std::byte> encodeIndexBuffer(std::span<const uint32_t> indices) {
+    TRACE_ZONE("encodeIndexBuffer");
+    size_t triangles = indices.size() / 3;
+    // a code byte per triangle up front, then aux bytes and explicit deltas
+    std::vector<std::byte> codes(triangles);
+    std::vector<std::byte> data;
+    data.reserve(triangles);
+    TriangleFifos fifos;
+    for (size_t t = 0; t < triangles; t++) {
+        uint32_t a = indices[t * 3], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+        int32_t edge = fifos.findEdge(a, b);
+        if (edge >= 0) {
+            uint8_t ref = encodeReference(fifos, c, data);
+            codes[t] = std::byte { static_cast<uint8_t>(edge << 4 | ref) };
+            // a neighbour walks the shared edges the other way
+            fifos.pushEdge(c, b);
+            fifos.pushEdge(a, c);
+            continue;
+        }
+        uint8_t ref_a = encodeReference(fifos, a, data);
+        size_t aux = data.size();
+        data.push_back(std::byte { 0 });
+        uint8_t ref_b = encodeReference(fifos, b, data);
+        uint8_t ref_c = encodeReference(fifos, c, data);
+        codes[t] = std::byte { static_cast<uint8_t>(NO_EDGE << 4 | ref_a) };
+        data[aux] = std::byte { static_cast<uint8_t>(ref_b << 4 | ref_c) };
+        fifos.pushEdge(b, a);
+        fifos.pushEdge(c, b);
+        fifos.pushEdge(a, c);
+    }
+    codes.insert(codes.end(), data.begin(), data.end());
+    return codes;
+}
+
+Result<void, std::string> decodeIndexBuffer(std::span<std::byte> out, uint32_t index_count, uint32_t index_size,
+    uint32_t vertex_count, std::span<const std::byte> encoded) {
+    TRACE_ZONE("decodeIndexBuffer");
+    if (index_count % 3 != 0) return Err { std::string("index count is not a triangle list") };
+    if (index_size != 2 && index_size != 4) return Err { std::string("indices are 2 or 4 bytes") };
+    if (index_size == 2 && vertex_count > 0x10000) return Err { std::string("too many vertices for 16-bit indices") };
+    if (out.size() != static_cast<size_t>(index_count) * index_size) return Err { std::string("output size mismatch") };
+    uint32_t triangles = index_count / 3;
+    if (encoded.size() < triangles) return Err { std::string("index stream is truncated") };
+    const auto *p_codes = reinterpret_cast<const uint8_t*>(encoded.data());
+    const uint8_t *p = p_codes + triangles;
+    const uint8_t *p_end = p_codes + encoded.size();
+    auto *p_out = reinterpret_cast<uint8_t*>(out.data());
+    TriangleFifos fifos;
+    for (uint32_t t = 0; t < triangles; t++) {
+        uint8_t code = p_codes[t];
+        uint32_t a = 0, b = 0, c = 0;
+        bool ok;
+        if (code >> 4 != NO_EDGE) {
+            auto edge = fifos.edge(code >> 4);
+            a = edge[0];
+            b = edge[1];
+            ok = decodeReference(fifos, code & 15, p, p_end, c);
+            fifos.pushEdge(c, b);
+            fifos.pushEdge(a, c);
+        } else {
+            ok = decodeReference(fifos, code & 15, p, p_end, a) && p < p_end;
+            if (ok) {
+                uint8_t aux = *p++;
+                ok = decodeReference(fifos, aux >> 4, p, p_end, b) && decodeReference(fifos, aux & 15, p, p_end, c);
+            }
+            fifos.pushEdge(b, a);
+            fifos.pushEdge(c, b);
+            fifos.pushEdge(a, c);
+        }
+        if (!ok) return Err { std::string("index stream is truncated") };
+        // also catches references to FIFO slots nothing was pushed to
+        if (a >= vertex_count || b >= vertex_count || c >= vertex_count) {
+            return Err { std::string("index out of range at triangle ") + std::to_string(t) };
+        }
+        uint8_t *p_triangle = p_out + static_cast<size_t>(t) * 3 * index_size;
+        if (index_size == 2) {
+            const uint16_t triangle[3] = { static_cast<uint16_t>(a), static_cast<uint16_t>(b), static_cast<uint16_t>(c) };
+            std::memcpy(p_triangle, triangle, sizeof(triangle));
+        } else {
+            const uint32_t triangle[3] = { a, b, c };
+            std::memcpy(p_triangle, triangle, sizeof(triangle));
+        }
+    }
+    if (p != p_end) return Err { std::string("index stream has trailing bytes") };
+    return Ok {};
+}
+
+std::vector<std::byte> encodeMesh(std::span<const Vertex> vertices, std::span<const uint32_t> indices) {
+    std::vector<std::byte> vertex_stream = encodeVertexBuffer(std::as_bytes(vertices), sizeof(Vertex));
+    std::vector<std::byte> index_stream = encodeIndexBuffer(indices.first(indices.size() / 3 * 3));
+    MeshHeader header {};
+    std::memcpy(header.magic, MESH_MAGIC, sizeof(MESH_MAGIC));
+    header.version = MESH_VERSION;
+    header.vertex_count = static_cast<uint32_t>(vertices.size());
+    header.vertex_size = sizeof(Vertex);
+    header.index_count = static_cast<uint32_t>(indices.size() / 3 * 3);
+    header.vertex_bytes = static_cast<uint32_t>(vertex_stream.size());
+    header.index_bytes = static_cast<uint32_t>(index_stream.size());
+
+    // sized once, growing it by insert() copies the vertex stream again
+    std::vector<std::byte> file(sizeof(header) + vertex_stream.size() + index_stream.size());
+    std::memcpy(file.data(), &header, sizeof(header));
+    std::copy(vertex_stream.begin(), vertex_stream.end(), file.begin() + sizeof(header));
+    std::copy(index_stream.begin(), index_stream.end(), file.begin() + sizeof(header) + vertex_stream.size());
+    return file;
+}
+
+bool looksLikeEncodedMesh(const void *p_data, size_t length) {
+    return length >= sizeof(MeshHeader) && std::memcmp(p_data, MESH_MAGIC, sizeof(MESH_MAGIC)) == 0;
+}
+
+Result<EncodedMesh, std::string> readEncodedMesh(std::span<const std::byte> file) {
+    if (!looksLikeEncodedMesh(file.data(), file.size())) return Err { std::string("not a compressed mesh") };
+    MeshHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.version != MESH_VERSION) {
+        return Err { "unsupported compressed mesh version " + std::to_string(header.version) };
+    }
+    if (!validVertexSize(header.vertex_size)) return Err { std::string("unsupported vertex size") };
+    if (header.index_count % 3 != 0) return Err { std::string("index count is not a triangle list") };
+    uint64_t streams = static_cast<uint64_t>(header.vertex_bytes) + header.index_bytes;
+    if (sizeof(header) + streams != file.size()) return Err { std::string("stream sizes do not match the file") };
+    EncodedMesh mesh;
+    mesh.vertex_count = header.vertex_count;
+    mesh.vertex_size = header.vertex_size;
+    mesh.index_count = header.index_count;
+    mesh.vertices = file.subspan(sizeof(header), header.vertex_bytes);
+    mesh.indices = file.subspan(sizeof(header) + header.vertex_bytes, header.index_bytes);
+    return Ok { mesh };
+}
@@ -0,0 +1,71 @@
+/*
+    mesh_codec.hpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "result.hpp"
+#include "vertex.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// Lossless compression for meshes that already went through vertex cache
+// and vertex fetch optimization, decoded byte for byte.
+//
+// Vertices are cut into blocks, each byte of the vertex becomes its own
+// stream of deltas against the previous vertex, and every 16 deltas are
+// packed at 0, 2, 4 or 8 bits with the outliers escaped. Triangles are coded
+// against a FIFO of recent edges and one of recent vertices, so most cost a
+// single byte when vertices are first referenced in order.
+
+// Vertex sizes are multiples of four, at most MAX_VERTEX_SIZE.
+inline static constexpr uint32_t MESH_CODEC_MAX_VERTEX_SIZE = 256;
+
+std::vector<std::byte> encodeVertexBuffer(std::span<const std::byte> vertices, uint32_t vertex_size);
+// `out` holds exactly vertex_count * vertex_size bytes.
+Result<void, std::string> decodeVertexBuffer(std::span<std::byte> out, uint32_t vertex_count, uint32_t vertex_size,
+    std::span<const std::byte> encoded);
+
+// Triangle lists only, the count is a multiple of three.
+std::vector<std::byte> encodeIndexBuffer(std::span<const uint32_t> indices);
+// Writes 2 or 4 byte indices into `out`, every index is checked against
+// `vertex_count`.
+Result<void, std::string> decodeIndexBuffer(std::span<std::byte> out, uint32_t index_count, uint32_t index_size,
+    uint32_t vertex_count, std::span<const std::byte> encoded);
+
+// What a compressed mesh file decodes to.
+struct EncodedMesh {
+    uint32_t vertex_count { 0 };
+    uint32_t vertex_size { 0 };
+    uint32_t index_count { 0 };
+    std::span<const std::byte> vertices {};
+    std::span<const std::byte> indices {};
+
+    inline size_t vertexBytes() const { return static_cast<size_t>(vertex_count) * vertex_size; }
+    // 16-bit indices whenever every vertex fits
+    inline uint32_t indexSize() const { return vertex_count <= 0x10000 ? 2 : 4; }
+    inline size_t indexBytes(uint32_t index_size) const { return static_cast<size_t>(index_count) * index_size; }
+};
+
+// A Vertex mesh in a file: a header and the two streams above.
+std::vector<std::byte> encodeMesh(std::span<const Vertex> vertices, std::span<const uint32_t> indices);
+
+bool looksLikeEncodedMesh(const void *p_data, size_t length);
+
+// Checks the header and stream bounds, decodes nothing; the spans point
+// into `file`.
+Result<EncodedMesh, std::string> readEncodedMesh(std::span<const std::byte> file);
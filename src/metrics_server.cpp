@@ -0,0 +1,208 @@
+/*
+    metrics_server.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "metrics_server.hpp"
+#include "trace.hpp"
+#include <charconv>
+#include <sstream>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#define METRICS_SOCKETS 1
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// how often the accept loop looks at the stop flag
+constexpr int POLL_MS = 200;
+// a scraper that stalls longer is dropped
+constexpr int CLIENT_TIMEOUT_MS = 1000;
+constexpr size_t MAX_REQUEST = 8192;
+
+#if METRICS_SOCKETS
+
+std::string systemError(std::string_view what) {
+    return std::string(what) + ": " + std::strerror(errno);
+}
+
+bool sendAll(int fd, std::string_view data) {
+#ifdef MSG_NOSIGNAL
+    constexpr int flags = MSG_NOSIGNAL;
+#else
+    constexpr int flags = 0;
+#endif
+    while (!data.empty()) {
+        ssize_t sent = send(fd, data.data(), data.size(), flags);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        data.remove_prefix(static_cast<size_t>(sent));
+    }
+    return true;
+}
+
+Result<int, std::string> listenUnix(const std::string& path) {
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) return Err { std::string("bad unix socket path") };
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return Err { systemError("socket") };
+    // a stale socket left by a crashed run
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        std::string error = systemError(path);
+        close(fd);
+        return Err { std::move(error) };
+    }
+    return Ok { fd };
+}
+
+Result<int, std::string> listenLoopback(std::string_view endpoint) {
+    std::string_view host = "127.0.0.1";
+    std::string_view port_text = endpoint;
+    if (size_t colon = endpoint.rfind(':'); colon != std::string_view::npos) {
+        host = endpoint.substr(0, colon);
+        port_text = endpoint.substr(colon + 1);
+    }
+    if (host == "localhost") host = "127.0.0.1";
+    uint16_t port = 0;
+    auto [end, ec] = std::from_chars(port_text.data(), port_text.data() + port_text.size(), port);
+    if (ec != std::errc() || end != port_text.data() + port_text.size()) {
+        return Err { "bad metrics port '" + std::string(port_text) + "'" };
+    }
+
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, std::string(host).c_str(), &addr.sin_addr) != 1) {
+        return Err { "bad metrics host '" + std::string(host) + "'" };
+    }
+    // only ever reachable from this machine
+    if ((ntohl(addr.sin_addr.s_addr) >> 24) != 127) {
+        return Err { "metrics are only served on loopback, not '" + std::string(host) + "'" };
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return Err { systemError("socket") };
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        std::string error = systemError(endpoint);
+        close(fd);
+        return Err { std::move(error) };
+    }
+    return Ok { fd };
+}
+
+#endif // METRICS_SOCKETS
+
+} // namespace
+
+Result<std::unique_ptr<MetricsServer>, std::string> MetricsServer::start(const metrics::Registry& registry,
+    std::string_view endpoint) {
+#if METRICS_SOCKETS
+    constexpr std::string_view UNIX_PREFIX = "unix:";
+    bool is_unix = endpoint.starts_with(UNIX_PREFIX);
+    std::string unix_path = is_unix ? std::string(endpoint.substr(UNIX_PREFIX.size())) : std::string();
+    Result<int, std::string> fd = is_unix ? listenUnix(unix_path) : listenLoopback(endpoint);
+    if (fd.is_err()) return Err { std::move(fd).unwrap_err() };
+    return Ok { std::unique_ptr<MetricsServer>(new MetricsServer(registry, std::move(fd).unwrap(), std::move(unix_path))) };
+#else
+    (void)registry;
+    (void)endpoint;
+    return Err { std::string("metrics sockets are not supported on this platform") };
+#endif
+}
+
+MetricsServer::MetricsServer(const metrics::Registry& registry, int listen_fd, std::string unix_path):
+    m_registry(registry), m_listen_fd(listen_fd), m_unix_path(std::move(unix_path)) {
+    m_thread = std::thread([this]() { serveLoop(); });
+}
+
+MetricsServer::~MetricsServer() {
+    m_stopping.store(true, std::memory_order_relaxed);
+    if (m_thread.joinable()) m_thread.join();
+#if METRICS_SOCKETS
+    close(m_listen_fd);
+    if (!m_unix_path.empty()) unlink(m_unix_path.c_str());
+#endif
+}
+
+void MetricsServer::serveLoop() {
+    TRACE_THREAD_NAME("metrics");
+#if METRICS_SOCKETS
+    while (!m_stopping.load(std::memory_order_relaxed)) {
+        pollfd listener { m_listen_fd, POLLIN, 0 };
+        if (poll(&listener, 1, POLL_MS) <= 0) continue;
+        int fd = accept(m_listen_fd, nullptr, nullptr);
+        if (fd < 0) continue;
+        timeval timeout { CLIENT_TIMEOUT_MS / 1000, (CLIENT_TIMEOUT_MS % 1000) * 1000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+        int no_sigpipe = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+        serveClient(fd);
+        close(fd);
+    }
+#endif
+}
+
+void MetricsServer::serveClient(int fd) {
+#if METRICS_SOCKETS
+    // only the request line matters, the headers are read and ignored
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST) {
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return;
+        request.append(buffer, static_cast<size_t>(received));
+    }
+
+    std::string_view line = std::string_view(request).substr(0, request.find("\r\n"));
+    const char *status = "200 OK";
+    std::ostringstream body;
+    if (!line.starts_with("GET ")) {
+        status = "405 Method Not Allowed";
+    } else if (!line.starts_with("GET /metrics ") && !line.starts_with("GET /metrics?") && !line.starts_with("GET / ")) {
+        status = "404 Not Found";
+    } else {
+        TRACE_ZONE("metrics scrape");
+        m_registry.write(body);
+        m_scrapes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::string content = body.str();
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\n"
+        << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        << "Content-Length: " << content.size() << "\r\n"
+        << "Connection: close\r\n\r\n"
+        << content;
+    sendAll(fd, response.str());
+#else
+    (void)fd;
+#endif
+}
@@ -0,0 +1,57 @@
+/*
+    metrics_server.hpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "metrics.hpp"
+#include "result.hpp"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Answers HTTP GET /metrics with the registry in Prometheus text format.
+// Scrapes are served one at a time from a thread of its own; it reads the
+// metrics' atomics and takes no lock the render thread holds.
+class MetricsServer {
+public:
+    // `endpoint` is "unix:<path>" for a Unix socket, or "[host:]port" for
+    // TCP, where host must be a loopback address.
+    static Result<std::unique_ptr<MetricsServer>, std::string> start(const metrics::Registry& registry,
+        std::string_view endpoint);
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+    // Stops accepting, waits for a scrape in flight and unlinks the socket.
+    ~MetricsServer();
+
+    inline uint64_t scrapes() const { return m_scrapes.load(std::memory_order_relaxed); }
+
+private:
+    MetricsServer(const metrics::Registry& registry, int listen_fd, std::string unix_path);
+
+    void serveLoop();
+    void serveClient(int fd);
+
+private:
+    const metrics::Registry& m_registry;
+    int m_listen_fd;
+    // removed on shutdown, empty for TCP
+    std::string m_unix_path;
+    std::atomic<bool> m_stopping { false };
+    std::atomic<uint64_t> m_scrapes { 0 };
+    std::thread m_thread {};
+};
@@ -1,19 +1,126 @@
 #pragma once
 
+#include "animation.hpp"
+#include "arena.hpp"
 #include "assimp/postprocess.h"
 #include "assimp/scene.h"
+#include "glb_reader.hpp"
+#include "mesh_codec.hpp"
+#include "obj_parser.hpp"
+#include "trace.hpp"
+#include "vertex.hpp"
 #include <assimp/Importer.hpp>
+#include <array>
+#include <cmath>
 #include <cstddef>
-#include <tuple>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 class Model {
 public:
-    void loadModelFromMemory(const void *p_buffer, size_t length) {
+    // `format_hint` is a file extension such as "obj"; OBJ, GLB and
+    // compressed meshes take the native readers, everything else goes
+    // through Assimp.
+    void loadModelFromMemory(const void *p_buffer, size_t length, std::string_view format_hint = "") {
+        TRACE_ZONE("Model::loadModelFromMemory");
+        m_arena.reset();
+        m_vertices = {};
+        m_indices = {};
+        m_skin_weights = {};
+        m_skeleton = {};
+        m_animations.clear();
+
+        const char *p_text = static_cast<const char*>(p_buffer);
+        if (format_hint == "obj" || (format_hint.empty() && looksLikeObj(p_text, length))) {
+            auto mesh = parseObj(p_text, length, m_arena);
+            if (mesh.is_ok()) {
+                ObjMesh obj = std::move(mesh).unwrap();
+                m_vertices = obj.vertices;
+                m_indices = obj.indices;
+                return;
+            }
+            fprintf(stderr, "Error parsing OBJ: %s, falling back to Assimp\n", std::move(mesh).unwrap_err().c_str());
+        }
+
+        if (format_hint == "glb" || (format_hint.empty() && looksLikeGlb(p_buffer, length))) {
+            auto mesh = readGlb({ static_cast<const std::byte*>(p_buffer), length });
+            if (mesh.is_ok()) {
+                copyGlb(std::move(mesh).unwrap());
+                return;
+            }
+            fprintf(stderr, "Error reading GLB: %s, falling back to Assimp\n", std::move(mesh).unwrap_err().c_str());
+        }
+
+        if (format_hint == "nmesh" || (format_hint.empty() && looksLikeEncodedMesh(p_buffer, length))) {
+            auto decoded = decodeEncodedMesh({ static_cast<const std::byte*>(p_buffer), length });
+            if (decoded.is_ok()) return;
+            fprintf(stderr, "Error decoding compressed mesh: %s\n", std::move(decoded).unwrap_err().c_str());
+            m_vertices = {};
+            m_indices = {};
+            return;
+        }
+
+        loadWithAssimp(p_buffer, length, format_hint);
+    }
+
+public:
+    std::span<Vertex> m_vertices {};
+    std::span<uint32_t> m_indices {};
+    // empty unless the mesh is skinned, then one entry per vertex
+    std::span<SkinWeights> m_skin_weights {};
+    Skeleton m_skeleton {};
+    std::vector<AnimationClip> m_animations {};
+
+    // joint indices are stored in a byte
+    inline static constexpr uint32_t MAX_JOINTS = 256;
+    inline static constexpr float ANIMATION_SAMPLE_RATE = 30.0f;
+
+private:
+    // Decodes straight into the arena, no copy of the streams is made.
+    Result<void, std::string> decodeEncodedMesh(std::span<const std::byte> file) {
+        auto read = readEncodedMesh(file);
+        if (read.is_err()) return Err { std::move(read).unwrap_err() };
+        EncodedMesh mesh = std::move(read).unwrap();
+        if (mesh.vertex_size != sizeof(Vertex)) return Err { std::string("vertex layout is not Vertex") };
+        m_vertices = m_arena.allocateArray<Vertex>(mesh.vertex_count);
+        m_indices = m_arena.allocateArray<uint32_t>(mesh.index_count);
+        auto vertices = decodeVertexBuffer(std::as_writable_bytes(m_vertices), mesh.vertex_count, mesh.vertex_size, mesh.vertices);
+        if (vertices.is_err()) return vertices;
+        return decodeIndexBuffer(std::as_writable_bytes(m_indices), mesh.index_count, sizeof(uint32_t), mesh.vertex_count,
+            mesh.indices);
+    }
+
+    // One copy out of the file into the arena, where Assimp makes two.
+    void copyGlb(const GlbMesh& mesh) {
+        m_vertices = m_arena.allocateArray<Vertex>(mesh.vertex_count);
+        if (!m_vertices.empty()) std::memcpy(m_vertices.data(), mesh.vertices.data(), m_vertices.size_bytes());
+        m_indices = m_arena.allocateArray<uint32_t>(mesh.index_count);
+        if (mesh.index_type == GlbIndexType::Uint32) {
+            if (!m_indices.empty()) std::memcpy(m_indices.data(), mesh.indices.data(), m_indices.size_bytes());
+            return;
+        }
+        for (uint32_t i = 0; i < mesh.index_count; i++) {
+            uint16_t index;
+            std::memcpy(&index, mesh.indices.data() + i * sizeof(uint16_t), sizeof(uint16_t));
+            m_indices[i] = index;
+        }
+    }
+
+    void loadWithAssimp(const void *p_buffer, size_t length, std::string_view format_hint) {
+        TRACE_ZONE("Assimp import");
         Assimp::Importer importer;
+        std::string hint(format_hint);
         const aiScene* scene = importer.ReadFileFromMemory(
-            p_buffer, length, 
-            aiProcess_Triangulate | aiProcess_FlipUVs
+            p_buffer, length,
+            aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_LimitBoneWeights,
+            hint.c_str()
         );
         if (!scene || !scene->mRootNode || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) {
             fprintf(stderr, "Error loading model: %s\n", importer.GetErrorString());
@@ -21,23 +128,232 @@ public:
         }
 
         const aiMesh* mesh = scene->mMeshes[0];
+        m_vertices = m_arena.allocateArray<Vertex>(mesh->mNumVertices);
         for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-            m_vertices.push_back({
-                mesh->mVertices[i].x,
-                mesh->mVertices[i].y,
-                mesh->mVertices[i].z
-            });
+            Vertex& vertex = m_vertices[i];
+            vertex.position[0] = mesh->mVertices[i].x;
+            vertex.position[1] = mesh->mVertices[i].y;
+            vertex.position[2] = mesh->mVertices[i].z;
+            if (mesh->HasNormals()) {
+                vertex.normal[0] = mesh->mNormals[i].x;
+                vertex.normal[1] = mesh->mNormals[i].y;
+                vertex.normal[2] = mesh->mNormals[i].z;
+            } else {
+                vertex.normal[0] = vertex.normal[1] = vertex.normal[2] = 0.0f;
+            }
+            if (mesh->HasTextureCoords(0)) {
+                vertex.uv[0] = mesh->mTextureCoords[0][i].x;
+                vertex.uv[1] = mesh->mTextureCoords[0][i].y;
+            } else {
+                vertex.uv[0] = vertex.uv[1] = 0.0f;
+            }
         }
 
+        size_t index_count = 0;
         for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+            index_count += mesh->mFaces[i].mNumIndices;
+        }
+        m_indices = m_arena.allocateArray<uint32_t>(index_count);
+        for (unsigned int i = 0, k = 0; i < mesh->mNumFaces; i++) {
             const aiFace& face = mesh->mFaces[i];
             for (unsigned int j = 0; j < face.mNumIndices; j++) {
-                m_indices.push_back(face.mIndices[j]);
+                m_indices[k++] = face.mIndices[j];
             }
         }
+
+        if (mesh->HasBones()) importSkin(scene, mesh);
     }
-    
-public:
-    std::vector<std::tuple<float, float, float>> m_vertices {};
-    std::vector<unsigned int> m_indices;
+
+    void importSkin(const aiScene *scene, const aiMesh *mesh) {
+        TRACE_ZONE("Import skin");
+        // the bones plus all their ancestors, so every joint's parent is a joint
+        std::unordered_set<const aiNode*> used;
+        for (unsigned int b = 0; b < mesh->mNumBones; b++) {
+            const aiNode *node = scene->mRootNode->FindNode(mesh->mBones[b]->mName.C_Str());
+            while (node && used.insert(node).second) node = node->mParent;
+        }
+
+        Skeleton skeleton;
+        std::vector<aiMatrix4x4> locals;
+        std::unordered_map<std::string, uint32_t> joint_of;
+        auto visit = [&](auto& self, const aiNode *node, int32_t parent) -> void {
+            if (!used.count(node)) return;
+            uint32_t joint = skeleton.jointCount();
+            skeleton.parents.push_back(parent);
+            skeleton.names.emplace_back(node->mName.C_Str());
+            skeleton.inverse_bind.push_back(JOINT_MATRIX_IDENTITY);
+            locals.push_back(node->mTransformation);
+            joint_of.emplace(skeleton.names.back(), joint);
+            for (unsigned int i = 0; i < node->mNumChildren; i++) {
+                self(self, node->mChildren[i], static_cast<int32_t>(joint));
+            }
+        };
+        visit(visit, scene->mRootNode, -1);
+        if (skeleton.jointCount() == 0 || skeleton.jointCount() > MAX_JOINTS) {
+            fprintf(stderr, "Skipping skin: %u joints, at most %u are supported\n", skeleton.jointCount(), MAX_JOINTS);
+            return;
+        }
+
+        skeleton.rest.resize(skeleton.jointCount());
+        for (uint32_t j = 0; j < skeleton.jointCount(); j++) {
+            aiVector3D scaling, position;
+            aiQuaternion rotation;
+            locals[j].Decompose(scaling, rotation, position);
+            writeTransform(skeleton.rest, j, position, rotation, scaling);
+        }
+
+        // keep the four strongest influences of each vertex
+        std::vector<std::array<uint8_t, 4>> joints(mesh->mNumVertices, std::array<uint8_t, 4> {});
+        std::vector<std::array<float, 4>> weights(mesh->mNumVertices, std::array<float, 4> {});
+        for (unsigned int b = 0; b < mesh->mNumBones; b++) {
+            const aiBone *bone = mesh->mBones[b];
+            auto it = joint_of.find(bone->mName.C_Str());
+            if (it == joint_of.end()) continue;
+            const aiMatrix4x4& offset = bone->mOffsetMatrix;
+            skeleton.inverse_bind[it->second] = JointMatrix {{
+                offset.a1, offset.a2, offset.a3, offset.a4,
+                offset.b1, offset.b2, offset.b3, offset.b4,
+                offset.c1, offset.c2, offset.c3, offset.c4,
+            }};
+            for (unsigned int i = 0; i < bone->mNumWeights; i++) {
+                const aiVertexWeight& influence = bone->mWeights[i];
+                if (influence.mVertexId >= mesh->mNumVertices) continue;
+                auto& vertex_weights = weights[influence.mVertexId];
+                size_t weakest = 0;
+                for (size_t k = 1; k < 4; k++) {
+                    if (vertex_weights[k] < vertex_weights[weakest]) weakest = k;
+                }
+                if (influence.mWeight <= vertex_weights[weakest]) continue;
+                vertex_weights[weakest] = influence.mWeight;
+                joints[influence.mVertexId][weakest] = static_cast<uint8_t>(it->second);
+            }
+        }
+
+        m_skin_weights = m_arena.allocateArray<SkinWeights>(mesh->mNumVertices);
+        for (unsigned int v = 0; v < mesh->mNumVertices; v++) {
+            m_skin_weights[v] = quantizeWeights(joints[v], weights[v]);
+        }
+
+        for (unsigned int a = 0; a < scene->mNumAnimations; a++) {
+            m_animations.push_back(resampleAnimation(*scene->mAnimations[a], skeleton, joint_of));
+        }
+        m_skeleton = std::move(skeleton);
+    }
+
+    // Normalizes to unorm8 summing to exactly 255, the rounding error goes
+    // to the strongest influence. A vertex without any follows joint 0.
+    static SkinWeights quantizeWeights(const std::array<uint8_t, 4>& joints, const std::array<float, 4>& weights) {
+        SkinWeights out {};
+        float sum = weights[0] + weights[1] + weights[2] + weights[3];
+        if (sum <= 0.0f) {
+            out.weights[0] = 255;
+            return out;
+        }
+        int total = 0;
+        size_t strongest = 0;
+        for (size_t k = 0; k < 4; k++) {
+            out.joints[k] = joints[k];
+            out.weights[k] = static_cast<uint8_t>(std::lround(weights[k] / sum * 255.0f));
+            total += out.weights[k];
+            if (weights[k] > weights[strongest]) strongest = k;
+        }
+        out.weights[strongest] = static_cast<uint8_t>(out.weights[strongest] + 255 - total);
+        return out;
+    }
+
+    static void writeTransform(Pose& pose, uint32_t joint,
+        const aiVector3D& position, const aiQuaternion& rotation, const aiVector3D& scaling) {
+        const float values[POSE_CHANNEL_COUNT] = {
+            position.x, position.y, position.z,
+            rotation.x, rotation.y, rotation.z, rotation.w,
+            scaling.x, scaling.y, scaling.z,
+        };
+        for (uint32_t c = 0; c < POSE_CHANNEL_COUNT; c++) pose.channels[c][joint] = values[c];
+    }
+
+    template<typename Key>
+    static size_t advanceKey(const Key *p_keys, unsigned int count, double tick, size_t cursor) {
+        while (cursor + 1 < count && p_keys[cursor + 1].mTime <= tick) cursor++;
+        return cursor;
+    }
+
+    static aiVector3D sampleKeys(const aiVectorKey *p_keys, unsigned int count, double tick, size_t& cursor) {
+        cursor = advanceKey(p_keys, count, tick, cursor);
+        const aiVectorKey& a = p_keys[cursor];
+        if (cursor + 1 >= count || tick <= a.mTime) return a.mValue;
+        const aiVectorKey& b = p_keys[cursor + 1];
+        float t = static_cast<float>((tick - a.mTime) / (b.mTime - a.mTime));
+        return aiVector3D {
+            a.mValue.x + (b.mValue.x - a.mValue.x) * t,
+            a.mValue.y + (b.mValue.y - a.mValue.y) * t,
+            a.mValue.z + (b.mValue.z - a.mValue.z) * t,
+        };
+    }
+
+    static aiQuaternion sampleKeys(const aiQuatKey *p_keys, unsigned int count, double tick, size_t& cursor) {
+        cursor = advanceKey(p_keys, count, tick, cursor);
+        const aiQuatKey& a = p_keys[cursor];
+        if (cursor + 1 >= count || tick <= a.mTime) return a.mValue;
+        const aiQuatKey& b = p_keys[cursor + 1];
+        aiQuaternion out;
+        aiQuaternion::Interpolate(out, a.mValue, b.mValue, static_cast<float>((tick - a.mTime) / (b.mTime - a.mTime)));
+        return out;
+    }
+
+    // Bakes the keys onto a fixed frame grid, with the final frame at the
+    // clip's end. Joints without a channel hold their rest transform.
+    static AnimationClip resampleAnimation(const aiAnimation& animation, const Skeleton& skeleton,
+        const std::unordered_map<std::string, uint32_t>& joint_of) {
+        AnimationClip clip;
+        clip.name = animation.mName.C_Str();
+        double ticks_per_second = animation.mTicksPerSecond > 0.0 ? animation.mTicksPerSecond : 25.0;
+        clip.duration = static_cast<float>(animation.mDuration / ticks_per_second);
+        clip.sample_rate = ANIMATION_SAMPLE_RATE;
+        clip.frame_count = static_cast<uint32_t>(std::ceil(clip.duration * clip.sample_rate)) + 1;
+        clip.joint_count = skeleton.jointCount();
+        clip.samples.resize(static_cast<size_t>(clip.frame_count) * POSE_CHANNEL_COUNT * clip.joint_count);
+
+        const size_t frame_stride = static_cast<size_t>(POSE_CHANNEL_COUNT) * clip.joint_count;
+        for (uint32_t f = 0; f < clip.frame_count; f++) {
+            for (uint32_t c = 0; c < POSE_CHANNEL_COUNT; c++) {
+                std::copy(skeleton.rest.channels[c].begin(), skeleton.rest.channels[c].end(),
+                    clip.samples.begin() + f * frame_stride + c * clip.joint_count);
+            }
+        }
+
+        for (unsigned int i = 0; i < animation.mNumChannels; i++) {
+            const aiNodeAnim& channel = *animation.mChannels[i];
+            auto it = joint_of.find(channel.mNodeName.C_Str());
+            if (it == joint_of.end()) continue;
+            uint32_t joint = it->second;
+            size_t position_cursor = 0, rotation_cursor = 0, scaling_cursor = 0;
+            for (uint32_t f = 0; f < clip.frame_count; f++) {
+                double tick = std::min(static_cast<double>(f) / clip.sample_rate * ticks_per_second, animation.mDuration);
+                float *p_frame = clip.samples.data() + f * frame_stride + joint;
+                if (channel.mNumPositionKeys > 0) {
+                    aiVector3D position = sampleKeys(channel.mPositionKeys, channel.mNumPositionKeys, tick, position_cursor);
+                    p_frame[POSE_TX * clip.joint_count] = position.x;
+                    p_frame[POSE_TY * clip.joint_count] = position.y;
+                    p_frame[POSE_TZ * clip.joint_count] = position.z;
+                }
+                if (channel.mNumRotationKeys > 0) {
+                    aiQuaternion rotation = sampleKeys(channel.mRotationKeys, channel.mNumRotationKeys, tick, rotation_cursor);
+                    p_frame[POSE_QX * clip.joint_count] = rotation.x;
+                    p_frame[POSE_QY * clip.joint_count] = rotation.y;
+                    p_frame[POSE_QZ * clip.joint_count] = rotation.z;
+                    p_frame[POSE_QW * clip.joint_count] = rotation.w;
+                }
+                if (channel.mNumScalingKeys > 0) {
+                    aiVector3D scaling = sampleKeys(channel.mScalingKeys, channel.mNumScalingKeys, tick, scaling_cursor);
+                    p_frame[POSE_SX * clip.joint_count] = scaling.x;
+                    p_frame[POSE_SY * clip.joint_count] = scaling.y;
+                    p_frame[POSE_SZ * clip.joint_count] = scaling.z;
+                }
+            }
+        }
+        return clip;
+    }
+
+private:
+    Arena m_arena {};
 };
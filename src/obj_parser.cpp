@@ -0,0 +1,469 @@
+/*
+    obj_parser.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "obj_parser.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OBJ_PARSER_SSE2 1
+#endif
+
+namespace {
+
+constexpr size_t MIN_CHUNK_SIZE = 256 << 10;
+constexpr uint32_t NO_INDEX = 0xffffffff;
+// marks an index that came from a negative (relative) reference: the low 31
+// bits are its offset from the chunk's first element plus LOCAL_BIAS, so
+// offsets back into earlier chunks stay positive
+constexpr uint32_t LOCAL_INDEX = 0x80000000;
+constexpr int64_t LOCAL_BIAS = 0x40000000;
+// a relative reference that reached before the first element
+constexpr uint32_t BAD_INDEX = 0xfffffffe;
+// largest biased offset, keeps flagged indices clear of BAD_INDEX and NO_INDEX
+constexpr int64_t LOCAL_MAX = (BAD_INDEX - 1) & ~LOCAL_INDEX;
+
+const char *find_newline(const char *p, const char *end) {
+#ifdef OBJ_PARSER_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline));
+        if (mask) {
+            return p + std::countr_zero(static_cast<unsigned>(mask));
+        }
+        p += 16;
+    }
+#endif
+    const void *found = std::memchr(p, '\n', end - p);
+    return found ? static_cast<const char*>(found) : end;
+}
+
+inline bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char *skip_blanks(const char *p, const char *end) {
+    while (p < end && is_blank(*p)) p++;
+    return p;
+}
+
+inline bool is_digit(char c) {
+    return static_cast<unsigned>(c - '0') < 10;
+}
+
+constexpr double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Decimal mantissa in an integer, one multiply or divide by an exact power of
+// ten. Exponents are handled here and digits past the 19th are dropped;
+// strtof only sees tokens without digits, such as inf and nan.
+const char *parse_float(const char *p, const char *end, float& out) {
+    const char *begin = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    const char *digits_begin = p;
+    for (; p < end && is_digit(*p); p++) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa) digits++;
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && is_digit(*p); p++) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) digits++;
+                exponent--;
+            }
+        }
+    }
+    if (p == digits_begin || (p == digits_begin + 1 && *digits_begin == '.')) {
+        char buffer[64];
+        size_t length = std::min<size_t>(end - begin, sizeof(buffer) - 1);
+        std::memcpy(buffer, begin, length);
+        buffer[length] = '\0';
+        char *parsed_end;
+        out = std::strtof(buffer, &parsed_end);
+        return begin + (parsed_end - buffer);
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *exp_begin = p++;
+        bool exp_negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exp_negative = *p == '-';
+            p++;
+        }
+        if (p < end && is_digit(*p)) {
+            int exp = 0;
+            for (; p < end && is_digit(*p); p++) {
+                if (exp < 10000) exp = exp * 10 + (*p - '0');
+            }
+            exponent += exp_negative ? -exp : exp;
+        } else {
+            p = exp_begin;
+        }
+    }
+
+    double value = static_cast<double>(mantissa);
+    if (exponent < 0) {
+        value = exponent >= -22 ? value / POW10[-exponent] : value * std::pow(10.0, exponent);
+    } else if (exponent > 0) {
+        value = exponent <= 22 ? value * POW10[exponent] : value * std::pow(10.0, exponent);
+    }
+    out = static_cast<float>(negative ? -value : value);
+    return p;
+}
+
+const char *parse_int(const char *p, const char *end, int64_t& out, bool& ok) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    ok = p < end && is_digit(*p);
+    int64_t value = 0;
+    for (; p < end && is_digit(*p); p++) {
+        value = value * 10 + (*p - '0');
+    }
+    out = negative ? -value : value;
+    return p;
+}
+
+struct Chunk {
+    const char *begin;
+    const char *end;
+    std::vector<float> positions {};
+    std::vector<float> normals {};
+    std::vector<float> uvs {};
+    // (position, uv, normal) triples, already fan-triangulated
+    std::vector<uint32_t> corners {};
+    std::string error {};
+    size_t position_base { 0 };
+    size_t uv_base { 0 };
+    size_t normal_base { 0 };
+};
+
+// Turns a 1-based or negative OBJ reference into a 0-based index, global for
+// positive references and relative to the chunk's first element (flagged)
+// for negative ones; globalize() rebases those once the chunk's base is known.
+bool resolve_reference(int64_t value, size_t local_count, uint32_t& out) {
+    if (value > 0) {
+        if (value - 1 >= int64_t(LOCAL_INDEX)) return false;
+        out = static_cast<uint32_t>(value - 1);
+        return true;
+    }
+    int64_t biased = int64_t(local_count) + value + LOCAL_BIAS;
+    if (value < 0 && biased >= 0 && biased <= LOCAL_MAX) {
+        out = static_cast<uint32_t>(biased) | LOCAL_INDEX;
+        return true;
+    }
+    return false;
+}
+
+void parse_chunk(Chunk& chunk) {
+    TRACE_ZONE("parse_obj_chunk");
+    // rough guesses so the hot loop rarely reallocates
+    size_t estimated_lines = (chunk.end - chunk.begin) / 32;
+    chunk.positions.reserve(estimated_lines * 3 / 2);
+    chunk.corners.reserve(estimated_lines * 9 / 2);
+
+    std::vector<uint32_t> face;
+    const char *p = chunk.begin;
+    while (p < chunk.end) {
+        const char *line_end = find_newline(p, chunk.end);
+        const char *q = skip_blanks(p, line_end);
+        p = line_end < chunk.end ? line_end + 1 : chunk.end;
+        if (q + 1 >= line_end) continue;
+
+        if (q[0] == 'v' && is_blank(q[1])) {
+            float xyz[3] = { 0.0f, 0.0f, 0.0f };
+            q += 2;
+            for (float& v : xyz) {
+                q = skip_blanks(q, line_end);
+                if (q >= line_end) break;
+                q = parse_float(q, line_end, v);
+            }
+            chunk.positions.insert(chunk.positions.end(), xyz, xyz + 3);
+        } else if (q[0] == 'v' && q[1] == 't') {
+            float uv[2] = { 0.0f, 0.0f };
+            q += 2;
+            for (float& v : uv) {
+                q = skip_blanks(q, line_end);
+                if (q >= line_end) break;
+                q = parse_float(q, line_end, v);
+            }
+            chunk.uvs.insert(chunk.uvs.end(), uv, uv + 2);
+        } else if (q[0] == 'v' && q[1] == 'n') {
+            float xyz[3] = { 0.0f, 0.0f, 0.0f };
+            q += 2;
+            for (float& v : xyz) {
+                q = skip_blanks(q, line_end);
+                if (q >= line_end) break;
+                q = parse_float(q, line_end, v);
+            }
+            chunk.normals.insert(chunk.normals.end(), xyz, xyz + 3);
+        } else if (q[0] == 'f' && is_blank(q[1])) {
+            face.clear();
+            q += 2;
+            for (;;) {
+                q = skip_blanks(q, line_end);
+                if (q >= line_end) break;
+                uint32_t corner[3] = { NO_INDEX, NO_INDEX, NO_INDEX };
+                int64_t value;
+                bool ok;
+                q = parse_int(q, line_end, value, ok);
+                if (!ok || !resolve_reference(value, chunk.positions.size() / 3, corner[0])) {
+                    chunk.error = "invalid face position reference";
+                    return;
+                }
+                if (q < line_end && *q == '/') {
+                    q++;
+                    if (q < line_end && *q != '/') {
+                        q = parse_int(q, line_end, value, ok);
+                        if (!ok || !resolve_reference(value, chunk.uvs.size() / 2, corner[1])) {
+                            chunk.error = "invalid face uv reference";
+                            return;
+                        }
+                    }
+                    if (q < line_end && *q == '/') {
+                        q++;
+                        q = parse_int(q, line_end, value, ok);
+                        if (!ok || !resolve_reference(value, chunk.normals.size() / 3, corner[2])) {
+                            chunk.error = "invalid face normal reference";
+                            return;
+                        }
+                    }
+                }
+                face.insert(face.end(), corner, corner + 3);
+                // skip whatever trails the reference
+                while (q < line_end && !is_blank(*q)) q++;
+            }
+            size_t corner_count = face.size() / 3;
+            for (size_t i = 2; i < corner_count; i++) {
+                chunk.corners.insert(chunk.corners.end(), &face[0], &face[3]);
+                chunk.corners.insert(chunk.corners.end(), &face[(i - 1) * 3], &face[i * 3]);
+                chunk.corners.insert(chunk.corners.end(), &face[i * 3], &face[(i + 1) * 3]);
+            }
+        }
+    }
+}
+
+// BAD_INDEX when a relative reference reaches before the file's first
+// element, which the range check after the merge rejects.
+inline uint32_t globalize(uint32_t index, size_t base) {
+    if (index == NO_INDEX || !(index & LOCAL_INDEX)) return index;
+    int64_t global = int64_t(base) + int64_t(index & ~LOCAL_INDEX) - LOCAL_BIAS;
+    return global >= 0 ? static_cast<uint32_t>(global) : BAD_INDEX;
+}
+
+inline uint64_t hash_corner(const uint32_t *corner) {
+    uint64_t h = (uint64_t(corner[0]) * 0x9E3779B97F4A7C15ull) ^ (uint64_t(corner[1]) * 0xC2B2AE3D27D4EB4Full);
+    h ^= uint64_t(corner[2]) * 0x165667B19E3779F9ull;
+    return h ^ (h >> 29);
+}
+
+} // namespace
+
+bool looksLikeObj(const char *p_data, size_t length) {
+    const char *p = p_data;
+    const char *end = p_data + length;
+    while (p < end) {
+        const char *line_end = find_newline(p, end);
+        const char *q = skip_blanks(p, line_end);
+        p = line_end < end ? line_end + 1 : end;
+        if (q == line_end || *q == '#') continue;
+        std::string_view line(q, line_end - q);
+        for (std::string_view keyword : { "v ", "vt ", "vn ", "f ", "o ", "g ", "s ", "mtllib ", "usemtl " }) {
+            if (line.starts_with(keyword)) return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+Result<ObjMesh, std::string> parseObj(const char *p_data, size_t length, Arena& arena) {
+    TRACE_ZONE("parseObj");
+    const char *end = p_data + length;
+    // embedded assets carry a trailing NUL
+    while (end > p_data && end[-1] == '\0') end--;
+    length = end - p_data;
+
+    ThreadPool& pool = ThreadPool::global();
+    size_t chunk_count = std::clamp<size_t>(length / MIN_CHUNK_SIZE, 1, pool.size() + 1);
+    std::vector<Chunk> chunks;
+    chunks.reserve(chunk_count);
+    const char *chunk_begin = p_data;
+    for (size_t i = 0; i < chunk_count && chunk_begin < end; i++) {
+        const char *chunk_end = i + 1 == chunk_count ? end : p_data + length * (i + 1) / chunk_count;
+        if (chunk_end < chunk_begin) chunk_end = chunk_begin;
+        const char *newline = find_newline(chunk_end, end);
+        chunk_end = newline < end ? newline + 1 : end;
+        chunks.push_back(Chunk { chunk_begin, chunk_end });
+        chunk_begin = chunk_end;
+    }
+
+    pool.parallelFor(chunks.size(), [&](size_t i) {
+        parse_chunk(chunks[i]);
+    });
+
+    size_t position_count = 0, uv_count = 0, normal_count = 0, corner_count = 0;
+    for (auto& chunk : chunks) {
+        if (!chunk.error.empty()) return Err { chunk.error };
+        chunk.position_base = position_count;
+        chunk.uv_base = uv_count;
+        chunk.normal_base = normal_count;
+        position_count += chunk.positions.size() / 3;
+        uv_count += chunk.uvs.size() / 2;
+        normal_count += chunk.normals.size() / 3;
+        corner_count += chunk.corners.size() / 3;
+    }
+    if (corner_count == 0) return Err { std::string("no faces") };
+
+    Arena scratch;
+    auto positions = scratch.allocateArray<float>(position_count * 3);
+    auto uvs = scratch.allocateArray<float>(uv_count * 2);
+    auto normals = scratch.allocateArray<float>(normal_count * 3);
+    auto corners = scratch.allocateArray<uint32_t>(corner_count * 3);
+    std::vector<size_t> corner_bases(chunks.size());
+    for (size_t i = 0, base = 0; i < chunks.size(); i++) {
+        corner_bases[i] = base;
+        base += chunks[i].corners.size();
+    }
+
+    std::atomic<bool> out_of_range { false };
+    bool has_attributes = false;
+    pool.parallelFor(chunks.size(), [&](size_t i) {
+        Chunk& chunk = chunks[i];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.position_base * 3);
+        std::copy(chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + chunk.uv_base * 2);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.normal_base * 3);
+        uint32_t *out = corners.data() + corner_bases[i];
+        for (size_t c = 0; c < chunk.corners.size(); c += 3) {
+            uint32_t v = globalize(chunk.corners[c], chunk.position_base);
+            uint32_t vt = globalize(chunk.corners[c + 1], chunk.uv_base);
+            uint32_t vn = globalize(chunk.corners[c + 2], chunk.normal_base);
+            if (v >= position_count || (vt != NO_INDEX && vt >= uv_count) || (vn != NO_INDEX && vn >= normal_count)) {
+                out_of_range.store(true, std::memory_order_relaxed);
+            }
+            out[c] = v;
+            out[c + 1] = vt;
+            out[c + 2] = vn;
+        }
+        chunk = Chunk { nullptr, nullptr };
+    });
+    if (out_of_range.load()) return Err { std::string("face reference out of range") };
+    for (size_t c = 0; c < corner_count && !has_attributes; c++) {
+        has_attributes = corners[c * 3 + 1] != NO_INDEX || corners[c * 3 + 2] != NO_INDEX;
+    }
+
+    ObjMesh mesh {};
+    mesh.indices = arena.allocateArray<uint32_t>(corner_count);
+
+    // corners that reference the same (position, uv, normal) share a vertex;
+    // with positions only that mapping is the identity
+    std::span<const uint32_t> unique_corners;
+    std::vector<uint32_t> unique;
+    if (!has_attributes) {
+        for (size_t c = 0; c < corner_count; c++) {
+            mesh.indices[c] = corners[c * 3];
+        }
+        unique.resize(position_count * 3, NO_INDEX);
+        for (size_t v = 0; v < position_count; v++) {
+            unique[v * 3] = static_cast<uint32_t>(v);
+        }
+    } else {
+        TRACE_ZONE("dedup vertices");
+        size_t capacity = std::bit_ceil(std::max<size_t>(position_count * 2, 64));
+        std::vector<uint32_t> table(capacity, NO_INDEX);
+        unique.reserve(position_count * 3);
+        for (size_t c = 0; c < corner_count; c++) {
+            const uint32_t *corner = &corners[c * 3];
+            size_t mask = table.size() - 1;
+            size_t slot = hash_corner(corner) & mask;
+            for (;; slot = (slot + 1) & mask) {
+                uint32_t id = table[slot];
+                if (id == NO_INDEX) {
+                    id = static_cast<uint32_t>(unique.size() / 3);
+                    unique.insert(unique.end(), corner, corner + 3);
+                    table[slot] = id;
+                    mesh.indices[c] = id;
+                    break;
+                }
+                if (std::memcmp(&unique[id * 3], corner, 3 * sizeof(uint32_t)) == 0) {
+                    mesh.indices[c] = id;
+                    break;
+                }
+            }
+            // keep the load factor under 1/2
+            if (unique.size() / 3 * 2 > table.size()) {
+                std::vector<uint32_t> grown(table.size() * 2, NO_INDEX);
+                size_t grown_mask = grown.size() - 1;
+                for (uint32_t id = 0; id < unique.size() / 3; id++) {
+                    size_t s = hash_corner(&unique[id * 3]) & grown_mask;
+                    while (grown[s] != NO_INDEX) s = (s + 1) & grown_mask;
+                    grown[s] = id;
+                }
+                table = std::move(grown);
+            }
+        }
+    }
+    unique_corners = unique;
+
+    size_t vertex_count = unique_corners.size() / 3;
+    mesh.vertices = arena.allocateArray<Vertex>(vertex_count);
+    constexpr size_t FILL_GRAIN = 1 << 16;
+    pool.parallelFor((vertex_count + FILL_GRAIN - 1) / FILL_GRAIN, [&](size_t block) {
+        size_t first = block * FILL_GRAIN;
+        size_t last = std::min(first + FILL_GRAIN, vertex_count);
+        for (size_t i = first; i < last; i++) {
+            const uint32_t *corner = &unique_corners[i * 3];
+            Vertex& vertex = mesh.vertices[i];
+            std::memcpy(vertex.position, &positions[size_t(corner[0]) * 3], sizeof(vertex.position));
+            if (corner[1] != NO_INDEX) {
+                // flipped like aiProcess_FlipUVs so both import paths agree
+                vertex.uv[0] = uvs[size_t(corner[1]) * 2];
+                vertex.uv[1] = 1.0f - uvs[size_t(corner[1]) * 2 + 1];
+            } else {
+                vertex.uv[0] = vertex.uv[1] = 0.0f;
+            }
+            if (corner[2] != NO_INDEX) {
+                std::memcpy(vertex.normal, &normals[size_t(corner[2]) * 3], sizeof(vertex.normal));
+            } else {
+                vertex.normal[0] = vertex.normal[1] = vertex.normal[2] = 0.0f;
+            }
+        }
+    });
+
+    return Ok { mesh };
+}
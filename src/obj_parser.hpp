@@ -0,0 +1,39 @@
+/*
+    obj_parser.hpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "arena.hpp"
+#include "result.hpp"
+#include "vertex.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+struct ObjMesh {
+    std::span<Vertex> vertices;
+    std::span<uint32_t> indices;
+};
+
+// Cheap sniff for OBJ text: the first meaningful line is a known keyword.
+bool looksLikeObj(const char *p_data, size_t length);
+
+// Parses all geometry of an OBJ file into one triangulated, indexed mesh.
+// Line-aligned chunks are parsed in parallel on the global thread pool and
+// identical (position, uv, normal) corners are merged. The vertex and index
+// arrays are allocated from `arena`.
+Result<ObjMesh, std::string> parseObj(const char *p_data, size_t length, Arena& arena);
@@ -0,0 +1,241 @@
+/*
+    scene_graph.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "scene_graph.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+// nodes per pool task within a level
+constexpr uint32_t UPDATE_CHUNK = 2048;
+
+// a * b for affine column-major matrices
+WorldMatrix multiply(const WorldMatrix& a, const WorldMatrix& b) {
+    WorldMatrix out;
+    for (int c = 0; c < 4; c++) {
+        const float *column = &b.m[c * 4];
+        for (int r = 0; r < 3; r++) {
+            out.m[c * 4 + r] = a.m[r] * column[0] + a.m[4 + r] * column[1] + a.m[8 + r] * column[2] + a.m[12 + r] * column[3];
+        }
+        out.m[c * 4 + 3] = column[3];
+    }
+    return out;
+}
+
+} // namespace
+
+SceneGraph::NodeId SceneGraph::createNode(NodeId parent, const NodeTransform& local) {
+    Slot parent_slot = NO_SLOT;
+    uint32_t depth = 0;
+    if (parent != NO_NODE) {
+        if (!alive(parent)) return NO_NODE;
+        parent_slot = m_slot_of[parent];
+        depth = m_depths[parent_slot] + 1;
+    }
+
+    NodeId id;
+    if (!m_free_ids.empty()) {
+        id = m_free_ids.back();
+        m_free_ids.pop_back();
+    } else {
+        id = static_cast<NodeId>(m_worlds.size());
+        m_worlds.push_back(WORLD_MATRIX_IDENTITY);
+        m_changed.push_back(0);
+        m_slot_of.push_back(NO_SLOT);
+    }
+
+    // appended for now, parents still come first; update() restores depth order
+    Slot slot = static_cast<Slot>(m_ids.size());
+    m_ids.push_back(id);
+    m_parents.push_back(parent_slot);
+    m_depths.push_back(depth);
+    for (auto& channel : m_locals) channel.push_back(0.0f);
+    m_dirty.push_back(0);
+    m_slot_of[id] = slot;
+    m_structure_dirty = true;
+
+    setLocal(id, local);
+    return id;
+}
+
+void SceneGraph::destroyNode(NodeId node) {
+    if (!alive(node)) return;
+    const Slot root = m_slot_of[node];
+    const Slot count = static_cast<Slot>(m_ids.size());
+
+    // descendants follow their ancestors, one pass finds the subtree
+    std::vector<Slot> remap(count);
+    std::vector<uint8_t> removed(count, 0);
+    removed[root] = 1;
+    Slot out = root;
+    for (Slot s = 0; s < count; s++) {
+        if (s > root && m_parents[s] != NO_SLOT && removed[m_parents[s]]) removed[s] = 1;
+        if (removed[s]) {
+            m_slot_of[m_ids[s]] = NO_SLOT;
+            m_free_ids.push_back(m_ids[s]);
+            remap[s] = NO_SLOT;
+            continue;
+        }
+        if (s < root) {
+            remap[s] = s;
+            continue;
+        }
+        remap[s] = out;
+        m_ids[out] = m_ids[s];
+        m_parents[out] = m_parents[s];
+        m_depths[out] = m_depths[s];
+        for (auto& channel : m_locals) channel[out] = channel[s];
+        m_dirty[out] = m_dirty[s];
+        out++;
+    }
+
+    m_ids.resize(out);
+    m_parents.resize(out);
+    m_depths.resize(out);
+    for (auto& channel : m_locals) channel.resize(out);
+    m_dirty.resize(out);
+    for (Slot s = root; s < out; s++) {
+        if (m_parents[s] != NO_SLOT) m_parents[s] = remap[m_parents[s]];
+        m_slot_of[m_ids[s]] = s;
+    }
+    m_structure_dirty = true;
+}
+
+void SceneGraph::setLocal(NodeId node, const NodeTransform& local) {
+    if (!alive(node)) return;
+    Slot slot = m_slot_of[node];
+    const float values[CHANNEL_COUNT] = {
+        local.translation[0], local.translation[1], local.translation[2],
+        local.rotation[0], local.rotation[1], local.rotation[2], local.rotation[3],
+        local.scale[0], local.scale[1], local.scale[2],
+    };
+    for (uint32_t c = 0; c < CHANNEL_COUNT; c++) m_locals[c][slot] = values[c];
+    markDirty(slot);
+}
+
+NodeTransform SceneGraph::local(NodeId node) const {
+    NodeTransform out;
+    if (!alive(node)) return out;
+    Slot slot = m_slot_of[node];
+    out.translation[0] = m_locals[TX][slot];
+    out.translation[1] = m_locals[TY][slot];
+    out.translation[2] = m_locals[TZ][slot];
+    out.rotation[0] = m_locals[QX][slot];
+    out.rotation[1] = m_locals[QY][slot];
+    out.rotation[2] = m_locals[QZ][slot];
+    out.rotation[3] = m_locals[QW][slot];
+    out.scale[0] = m_locals[SX][slot];
+    out.scale[1] = m_locals[SY][slot];
+    out.scale[2] = m_locals[SZ][slot];
+    return out;
+}
+
+void SceneGraph::markDirty(Slot slot) {
+    m_dirty[slot] = 1;
+    m_min_dirty_depth = std::min(m_min_dirty_depth, m_depths[slot]);
+}
+
+void SceneGraph::sortByDepth() {
+    TRACE_ZONE("SceneGraph::sortByDepth");
+    const Slot count = static_cast<Slot>(m_ids.size());
+    uint32_t level_count = 0;
+    for (uint32_t depth : m_depths) level_count = std::max(level_count, depth + 1);
+
+    m_level_begin.assign(level_count + 1, 0);
+    for (uint32_t depth : m_depths) m_level_begin[depth + 1]++;
+    for (uint32_t d = 0; d < level_count; d++) m_level_begin[d + 1] += m_level_begin[d];
+    m_structure_dirty = false;
+    if (std::is_sorted(m_depths.begin(), m_depths.end())) return;
+
+    // stable counting sort, relative order within a level is kept
+    std::vector<Slot> next(m_level_begin.begin(), m_level_begin.end() - 1);
+    std::vector<Slot> remap(count);
+    for (Slot s = 0; s < count; s++) remap[s] = next[m_depths[s]]++;
+
+    auto permute = [&](auto& array) {
+        std::remove_reference_t<decltype(array)> sorted(array.size());
+        for (Slot s = 0; s < count; s++) sorted[remap[s]] = array[s];
+        array.swap(sorted);
+    };
+    permute(m_ids);
+    permute(m_parents);
+    permute(m_depths);
+    for (auto& channel : m_locals) permute(channel);
+    permute(m_dirty);
+    for (Slot s = 0; s < count; s++) {
+        if (m_parents[s] != NO_SLOT) m_parents[s] = remap[m_parents[s]];
+        m_slot_of[m_ids[s]] = s;
+    }
+}
+
+void SceneGraph::update(ThreadPool& pool) {
+    TRACE_ZONE("SceneGraph::update");
+    std::fill(m_changed.begin(), m_changed.end(), 0);
+    m_last_update_count = 0;
+    if (m_structure_dirty) sortByDepth();
+    if (m_min_dirty_depth == NO_SLOT || m_ids.empty()) {
+        m_min_dirty_depth = NO_SLOT;
+        return;
+    }
+
+    const float *tx = m_locals[TX].data(), *ty = m_locals[TY].data(), *tz = m_locals[TZ].data();
+    const float *qx = m_locals[QX].data(), *qy = m_locals[QY].data();
+    const float *qz = m_locals[QZ].data(), *qw = m_locals[QW].data();
+    const float *sx = m_locals[SX].data(), *sy = m_locals[SY].data(), *sz = m_locals[SZ].data();
+
+    // levels above the shallowest edit cannot have changed; within a level
+    // nodes only read their parent's finished level, so chunks are independent
+    std::atomic<uint32_t> updated { 0 };
+    const uint32_t level_count = static_cast<uint32_t>(m_level_begin.size() - 1);
+    for (uint32_t depth = m_min_dirty_depth; depth < level_count; depth++) {
+        const Slot begin = m_level_begin[depth];
+        const Slot end = m_level_begin[depth + 1];
+        const uint32_t chunk_count = (end - begin + UPDATE_CHUNK - 1) / UPDATE_CHUNK;
+        pool.parallelFor(chunk_count, [&, begin, end](size_t chunk) {
+            const Slot first = begin + static_cast<Slot>(chunk) * UPDATE_CHUNK;
+            const Slot last = std::min(end, first + UPDATE_CHUNK);
+            uint32_t count = 0;
+            for (Slot s = first; s < last; s++) {
+                const Slot parent = m_parents[s];
+                if (parent != NO_SLOT) m_dirty[s] |= m_dirty[parent];
+                if (!m_dirty[s]) continue;
+
+                float xx = qx[s] * qx[s], yy = qy[s] * qy[s], zz = qz[s] * qz[s];
+                float xy = qx[s] * qy[s], xz = qx[s] * qz[s], yz = qy[s] * qz[s];
+                float wx = qw[s] * qx[s], wy = qw[s] * qy[s], wz = qw[s] * qz[s];
+                WorldMatrix local {{
+                    (1.0f - 2.0f * (yy + zz)) * sx[s], 2.0f * (xy + wz) * sx[s], 2.0f * (xz - wy) * sx[s], 0.0f,
+                    2.0f * (xy - wz) * sy[s], (1.0f - 2.0f * (xx + zz)) * sy[s], 2.0f * (yz + wx) * sy[s], 0.0f,
+                    2.0f * (xz + wy) * sz[s], 2.0f * (yz - wx) * sz[s], (1.0f - 2.0f * (xx + yy)) * sz[s], 0.0f,
+                    tx[s], ty[s], tz[s], 1.0f,
+                }};
+                const NodeId id = m_ids[s];
+                m_worlds[id] = parent == NO_SLOT ? local : multiply(m_worlds[m_ids[parent]], local);
+                m_changed[id] = 1;
+                count++;
+            }
+            updated.fetch_add(count, std::memory_order_relaxed);
+        });
+    }
+
+    if (m_min_dirty_depth < level_count) {
+        std::fill(m_dirty.begin() + m_level_begin[m_min_dirty_depth], m_dirty.end(), 0);
+    }
+    m_min_dirty_depth = NO_SLOT;
+    m_last_update_count = updated.load(std::memory_order_relaxed);
+    TRACE_COUNTER("transforms updated", m_last_update_count);
+}
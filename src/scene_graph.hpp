@@ -0,0 +1,132 @@
+/*
+    scene_graph.hpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "thread_pool.hpp"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Column-major 4x4, the layout of a WGSL mat4x4f, so world matrices can be
+// copied into an instance buffer as they are.
+struct WorldMatrix {
+    float m[16];
+};
+
+inline constexpr WorldMatrix WORLD_MATRIX_IDENTITY {{
+    1.0f, 0.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f, 0.0f,
+    0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f,
+}};
+
+struct NodeTransform {
+    float translation[3] { 0.0f, 0.0f, 0.0f };
+    // unit quaternion, x y z w
+    float rotation[4] { 0.0f, 0.0f, 0.0f, 1.0f };
+    float scale[3] { 1.0f, 1.0f, 1.0f };
+};
+
+// Transform hierarchy. Local transforms live in SoA arrays sorted by depth,
+// so every level only reads the level above it. Editing a node marks it
+// dirty; update() pushes the flags down and recomputes only the dirty
+// subtrees, one level at a time with each level split across the pool.
+//
+// Node ids are stable and index the world matrix array, which is what the
+// GPU instance buffer mirrors. Ids of destroyed nodes are reused.
+class SceneGraph {
+public:
+    using NodeId = uint32_t;
+    inline static constexpr NodeId NO_NODE = 0xffffffff;
+
+    NodeId createNode(NodeId parent = NO_NODE, const NodeTransform& local = {});
+
+    // Destroys the node together with its subtree.
+    void destroyNode(NodeId node);
+
+    void setLocal(NodeId node, const NodeTransform& local);
+    NodeTransform local(NodeId node) const;
+
+    inline bool alive(NodeId node) const { return node < m_slot_of.size() && m_slot_of[node] != NO_SLOT; }
+
+    // As of the last update().
+    inline const WorldMatrix& world(NodeId node) const { return m_worlds[node]; }
+
+    // Indexed by node id, entries of unused ids are stale.
+    inline std::span<const WorldMatrix> worldMatrices() const { return m_worlds; }
+
+    void update(ThreadPool& pool);
+
+    // Calls f(first, count) for runs of ids whose world matrix changed in the
+    // last update(). Runs separated by fewer than `max_gap` ids are merged,
+    // trading a few redundant bytes for fewer uploads.
+    template<typename Func>
+    void forEachChangedRun(Func&& f, uint32_t max_gap = 16) const {
+        const uint32_t count = static_cast<uint32_t>(m_changed.size());
+        uint32_t id = 0;
+        while (id < count) {
+            if (!m_changed[id]) {
+                id++;
+                continue;
+            }
+            uint32_t first = id;
+            uint32_t last = id;
+            for (id++; id < count && id - last <= max_gap; id++) {
+                if (m_changed[id]) last = id;
+            }
+            f(first, last - first + 1);
+            id = last + 1;
+        }
+    }
+
+    inline uint32_t nodeCount() const { return static_cast<uint32_t>(m_ids.size()); }
+    // ids in use or free, the length of worldMatrices()
+    inline uint32_t idCapacity() const { return static_cast<uint32_t>(m_worlds.size()); }
+    inline uint32_t lastUpdateCount() const { return m_last_update_count; }
+
+private:
+    using Slot = uint32_t;
+    inline static constexpr Slot NO_SLOT = 0xffffffff;
+
+    enum Channel : uint32_t {
+        TX, TY, TZ, QX, QY, QZ, QW, SX, SY, SZ, CHANNEL_COUNT,
+    };
+
+    // Restores depth order after nodes were added and rebuilds the levels.
+    void sortByDepth();
+    void markDirty(Slot slot);
+
+private:
+    // by slot, sorted by depth
+    std::vector<NodeId> m_ids {};
+    std::vector<Slot> m_parents {};
+    std::vector<uint32_t> m_depths {};
+    std::vector<float> m_locals[CHANNEL_COUNT] {};
+    std::vector<uint8_t> m_dirty {};
+    // first slot of each depth, plus the end
+    std::vector<Slot> m_level_begin { 0 };
+
+    // by node id
+    std::vector<Slot> m_slot_of {};
+    std::vector<WorldMatrix> m_worlds {};
+    std::vector<uint8_t> m_changed {};
+    std::vector<NodeId> m_free_ids {};
+
+    // nodes were added or removed since the levels were last built
+    bool m_structure_dirty { false };
+    uint32_t m_min_dirty_depth { NO_SLOT };
+    uint32_t m_last_update_count { 0 };
+};
@@ -0,0 +1,105 @@
+/*
+    simulation.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "simulation.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const auto STEP_DURATION = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(Simulation::STEP));
+
+inline void lerp3(const float *a, const float *b, float t, float *out) {
+    for (int i = 0; i < 3; i++) out[i] = a[i] + (b[i] - a[i]) * t;
+}
+
+} // namespace
+
+void Simulation::reset(std::vector<Light> lights, std::vector<LightOrbit> orbits, std::chrono::steady_clock::time_point start) {
+    m_lights = std::move(lights);
+    m_orbits = std::move(orbits);
+    m_orbits.resize(m_lights.size());
+    m_step = 0;
+    m_time = 0.0;
+    m_due = start;
+    m_next_due = start + STEP_DURATION;
+    // step 0 is placed like every other, and blends with itself
+    step();
+    m_previous_lights = m_lights;
+}
+
+uint32_t Simulation::advance(std::chrono::steady_clock::time_point now) {
+    uint32_t ran = 0;
+    while (now >= m_next_due) {
+        if (ran == MAX_CATCH_UP) {
+            m_next_due = now + STEP_DURATION;
+            break;
+        }
+        TRACE_ZONE("simulation step");
+        m_previous_lights.assign(m_lights.begin(), m_lights.end());
+        m_step++;
+        m_time += STEP;
+        step();
+        m_due = m_next_due;
+        m_next_due += STEP_DURATION;
+        ran++;
+    }
+    return ran;
+}
+
+// Orbits the demo lights around the model.
+void Simulation::step() {
+    float time = static_cast<float>(m_time);
+    for (size_t i = 0; i < m_lights.size(); i++) {
+        const LightOrbit& orbit = m_orbits[i];
+        float angle = orbit.phase + time * orbit.speed;
+        Light& light = m_lights[i];
+        light.position[0] = orbit.radius * std::cos(angle);
+        light.position[1] = orbit.height;
+        light.position[2] = orbit.radius * std::sin(angle);
+        if (light.type == LightType::Spot) {
+            // aimed at the model's axis
+            light.direction[0] = -light.position[0];
+            light.direction[1] = 0.0f;
+            light.direction[2] = -light.position[2];
+        }
+    }
+}
+
+void Simulation::snapshot(SceneSnapshot& out) const {
+    out.step = m_step;
+    out.time = m_time;
+    out.previous_time = m_step > 0 ? m_time - STEP : m_time;
+    out.due = m_due;
+    out.lights.assign(m_lights.begin(), m_lights.end());
+    out.previous_lights.assign(m_previous_lights.begin(), m_previous_lights.end());
+}
+
+float blendFactor(const SceneSnapshot& snapshot, std::chrono::steady_clock::time_point now) {
+    double since = std::chrono::duration<double>(now - snapshot.due).count();
+    return static_cast<float>(std::clamp(since / Simulation::STEP, 0.0, 1.0));
+}
+
+void blendLights(const SceneSnapshot& snapshot, float t, std::vector<Light>& out) {
+    out.assign(snapshot.lights.begin(), snapshot.lights.end());
+    if (snapshot.previous_lights.size() != out.size()) return;
+    for (size_t i = 0; i < out.size(); i++) {
+        const Light& from = snapshot.previous_lights[i];
+        lerp3(from.position, snapshot.lights[i].position, t, out[i].position);
+        lerp3(from.direction, snapshot.lights[i].direction, t, out[i].direction);
+    }
+}
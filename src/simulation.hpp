@@ -0,0 +1,83 @@
+/*
+    simulation.hpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "clustered_lighting.h"
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+struct LightOrbit {
+    float radius { 1.0f };
+    float height { 0.0f };
+    float phase { 0.0f };
+    // radians per second
+    float speed { 0.0f };
+};
+
+// The two most recent steps, as the renderer sees them. Never changed
+// after it is published, the renderer blends between the two.
+struct SceneSnapshot {
+    uint64_t step { 0 };
+    // simulated seconds at this step and the one before
+    double time { 0.0 };
+    double previous_time { 0.0 };
+    // when this step was due on the wall clock
+    std::chrono::steady_clock::time_point due {};
+    std::vector<Light> lights {};
+    std::vector<Light> previous_lights {};
+};
+
+// Advances the animated scene state at a fixed rate, however often frames
+// are rendered.
+class Simulation {
+public:
+    inline static constexpr double STEP = 1.0 / 60.0;
+    // steps run by one advance() before the clock is let go
+    inline static constexpr uint32_t MAX_CATCH_UP = 8;
+
+    void reset(std::vector<Light> lights, std::vector<LightOrbit> orbits, std::chrono::steady_clock::time_point start);
+
+    // Runs every step due by `now` and returns how many ran. After a stall
+    // longer than MAX_CATCH_UP steps the rest are dropped.
+    uint32_t advance(std::chrono::steady_clock::time_point now);
+
+    // Copies the last two steps into `out`, reusing its storage.
+    void snapshot(SceneSnapshot& out) const;
+
+    inline std::chrono::steady_clock::time_point nextStep() const { return m_next_due; }
+    inline uint64_t steps() const { return m_step; }
+
+private:
+    void step();
+
+private:
+    std::vector<Light> m_lights {};
+    std::vector<Light> m_previous_lights {};
+    std::vector<LightOrbit> m_orbits {};
+    uint64_t m_step { 0 };
+    double m_time { 0.0 };
+    std::chrono::steady_clock::time_point m_due {};
+    std::chrono::steady_clock::time_point m_next_due {};
+};
+
+// How far `now` is past the snapshot's step, in steps, clamped to 0..1.
+// Drawing the blend at this factor shows the scene one step behind the
+// simulation, without ever extrapolating.
+float blendFactor(const SceneSnapshot& snapshot, std::chrono::steady_clock::time_point now);
+
+// The snapshot's lights between its two steps, written over `out`.
+void blendLights(const SceneSnapshot& snapshot, float t, std::vector<Light>& out);
@@ -0,0 +1,36 @@
+/*
+    vertex.hpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+// Interleaved layout uploaded as-is into the vertex heap.
+struct Vertex {
+    float position[3];
+    float normal[3];
+    float uv[2];
+};
+
+static_assert(sizeof(Vertex) == 8 * sizeof(float));
+
+// Up to four influences per vertex: joint indices into the skeleton and
+// unorm8 weights that sum to exactly 255. Unused slots have weight 0.
+struct SkinWeights {
+    uint8_t joints[4];
+    uint8_t weights[4];
+};
+
+static_assert(sizeof(SkinWeights) == 8);
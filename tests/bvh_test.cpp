@@ -0,0 +1,167 @@
+/*
+    bvh_test.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "bvh.hpp"
+#include "check.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Above BvhConfig::parallel_threshold, so the build also splits on the pool.
+constexpr uint32_t BOX_COUNT = 20000;
+constexpr uint32_t QUERY_COUNT = 200;
+constexpr float WORLD_SIZE = 100.0f;
+
+// Deterministic noise, so a failure reproduces.
+struct Lcg {
+    uint32_t state { 777 };
+
+    inline uint32_t next() {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+    inline float unit() { return static_cast<float>(next() & 0xffff) / 65535.0f; }
+    inline float range(float low, float high) { return low + (high - low) * unit(); }
+};
+
+Aabb randomBox(Lcg& lcg, float extent) {
+    Aabb box;
+    for (int axis = 0; axis < 3; axis++) {
+        box.min[axis] = lcg.range(0.0f, WORLD_SIZE);
+        box.max[axis] = box.min[axis] + lcg.range(0.01f, extent);
+    }
+    return box;
+}
+
+bool overlaps(const Aabb& a, const Aabb& b) {
+    for (int axis = 0; axis < 3; axis++) {
+        if (a.max[axis] < b.min[axis] || b.max[axis] < a.min[axis]) return false;
+    }
+    return true;
+}
+
+// Entry distance by the slab test, infinite on a miss.
+float rayEntry(const Ray& ray, const Aabb& box) {
+    float t_near = 0.0f, t_far = ray.t_max;
+    for (int axis = 0; axis < 3; axis++) {
+        float inverse = 1.0f / ray.direction[axis];
+        float t0 = (box.min[axis] - ray.origin[axis]) * inverse;
+        float t1 = (box.max[axis] - ray.origin[axis]) * inverse;
+        t_near = std::max(t_near, std::min(t0, t1));
+        t_far = std::min(t_far, std::max(t0, t1));
+    }
+    return t_near <= t_far ? t_near : BVH_INFINITY;
+}
+
+float pointDistance(const float point[3], const Aabb& box) {
+    float squared = 0.0f;
+    for (int axis = 0; axis < 3; axis++) {
+        float d = std::max({ box.min[axis] - point[axis], point[axis] - box.max[axis], 0.0f });
+        squared += d * d;
+    }
+    return std::sqrt(squared);
+}
+
+bool nearlyEqual(float a, float b) {
+    if (std::isinf(a) || std::isinf(b)) return a == b;
+    return std::fabs(a - b) <= 1e-3f * std::max(1.0f, std::fabs(a));
+}
+
+// Every query against brute force over `bounds`.
+void checkQueries(const Bvh& bvh, const std::vector<Aabb>& bounds, Lcg& lcg) {
+    CHECK(bvh.primitiveCount() == bounds.size());
+    uint32_t box_mismatches = 0, ray_mismatches = 0, packet_mismatches = 0, nearest_mismatches = 0;
+    std::vector<uint32_t> found;
+    std::vector<uint32_t> expected;
+    std::vector<Ray> rays;
+    for (uint32_t q = 0; q < QUERY_COUNT; q++) {
+        Aabb query = randomBox(lcg, 10.0f);
+        found.clear();
+        bvh.queryAabb(query, found);
+        expected.clear();
+        for (uint32_t i = 0; i < bounds.size(); i++) {
+            if (overlaps(query, bounds[i])) expected.push_back(i);
+        }
+        std::sort(found.begin(), found.end());
+        if (found != expected) box_mismatches++;
+
+        Ray& ray = rays.emplace_back();
+        for (int axis = 0; axis < 3; axis++) {
+            ray.origin[axis] = lcg.range(-10.0f, WORLD_SIZE + 10.0f);
+            ray.direction[axis] = lcg.range(-1.0f, 1.0f);
+        }
+        float best = BVH_INFINITY;
+        for (const Aabb& box : bounds) best = std::min(best, rayEntry(ray, box));
+        RayHit hit = bvh.raycast(ray);
+        if (hit.hit() != !std::isinf(best) || (hit.hit() && !nearlyEqual(hit.t, best))) ray_mismatches++;
+
+        float point[3] = { lcg.range(0.0f, WORLD_SIZE), lcg.range(0.0f, WORLD_SIZE), lcg.range(0.0f, WORLD_SIZE) };
+        float closest = BVH_INFINITY;
+        for (const Aabb& box : bounds) closest = std::min(closest, pointDistance(point, box));
+        if (!nearlyEqual(bvh.nearest(point).distance, closest)) nearest_mismatches++;
+    }
+
+    std::vector<RayHit> hits(rays.size());
+    bvh.raycastPacket(rays, hits);
+    for (size_t i = 0; i < rays.size(); i++) {
+        RayHit single = bvh.raycast(rays[i]);
+        if (hits[i].hit() != single.hit() || (single.hit() && !nearlyEqual(hits[i].t, single.t))) packet_mismatches++;
+    }
+    CHECK(box_mismatches == 0);
+    CHECK(ray_mismatches == 0);
+    CHECK(packet_mismatches == 0);
+    CHECK(nearest_mismatches == 0);
+}
+
+void testBuild() {
+    Lcg lcg;
+    std::vector<Aabb> bounds(BOX_COUNT);
+    for (Aabb& box : bounds) box = randomBox(lcg, 2.0f);
+    Bvh bvh;
+    bvh.build(bounds, ThreadPool::global());
+    checkQueries(bvh, bounds, lcg);
+}
+
+// A tenth of the boxes moves and only their paths are refitted; then all
+// of them move far and the whole tree is refitted.
+void testRefit() {
+    Lcg lcg;
+    std::vector<Aabb> bounds(BOX_COUNT);
+    for (Aabb& box : bounds) box = randomBox(lcg, 2.0f);
+    Bvh bvh;
+    bvh.build(bounds, ThreadPool::global());
+
+    std::vector<uint32_t> moved;
+    for (uint32_t i = 0; i < BOX_COUNT; i += 10) {
+        bounds[i] = randomBox(lcg, 3.0f);
+        moved.push_back(i);
+    }
+    bvh.refit(bounds, moved);
+    checkQueries(bvh, bounds, lcg);
+
+    for (Aabb& box : bounds) box = randomBox(lcg, 4.0f);
+    bvh.refit(bounds);
+    checkQueries(bvh, bounds, lcg);
+}
+
+} // namespace
+
+int main() {
+    testBuild();
+    testRefit();
+    return checkResult();
+}
@@ -0,0 +1,35 @@
+/*
+    check.hpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include <cstdio>
+
+// Failed checks are printed and counted, the test returns checkResult()
+// from main so one run reports every failure.
+inline int g_check_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            g_check_failures++; \
+        } \
+    } while (0)
+
+inline int checkResult() {
+    if (g_check_failures) std::fprintf(stderr, "%d checks failed\n", g_check_failures);
+    return g_check_failures ? 1 : 0;
+}
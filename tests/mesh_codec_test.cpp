@@ -0,0 +1,179 @@
+/*
+    mesh_codec_test.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "check.hpp"
+#include "mesh_codec.hpp"
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Deterministic noise, so a failure reproduces.
+struct Lcg {
+    uint32_t state { 12345 };
+
+    inline uint32_t next() {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+    inline float unit() { return static_cast<float>(next() & 0xffff) / 65535.0f; }
+};
+
+struct Mesh {
+    std::vector<Vertex> vertices {};
+    std::vector<uint32_t> indices {};
+};
+
+// A width by height grid of vertices, two triangles per cell in row order,
+// as a cache-optimized mesh would reference them. `noise` jitters the
+// attributes so the deltas also need the wide and escaped encodings.
+Mesh makeGrid(uint32_t width, uint32_t height, float noise, Lcg& lcg) {
+    Mesh mesh;
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            Vertex& vertex = mesh.vertices.emplace_back();
+            vertex.position[0] = static_cast<float>(x) + noise * lcg.unit();
+            vertex.position[1] = noise * lcg.unit();
+            vertex.position[2] = static_cast<float>(y);
+            vertex.normal[0] = noise * lcg.unit();
+            vertex.normal[1] = 1.0f;
+            vertex.normal[2] = 0.0f;
+            vertex.uv[0] = static_cast<float>(x) / static_cast<float>(width);
+            vertex.uv[1] = static_cast<float>(y) / static_cast<float>(height);
+        }
+    }
+    for (uint32_t y = 0; y + 1 < height; y++) {
+        for (uint32_t x = 0; x + 1 < width; x++) {
+            uint32_t i = y * width + x;
+            mesh.indices.insert(mesh.indices.end(), { i, i + width, i + 1, i + 1, i + width, i + width + 1 });
+        }
+    }
+    return mesh;
+}
+
+bool sameIndices(const std::vector<std::byte>& decoded, uint32_t index_size, const std::vector<uint32_t>& indices) {
+    for (size_t i = 0; i < indices.size(); i++) {
+        uint32_t value = 0;
+        std::memcpy(&value, decoded.data() + i * index_size, index_size);
+        if (value != indices[i]) return false;
+    }
+    return true;
+}
+
+// Through the file format and back, decoding the indices at both sizes the
+// vertex count allows.
+void checkMeshRoundTrip(const Mesh& mesh) {
+    std::vector<std::byte> file = encodeMesh(mesh.vertices, mesh.indices);
+    CHECK(looksLikeEncodedMesh(file.data(), file.size()));
+    auto read = readEncodedMesh(file);
+    CHECK(read.is_ok());
+    if (!read.is_ok()) return;
+    EncodedMesh encoded = std::move(read).unwrap();
+    CHECK(encoded.vertex_count == mesh.vertices.size());
+    CHECK(encoded.vertex_size == sizeof(Vertex));
+    CHECK(encoded.index_count == mesh.indices.size());
+
+    std::vector<std::byte> vertices(encoded.vertexBytes());
+    CHECK(decodeVertexBuffer(vertices, encoded.vertex_count, encoded.vertex_size, encoded.vertices).is_ok());
+    CHECK(std::memcmp(vertices.data(), mesh.vertices.data(), vertices.size()) == 0);
+
+    for (uint32_t index_size : { 2u, 4u }) {
+        if (index_size == 2 && encoded.vertex_count > 0x10000) continue;
+        std::vector<std::byte> indices(encoded.indexBytes(index_size));
+        CHECK(decodeIndexBuffer(indices, encoded.index_count, index_size, encoded.vertex_count, encoded.indices).is_ok());
+        CHECK(sameIndices(indices, index_size, mesh.indices));
+    }
+}
+
+void testSmoothGrid() {
+    Lcg lcg;
+    checkMeshRoundTrip(makeGrid(64, 48, 0.0f, lcg));
+}
+
+void testNoisyGrid() {
+    Lcg lcg;
+    checkMeshRoundTrip(makeGrid(37, 29, 1000.0f, lcg));
+}
+
+// More vertices than 16-bit indices reach.
+void testLargeGrid() {
+    Lcg lcg;
+    Mesh mesh = makeGrid(300, 300, 0.5f, lcg);
+    EncodedMesh encoded;
+    encoded.vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+    CHECK(encoded.indexSize() == 4);
+    checkMeshRoundTrip(mesh);
+}
+
+// Random bytes at vertex sizes other than Vertex's, with counts that end
+// in a partial block and a partial group.
+void testRandomVertexBytes() {
+    Lcg lcg;
+    for (uint32_t vertex_size : { 4u, 12u, 20u, MESH_CODEC_MAX_VERTEX_SIZE }) {
+        for (uint32_t vertex_count : { 1u, 15u, 17u, 1000u }) {
+            std::vector<std::byte> vertices(static_cast<size_t>(vertex_size) * vertex_count);
+            for (std::byte& b : vertices) b = static_cast<std::byte>(lcg.next());
+            std::vector<std::byte> encoded = encodeVertexBuffer(vertices, vertex_size);
+            std::vector<std::byte> decoded(vertices.size());
+            CHECK(decodeVertexBuffer(decoded, vertex_count, vertex_size, encoded).is_ok());
+            CHECK(decoded == vertices);
+        }
+    }
+}
+
+// Triangles that come back to old vertices, past what the FIFOs remember.
+void testScatteredIndices() {
+    Lcg lcg;
+    const uint32_t vertex_count = 5000;
+    std::vector<uint32_t> indices(3 * 4000);
+    for (uint32_t& index : indices) index = lcg.next() % vertex_count;
+    std::vector<std::byte> encoded = encodeIndexBuffer(indices);
+    std::vector<std::byte> decoded(indices.size() * 4);
+    CHECK(decodeIndexBuffer(decoded, static_cast<uint32_t>(indices.size()), 4, vertex_count, encoded).is_ok());
+    CHECK(sameIndices(decoded, 4, indices));
+}
+
+void testCorruptInput() {
+    Lcg lcg;
+    Mesh mesh = makeGrid(16, 16, 0.5f, lcg);
+    std::vector<std::byte> encoded = encodeVertexBuffer(std::as_bytes(std::span<const Vertex>(mesh.vertices)), sizeof(Vertex));
+    std::vector<std::byte> decoded(mesh.vertices.size() * sizeof(Vertex));
+    std::span<const std::byte> truncated(encoded.data(), encoded.size() - 1);
+    CHECK(decodeVertexBuffer(decoded, static_cast<uint32_t>(mesh.vertices.size()), sizeof(Vertex), truncated).is_err());
+
+    std::vector<std::byte> index_stream = encodeIndexBuffer(mesh.indices);
+    std::vector<std::byte> indices(mesh.indices.size() * 4);
+    const uint32_t index_count = static_cast<uint32_t>(mesh.indices.size());
+    // every index is checked against the vertex count
+    CHECK(decodeIndexBuffer(indices, index_count, 4, static_cast<uint32_t>(mesh.vertices.size()) - 1, index_stream).is_err());
+    std::span<const std::byte> short_stream(index_stream.data(), index_stream.size() - 1);
+    CHECK(decodeIndexBuffer(indices, index_count, 4, static_cast<uint32_t>(mesh.vertices.size()), short_stream).is_err());
+
+    std::vector<std::byte> file = encodeMesh(mesh.vertices, mesh.indices);
+    file.pop_back();
+    CHECK(readEncodedMesh(file).is_err());
+}
+
+} // namespace
+
+int main() {
+    testSmoothGrid();
+    testNoisyGrid();
+    testLargeGrid();
+    testRandomVertexBytes();
+    testScatteredIndices();
+    testCorruptInput();
+    return checkResult();
+}
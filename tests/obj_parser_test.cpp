@@ -0,0 +1,106 @@
+/*
+    obj_parser_test.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "check.hpp"
+#include "obj_parser.hpp"
+#include <string>
+#include <vector>
+
+namespace {
+
+// Large enough for parseObj() to cut it into several chunks.
+constexpr size_t MIN_FILE_SIZE = 2 << 20;
+
+// Vertex i sits at x = i and u = i, so a corner's vertex tells which
+// references it resolved to.
+void appendVertex(std::string& obj, size_t& vertex_count) {
+    std::string x = std::to_string(vertex_count++);
+    obj += "v " + x + " 0 0\nvt " + x + " 0\nvn 0 0 1\n";
+}
+
+void checkCorners(const std::string& obj, const std::vector<float>& expected_x) {
+    Arena arena;
+    auto parsed = parseObj(obj.data(), obj.size(), arena);
+    CHECK(parsed.is_ok());
+    if (!parsed.is_ok()) {
+        std::fprintf(stderr, "parseObj: %s\n", std::move(parsed).unwrap_err().c_str());
+        return;
+    }
+    ObjMesh mesh = std::move(parsed).unwrap();
+    CHECK(mesh.indices.size() == expected_x.size());
+    if (mesh.indices.size() != expected_x.size()) return;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < expected_x.size(); i++) {
+        uint32_t index = mesh.indices[i];
+        if (index >= mesh.vertices.size() || mesh.vertices[index].position[0] != expected_x[i]
+            || mesh.vertices[index].uv[0] != expected_x[i]) {
+            mismatches++;
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+// Every vertex comes first, so each later chunk starts without vertices of
+// its own and its -1 and -2 references reach one and two elements back
+// into the previous chunks.
+void testRelativeAcrossChunks() {
+    std::string obj;
+    size_t vertex_count = 0;
+    while (obj.size() < MIN_FILE_SIZE / 3) appendVertex(obj, vertex_count);
+    std::vector<float> expected_x;
+    const float last = static_cast<float>(vertex_count - 1);
+    while (obj.size() < MIN_FILE_SIZE) {
+        obj += "f -3/-3/-3 -2/-2/-2 -1/-1/-1\n";
+        expected_x.insert(expected_x.end(), { last - 2, last - 1, last });
+        obj += "f -1/-1 -2/-2 -" + std::to_string(vertex_count) + "/-" + std::to_string(vertex_count) + "\n";
+        expected_x.insert(expected_x.end(), { last, last - 1, 0.0f });
+    }
+    checkCorners(obj, expected_x);
+}
+
+// Vertices and faces interleaved, so references near a chunk's start mix
+// elements of the chunk with ones before it.
+void testRelativeInterleaved() {
+    std::string obj;
+    size_t vertex_count = 0;
+    std::vector<float> expected_x;
+    for (int i = 0; i < 3; i++) appendVertex(obj, vertex_count);
+    while (obj.size() < MIN_FILE_SIZE) {
+        appendVertex(obj, vertex_count);
+        const float last = static_cast<float>(vertex_count - 1);
+        obj += "f -4/-4/-4 -2/-2/-2 -1/-1/-1\n";
+        expected_x.insert(expected_x.end(), { last - 3, last - 1, last });
+        // absolute references mixed in
+        std::string previous = std::to_string(vertex_count - 1);
+        obj += "f 1/1 -1/-1 " + previous + "/" + previous + "\n";
+        expected_x.insert(expected_x.end(), { 0.0f, last, last - 1 });
+    }
+    checkCorners(obj, expected_x);
+}
+
+void testRelativeBeforeFirst() {
+    std::string obj = "v 0 0 0\nv 1 0 0\nf -1 -2 -3\n";
+    Arena arena;
+    CHECK(parseObj(obj.data(), obj.size(), arena).is_err());
+}
+
+} // namespace
+
+int main() {
+    testRelativeAcrossChunks();
+    testRelativeInterleaved();
+    testRelativeBeforeFirst();
+    return checkResult();
+}
@@ -0,0 +1,123 @@
+/*
+    tlsf_allocator_test.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "check.hpp"
+#include "tlsf_allocator.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t HEAP_SIZE = 64ull << 20;
+
+// Deterministic noise, so a failure reproduces.
+struct Lcg {
+    uint32_t state { 4242 };
+
+    inline uint32_t next() {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+};
+
+struct Live {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t node;
+};
+
+// Live ranges lie inside the heap, hold what was asked for and never
+// overlap; the free byte count is whatever they leave.
+bool consistent(const TlsfAllocator& tlsf, std::vector<Live> live) {
+    std::sort(live.begin(), live.end(), [](const Live& a, const Live& b) { return a.offset < b.offset; });
+    uint64_t used = 0;
+    for (size_t i = 0; i < live.size(); i++) {
+        uint64_t node_size = tlsf.nodeSize(live[i].node);
+        if (node_size < live[i].size || live[i].offset + node_size > tlsf.size()) return false;
+        if (i > 0 && live[i - 1].offset + tlsf.nodeSize(live[i - 1].node) > live[i].offset) return false;
+        used += node_size;
+    }
+    return tlsf.freeBytes() == tlsf.size() - used && tlsf.allocationCount() == live.size();
+}
+
+void testWholeHeap() {
+    TlsfAllocator tlsf(HEAP_SIZE);
+    CHECK(tlsf.largestFree() == HEAP_SIZE);
+    TlsfAllocator::Allocation all = tlsf.allocate(HEAP_SIZE);
+    CHECK(all.node != TlsfAllocator::NO_SPACE);
+    CHECK(all.offset == 0);
+    CHECK(tlsf.freeBytes() == 0);
+    CHECK(tlsf.allocate(1).node == TlsfAllocator::NO_SPACE);
+    tlsf.free(all.node);
+    CHECK(tlsf.freeBytes() == HEAP_SIZE);
+    CHECK(tlsf.allocate(HEAP_SIZE + 1).node == TlsfAllocator::NO_SPACE);
+}
+
+// Random allocations and frees of mixed sizes; once everything is freed
+// the neighbours must have merged back into one range.
+void testRandomChurn() {
+    Lcg lcg;
+    TlsfAllocator tlsf(HEAP_SIZE);
+    std::vector<Live> live;
+    uint32_t inconsistent = 0;
+    for (uint32_t step = 0; step < 20000; step++) {
+        bool allocate = live.empty() || lcg.next() % 3 != 0;
+        if (allocate) {
+            // mostly small, now and then up to a megabyte
+            uint64_t size = lcg.next() % 8 == 0 ? 1 + lcg.next() % (1u << 20) : 1 + lcg.next() % 4096;
+            TlsfAllocator::Allocation allocation = tlsf.allocate(size);
+            if (allocation.node != TlsfAllocator::NO_SPACE) live.push_back({ allocation.offset, size, allocation.node });
+        } else {
+            size_t i = lcg.next() % live.size();
+            tlsf.free(live[i].node);
+            live[i] = live.back();
+            live.pop_back();
+        }
+        if (step % 1000 == 0 && !consistent(tlsf, live)) inconsistent++;
+    }
+    CHECK(inconsistent == 0);
+    CHECK(consistent(tlsf, live));
+
+    for (const Live& allocation : live) tlsf.free(allocation.node);
+    CHECK(tlsf.allocationCount() == 0);
+    CHECK(tlsf.freeBytes() == HEAP_SIZE);
+    CHECK(tlsf.largestFree() == HEAP_SIZE);
+}
+
+// A heap cut into pieces serves a large request once the pieces around a
+// gap are freed.
+void testCoalescing() {
+    TlsfAllocator tlsf(1 << 20);
+    std::vector<uint32_t> nodes;
+    for (uint32_t i = 0; i < 16; i++) nodes.push_back(tlsf.allocate(64 << 10).node);
+    CHECK(std::find(nodes.begin(), nodes.end(), TlsfAllocator::NO_SPACE) == nodes.end());
+    CHECK(tlsf.allocate(128 << 10).node == TlsfAllocator::NO_SPACE);
+    tlsf.free(nodes[5]);
+    tlsf.free(nodes[7]);
+    CHECK(tlsf.allocate(128 << 10).node == TlsfAllocator::NO_SPACE);
+    tlsf.free(nodes[6]);
+    TlsfAllocator::Allocation merged = tlsf.allocate(192 << 10);
+    CHECK(merged.node != TlsfAllocator::NO_SPACE);
+    CHECK(merged.offset == 5 * (64 << 10));
+}
+
+} // namespace
+
+int main() {
+    testWholeHeap();
+    testRandomChurn();
+    testCoalescing();
+    return checkResult();
+}
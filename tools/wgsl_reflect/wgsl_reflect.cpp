@@ -0,0 +1,824 @@
+/*
+    wgsl_reflect.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+// Build step: wgsl_reflect <input.wgsl> <output.h>
+//
+// Reflects a WGSL module into a header of constexpr WebGPU descriptors in
+// namespace wgsl::<file stem>:
+//  - every struct reachable from a uniform or storage variable, as a C++
+//    struct padded to the WGSL host-shareable layout,
+//  - every struct a vertex entry point takes, as a packed C++ struct, with
+//    its vertex attributes and one buffer layout per struct parameter. The
+//    parameter order is the buffer slot and a parameter named `instance`
+//    steps per instance,
+//  - every bind group, as an array of layout entries whose visibility is
+//    the set of stages that reach each binding.
+//
+// Only the subset of WGSL the shaders of this repo use is understood.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string g_input_path;
+
+[[noreturn]] void fail(const std::string& message) {
+    std::fprintf(stderr, "%s: error: %s\n", g_input_path.c_str(), message.c_str());
+    std::exit(1);
+}
+
+// ---- tokens ----
+
+struct Token {
+    enum Kind { Ident, Number, Punct, End } kind;
+    std::string text;
+    uint32_t line;
+};
+
+std::vector<Token> tokenize(const std::string& source) {
+    std::vector<Token> tokens;
+    uint32_t line = 1;
+    size_t i = 0;
+    while (i < source.size()) {
+        char c = source[i];
+        if (c == '\n') {
+            line++;
+            i++;
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            i++;
+        } else if (source.compare(i, 2, "//") == 0) {
+            while (i < source.size() && source[i] != '\n') i++;
+        } else if (source.compare(i, 2, "/*") == 0) {
+            // block comments nest in WGSL
+            int depth = 0;
+            do {
+                if (source.compare(i, 2, "/*") == 0) {
+                    depth++;
+                    i += 2;
+                } else if (source.compare(i, 2, "*/") == 0) {
+                    depth--;
+                    i += 2;
+                } else {
+                    if (source[i] == '\n') line++;
+                    i++;
+                }
+            } while (depth > 0 && i < source.size());
+        } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            size_t begin = i;
+            while (i < source.size() && (std::isalnum(static_cast<unsigned char>(source[i])) || source[i] == '_')) i++;
+            tokens.push_back({ Token::Ident, source.substr(begin, i - begin), line });
+        } else if (std::isdigit(static_cast<unsigned char>(c))) {
+            size_t begin = i;
+            while (i < source.size() && (std::isalnum(static_cast<unsigned char>(source[i])) || source[i] == '.')) i++;
+            tokens.push_back({ Token::Number, source.substr(begin, i - begin), line });
+        } else if (source.compare(i, 2, "->") == 0) {
+            tokens.push_back({ Token::Punct, "->", line });
+            i += 2;
+        } else {
+            tokens.push_back({ Token::Punct, std::string(1, c), line });
+            i++;
+        }
+    }
+    tokens.push_back({ Token::End, "", line });
+    return tokens;
+}
+
+// ---- syntax ----
+
+struct Type {
+    std::string name;
+    // template arguments: types, numbers, address spaces, texel formats
+    std::vector<Type> args;
+};
+
+struct Attribute {
+    std::string name;
+    std::vector<std::string> args;
+};
+
+using Attributes = std::vector<Attribute>;
+
+const Attribute *findAttribute(const Attributes& attributes, const std::string& name) {
+    for (const Attribute& attribute : attributes) {
+        if (attribute.name == name) return &attribute;
+    }
+    return nullptr;
+}
+
+struct Member {
+    Attributes attributes;
+    std::string name;
+    Type type;
+};
+
+struct Struct {
+    std::string name;
+    std::vector<Member> members;
+};
+
+struct Variable {
+    Attributes attributes;
+    std::string address_space;
+    std::string access;
+    std::string name;
+    Type type;
+};
+
+struct Function {
+    Attributes attributes;
+    std::string name;
+    std::vector<Member> params;
+    // every identifier of the body, enough to find calls and used bindings
+    std::set<std::string> identifiers;
+};
+
+struct Module {
+    std::vector<Struct> structs;
+    std::vector<Variable> variables;
+    std::vector<Function> functions;
+
+    const Struct *findStruct(const std::string& name) const {
+        for (const Struct& s : structs) {
+            if (s.name == name) return &s;
+        }
+        return nullptr;
+    }
+};
+
+class Parser {
+public:
+    explicit Parser(std::vector<Token> tokens) : m_tokens(std::move(tokens)) {}
+
+    Module parse() {
+        Module module;
+        while (peek().kind != Token::End) {
+            Attributes attributes = parseAttributes();
+            if (accept("struct")) {
+                module.structs.push_back(parseStruct());
+            } else if (accept("var")) {
+                module.variables.push_back(parseVariable(std::move(attributes)));
+            } else if (accept("fn")) {
+                module.functions.push_back(parseFunction(std::move(attributes)));
+            } else {
+                // const, override, alias, enable and friends
+                skipStatement();
+            }
+        }
+        return module;
+    }
+
+private:
+    const Token& peek() const { return m_tokens[m_pos]; }
+    const Token& next() {
+        const Token& token = m_tokens[m_pos];
+        if (token.kind != Token::End) m_pos++;
+        return token;
+    }
+    bool accept(const std::string& text) {
+        if (peek().kind == Token::End || peek().text != text) return false;
+        m_pos++;
+        return true;
+    }
+    void expect(const std::string& text) {
+        if (!accept(text)) fail("line " + std::to_string(peek().line) + ": expected '" + text + "', found '" + peek().text + "'");
+    }
+    std::string identifier() {
+        if (peek().kind != Token::Ident) fail("line " + std::to_string(peek().line) + ": expected an identifier, found '" + peek().text + "'");
+        return next().text;
+    }
+
+    Attributes parseAttributes() {
+        Attributes attributes;
+        while (accept("@")) {
+            Attribute attribute;
+            attribute.name = identifier();
+            if (accept("(")) {
+                std::string arg;
+                int depth = 0;
+                while (depth > 0 || peek().text != ")") {
+                    if (peek().kind == Token::End) fail("unterminated attribute");
+                    const Token& token = next();
+                    if (token.text == "(") depth++;
+                    if (token.text == ")") depth--;
+                    if (depth == 0 && token.text == ",") {
+                        attribute.args.push_back(arg);
+                        arg.clear();
+                    } else {
+                        arg += token.text;
+                    }
+                }
+                expect(")");
+                if (!arg.empty()) attribute.args.push_back(arg);
+            }
+            attributes.push_back(std::move(attribute));
+        }
+        return attributes;
+    }
+
+    Type parseType() {
+        Type type;
+        type.name = next().text;
+        if (accept("<")) {
+            do {
+                type.args.push_back(parseType());
+            } while (accept(","));
+            expect(">");
+        }
+        return type;
+    }
+
+    Struct parseStruct() {
+        Struct s;
+        s.name = identifier();
+        expect("{");
+        while (!accept("}")) {
+            Member member;
+            member.attributes = parseAttributes();
+            member.name = identifier();
+            expect(":");
+            member.type = parseType();
+            s.members.push_back(std::move(member));
+            if (!accept(",")) {
+                expect("}");
+                break;
+            }
+        }
+        accept(";");
+        return s;
+    }
+
+    Variable parseVariable(Attributes attributes) {
+        Variable variable;
+        variable.attributes = std::move(attributes);
+        if (accept("<")) {
+            variable.address_space = identifier();
+            if (accept(",")) variable.access = identifier();
+            expect(">");
+        }
+        variable.name = identifier();
+        if (accept(":")) variable.type = parseType();
+        skipStatement();
+        return variable;
+    }
+
+    Function parseFunction(Attributes attributes) {
+        Function function;
+        function.attributes = std::move(attributes);
+        function.name = identifier();
+        expect("(");
+        while (!accept(")")) {
+            Member param;
+            param.attributes = parseAttributes();
+            param.name = identifier();
+            expect(":");
+            param.type = parseType();
+            function.params.push_back(std::move(param));
+            if (!accept(",")) {
+                expect(")");
+                break;
+            }
+        }
+        if (accept("->")) {
+            parseAttributes();
+            parseType();
+        }
+        expect("{");
+        int depth = 1;
+        while (depth > 0) {
+            const Token& token = next();
+            if (token.kind == Token::End) fail("unterminated function " + function.name);
+            if (token.text == "{") depth++;
+            if (token.text == "}") depth--;
+            if (token.kind == Token::Ident) function.identifiers.insert(token.text);
+        }
+        return function;
+    }
+
+    void skipStatement() {
+        int depth = 0;
+        while (peek().kind != Token::End) {
+            const Token& token = next();
+            if (token.text == "{" || token.text == "(") depth++;
+            if (token.text == "}" || token.text == ")") depth--;
+            if (depth <= 0 && (token.text == ";" || (token.text == "}" && depth == 0))) return;
+        }
+    }
+
+private:
+    std::vector<Token> m_tokens;
+    size_t m_pos { 0 };
+};
+
+// ---- types ----
+
+struct Scalar {
+    // "" when not a scalar
+    std::string wgsl;
+    std::string cpp;
+    uint32_t size { 0 };
+};
+
+Scalar scalarOf(const std::string& name) {
+    if (name == "f32") return { "f32", "float", 4 };
+    if (name == "u32") return { "u32", "uint32_t", 4 };
+    if (name == "i32") return { "i32", "int32_t", 4 };
+    if (name == "f16") return { "f16", "uint16_t", 2 };
+    return {};
+}
+
+// vecN<T>, vecNf, matCxR<T> and matCxRf spelled out
+struct Shape {
+    uint32_t columns { 0 };
+    uint32_t rows { 0 };
+    Scalar scalar;
+};
+
+bool shapeOf(const Type& type, Shape& shape) {
+    const std::string& name = type.name;
+    Scalar scalar = scalarOf(name);
+    if (!scalar.wgsl.empty()) {
+        shape = { 1, 1, scalar };
+        return true;
+    }
+    auto element = [&](size_t suffix_at) {
+        if (name.size() > suffix_at) {
+            static const std::map<char, std::string> suffixes { { 'f', "f32" }, { 'u', "u32" }, { 'i', "i32" }, { 'h', "f16" } };
+            auto it = suffixes.find(name[suffix_at]);
+            return it == suffixes.end() ? Scalar {} : scalarOf(it->second);
+        }
+        return type.args.size() == 1 ? scalarOf(type.args[0].name) : Scalar {};
+    };
+    if (name.size() >= 4 && name.compare(0, 3, "vec") == 0 && std::isdigit(static_cast<unsigned char>(name[3]))) {
+        shape = { 1, static_cast<uint32_t>(name[3] - '0'), element(4) };
+        return !shape.scalar.wgsl.empty();
+    }
+    if (name.size() >= 6 && name.compare(0, 3, "mat") == 0 && name[4] == 'x') {
+        shape = { static_cast<uint32_t>(name[3] - '0'), static_cast<uint32_t>(name[5] - '0'), element(6) };
+        return !shape.scalar.wgsl.empty();
+    }
+    return false;
+}
+
+inline uint32_t roundUp(uint32_t alignment, uint32_t value) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+struct Layout {
+    uint32_t align { 0 };
+    uint32_t size { 0 };
+    // arrays without a length only
+    bool runtime_sized { false };
+};
+
+// member offsets of a host-shareable struct, WGSL alignment rules
+struct StructLayout {
+    Layout layout;
+    std::vector<uint32_t> offsets;
+    std::vector<Layout> members;
+};
+
+class HostLayouts {
+public:
+    explicit HostLayouts(const Module& module) : m_module(module) {}
+
+    Layout of(const Type& type) {
+        Shape shape;
+        if (type.name == "atomic" && type.args.size() == 1) return of(type.args[0]);
+        if (shapeOf(type, shape)) {
+            uint32_t s = shape.scalar.size;
+            uint32_t vector_align = shape.rows == 1 ? s : (shape.rows == 2 ? 2 * s : 4 * s);
+            uint32_t vector_size = shape.rows * s;
+            if (shape.columns == 1) return { vector_align, vector_size };
+            return { vector_align, shape.columns * roundUp(vector_align, vector_size) };
+        }
+        if (type.name == "array") {
+            if (type.args.empty()) fail("array without an element type");
+            Layout element = of(type.args[0]);
+            uint32_t stride = roundUp(element.align, element.size);
+            if (type.args.size() == 1) return { element.align, stride, true };
+            return { element.align, stride * static_cast<uint32_t>(std::stoul(type.args[1].name)) };
+        }
+        if (const Struct *p_struct = m_module.findStruct(type.name)) return structLayout(*p_struct).layout;
+        fail("type " + type.name + " is not host-shareable");
+    }
+
+    const StructLayout& structLayout(const Struct& s) {
+        auto it = m_structs.find(s.name);
+        if (it != m_structs.end()) return it->second;
+        StructLayout layout;
+        uint32_t offset = 0;
+        layout.layout.align = 1;
+        for (size_t i = 0; i < s.members.size(); i++) {
+            const Member& member = s.members[i];
+            Layout m = of(member.type);
+            if (const Attribute *p_align = findAttribute(member.attributes, "align")) m.align = std::stoul(p_align->args.at(0));
+            if (const Attribute *p_size = findAttribute(member.attributes, "size")) m.size = std::stoul(p_size->args.at(0));
+            if (m.runtime_sized && i + 1 != s.members.size()) fail(s.name + "." + member.name + ": runtime-sized array is not last");
+            offset = roundUp(m.align, offset);
+            layout.offsets.push_back(offset);
+            layout.members.push_back(m);
+            offset += m.runtime_sized ? 0 : m.size;
+            layout.layout.align = std::max(layout.layout.align, m.align);
+            layout.layout.runtime_sized = m.runtime_sized;
+        }
+        layout.layout.size = roundUp(layout.layout.align, offset);
+        return m_structs.emplace(s.name, std::move(layout)).first->second;
+    }
+
+private:
+    const Module& m_module;
+    std::map<std::string, StructLayout> m_structs;
+};
+
+// ---- emission ----
+
+std::string upper(std::string text) {
+    for (char& c : text) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    return text;
+}
+
+class Emitter {
+public:
+    Emitter(const Module& module, std::string name_space) :
+        m_module(module), m_layouts(module), m_namespace(std::move(name_space)) {}
+
+    std::string run() {
+        m_out << "// Generated by wgsl_reflect from " << g_input_path << ", do not edit.\n\n";
+        m_out << "#pragma once\n\n";
+        m_out << "#include \"webgpu/webgpu.hpp\"\n#include <cstddef>\n#include <cstdint>\n\n";
+        m_out << "namespace wgsl::" << m_namespace << " {\n";
+
+        for (const Variable& variable : m_module.variables) {
+            if (variable.address_space == "uniform" || variable.address_space == "storage") collectHostStructs(variable.type);
+        }
+        for (const Struct& s : m_module.structs) {
+            if (m_host_structs.count(s.name)) emitHostStruct(s);
+        }
+        for (const Function& function : m_module.functions) {
+            if (findAttribute(function.attributes, "vertex")) emitVertexInputs(function);
+        }
+        for (const Function& function : m_module.functions) {
+            emitEntryPoint(function);
+        }
+        emitBindGroups();
+
+        m_out << "\n} // namespace wgsl::" << m_namespace << "\n";
+        return m_out.str();
+    }
+
+private:
+    // dependencies first, so each struct only names emitted ones
+    void collectHostStructs(const Type& type) {
+        for (const Type& arg : type.args) collectHostStructs(arg);
+        const Struct *p_struct = m_module.findStruct(type.name);
+        if (!p_struct || m_host_structs.count(type.name)) return;
+        for (const Member& member : p_struct->members) collectHostStructs(member.type);
+        m_host_structs.insert(type.name);
+    }
+
+    // C++ element type and array extents of a host-shareable member
+    void hostDeclarator(const Type& type, std::string& base, std::string& extents) {
+        Shape shape;
+        if (type.name == "atomic") return hostDeclarator(type.args.at(0), base, extents);
+        if (shapeOf(type, shape)) {
+            base = shape.scalar.cpp;
+            Layout layout = m_layouts.of(type);
+            if (shape.columns > 1) {
+                uint32_t column_stride = layout.size / shape.columns;
+                extents += "[" + std::to_string(shape.columns) + "][" + std::to_string(column_stride / shape.scalar.size) + "]";
+            } else if (shape.rows > 1) {
+                extents += "[" + std::to_string(shape.rows) + "]";
+            }
+            return;
+        }
+        if (type.name == "array") {
+            const Type& element = type.args.at(0);
+            Layout element_layout = m_layouts.of(element);
+            uint32_t stride = roundUp(element_layout.align, element_layout.size);
+            std::string element_extents;
+            Shape element_shape;
+            if (shapeOf(element, element_shape) && element_shape.columns == 1 && stride != element_layout.size) {
+                // vec3 elements keep their padding word
+                base = element_shape.scalar.cpp;
+                element_extents = "[" + std::to_string(stride / element_shape.scalar.size) + "]";
+            } else {
+                hostDeclarator(element, base, element_extents);
+            }
+            extents += "[" + (type.args.size() > 1 ? type.args[1].name : std::string("1")) + "]" + element_extents;
+            return;
+        }
+        base = type.name;
+    }
+
+    void emitHostStruct(const Struct& s) {
+        const StructLayout& layout = m_layouts.structLayout(s);
+        m_out << "\n// host-shareable, " << layout.layout.size << " bytes aligned to " << layout.layout.align << "\n";
+        m_out << "struct alignas(" << layout.layout.align << ") " << s.name << " {\n";
+        uint32_t offset = 0;
+        uint32_t pad = 0;
+        std::vector<std::string> asserts;
+        for (size_t i = 0; i < s.members.size(); i++) {
+            const Member& member = s.members[i];
+            const Layout& m = layout.members[i];
+            if (layout.offsets[i] > offset) {
+                m_out << "    uint8_t reflect_pad" << pad++ << "_[" << layout.offsets[i] - offset << "];\n";
+            }
+            offset = layout.offsets[i];
+            if (m.runtime_sized) {
+                // not a member: the array follows the fixed part in the buffer
+                Layout element = m_layouts.of(member.type.args.at(0));
+                m_out << "    // " << member.name << ": array<" << member.type.args.at(0).name << ">\n";
+                m_out << "    inline static constexpr size_t " << upper(member.name) << "_OFFSET = " << offset << ";\n";
+                m_out << "    inline static constexpr size_t " << upper(member.name) << "_STRIDE = " << roundUp(element.align, element.size) << ";\n";
+                continue;
+            }
+            std::string base, extents;
+            hostDeclarator(member.type, base, extents);
+            m_out << "    " << base << " " << member.name << extents << ";\n";
+            asserts.push_back("static_assert(offsetof(" + s.name + ", " + member.name + ") == " + std::to_string(offset) + ");");
+            offset += m.size;
+        }
+        uint32_t fixed_end = layout.layout.runtime_sized ? layout.offsets.back() : layout.layout.size;
+        if (fixed_end > offset) m_out << "    uint8_t reflect_pad" << pad++ << "_[" << fixed_end - offset << "];\n";
+        m_out << "};\n";
+        if (!layout.layout.runtime_sized) {
+            m_out << "static_assert(sizeof(" << s.name << ") == " << layout.layout.size << ");\n";
+        }
+        for (const std::string& line : asserts) m_out << line << "\n";
+    }
+
+    static std::string vertexFormat(const Type& type) {
+        Shape shape;
+        if (!shapeOf(type, shape) || shape.columns != 1) fail("vertex input of type " + type.name + " has no vertex format");
+        std::string base;
+        if (shape.scalar.wgsl == "f32") base = "Float32";
+        else if (shape.scalar.wgsl == "u32") base = "Uint32";
+        else if (shape.scalar.wgsl == "i32") base = "Sint32";
+        else if (shape.scalar.wgsl == "f16" && (shape.rows == 2 || shape.rows == 4)) base = "Float16";
+        else fail("vertex input of type " + type.name + " has no vertex format");
+        return "WGPUVertexFormat_" + base + (shape.rows == 1 ? "" : "x" + std::to_string(shape.rows));
+    }
+
+    // packed structs, one per vertex buffer
+    void emitVertexInputs(const Function& function) {
+        for (const Member& param : function.params) {
+            const Struct *p_struct = m_module.findStruct(param.type.name);
+            if (!p_struct) continue;
+            if (m_vertex_structs.count(p_struct->name)) continue;
+            m_vertex_structs.insert(p_struct->name);
+            m_out << "\n// vertex input, tightly packed\n";
+            m_out << "struct " << p_struct->name << " {\n";
+            uint32_t offset = 0;
+            std::vector<std::string> asserts;
+            for (const Member& member : p_struct->members) {
+                if (!findAttribute(member.attributes, "location")) continue;
+                Shape shape;
+                vertexFormat(member.type);
+                shapeOf(member.type, shape);
+                m_out << "    " << shape.scalar.cpp << " " << member.name;
+                if (shape.rows > 1) m_out << "[" << shape.rows << "]";
+                m_out << ";\n";
+                asserts.push_back("static_assert(offsetof(" + p_struct->name + ", " + member.name + ") == " + std::to_string(offset) + ");");
+                offset += shape.rows * shape.scalar.size;
+            }
+            m_out << "};\n";
+            m_out << "static_assert(sizeof(" << p_struct->name << ") == " << offset << ");\n";
+            for (const std::string& line : asserts) m_out << line << "\n";
+        }
+    }
+
+    void emitEntryPoint(const Function& function) {
+        const Attribute *p_workgroup = findAttribute(function.attributes, "workgroup_size");
+        bool vertex = findAttribute(function.attributes, "vertex") != nullptr;
+        if (!vertex && !p_workgroup && !findAttribute(function.attributes, "fragment")) return;
+
+        m_out << "\nnamespace " << function.name << " {\n";
+        m_out << "inline constexpr const char *ENTRY_POINT = \"" << function.name << "\";\n";
+        if (p_workgroup) {
+            m_out << "inline constexpr uint32_t WORKGROUP_SIZE[3] = { ";
+            for (size_t i = 0; i < 3; i++) {
+                if (i > 0) m_out << ", ";
+                m_out << (i < p_workgroup->args.size() ? p_workgroup->args[i] : std::string("1"));
+            }
+            m_out << " };\n";
+        }
+        if (vertex) {
+            std::vector<std::string> buffers;
+            for (const Member& param : function.params) {
+                if (findAttribute(param.attributes, "builtin")) continue;
+                const Struct *p_struct = m_module.findStruct(param.type.name);
+                if (!p_struct) fail(function.name + ": vertex input " + param.name + " must be a struct, one per vertex buffer");
+                const std::string prefix = upper(param.name);
+                m_out << "inline constexpr uint32_t " << prefix << "_SLOT = " << buffers.size() << ";\n";
+                m_out << "inline constexpr WGPUVertexAttribute " << prefix << "_ATTRIBUTES[] = {\n";
+                size_t attribute_count = 0;
+                for (const Member& member : p_struct->members) {
+                    const Attribute *p_location = findAttribute(member.attributes, "location");
+                    if (!p_location) continue;
+                    m_out << "    { .format = " << vertexFormat(member.type)
+                          << ", .offset = offsetof(" << p_struct->name << ", " << member.name << ")"
+                          << ", .shaderLocation = " << p_location->args.at(0) << " },\n";
+                    attribute_count++;
+                }
+                m_out << "};\n";
+                buffers.push_back("    { .arrayStride = sizeof(" + p_struct->name + "), .stepMode = "
+                    + (param.name == "instance" ? "WGPUVertexStepMode_Instance" : "WGPUVertexStepMode_Vertex")
+                    + ", .attributeCount = " + std::to_string(attribute_count)
+                    + ", .attributes = " + prefix + "_ATTRIBUTES },");
+            }
+            if (!buffers.empty()) {
+                m_out << "inline constexpr WGPUVertexBufferLayout BUFFERS[] = {\n";
+                for (const std::string& line : buffers) m_out << line << "\n";
+                m_out << "};\n";
+            }
+            m_out << "inline constexpr size_t BUFFER_COUNT = " << buffers.size() << ";\n";
+        }
+        m_out << "} // namespace " << function.name << "\n";
+    }
+
+    // identifiers reachable from an entry point through the functions it calls
+    std::set<std::string> reachable(const Function& entry) const {
+        std::set<std::string> seen { entry.name };
+        std::set<std::string> identifiers;
+        std::vector<const Function*> stack { &entry };
+        while (!stack.empty()) {
+            const Function *p_function = stack.back();
+            stack.pop_back();
+            for (const std::string& id : p_function->identifiers) {
+                identifiers.insert(id);
+                for (const Function& callee : m_module.functions) {
+                    if (callee.name == id && seen.insert(id).second) stack.push_back(&callee);
+                }
+            }
+        }
+        return identifiers;
+    }
+
+    std::string visibility(const Variable& variable) const {
+        std::vector<std::string> stages;
+        static const std::pair<const char*, const char*> STAGES[] = {
+            { "vertex", "WGPUShaderStage_Vertex" },
+            { "fragment", "WGPUShaderStage_Fragment" },
+            { "compute", "WGPUShaderStage_Compute" },
+        };
+        for (const auto& [attribute, stage] : STAGES) {
+            for (const Function& function : m_module.functions) {
+                if (findAttribute(function.attributes, attribute) && reachable(function).count(variable.name)) {
+                    stages.push_back(stage);
+                    break;
+                }
+            }
+        }
+        if (stages.empty()) return "WGPUShaderStage_None";
+        std::string out = stages[0];
+        for (size_t i = 1; i < stages.size(); i++) out += " | " + stages[i];
+        return out;
+    }
+
+    static std::string viewDimension(const std::string& name) {
+        if (name.find("cube_array") != std::string::npos) return "WGPUTextureViewDimension_CubeArray";
+        if (name.find("cube") != std::string::npos) return "WGPUTextureViewDimension_Cube";
+        if (name.find("2d_array") != std::string::npos) return "WGPUTextureViewDimension_2DArray";
+        if (name.find("3d") != std::string::npos) return "WGPUTextureViewDimension_3D";
+        if (name.find("1d") != std::string::npos) return "WGPUTextureViewDimension_1D";
+        return "WGPUTextureViewDimension_2D";
+    }
+
+    static std::string texelFormat(const std::string& name) {
+        static const std::map<std::string, std::string> FORMATS {
+            { "rgba8unorm", "RGBA8Unorm" }, { "rgba8snorm", "RGBA8Snorm" }, { "rgba8uint", "RGBA8Uint" },
+            { "rgba8sint", "RGBA8Sint" }, { "bgra8unorm", "BGRA8Unorm" }, { "rgba16uint", "RGBA16Uint" },
+            { "rgba16sint", "RGBA16Sint" }, { "rgba16float", "RGBA16Float" }, { "r32uint", "R32Uint" },
+            { "r32sint", "R32Sint" }, { "r32float", "R32Float" }, { "rg32uint", "RG32Uint" },
+            { "rg32sint", "RG32Sint" }, { "rg32float", "RG32Float" }, { "rgba32uint", "RGBA32Uint" },
+            { "rgba32sint", "RGBA32Sint" }, { "rgba32float", "RGBA32Float" },
+        };
+        auto it = FORMATS.find(name);
+        if (it == FORMATS.end()) fail("unknown texel format " + name);
+        return "WGPUTextureFormat_" + it->second;
+    }
+
+    std::string layoutEntry(const Variable& variable, const std::string& binding) {
+        std::string entry = "{ .binding = " + binding + ", .visibility = " + visibility(variable);
+        const std::string& type = variable.type.name;
+        if (variable.address_space == "uniform" || variable.address_space == "storage") {
+            std::string binding_type = "WGPUBufferBindingType_Uniform";
+            if (variable.address_space == "storage") {
+                binding_type = variable.access == "read_write" ? "WGPUBufferBindingType_Storage" : "WGPUBufferBindingType_ReadOnlyStorage";
+            }
+            // runtime-sized data is only checked at draw time
+            Layout layout = m_layouts.of(variable.type);
+            uint32_t min_size = layout.runtime_sized ? 0 : layout.size;
+            entry += ", .buffer = { .type = " + binding_type + ", .minBindingSize = " + std::to_string(min_size) + " }";
+        } else if (type == "sampler") {
+            entry += ", .sampler = { .type = WGPUSamplerBindingType_Filtering }";
+        } else if (type == "sampler_comparison") {
+            entry += ", .sampler = { .type = WGPUSamplerBindingType_Comparison }";
+        } else if (type.compare(0, 16, "texture_storage_") == 0) {
+            const std::string& access = variable.type.args.at(1).name;
+            std::string storage_access = access == "read" ? "WGPUStorageTextureAccess_ReadOnly"
+                : access == "read_write" ? "WGPUStorageTextureAccess_ReadWrite" : "WGPUStorageTextureAccess_WriteOnly";
+            entry += ", .storageTexture = { .access = " + storage_access + ", .format = " + texelFormat(variable.type.args.at(0).name)
+                + ", .viewDimension = " + viewDimension(type) + " }";
+        } else if (type.compare(0, 8, "texture_") == 0) {
+            std::string sample_type = "WGPUTextureSampleType_Float";
+            if (type.find("depth") != std::string::npos) sample_type = "WGPUTextureSampleType_Depth";
+            else if (!variable.type.args.empty() && variable.type.args[0].name == "u32") sample_type = "WGPUTextureSampleType_Uint";
+            else if (!variable.type.args.empty() && variable.type.args[0].name == "i32") sample_type = "WGPUTextureSampleType_Sint";
+            bool multisampled = type.find("multisampled") != std::string::npos;
+            entry += ", .texture = { .sampleType = " + sample_type + ", .viewDimension = " + viewDimension(type)
+                + ", .multisampled = " + (multisampled ? "1" : "0") + " }";
+        } else {
+            fail("binding " + variable.name + " of type " + type + " is not supported");
+        }
+        return entry + " },";
+    }
+
+    void emitBindGroups() {
+        std::map<uint32_t, std::vector<std::pair<uint32_t, const Variable*>>> groups;
+        for (const Variable& variable : m_module.variables) {
+            const Attribute *p_group = findAttribute(variable.attributes, "group");
+            const Attribute *p_binding = findAttribute(variable.attributes, "binding");
+            if (!p_group || !p_binding) continue;
+            groups[std::stoul(p_group->args.at(0))].emplace_back(std::stoul(p_binding->args.at(0)), &variable);
+        }
+        for (auto& [group, bindings] : groups) {
+            std::sort(bindings.begin(), bindings.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            m_out << "\nnamespace group" << group << " {\n";
+            for (const auto& [binding, p_variable] : bindings) {
+                m_out << "inline constexpr uint32_t " << upper(p_variable->name) << " = " << binding << ";\n";
+            }
+            m_out << "inline constexpr WGPUBindGroupLayoutEntry ENTRIES[] = {\n";
+            for (const auto& [binding, p_variable] : bindings) {
+                m_out << "    " << layoutEntry(*p_variable, upper(p_variable->name)) << "\n";
+            }
+            m_out << "};\n";
+            m_out << "inline constexpr size_t ENTRY_COUNT = " << bindings.size() << ";\n";
+            m_out << "} // namespace group" << group << "\n";
+        }
+    }
+
+private:
+    const Module& m_module;
+    HostLayouts m_layouts;
+    std::string m_namespace;
+    std::ostringstream m_out;
+    std::set<std::string> m_host_structs;
+    std::set<std::string> m_vertex_structs;
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::fprintf(stderr, "usage: wgsl_reflect <input.wgsl> <output.h>\n");
+        return 1;
+    }
+    g_input_path = argv[1];
+    std::ifstream input(g_input_path, std::ios::binary);
+    if (!input) fail("cannot open");
+    std::stringstream source;
+    source << input.rdbuf();
+
+    // "path/to/skinning.wgsl" reflects into wgsl::skinning
+    std::string stem = g_input_path.substr(g_input_path.find_last_of("/\\") + 1);
+    stem = stem.substr(0, stem.find('.'));
+    for (char& c : stem) {
+        if (!std::isalnum(static_cast<unsigned char>(c))) c = '_';
+    }
+
+    Module module = Parser(tokenize(source.str())).parse();
+    std::string header = Emitter(module, stem).run();
+
+    // unchanged headers keep their timestamp, nothing recompiles
+    std::ifstream previous(argv[2], std::ios::binary);
+    std::stringstream previous_text;
+    if (previous) previous_text << previous.rdbuf();
+    if (previous && previous_text.str() == header) return 0;
+    previous.close();
+    std::ofstream output(argv[2], std::ios::binary);
+    output << header;
+    return output ? 0 : 1;
+}
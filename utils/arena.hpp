@@ -0,0 +1,70 @@
+/*
+    bump arena
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Hands out uninitialized memory from large blocks and frees it all at once.
+// Not thread safe, give each thread its own arena.
+class Arena {
+public:
+    explicit Arena(size_t block_size = 1 << 20): m_block_size(block_size) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+
+    inline void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        uintptr_t current = reinterpret_cast<uintptr_t>(m_cursor);
+        uintptr_t aligned = (current + align - 1) & ~(uintptr_t(align) - 1);
+        if (!m_cursor || aligned + size > reinterpret_cast<uintptr_t>(m_end)) {
+            // oversized requests get a block of their own
+            size_t block_size = std::max(m_block_size, size + align);
+            m_blocks.push_back(std::make_unique_for_overwrite<std::byte[]>(block_size));
+            m_cursor = m_blocks.back().get();
+            m_end = m_cursor + block_size;
+            current = reinterpret_cast<uintptr_t>(m_cursor);
+            aligned = (current + align - 1) & ~(uintptr_t(align) - 1);
+        }
+        m_cursor = reinterpret_cast<std::byte*>(aligned + size);
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    // Elements are left uninitialized.
+    template<typename T>
+    requires std::is_trivially_destructible_v<T>
+    inline std::span<T> allocateArray(size_t count) {
+        if (count == 0) return {};
+        return { static_cast<T*>(allocate(count * sizeof(T), alignof(T))), count };
+    }
+
+    inline void reset() {
+        m_blocks.clear();
+        m_cursor = m_end = nullptr;
+    }
+
+private:
+    size_t m_block_size;
+    std::vector<std::unique_ptr<std::byte[]>> m_blocks {};
+    std::byte* m_cursor { nullptr };
+    std::byte* m_end { nullptr };
+};
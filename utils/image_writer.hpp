@@ -0,0 +1,129 @@
+/*
+    image writer
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace image_writer_detail {
+
+inline const std::array<uint32_t, 256>& crcTable() {
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> t {};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    return table;
+}
+
+inline uint32_t crc32(uint32_t crc, const uint8_t *p_data, size_t length) {
+    const auto& table = crcTable();
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) crc = table[(crc ^ p_data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline void putBe32(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+inline void putChunk(std::vector<uint8_t>& out, const char type[4], const std::vector<uint8_t>& data) {
+    putBe32(out, static_cast<uint32_t>(data.size()));
+    size_t type_at = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    putBe32(out, crc32(0, out.data() + type_at, data.size() + 4));
+}
+
+} // namespace image_writer_detail
+
+// Encodes 8-bit RGBA rows as a PNG. The zlib stream uses stored blocks:
+// captures are written often and read rarely, so size is traded for never
+// stalling a worker on compression.
+inline std::vector<uint8_t> encodePng(uint32_t width, uint32_t height, const uint8_t *p_rgba, size_t row_stride) {
+    using namespace image_writer_detail;
+    constexpr size_t MAX_STORED_BLOCK = 65535;
+
+    std::vector<uint8_t> png { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+    std::vector<uint8_t> header;
+    putBe32(header, width);
+    putBe32(header, height);
+    // 8 bits per channel, RGBA, deflate, adaptive filtering, no interlace
+    header.insert(header.end(), { 8, 6, 0, 0, 0 });
+    putChunk(png, "IHDR", header);
+
+    // each row is prefixed by filter type 0
+    const size_t row_bytes = static_cast<size_t>(width) * 4;
+    std::vector<uint8_t> raw;
+    raw.reserve((row_bytes + 1) * height);
+    for (uint32_t y = 0; y < height; y++) {
+        raw.push_back(0);
+        const uint8_t *p_row = p_rgba + y * row_stride;
+        raw.insert(raw.end(), p_row, p_row + row_bytes);
+    }
+
+    std::vector<uint8_t> zlib { 0x78, 0x01 };
+    zlib.reserve(raw.size() + raw.size() / MAX_STORED_BLOCK * 5 + 16);
+    size_t offset = 0;
+    do {
+        size_t length = std::min(raw.size() - offset, MAX_STORED_BLOCK);
+        bool last = offset + length == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(length));
+        zlib.push_back(static_cast<uint8_t>(length >> 8));
+        zlib.push_back(static_cast<uint8_t>(~length));
+        zlib.push_back(static_cast<uint8_t>(~length >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+        offset += length;
+    } while (offset < raw.size());
+
+    // adler-32, reduced often enough that the sums cannot overflow
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < raw.size();) {
+        size_t end = std::min(raw.size(), i + 5552);
+        for (; i < end; i++) {
+            a += raw[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    putBe32(zlib, (b << 16) | a);
+
+    putChunk(png, "IDAT", zlib);
+    putChunk(png, "IEND", {});
+    return png;
+}
+
+inline bool writeFile(const std::string& path, const void *p_data, size_t size) {
+    FILE *p_file = std::fopen(path.c_str(), "wb");
+    if (!p_file) return false;
+    bool ok = std::fwrite(p_data, 1, size, p_file) == size;
+    return std::fclose(p_file) == 0 && ok;
+}
@@ -0,0 +1,122 @@
+/*
+    mapped file
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+// A read-only view of a whole file. Mapped where the platform has mmap, so
+// pages are only faulted in as they are touched and never copied into the
+// heap; read into memory everywhere else.
+
+#include "result.hpp"
+#include <cstddef>
+#include <fstream>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#define MAPPED_FILE_MMAP 1
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    inline MappedFile(MappedFile&& other) noexcept:
+        m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0)),
+        m_mapped(std::exchange(other.m_mapped, false)), m_copy(std::move(other.m_copy)) {}
+
+    inline MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            m_data = std::exchange(other.m_data, nullptr);
+            m_size = std::exchange(other.m_size, 0);
+            m_mapped = std::exchange(other.m_mapped, false);
+            m_copy = std::move(other.m_copy);
+        }
+        return *this;
+    }
+
+    inline ~MappedFile() { unmap(); }
+
+    inline static Result<MappedFile, std::string> open(const std::string& path) {
+        MappedFile file;
+#if MAPPED_FILE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return Err { path + ": " + std::strerror(errno) };
+        struct stat info {};
+        if (fstat(fd, &info) < 0) {
+            std::string error = path + ": " + std::strerror(errno);
+            close(fd);
+            return Err { std::move(error) };
+        }
+        file.m_size = static_cast<size_t>(info.st_size);
+        if (file.m_size > 0) {
+            void *p_data = mmap(nullptr, file.m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p_data == MAP_FAILED) {
+                std::string error = path + ": " + std::strerror(errno);
+                close(fd);
+                return Err { std::move(error) };
+            }
+            file.m_data = static_cast<const std::byte*>(p_data);
+            file.m_mapped = true;
+        }
+        // the mapping keeps its own reference to the file
+        close(fd);
+#else
+        std::ifstream stream(path, std::ios::binary | std::ios::ate);
+        if (!stream) return Err { path + ": cannot open" };
+        std::streamsize size = stream.tellg();
+        if (size < 0) return Err { path + ": cannot size" };
+        file.m_copy.resize(static_cast<size_t>(size));
+        stream.seekg(0);
+        if (size > 0 && !stream.read(reinterpret_cast<char*>(file.m_copy.data()), size)) return Err { path + ": cannot read" };
+        file.m_data = file.m_copy.data();
+        file.m_size = file.m_copy.size();
+#endif
+        return Ok { std::move(file) };
+    }
+
+    inline std::span<const std::byte> bytes() const { return { m_data, m_size }; }
+    // false when the platform fell back to reading the file
+    inline bool mapped() const { return m_mapped; }
+
+private:
+    inline void unmap() {
+#if MAPPED_FILE_MMAP
+        if (m_mapped) munmap(const_cast<std::byte*>(m_data), m_size);
+#endif
+        m_data = nullptr;
+        m_size = 0;
+        m_mapped = false;
+        m_copy.clear();
+    }
+
+private:
+    const std::byte *m_data { nullptr };
+    size_t m_size { 0 };
+    bool m_mapped { false };
+    // backing store without mmap
+    std::vector<std::byte> m_copy {};
+};
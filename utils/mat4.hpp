@@ -0,0 +1,96 @@
+/*
+    4x4 matrix helpers
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <utility>
+
+// Column-major float[16], the layout of a WGSL mat4x4f. Views are
+// right-handed looking down -z, projections map depth to WebGPU's 0..1.
+
+// out = a * b, out must not alias a or b
+inline void mat4Multiply(const float *a, const float *b, float *out) {
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            out[c * 4 + r] = a[r] * b[c * 4] + a[4 + r] * b[c * 4 + 1] + a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+        }
+    }
+}
+
+// Gauss-Jordan with partial pivoting, the identity for a singular matrix
+inline void mat4Invert(const float *m, float *out) {
+    double a[4][8];
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            a[r][c] = m[c * 4 + r];
+            a[r][c + 4] = r == c ? 1.0 : 0.0;
+        }
+    }
+    for (int c = 0; c < 4; c++) {
+        int pivot = c;
+        for (int r = c + 1; r < 4; r++) {
+            if (std::fabs(a[r][c]) > std::fabs(a[pivot][c])) pivot = r;
+        }
+        if (std::fabs(a[pivot][c]) < 1e-12) {
+            for (int i = 0; i < 16; i++) out[i] = i % 5 == 0 ? 1.0f : 0.0f;
+            return;
+        }
+        std::swap(a[c], a[pivot]);
+        double scale = 1.0 / a[c][c];
+        for (int k = 0; k < 8; k++) a[c][k] *= scale;
+        for (int r = 0; r < 4; r++) {
+            if (r == c) continue;
+            double factor = a[r][c];
+            for (int k = 0; k < 8; k++) a[r][k] -= factor * a[c][k];
+        }
+    }
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) out[c * 4 + r] = static_cast<float>(a[r][c + 4]);
+    }
+}
+
+// `up` must not be parallel to the view direction
+inline void mat4LookAt(const float eye[3], const float target[3], const float up[3], float out[16]) {
+    auto normalize = [](float v[3]) {
+        float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (length <= 0.0f) return;
+        for (int i = 0; i < 3; i++) v[i] /= length;
+    };
+    float z[3] = { eye[0] - target[0], eye[1] - target[1], eye[2] - target[2] };
+    normalize(z);
+    float x[3] = { up[1] * z[2] - up[2] * z[1], up[2] * z[0] - up[0] * z[2], up[0] * z[1] - up[1] * z[0] };
+    normalize(x);
+    float y[3] = { z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0] };
+    const float *axes[3] = { x, y, z };
+    for (int r = 0; r < 3; r++) {
+        out[r] = axes[r][0];
+        out[4 + r] = axes[r][1];
+        out[8 + r] = axes[r][2];
+        out[12 + r] = -(axes[r][0] * eye[0] + axes[r][1] * eye[1] + axes[r][2] * eye[2]);
+    }
+    out[3] = out[7] = out[11] = 0.0f;
+    out[15] = 1.0f;
+}
+
+inline void mat4Perspective(float fov_y, float aspect, float near_plane, float far_plane, float out[16]) {
+    const float f = 1.0f / std::tan(fov_y * 0.5f);
+    for (int i = 0; i < 16; i++) out[i] = 0.0f;
+    out[0] = f / aspect;
+    out[5] = f;
+    out[10] = far_plane / (near_plane - far_plane);
+    out[11] = -1.0f;
+    out[14] = near_plane * far_plane / (near_plane - far_plane);
+}
@@ -0,0 +1,216 @@
+/*
+    metrics
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+// Counters, gauges and histograms are plain relaxed atomics, so recording
+// never blocks. The registry lock is only taken to register a series and to
+// serialize a scrape, both off the hot path.
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace metrics {
+
+class Counter {
+public:
+    inline void add(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    inline uint64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> m_value { 0 };
+};
+
+class Gauge {
+public:
+    inline void set(double value) { m_value.store(value, std::memory_order_relaxed); }
+    inline double value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> m_value { 0.0 };
+};
+
+// Fixed upper bounds, ascending. Buckets are kept per bound and only made
+// cumulative when written, so an observation touches one bucket and the sum.
+class Histogram {
+public:
+    explicit Histogram(std::span<const double> bounds):
+        m_bounds(bounds.begin(), bounds.end()),
+        m_buckets(std::make_unique<std::atomic<uint64_t>[]>(bounds.size() + 1)) {}
+
+    inline void observe(double value) {
+        size_t bucket = 0;
+        while (bucket < m_bounds.size() && value > m_bounds[bucket]) bucket++;
+        m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        // the sum is kept in nanounits, an atomic double has no fetch_add here
+        m_sum_nano.fetch_add(static_cast<int64_t>(std::llround(value * 1e9)), std::memory_order_relaxed);
+    }
+
+    inline std::span<const double> bounds() const { return m_bounds; }
+    // the last bucket is +Inf
+    inline uint64_t bucket(size_t i) const { return m_buckets[i].load(std::memory_order_relaxed); }
+    inline double sum() const { return static_cast<double>(m_sum_nano.load(std::memory_order_relaxed)) * 1e-9; }
+
+private:
+    std::vector<double> m_bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_buckets;
+    std::atomic<int64_t> m_sum_nano { 0 };
+};
+
+// Seconds, spanning a 1000 Hz frame to a multi-frame hitch.
+inline constexpr double FRAME_SECONDS_BUCKETS[] = {
+    0.001, 0.002, 0.004, 0.006, 0.008, 0.010, 0.0125, 0.0167, 0.020, 0.025, 0.0333, 0.050, 0.100, 0.250,
+};
+
+class Registry {
+public:
+    // `labels` is written between the braces as given, e.g. `category="geometry"`.
+    // Series of one name share its help text and type. The returned
+    // reference lives as long as the registry.
+    inline Counter& counter(const std::string& name, const std::string& help, const std::string& labels = {}) {
+        std::lock_guard lock(m_mutex);
+        Series& series = family(name, help, Type::Counter).series.emplace_back();
+        series.labels = labels;
+        series.counter = std::make_unique<Counter>();
+        return *series.counter;
+    }
+
+    inline Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = {}) {
+        std::lock_guard lock(m_mutex);
+        Series& series = family(name, help, Type::Gauge).series.emplace_back();
+        series.labels = labels;
+        series.gauge = std::make_unique<Gauge>();
+        return *series.gauge;
+    }
+
+    inline Histogram& histogram(const std::string& name, const std::string& help, std::span<const double> bounds,
+        const std::string& labels = {}) {
+        std::lock_guard lock(m_mutex);
+        Series& series = family(name, help, Type::Histogram).series.emplace_back();
+        series.labels = labels;
+        series.histogram = std::make_unique<Histogram>(bounds);
+        return *series.histogram;
+    }
+
+    // Prometheus text exposition format, version 0.0.4.
+    inline void write(std::ostream& out) const {
+        std::lock_guard lock(m_mutex);
+        out.precision(9);
+        for (const Family& family : m_families) {
+            out << "# HELP " << family.name << ' ' << family.help << '\n';
+            out << "# TYPE " << family.name << ' ' << typeName(family.type) << '\n';
+            for (const Series& series : family.series) {
+                switch (family.type) {
+                    case Type::Counter: {
+                        writeName(out, family.name, "", series.labels);
+                        out << ' ' << series.counter->value() << '\n';
+                        break;
+                    }
+                    case Type::Gauge: {
+                        writeName(out, family.name, "", series.labels);
+                        out << ' ' << series.gauge->value() << '\n';
+                        break;
+                    }
+                    case Type::Histogram: {
+                        writeHistogram(out, family.name, series);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    enum class Type : uint8_t {
+        Counter, Gauge, Histogram,
+    };
+
+    struct Series {
+        std::string labels;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+    };
+
+    struct Family {
+        std::string name;
+        std::string help;
+        Type type;
+        std::vector<Series> series;
+    };
+
+    inline Family& family(const std::string& name, const std::string& help, Type type) {
+        for (Family& family : m_families) {
+            if (family.name == name) return family;
+        }
+        return m_families.emplace_back(Family { name, help, type, {} });
+    }
+
+    inline static const char *typeName(Type type) {
+        switch (type) {
+            case Type::Counter: return "counter";
+            case Type::Gauge: return "gauge";
+            case Type::Histogram: return "histogram";
+        }
+        return "untyped";
+    }
+
+    inline static void writeName(std::ostream& out, const std::string& name, const char *suffix,
+        const std::string& labels, const char *extra_label = nullptr) {
+        out << name << suffix;
+        if (labels.empty() && !extra_label) return;
+        out << '{' << labels;
+        if (extra_label) out << (labels.empty() ? "" : ",") << extra_label;
+        out << '}';
+    }
+
+    inline static void writeHistogram(std::ostream& out, const std::string& name, const Series& series) {
+        const Histogram& histogram = *series.histogram;
+        std::span<const double> bounds = histogram.bounds();
+        uint64_t cumulative = 0;
+        std::string le;
+        for (size_t i = 0; i <= bounds.size(); i++) {
+            cumulative += histogram.bucket(i);
+            le = i < bounds.size() ? "le=\"" + formatBound(bounds[i]) + "\"" : "le=\"+Inf\"";
+            writeName(out, name, "_bucket", series.labels, le.c_str());
+            out << ' ' << cumulative << '\n';
+        }
+        writeName(out, name, "_sum", series.labels);
+        out << ' ' << histogram.sum() << '\n';
+        // from the buckets, so the count always matches the +Inf bucket
+        writeName(out, name, "_count", series.labels);
+        out << ' ' << cumulative << '\n';
+    }
+
+    inline static std::string formatBound(double bound) {
+        std::string text = std::to_string(bound);
+        while (text.size() > 1 && text.back() == '0') text.pop_back();
+        if (text.back() == '.') text.pop_back();
+        return text;
+    }
+
+private:
+    mutable std::mutex m_mutex {};
+    std::vector<Family> m_families {};
+};
+
+} // namespace metrics
@@ -0,0 +1,208 @@
+/*
+    task graph
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// One-shot dependency graph. Tasks run as soon as everything they depend on
+// has finished, on the pool or, for Affinity::Main, on the thread calling
+// run(). A task can only depend on tasks added before it, add() throws
+// otherwise, so the graph is acyclic by construction. Names must outlive the
+// graph (string literals).
+class TaskGraph {
+public:
+    using TaskId = uint32_t;
+
+    enum class Affinity : uint8_t {
+        Any, Main,
+    };
+
+    inline TaskId add(const char *name, std::function<void()> body,
+        std::initializer_list<TaskId> dependencies = {}, Affinity affinity = Affinity::Any) {
+        TaskId id = static_cast<TaskId>(m_tasks.size());
+        // what keeps the graph acyclic, checked before anything is added
+        for (TaskId dependency : dependencies) {
+            if (dependency >= id) {
+                throw std::invalid_argument(std::string("task ") + name + " depends on task "
+                    + std::to_string(dependency) + ", which was not added before it");
+            }
+        }
+        Task& task = m_tasks.emplace_back();
+        task.name = name;
+        task.body = std::move(body);
+        task.affinity = affinity;
+        for (TaskId dependency : dependencies) {
+            m_tasks[dependency].dependents.push_back(id);
+            task.dependency_count++;
+        }
+        return id;
+    }
+
+    // Blocks until every task has run. The first exception thrown by a task
+    // cancels the tasks that have not started yet and is rethrown here.
+    inline void run(ThreadPool& pool) {
+        auto state = std::make_shared<RunState>();
+        state->graph = this;
+        state->pool = &pool;
+        state->remaining = m_tasks.size();
+        state->pending.reset(new std::atomic<uint32_t>[m_tasks.size()]);
+        for (size_t i = 0; i < m_tasks.size(); i++) {
+            state->pending[i].store(m_tasks[i].dependency_count, std::memory_order_relaxed);
+        }
+
+        m_begin_ns = now();
+        for (TaskId id = 0; id < m_tasks.size(); id++) {
+            if (m_tasks[id].dependency_count == 0) dispatch(state, id);
+        }
+
+        for (;;) {
+            TaskId id;
+            {
+                std::unique_lock lock(state->mutex);
+                state->cv.wait(lock, [&]() { return state->remaining == 0 || !state->main_ready.empty(); });
+                if (state->main_ready.empty()) break;
+                id = state->main_ready.front();
+                state->main_ready.pop_front();
+            }
+            execute(state, id, true);
+        }
+        m_end_ns = now();
+
+        if (state->error) std::rethrow_exception(state->error);
+    }
+
+    inline double wallMs() const { return static_cast<double>(m_end_ns - m_begin_ns) / 1e6; }
+
+    // Per-task start, duration and a bar chart of the run.
+    inline void report(std::ostream& out) const {
+        constexpr int BAR_WIDTH = 40;
+        double wall_ms = std::max(wallMs(), 1e-6);
+        char line[160];
+        std::snprintf(line, sizeof(line), "startup timeline, %.2f ms total\n", wallMs());
+        out << line;
+        std::snprintf(line, sizeof(line), "  %-24s %-6s %9s %9s\n", "task", "thread", "start ms", "ms");
+        out << line;
+        for (const Task& task : m_tasks) {
+            double start_ms = static_cast<double>(task.begin_ns - m_begin_ns) / 1e6;
+            double duration_ms = static_cast<double>(task.end_ns - task.begin_ns) / 1e6;
+            int bar_begin = std::clamp(static_cast<int>(start_ms / wall_ms * BAR_WIDTH), 0, BAR_WIDTH - 1);
+            int bar_end = std::clamp(static_cast<int>((start_ms + duration_ms) / wall_ms * BAR_WIDTH), bar_begin + 1, BAR_WIDTH);
+            char bar[BAR_WIDTH + 1];
+            for (int i = 0; i < BAR_WIDTH; i++) {
+                bar[i] = i >= bar_begin && i < bar_end ? '#' : ' ';
+            }
+            bar[BAR_WIDTH] = '\0';
+            std::snprintf(line, sizeof(line), "  %-24s %-6s %9.2f %9.2f |%s|\n",
+                task.name, !task.ran ? "-" : (task.on_main ? "main" : "pool"), start_ms, duration_ms, bar);
+            out << line;
+        }
+    }
+
+private:
+    struct Task {
+        const char *name { nullptr };
+        std::function<void()> body {};
+        std::vector<TaskId> dependents {};
+        uint32_t dependency_count { 0 };
+        Affinity affinity { Affinity::Any };
+        bool on_main { false };
+        bool ran { false };
+        uint64_t begin_ns { 0 };
+        uint64_t end_ns { 0 };
+    };
+
+    // shared with pool tasks, which may still be unwinding after run() returns
+    struct RunState {
+        TaskGraph *graph { nullptr };
+        ThreadPool *pool { nullptr };
+        std::unique_ptr<std::atomic<uint32_t>[]> pending {};
+        std::mutex mutex {};
+        std::condition_variable cv {};
+        std::deque<TaskId> main_ready {};
+        size_t remaining { 0 };
+        std::exception_ptr error {};
+        std::atomic<bool> failed { false };
+    };
+
+    inline static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+
+    inline static void dispatch(const std::shared_ptr<RunState>& state, TaskId id) {
+        if (state->graph->m_tasks[id].affinity == Affinity::Main) {
+            {
+                std::lock_guard lock(state->mutex);
+                state->main_ready.push_back(id);
+            }
+            state->cv.notify_all();
+            return;
+        }
+        state->pool->submit([state, id]() { execute(state, id, false); });
+    }
+
+    inline static void execute(const std::shared_ptr<RunState>& state, TaskId id, bool on_main) {
+        Task& task = state->graph->m_tasks[id];
+        task.on_main = on_main;
+        task.begin_ns = now();
+        if (!state->failed.load(std::memory_order_acquire)) {
+            TRACE_ZONE(task.name);
+            try {
+                task.body();
+                task.ran = true;
+            } catch (...) {
+                std::lock_guard lock(state->mutex);
+                if (!state->error) state->error = std::current_exception();
+                state->failed.store(true, std::memory_order_release);
+            }
+        }
+        task.end_ns = now();
+
+        for (TaskId dependent : task.dependents) {
+            if (state->pending[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                dispatch(state, dependent);
+            }
+        }
+        {
+            std::lock_guard lock(state->mutex);
+            state->remaining--;
+        }
+        state->cv.notify_all();
+    }
+
+private:
+    std::vector<Task> m_tasks {};
+    uint64_t m_begin_ns { 0 };
+    uint64_t m_end_ns { 0 };
+};
@@ -0,0 +1,140 @@
+/*
+    thread pool
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned thread_count) {
+        for (unsigned i = 0; i < thread_count; i++) {
+            m_workers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    inline ~ThreadPool() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    // Shared pool sized to leave one core for the calling thread.
+    inline static ThreadPool& global() {
+        static ThreadPool pool { std::max(std::thread::hardware_concurrency(), 2u) - 1 };
+        return pool;
+    }
+
+    inline unsigned size() const { return static_cast<unsigned>(m_workers.size()); }
+
+    template<typename Func, typename R = std::invoke_result_t<std::decay_t<Func>>>
+    inline std::future<R> submit(Func&& f) {
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<Func>(f));
+        std::future<R> future = task->get_future();
+        {
+            std::lock_guard lock(m_mutex);
+            m_tasks.emplace_back([task]() { (*task)(); });
+        }
+        m_cv.notify_one();
+        return future;
+    }
+
+    // Runs f(i) for every i in [0, count) and returns once all have finished.
+    // The calling thread takes part, so nesting inside a task cannot deadlock.
+    template<typename Func>
+    inline void parallelFor(size_t count, Func&& f) {
+        if (count == 0) return;
+        if (count == 1 || m_workers.empty()) {
+            for (size_t i = 0; i < count; i++) f(i);
+            return;
+        }
+
+        struct State {
+            std::atomic<size_t> next { 0 };
+            std::atomic<size_t> done { 0 };
+            size_t count;
+            std::function<void(size_t)> body;
+        };
+        // helpers that start after the last index was claimed only touch the
+        // shared state, never `f`, which lives on our stack
+        auto state = std::make_shared<State>();
+        state->count = count;
+        state->body = [&f](size_t i) { f(i); };
+
+        auto run = [](State& s) {
+            for (size_t i = s.next.fetch_add(1); i < s.count; i = s.next.fetch_add(1)) {
+                s.body(i);
+                if (s.done.fetch_add(1) + 1 == s.count) {
+                    s.done.notify_all();
+                }
+            }
+        };
+
+        size_t helpers = std::min<size_t>(m_workers.size(), count - 1);
+        {
+            std::lock_guard lock(m_mutex);
+            for (size_t i = 0; i < helpers; i++) {
+                m_tasks.emplace_back([state, run]() { run(*state); });
+            }
+        }
+        m_cv.notify_all();
+
+        run(*state);
+        for (size_t done = state->done.load(); done < count; done = state->done.load()) {
+            state->done.wait(done);
+        }
+    }
+
+private:
+    inline void workerLoop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(m_mutex);
+                m_cv.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+                if (m_stopping && m_tasks.empty()) return;
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+private:
+    std::vector<std::thread> m_workers {};
+    std::deque<std::function<void()>> m_tasks {};
+    std::mutex m_mutex {};
+    std::condition_variable m_cv {};
+    bool m_stopping { false };
+};
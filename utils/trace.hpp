@@ -0,0 +1,242 @@
+/*
+    scoped tracing
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+// Zones and counters are recorded into per-thread single-producer rings and
+// only serialized when TRACE_FLUSH is called. Without NOCTURNE_TRACE every
+// macro expands to nothing.
+
+#if NOCTURNE_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace trace {
+
+enum class EventType : uint8_t {
+    Zone, Counter,
+};
+
+struct Event {
+    const char* name;
+    uint64_t begin_ns;
+    uint64_t end_ns;
+    double value;
+    EventType type;
+};
+
+inline uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+// Taken during static initialization, so zones opened before the tracer is
+// first touched still land at non-negative timestamps.
+inline const uint64_t process_epoch_ns = now();
+
+class ThreadBuffer {
+public:
+    inline static constexpr size_t CAPACITY = 1 << 16;
+
+    ThreadBuffer(uint32_t tid): m_tid(tid) {}
+
+    // Owner thread only. When the consumer falls behind the newest event is
+    // dropped, so the reader never sees a slot being overwritten.
+    inline void push(const Event& event) {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        uint64_t tail = m_tail.load(std::memory_order_acquire);
+        if (head - tail >= CAPACITY) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        m_events[head & (CAPACITY - 1)] = event;
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    template<typename Func>
+    inline void drain(Func&& f) {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        for (; tail != head; tail++) {
+            f(m_events[tail & (CAPACITY - 1)]);
+        }
+        m_tail.store(tail, std::memory_order_release);
+    }
+
+    inline uint32_t tid() const { return m_tid; }
+    inline const char* name() const { return m_name.load(std::memory_order_acquire); }
+    inline void setName(const char* name) { m_name.store(name, std::memory_order_release); }
+    inline uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    alignas(64) std::atomic<uint64_t> m_head { 0 };
+    alignas(64) std::atomic<uint64_t> m_tail { 0 };
+    std::atomic<uint64_t> m_dropped { 0 };
+    std::atomic<const char*> m_name { nullptr };
+    uint32_t m_tid;
+    Event m_events[CAPACITY];
+};
+
+class Tracer {
+public:
+    inline static Tracer& instance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    inline ThreadBuffer& local() {
+        thread_local ThreadBuffer* buffer = registerThread();
+        return *buffer;
+    }
+
+    // Drains every thread's ring into a Chrome trace JSON file, which both
+    // chrome://tracing and ui.perfetto.dev open. Drained events are consumed,
+    // so consecutive flushes produce disjoint captures.
+    inline bool flush(std::string_view path) {
+        std::lock_guard lock(m_mutex);
+        std::ofstream out { std::string(path) };
+        if (!out) return false;
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        auto separator = [&]() {
+            if (!first) out << ",\n";
+            first = false;
+        };
+        for (auto& buffer : m_buffers) {
+            if (buffer->name()) {
+                separator();
+                out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->tid()
+                    << ",\"args\":{\"name\":";
+                writeString(out, buffer->name());
+                out << "}}";
+            }
+            buffer->drain([&](const Event& event) {
+                separator();
+                out << "{\"name\":";
+                writeString(out, event.name);
+                out << ",\"pid\":1,\"tid\":" << buffer->tid()
+                    << ",\"ts\":" << toMicros(sinceEpoch(event.begin_ns));
+                switch (event.type) {
+                    case EventType::Zone: {
+                        out << ",\"ph\":\"X\",\"dur\":" << toMicros(event.end_ns - event.begin_ns) << '}';
+                        break;
+                    }
+                    case EventType::Counter: {
+                        out << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+                        break;
+                    }
+                }
+            });
+            if (buffer->dropped()) {
+                separator();
+                out << "{\"ph\":\"C\",\"name\":\"trace dropped events\",\"pid\":1,\"tid\":" << buffer->tid()
+                    << ",\"ts\":" << toMicros(sinceEpoch(now()))
+                    << ",\"args\":{\"value\":" << buffer->dropped() << "}}";
+            }
+        }
+        out << "]}\n";
+        return static_cast<bool>(out);
+    }
+
+private:
+    Tracer() = default;
+
+    inline ThreadBuffer* registerThread() {
+        std::lock_guard lock(m_mutex);
+        auto buffer = std::make_unique<ThreadBuffer>(static_cast<uint32_t>(m_buffers.size() + 1));
+        m_buffers.push_back(std::move(buffer));
+        return m_buffers.back().get();
+    }
+
+    inline static uint64_t sinceEpoch(uint64_t ns) {
+        return ns > process_epoch_ns ? ns - process_epoch_ns : 0;
+    }
+
+    inline static double toMicros(uint64_t ns) {
+        return static_cast<double>(ns) / 1000.0;
+    }
+
+    inline static void writeString(std::ostream& out, std::string_view str) {
+        out << '"';
+        for (char c : str) {
+            if (c == '"' || c == '\\') out << '\\';
+            out << c;
+        }
+        out << '"';
+    }
+
+private:
+    std::mutex m_mutex;
+    // buffers outlive their threads so late flushes still see their events
+    std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+};
+
+class Zone {
+public:
+    inline Zone(const char* name): m_name(name), m_begin_ns(now()) {}
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+    inline ~Zone() {
+        Tracer::instance().local().push(Event {
+            .name = m_name,
+            .begin_ns = m_begin_ns,
+            .end_ns = now(),
+            .value = 0.0,
+            .type = EventType::Zone
+        });
+    }
+private:
+    const char* m_name;
+    uint64_t m_begin_ns;
+};
+
+inline void counter(const char* name, double value) {
+    uint64_t ts = now();
+    Tracer::instance().local().push(Event {
+        .name = name,
+        .begin_ns = ts,
+        .end_ns = ts,
+        .value = value,
+        .type = EventType::Counter
+    });
+}
+
+} // namespace trace
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+// `name` must outlive the tracer, string literals are expected
+#define TRACE_ZONE(name) ::trace::Zone TRACE_CONCAT(trace_zone_, __LINE__) { name }
+#define TRACE_COUNTER(name, value) ::trace::counter(name, static_cast<double>(value))
+#define TRACE_THREAD_NAME(name) ::trace::Tracer::instance().local().setName(name)
+#define TRACE_FLUSH(path) ::trace::Tracer::instance().flush(path)
+
+#else
+
+#define TRACE_ZONE(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_FLUSH(path) ((void)0)
+
+#endif // NOCTURNE_TRACE
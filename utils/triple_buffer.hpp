@@ -0,0 +1,63 @@
+/*
+    triple buffer
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+// Hands the latest value from one writer thread to one reader thread
+// without either ever waiting. The writer fills back() and publishes it;
+// the reader picks up whatever was published last and keeps reading it
+// until something newer arrives. Values in between are skipped.
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() = default;
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // Writer side. Holds whatever the writer published two values ago, so
+    // its storage can be reused.
+    inline T& back() { return m_buffers[m_back]; }
+
+    inline void publish() {
+        uint8_t previous = m_middle.exchange(static_cast<uint8_t>(m_back | FRESH), std::memory_order_acq_rel);
+        m_back = previous & INDEX;
+    }
+
+    // Reader side. Swaps in the newest value, false when nothing was
+    // published since the last call and front() is unchanged.
+    inline bool acquire() {
+        if (!(m_middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & INDEX;
+        return true;
+    }
+
+    inline const T& front() const { return m_buffers[m_front]; }
+
+private:
+    inline static constexpr uint8_t INDEX = 3;
+    inline static constexpr uint8_t FRESH = 4;
+
+    std::array<T, 3> m_buffers {};
+    uint8_t m_back { 0 };
+    // index of the buffer between the two, FRESH until the reader takes it
+    std::atomic<uint8_t> m_middle { 1 };
+    uint8_t m_front { 2 };
+};
@@ -0,0 +1,78 @@
+/*
+    event_script.hpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include "export_api.h"
+#include "window.hpp"
+#include <cstdint>
+#include <memory>
+#include <result.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ScriptedEvent {
+    uint64_t frame;
+    WindowEvent event;
+};
+
+// Window events keyed by the frame they arrive in. A frame ends each time
+// pollEvent() returns None, so replaying a script into the same loop gives
+// the same input timeline on every run. The text form is one event a line:
+//
+//   <frame> close
+//   <frame> resize <w> <h>
+//   <frame> key <code> down|up
+//   <frame> motion <x> <y>
+//   <frame> button <button> down|up <x> <y>
+//
+// Lines starting with '#' are comments. Frames never decrease.
+class WINDOW_LIB_API EventScript {
+public:
+    static Result<EventScript, void> parse(std::string_view text);
+    static Result<EventScript, void> load(const std::string& path);
+
+    std::string serialize() const;
+    bool save(const std::string& path) const;
+
+    // Events of one frame keep the order they were appended in.
+    void append(uint64_t frame, const WindowEvent& event);
+
+    inline const std::vector<ScriptedEvent>& events() const { return m_events; }
+
+private:
+    std::vector<ScriptedEvent> m_events {};
+};
+
+// Forwards the events of `window` and writes them to `path` as a script
+// when destroyed, so a session in a real window can be replayed later.
+class WINDOW_LIB_API EventRecorder: public Window {
+public:
+    EventRecorder(std::unique_ptr<Window> window, std::string path);
+    ~EventRecorder() override;
+
+    WindowDisplay getDisplay() const override;
+    WindowEvent pollEvent() override;
+    const WindowConfig& getConfig() const override;
+
+    inline const EventScript& script() const { return m_script; }
+
+private:
+    std::unique_ptr<Window> m_window;
+    std::string m_path;
+    EventScript m_script {};
+    uint64_t m_frame { 0 };
+};
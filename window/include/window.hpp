@@ -36,6 +36,8 @@ END_BIT_TAGS;
 enum class WindowType {
     SDL3,
     GLFW,
+    // no display, windows only replay an event script
+    Null,
 };
 
 struct WindowConfig {
@@ -45,9 +47,10 @@ struct WindowConfig {
 };
 
 enum class WindowEventType {
-    None, Close,
+    None, Close, Resize, Key, MouseMotion, MouseButton,
 };
 
+// pollEvent() returns None once the events of the current frame are drained
 struct WindowEvent {
     struct None {};
     struct Close {};
@@ -56,12 +59,31 @@ struct WindowEvent {
         int w, h;
     };
 
+    struct Key {
+        // SDL keycode
+        uint32_t code;
+        bool down;
+    };
+
+    struct MouseMotion {
+        float x, y;
+    };
+
+    struct MouseButton {
+        uint8_t button;
+        bool down;
+        float x, y;
+    };
+
     WindowEventType type;
 
     union {
         None none_info;
         Close close_info;
         Resize resize_info;
+        Key key_info;
+        MouseMotion motion_info;
+        MouseButton button_info;
     };
 };
 
@@ -69,7 +91,9 @@ struct WindowDisplay {
     enum class Type {
         HWND,
         X11,
-        Wayland
+        Wayland,
+        // nothing to present to
+        None
     };
 
     struct HWND {
@@ -116,7 +140,12 @@ public:
     virtual ~WindowSystem() = default;
 };
 
+class EventScript;
+
 class WINDOW_LIB_API WindowSystemFactory {
 public:
     static Result<std::unique_ptr<WindowSystem>, void> create(WindowType type);
+
+    // A WindowType::Null system whose windows replay `script`.
+    static Result<std::unique_ptr<WindowSystem>, void> createNull(EventScript script);
 };
\ No newline at end of file
@@ -0,0 +1,154 @@
+/*
+    event_script.cpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#include "event_script.hpp"
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+bool parseState(std::istream& in, bool& down) {
+    std::string state;
+    in >> state;
+    if (state == "down") down = true;
+    else if (state == "up") down = false;
+    else return false;
+    return true;
+}
+
+} // namespace
+
+Result<EventScript, void> EventScript::parse(std::string_view text) {
+    EventScript script;
+    std::istringstream lines { std::string(text) };
+    std::string line;
+    uint64_t last_frame = 0;
+    while (std::getline(lines, line)) {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') continue;
+
+        std::istringstream in(line);
+        uint64_t frame;
+        std::string kind;
+        if (!(in >> frame >> kind) || frame < last_frame) return Err{};
+        last_frame = frame;
+
+        WindowEvent event {};
+        bool ok = true;
+        if (kind == "close") {
+            event.type = WindowEventType::Close;
+            event.close_info = WindowEvent::Close{};
+        } else if (kind == "resize") {
+            event.type = WindowEventType::Resize;
+            ok = static_cast<bool>(in >> event.resize_info.w >> event.resize_info.h);
+        } else if (kind == "key") {
+            event.type = WindowEventType::Key;
+            ok = static_cast<bool>(in >> event.key_info.code) && parseState(in, event.key_info.down);
+        } else if (kind == "motion") {
+            event.type = WindowEventType::MouseMotion;
+            ok = static_cast<bool>(in >> event.motion_info.x >> event.motion_info.y);
+        } else if (kind == "button") {
+            event.type = WindowEventType::MouseButton;
+            unsigned button;
+            ok = static_cast<bool>(in >> button) && parseState(in, event.button_info.down)
+                && static_cast<bool>(in >> event.button_info.x >> event.button_info.y);
+            event.button_info.button = static_cast<uint8_t>(button);
+        } else {
+            ok = false;
+        }
+        if (!ok) return Err{};
+        script.m_events.push_back({ frame, event });
+    }
+    return Ok { std::move(script) };
+}
+
+Result<EventScript, void> EventScript::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return Err{};
+    std::ostringstream text;
+    text << file.rdbuf();
+    return parse(text.str());
+}
+
+std::string EventScript::serialize() const {
+    std::ostringstream out;
+    // mouse positions must read back bit for bit
+    out << std::setprecision(std::numeric_limits<float>::max_digits10);
+    for (const ScriptedEvent& scripted : m_events) {
+        const WindowEvent& event = scripted.event;
+        out << scripted.frame << ' ';
+        switch (event.type) {
+            case WindowEventType::Close:
+                out << "close";
+                break;
+            case WindowEventType::Resize:
+                out << "resize " << event.resize_info.w << ' ' << event.resize_info.h;
+                break;
+            case WindowEventType::Key:
+                out << "key " << event.key_info.code << (event.key_info.down ? " down" : " up");
+                break;
+            case WindowEventType::MouseMotion:
+                out << "motion " << event.motion_info.x << ' ' << event.motion_info.y;
+                break;
+            case WindowEventType::MouseButton:
+                out << "button " << unsigned(event.button_info.button) << (event.button_info.down ? " down " : " up ")
+                    << event.button_info.x << ' ' << event.button_info.y;
+                break;
+            case WindowEventType::None:
+                break;
+        }
+        out << '\n';
+    }
+    return out.str();
+}
+
+bool EventScript::save(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+    file << serialize();
+    return static_cast<bool>(file);
+}
+
+void EventScript::append(uint64_t frame, const WindowEvent& event) {
+    if (event.type == WindowEventType::None) return;
+    m_events.push_back({ frame, event });
+}
+
+EventRecorder::EventRecorder(std::unique_ptr<Window> window, std::string path):
+    m_window(std::move(window)), m_path(std::move(path)) {}
+
+EventRecorder::~EventRecorder() {
+    m_script.save(m_path);
+}
+
+WindowDisplay EventRecorder::getDisplay() const {
+    return m_window->getDisplay();
+}
+
+WindowEvent EventRecorder::pollEvent() {
+    WindowEvent event = m_window->pollEvent();
+    if (event.type == WindowEventType::None) {
+        m_frame++;
+    } else {
+        m_script.append(m_frame, event);
+    }
+    return event;
+}
+
+const WindowConfig& EventRecorder::getConfig() const {
+    return m_window->getConfig();
+}
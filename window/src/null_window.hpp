@@ -0,0 +1,82 @@
+/*
+    null_window.hpp
+    Copyright (C) 2025 zlc-dev
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+*/
+
+#pragma once
+
+#include <memory>
+#include "event_script.hpp"
+#include "result.hpp"
+#include "window.hpp"
+
+// A window without a display. It keeps the configured size, has no surface
+// and hands out the events of its script at their frames. Once the script
+// runs out every frame is empty.
+class NullWindow: public Window {
+public:
+    NullWindow(WindowConfig config, EventScript script) : m_config(config), m_script(std::move(script)) {}
+
+    WindowDisplay getDisplay() const override {
+        return WindowDisplay {
+            .type = WindowDisplay::Type::None,
+            .hwnd = WindowDisplay::HWND { .hwnd = nullptr, .hinstance = nullptr }
+        };
+    }
+
+    WindowEvent pollEvent() override {
+        const auto& events = m_script.events();
+        if (m_next < events.size() && events[m_next].frame <= m_frame) {
+            const WindowEvent& event = events[m_next++].event;
+            if (event.type == WindowEventType::Resize) {
+                m_config.w = event.resize_info.w;
+                m_config.h = event.resize_info.h;
+            }
+            return event;
+        }
+        m_frame++;
+        return WindowEvent {
+            .type = WindowEventType::None,
+            .none_info = WindowEvent::None{}
+        };
+    }
+
+    const WindowConfig& getConfig() const override {
+        return m_config;
+    }
+
+private:
+    WindowConfig m_config;
+    EventScript m_script;
+    size_t m_next { 0 };
+    uint64_t m_frame { 0 };
+};
+
+class NullWindowSystem: public WindowSystem {
+public:
+    NullWindowSystem(EventScript script) : m_script(std::move(script)) {}
+
+    static Result<std::unique_ptr<WindowSystem>, void> init(EventScript script) {
+        std::unique_ptr<WindowSystem> ret = std::make_unique<NullWindowSystem>(std::move(script));
+        return Ok{ std::move(ret) };
+    }
+
+    // every window replays the whole script
+    Result<std::unique_ptr<Window>, void> create(WindowConfig config) override {
+        std::unique_ptr<Window> ret = std::make_unique<NullWindow>(config, m_script);
+        return Ok{ std::move(ret) };
+    }
+
+private:
+    EventScript m_script;
+};
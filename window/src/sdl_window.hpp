@@ -93,9 +93,11 @@ public:
     }
 #endif
 
+    // Skips SDL events without a WindowEvent, so None only comes back once
+    // the queue is empty.
     WindowEvent pollEvent() override {
         SDL_Event event;
-        if (SDL_PollEvent(&event)) {
+        while (SDL_PollEvent(&event)) {
             switch(event.type) {
                 case SDL_EVENT_QUIT: {
                     return WindowEvent {
@@ -103,19 +105,51 @@ public:
                         .close_info = WindowEvent::Close{}
                     };
                 }
-                default: {
+                case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED: {
+                    m_config.w = event.window.data1;
+                    m_config.h = event.window.data2;
                     return WindowEvent {
-                        .type = WindowEventType::None,
-                        .none_info = WindowEvent::None{}
+                        .type = WindowEventType::Resize,
+                        .resize_info = WindowEvent::Resize { .w = event.window.data1, .h = event.window.data2 }
                     };
                 }
+                case SDL_EVENT_KEY_DOWN:
+                case SDL_EVENT_KEY_UP: {
+                    // repeats carry no new state
+                    if (event.key.repeat) break;
+                    return WindowEvent {
+                        .type = WindowEventType::Key,
+                        .key_info = WindowEvent::Key {
+                            .code = static_cast<uint32_t>(event.key.key),
+                            .down = event.type == SDL_EVENT_KEY_DOWN
+                        }
+                    };
+                }
+                case SDL_EVENT_MOUSE_MOTION: {
+                    return WindowEvent {
+                        .type = WindowEventType::MouseMotion,
+                        .motion_info = WindowEvent::MouseMotion { .x = event.motion.x, .y = event.motion.y }
+                    };
+                }
+                case SDL_EVENT_MOUSE_BUTTON_DOWN:
+                case SDL_EVENT_MOUSE_BUTTON_UP: {
+                    return WindowEvent {
+                        .type = WindowEventType::MouseButton,
+                        .button_info = WindowEvent::MouseButton {
+                            .button = event.button.button,
+                            .down = event.type == SDL_EVENT_MOUSE_BUTTON_DOWN,
+                            .x = event.button.x,
+                            .y = event.button.y
+                        }
+                    };
+                }
+                default: break;
             } 
-        } else {
-            return WindowEvent {
-                .type = WindowEventType::None,
-                .none_info = WindowEvent::None{}
-            };
         }
+        return WindowEvent {
+            .type = WindowEventType::None,
+            .none_info = WindowEvent::None{}
+        };
     }
 
     const WindowConfig& getConfig() const override {
@@ -14,6 +14,7 @@
 */
 
 #include "window.hpp"
+#include "null_window.hpp"
 #include "result.hpp"
 #include "sdl_window.hpp"
 #include <memory>
@@ -23,7 +24,14 @@ Result<std::unique_ptr<WindowSystem>, void> WindowSystemFactory::create(WindowTy
         case WindowType::SDL3: {
             return SDLWindowSystem::init();
         }
+        case WindowType::Null: {
+            return NullWindowSystem::init({});
+        }
         default:
             return Err{};
     }
+}
+
+Result<std::unique_ptr<WindowSystem>, void> WindowSystemFactory::createNull(EventScript script) {
+    return NullWindowSystem::init(std::move(script));
 }
\ No newline at end of file